@@ -6,12 +6,16 @@
 #define MAIN_H
 
 #include <string>
+#include <utility>
 #include <vector>
 #include <filesystem>
 
 struct CLIOptions {
     bool backup_mode = false;
     bool restore_mode = false;
+    bool verify_mode = false;   // 只校验已有归档, 不写入
+    bool verify = false;        // 备份完成后校验归档
+    bool watch_mode = false;    // 监视源目录, 把变化写入变更日志
     std::filesystem::path source_path;
     std::filesystem::path target_path;
     bool use_tar = false;
@@ -23,7 +27,13 @@ struct CLIOptions {
 
     // 格式特定选项
     std::string tar_standard = "pax";     // "gnu" 或 "pax"，默认 pax
-    std::string zip_encryption = "zipcrypto"; // "zipcrypto" 或 "rc4"，默认 zipcrypto
+    bool tar_append = false;              // 在已有 tar 归档末尾追加, 不重写已有内容
+    std::string tar_frames;               // 非空时按该帧大小分帧压缩 tar(如 "4M"), 支持单位: K, M, G
+    std::string zip_encryption = "zipcrypto"; // "zipcrypto"、"rc4" 或 "aes"，默认 zipcrypto
+    int zip_level = 6;                        // Deflate 压缩级别 0-9, 0 表示只存储
+    int zip_threads = 0;                      // 并行压缩 ZIP 条目的线程数, 0 表示使用全部核心
+    bool zip_stream = false;                  // 顺序写出 ZIP, 不回写本地文件头, 目标可以是管道
+    bool zip_update = false;                  // 就地更新已有 ZIP, 只写出新增和变化的文件
 
     // 过滤选项
     std::vector<std::string> include_patterns;
@@ -39,6 +49,19 @@ struct CLIOptions {
     std::vector<std::string> exclude_users;
     std::vector<std::string> include_groups;
     std::vector<std::string> exclude_groups;
+
+    // 多源备份: (源路径, 归档内前缀)
+    std::vector<std::pair<std::filesystem::path, std::filesystem::path>> extra_sources;
+
+    // 增量选项
+    std::filesystem::path journal_path; // 变更日志文件
+
+    // 资源选项
+    std::string memory_limit; // I/O 缓冲区总内存上限, 支持单位: K, M, G (如 "256M")
+    std::string archive_index = "sqlite"; // TAR/ZIP 的路径索引: "sqlite" 或 "memory"(有序数组 + 哈希表)
+
+    // 诊断选项
+    std::filesystem::path trace_path;   // 非空时将 span 以 Chrome trace JSON 写出
 };
 
 void print_usage(const char* program_name);
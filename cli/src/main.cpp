@@ -3,6 +3,9 @@
 //
 #include "main.h"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
 #include <string>
 #include <vector>
 #include <filesystem>
@@ -11,12 +14,17 @@
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <thread>
 
 #include "backup/backup_controller.h"
+#include "backup/backup_verifier.h"
+#include "backup/change_journal.h"
 #include "filesystem/compresses_device.h"
 #include "filesystem/seven_zip_device.h"
 #include "filesystem/system_device.h"
 #include "utils/admin_privilege.h"
+#include "utils/buffer_pool.h"
+#include "utils/trace.h"
 
 #ifdef min
 #undef min
@@ -31,6 +39,8 @@ void print_usage(const char* program_name) {
     std::cout << "Basic Options:" << std::endl;
     std::cout << "  -b, --backup          Backup mode (default)" << std::endl;
     std::cout << "  -r, --restore         Restore mode" << std::endl;
+    std::cout << "  -V, --verify-only     Verify mode: compare an existing archive <target_path> with <source_path>" << std::endl;
+    std::cout << "      --verify          Verify the archive against the source after backup" << std::endl;
     std::cout << "  -t, --tar             Use TAR format" << std::endl;
     std::cout << "  -z, --zip             Use ZIP format" << std::endl;
     std::cout << "  -7z, --7z             Use 7-Zip format" << std::endl;
@@ -41,7 +51,13 @@ void print_usage(const char* program_name) {
     std::cout << std::endl;
     std::cout << "Format-specific Options:" << std::endl;
     std::cout << "  --tar-format FORMAT   TAR format: 'pax' or 'gnu' (default: pax)" << std::endl;
-    std::cout << "  --zip-encryption TYPE ZIP encryption: 'zipcrypto' or 'rc4' (default: zipcrypto)" << std::endl;
+    std::cout << "  --tar-append          Append to an existing TAR archive instead of overwriting it" << std::endl;
+    std::cout << "  --tar-frames SIZE     Compress the TAR as independent gzip frames of SIZE (e.g., 4M) for fast single-file restores" << std::endl;
+    std::cout << "  --zip-encryption TYPE ZIP encryption: 'zipcrypto', 'rc4' or 'aes' (WinZip AES-256, default: zipcrypto)" << std::endl;
+    std::cout << "  --zip-level N         ZIP Deflate level 0-9, 0 stores without compression (default: 6)" << std::endl;
+    std::cout << "  --zip-threads N       Threads compressing ZIP entries in parallel, 1 compresses inline (default: all cores)" << std::endl;
+    std::cout << "  --zip-stream          Write the ZIP without seeking (data descriptors), so <target_path> may be a pipe or /dev/stdout; status messages then go to stderr" << std::endl;
+    std::cout << "  --zip-update          Update an existing ZIP in place: add new files, replace changed ones, keep the rest untouched" << std::endl;
     std::cout << std::endl;
     std::cout << "Filter Options (Backup mode only):" << std::endl;
     std::cout << "  --include PATTERN     Include files matching pattern (can be used multiple times)" << std::endl;
@@ -58,6 +74,23 @@ void print_usage(const char* program_name) {
     std::cout << "  --include-group GROUP Include files owned by group" << std::endl;
     std::cout << "  --exclude-group GROUP Exclude files owned by group" << std::endl;
     std::cout << std::endl;
+    std::cout << "Multi-source Options (Backup mode only):" << std::endl;
+    std::cout << "  --add-source PATH[=PREFIX]" << std::endl;
+    std::cout << "                        Also back up PATH under PREFIX in the same archive (can be used multiple times)," << std::endl;
+    std::cout << "                        sources are walked concurrently; <source_path> may then be omitted" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Incremental Options (Linux):" << std::endl;
+    std::cout << "  --watch               Watch <source_path> and record changed paths into the journal until stopped" << std::endl;
+    std::cout << "  --journal FILE        Change journal; in backup mode only the journaled paths are backed up" << std::endl;
+    std::cout << "                        (falls back to a full scan after an event overflow or on first use)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Resource Options:" << std::endl;
+    std::cout << "  --memory-limit SIZE   Cap memory used for I/O buffers (e.g., 256M; default: 128M)" << std::endl;
+    std::cout << "  --archive-index TYPE  TAR/ZIP path index: 'sqlite' or 'memory' (faster open and lookup; default: sqlite)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Diagnostics Options:" << std::endl;
+    std::cout << "  --trace FILE          Write a Chrome trace JSON of the run (open in Perfetto)" << std::endl;
+    std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  Basic backup:" << std::endl;
     std::cout << "    " << program_name << " -z /path/to/source /path/to/backup.zip" << std::endl;
@@ -77,6 +110,16 @@ void print_usage(const char* program_name) {
     std::cout << "  Backup files modified in last week (> 1MB):" << std::endl;
     std::cout << "    " << program_name << " -z --after 2025-12-23 --min-size 1M /src backup.zip" << std::endl;
     std::cout << std::endl;
+    std::cout << "  Several sources into one archive:" << std::endl;
+    std::cout << "    " << program_name << " -t --add-source /etc=etc --add-source /srv=srv --add-source /var/lib/app=var/lib/app backup.tar" << std::endl;
+    std::cout << std::endl;
+    std::cout << "  Backup and verify sizes and CRC32 of every file:" << std::endl;
+    std::cout << "    " << program_name << " -z --verify /src backup.zip" << std::endl;
+    std::cout << std::endl;
+    std::cout << "  Journaled incremental backup:" << std::endl;
+    std::cout << "    " << program_name << " --watch --journal /var/lib/bs/src.journal /src &" << std::endl;
+    std::cout << "    " << program_name << " -t --journal /var/lib/bs/src.journal /src incr.tar" << std::endl;
+    std::cout << std::endl;
     std::cout << "  Restore:" << std::endl;
     std::cout << "    " << program_name << " -r -z /path/to/backup.zip /path/to/restore" << std::endl;
 
@@ -101,9 +144,29 @@ bool parse_arguments(const int argc, char* argv[], CLIOptions& options) {
         if (arg == "-b" || arg == "--backup") {
             options.backup_mode = true;
             options.restore_mode = false;
+            options.verify_mode = false;
         } else if (arg == "-r" || arg == "--restore") {
             options.restore_mode = true;
             options.backup_mode = false;
+            options.verify_mode = false;
+        } else if (arg == "-V" || arg == "--verify-only") {
+            options.verify_mode = true;
+            options.backup_mode = false;
+            options.restore_mode = false;
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (arg == "--watch") {
+            options.watch_mode = true;
+            options.backup_mode = false;
+            options.restore_mode = false;
+            options.verify_mode = false;
+        } else if (arg == "--journal") {
+            if (i + 1 < argc) {
+                options.journal_path = argv[++i];
+            } else {
+                std::cerr << "Error: --journal requires a file path" << std::endl;
+                return false;
+            }
         } else if (arg == "-t" || arg == "--tar") {
             options.use_tar = true;
             options.use_zip = false;
@@ -226,17 +289,96 @@ bool parse_arguments(const int argc, char* argv[], CLIOptions& options) {
                 std::cerr << "Error: --tar-format requires a format (pax or gnu)" << std::endl;
                 return false;
             }
+        } else if (arg == "--tar-append") {
+            options.tar_append = true;
+        } else if (arg == "--tar-frames") {
+            if (i + 1 < argc) {
+                options.tar_frames = argv[++i];
+            } else {
+                std::cerr << "Error: --tar-frames requires a frame size (e.g., 4M)" << std::endl;
+                return false;
+            }
         } else if (arg == "--zip-encryption") {
             if (i + 1 < argc) {
                 std::string encryption = argv[++i];
-                if (encryption == "zipcrypto" || encryption == "rc4") {
+                if (encryption == "zipcrypto" || encryption == "rc4" || encryption == "aes") {
                     options.zip_encryption = encryption;
                 } else {
-                    std::cerr << "Error: --zip-encryption must be 'zipcrypto' or 'rc4'" << std::endl;
+                    std::cerr << "Error: --zip-encryption must be 'zipcrypto', 'rc4' or 'aes'" << std::endl;
+                    return false;
+                }
+            } else {
+                std::cerr << "Error: --zip-encryption requires a type (zipcrypto, rc4 or aes)" << std::endl;
+                return false;
+            }
+        } else if (arg == "--zip-level") {
+            if (i + 1 < argc) {
+                const std::string level = argv[++i];
+                if (level.size() == 1 && level[0] >= '0' && level[0] <= '9') {
+                    options.zip_level = level[0] - '0';
+                } else {
+                    std::cerr << "Error: --zip-level must be a number from 0 to 9" << std::endl;
+                    return false;
+                }
+            } else {
+                std::cerr << "Error: --zip-level requires a level (0-9)" << std::endl;
+                return false;
+            }
+        } else if (arg == "--zip-threads") {
+            if (i + 1 < argc) {
+                const std::string threads = argv[++i];
+                if (!threads.empty() && threads.size() <= 4 &&
+                    threads.find_first_not_of("0123456789") == std::string::npos && std::stoi(threads) > 0) {
+                    options.zip_threads = std::stoi(threads);
+                } else {
+                    std::cerr << "Error: --zip-threads must be a positive number" << std::endl;
+                    return false;
+                }
+            } else {
+                std::cerr << "Error: --zip-threads requires a thread count" << std::endl;
+                return false;
+            }
+        } else if (arg == "--zip-stream") {
+            options.zip_stream = true;
+        } else if (arg == "--zip-update") {
+            options.zip_update = true;
+        } else if (arg == "--add-source") {
+            if (i + 1 < argc) {
+                const std::string spec = argv[++i];
+                // PATH=PREFIX, 未给出前缀时使用去掉根的源路径
+                const auto eq = spec.rfind('=');
+                std::filesystem::path source = eq == std::string::npos ? spec : spec.substr(0, eq);
+                std::filesystem::path prefix = eq == std::string::npos ? source.relative_path() : std::filesystem::path(spec.substr(eq + 1));
+                options.extra_sources.emplace_back(source, prefix.relative_path());
+            } else {
+                std::cerr << "Error: --add-source requires a path" << std::endl;
+                return false;
+            }
+        } else if (arg == "--memory-limit") {
+            if (i + 1 < argc) {
+                options.memory_limit = argv[++i];
+            } else {
+                std::cerr << "Error: --memory-limit requires a size" << std::endl;
+                return false;
+            }
+        } else if (arg == "--archive-index") {
+            if (i + 1 < argc) {
+                std::string index = argv[++i];
+                if (index == "sqlite" || index == "memory") {
+                    options.archive_index = index;
+                } else {
+                    std::cerr << "Error: --archive-index must be 'sqlite' or 'memory'" << std::endl;
                     return false;
                 }
             } else {
-                std::cerr << "Error: --zip-encryption requires a type (zipcrypto or rc4)" << std::endl;
+                std::cerr << "Error: --archive-index requires a type (sqlite or memory)" << std::endl;
+                return false;
+            }
+        } else if (arg == "--trace") {
+            if (i + 1 < argc) {
+                options.trace_path = argv[++i];
+            } else {
+                std::cerr << "Error: --trace requires an output file" << std::endl;
                 return false;
             }
         } else if (arg[0] != '-') {
@@ -254,17 +396,37 @@ bool parse_arguments(const int argc, char* argv[], CLIOptions& options) {
             return false;
         }
     }
+    // 使用 --add-source 时只给出一个路径参数, 它就是目标路径
+    if (!options.extra_sources.empty() && options.target_path.empty()) {
+        options.target_path = options.source_path;
+        options.source_path.clear();
+    }
     return true;
 }
 bool validate_options(const CLIOptions& options) {
+    if (options.watch_mode) {
+        if (options.source_path.empty() || options.journal_path.empty()) {
+            std::cerr << "Error: --watch requires <source_path> and --journal FILE" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (!options.journal_path.empty() && (!options.backup_mode || !options.extra_sources.empty())) {
+        std::cerr << "Error: --journal can only be used in backup mode with a single source" << std::endl;
+        return false;
+    }
     // Check path parameters
-    if (options.source_path.empty() || options.target_path.empty()) {
+    if ((options.source_path.empty() && options.extra_sources.empty()) || options.target_path.empty()) {
         std::cerr << "Error: Source path and target path are required" << std::endl;
         return false;
     }
+    if (!options.extra_sources.empty() && !options.backup_mode && !options.verify_mode) {
+        std::cerr << "Error: --add-source can only be used in backup or verify mode" << std::endl;
+        return false;
+    }
     // Check mode
-    if (!options.backup_mode && !options.restore_mode) {
-        std::cerr << "Error: Must specify backup mode (-b) or restore mode (-r)" << std::endl;
+    if (!options.backup_mode && !options.restore_mode && !options.verify_mode) {
+        std::cerr << "Error: Must specify backup mode (-b), restore mode (-r) or verify mode (-V)" << std::endl;
         return false;
     }
     // Check compression format
@@ -281,18 +443,39 @@ bool validate_options(const CLIOptions& options) {
         std::cerr << "Error: Must specify password (-p) when using encryption option (-e)" << std::endl;
         return false;
     }
+    if (options.zip_stream && (!options.use_zip || !options.backup_mode)) {
+        std::cerr << "Error: --zip-stream can only be used when creating a ZIP backup" << std::endl;
+        return false;
+    }
+    if (options.zip_update && (!options.use_zip || !options.backup_mode)) {
+        std::cerr << "Error: --zip-update can only be used when creating a ZIP backup" << std::endl;
+        return false;
+    }
+    if (options.zip_update && options.zip_stream) {
+        std::cerr << "Error: --zip-update cannot be combined with --zip-stream" << std::endl;
+        return false;
+    }
+    if (options.zip_stream && options.verify) {
+        std::cerr << "Error: --verify cannot read back a streamed ZIP; verify the stored copy with -V instead" << std::endl;
+        return false;
+    }
     if (options.backup_mode) {
-        try {
-            const auto src = std::filesystem::weakly_canonical(options.source_path);
-            const auto dst = std::filesystem::weakly_canonical(options.target_path);
-            std::error_code ec;
-            if (const auto rel = std::filesystem::relative(dst, src, ec);
-                !ec && !rel.empty() && rel.native().front() != L'.') {
-                std::cerr << "Error: target archive resides inside source directory; choose a different output location." << std::endl;
-                return false;
+        std::vector<std::filesystem::path> sources;
+        if (!options.source_path.empty()) sources.push_back(options.source_path);
+        for (const auto& [source, prefix] : options.extra_sources) sources.push_back(source);
+        for (const auto& source : sources) {
+            try {
+                const auto src = std::filesystem::weakly_canonical(source);
+                const auto dst = std::filesystem::weakly_canonical(options.target_path);
+                std::error_code ec;
+                if (const auto rel = std::filesystem::relative(dst, src, ec);
+                    !ec && !rel.empty() && rel.native().front() != L'.') {
+                    std::cerr << "Error: target archive resides inside source directory; choose a different output location." << std::endl;
+                    return false;
+                }
+            } catch (const std::exception&) {
+                // best effort: if canonical fails, skip this check
             }
-        } catch (const std::exception&) {
-            // best effort: if canonical fails, skip this check
         }
     }
     return true;
@@ -345,6 +528,31 @@ std::chrono::system_clock::time_point parse_date(const std::string& date_str) {
     }
     return std::chrono::system_clock::from_time_t(std::mktime(&tm));
 }
+// 在 main 的任意返回路径上导出 trace
+struct TraceDumpGuard {
+    std::filesystem::path path;
+    ~TraceDumpGuard() {
+        if (path.empty()) return;
+        trace::set_enabled(false);
+        if (trace::dump_chrome_trace(path)) {
+            std::cout << "Trace written to: " << path << " (" << trace::span_count() << " spans)" << std::endl;
+        } else {
+            std::cerr << "Error: failed to write trace file: " << path << std::endl;
+        }
+    }
+};
+// 归档写到标准输出时, 状态信息改写到标准错误, 避免混入归档数据
+struct StdoutToStderrGuard {
+    std::streambuf* saved = nullptr;
+    explicit StdoutToStderrGuard(const bool redirect) {
+        if (redirect) saved = std::cout.rdbuf(std::cerr.rdbuf());
+    }
+    ~StdoutToStderrGuard() {
+        if (saved) std::cout.rdbuf(saved);
+    }
+    StdoutToStderrGuard(const StdoutToStderrGuard&) = delete;
+    StdoutToStderrGuard& operator=(const StdoutToStderrGuard&) = delete;
+};
 // 将 CLI 选项转换为 BackupConfig
 BackupConfig build_backup_config(const CLIOptions& options) {
     BackupConfig config;
@@ -389,6 +597,95 @@ BackupConfig build_backup_config(const CLIOptions& options) {
     return config;
 }
 
+// 监视模式下由 SIGINT/SIGTERM 请求退出
+std::atomic<bool> g_stop_requested{false};
+void request_stop(int) {
+    g_stop_requested = true;
+}
+
+// 检查并打开所有源目录; 多个源时并发遍历并写入同一个归档
+bool open_sources(const CLIOptions& options, std::vector<std::unique_ptr<Device>>& devices, std::vector<BackupSource>& sources) {
+    if (!options.source_path.empty() && !std::filesystem::exists(options.source_path)) {
+        std::cerr << "Error: Source path does not exist: " << options.source_path << std::endl;
+        return false;
+    }
+    for (const auto& [source, prefix] : options.extra_sources) {
+        if (!std::filesystem::exists(source)) {
+            std::cerr << "Error: Source path does not exist: " << source << std::endl;
+            return false;
+        }
+    }
+    if (!options.source_path.empty()) {
+        devices.push_back(std::make_unique<SystemDevice>(options.source_path));
+        sources.push_back({*devices.back(), {}});
+    }
+    for (const auto& [source, prefix] : options.extra_sources) {
+        devices.push_back(std::make_unique<SystemDevice>(source));
+        sources.push_back({*devices.back(), prefix});
+        if (options.verbose) {
+            std::cout << "Additional source: " << source << " -> " << prefix << std::endl;
+        }
+    }
+    return true;
+}
+
+db::IndexBackend index_backend(const CLIOptions& options) {
+    return options.archive_index == "memory" ? db::IndexBackend::Memory : db::IndexBackend::Sqlite;
+}
+
+// 以只读方式重新打开归档, 供校验使用
+std::unique_ptr<Device> open_archive(const CLIOptions& options) {
+    const std::vector<uint8_t> password_vec{options.password.begin(), options.password.end()};
+    if (options.use_tar) {
+        if (auto device = std::make_unique<TarDevice>(options.target_path, TarDevice::Mode::ReadOnly, index_backend(options)); device->is_open()) {
+            return device;
+        }
+    } else if (options.use_zip) {
+        if (auto device = std::make_unique<ZipDevice>(options.target_path, ZipDevice::Mode::ReadOnly, password_vec, index_backend(options)); device->is_open()) {
+            return device;
+        }
+    } else if (options.use_7z) {
+        if (auto device = std::make_unique<SevenZipDevice>(options.target_path, SevenZipDevice::Mode::ReadOnly,
+                                                           sevenzip::CompressionMethod::LZMA2,
+                                                           password_vec.empty() ? sevenzip::EncryptionMethod::None : sevenzip::EncryptionMethod::AES256,
+                                                           password_vec); device->is_open()) {
+            return device;
+        }
+    }
+    return nullptr;
+}
+
+// 逐个源比较归档成员与源文件的大小和 CRC32, 全部一致时返回 true
+bool verify_archive(const CLIOptions& options, const std::vector<BackupSource>& sources) {
+    const auto archive = open_archive(options);
+    if (!archive) {
+        std::cerr << "Error: Cannot open archive for verification: " << options.target_path << std::endl;
+        return false;
+    }
+    if (options.verbose) {
+        std::cout << "Verifying archive against source..." << std::endl;
+    }
+    const BackupVerifier verifier;
+    size_t files = 0, issues = 0;
+    uint64_t bytes = 0;
+    // 根源(空前缀)会遍历整个归档, 其他源的成员不属于它
+    std::vector<std::filesystem::path> prefixes;
+    for (const auto& source : sources) {
+        prefixes.push_back(source.prefix);
+    }
+    for (const auto& source : sources) {
+        const auto report = verifier.verify(source.device, *archive, source.prefix, prefixes);
+        files += report.files_checked;
+        bytes += report.bytes_checked;
+        issues += report.issues.size();
+        for (const auto& issue : report.issues) {
+            std::cerr << "Verify failed: " << issue.path.generic_string() << ": " << issue.reason << std::endl;
+        }
+    }
+    std::cout << "Verified " << files << " files (" << bytes << " bytes), " << issues << " mismatch(es)" << std::endl;
+    return issues == 0;
+}
+
 int main(int argc, char* argv[]) {
     CLIOptions options;
 
@@ -403,6 +700,27 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // 流式 zip 通常写往管道或标准输出, 此后的状态信息(包括 trace 导出的提示)都写到标准错误
+    const StdoutToStderrGuard stdout_guard(options.backup_mode &&
+        (options.zip_stream || options.target_path == "/dev/stdout"));
+
+    if (!options.memory_limit.empty()) {
+        const auto limit = parse_size(options.memory_limit);
+        if (limit == 0) {
+            std::cerr << "Error: invalid --memory-limit: " << options.memory_limit << std::endl;
+            return 1;
+        }
+        buffer_pool::BufferPool::instance().set_memory_limit(limit);
+    }
+
+    TraceDumpGuard trace_guard{options.trace_path};
+    if (!options.trace_path.empty()) {
+        if (!trace::is_compiled_in()) {
+            std::cout << "Warning: tracing was compiled out (BACKUPSUITE_ENABLE_TRACE=OFF); the trace will be empty." << std::endl;
+        }
+        trace::set_enabled(true);
+    }
+
     if (is_running_as_admin())
     {
         std::cout << "Warning: Running with administrative privileges may affect file attribute handling." << std::endl;
@@ -460,20 +778,46 @@ int main(int argc, char* argv[]) {
                 }
             }
 
-            // Check if source path exists
-            if (!std::filesystem::exists(options.source_path)) {
-                std::cerr << "Error: Source path does not exist: " << options.source_path << std::endl;
+            std::vector<std::unique_ptr<Device>> source_devices;
+            std::vector<BackupSource> sources;
+            if (!open_sources(options, source_devices, sources)) {
                 return 1;
             }
-
-            // Create source device
-            SystemDevice source_device(options.source_path);
+            // 使用变更日志时只备份上次以来变化的路径
+            std::unique_ptr<ChangeJournal> journal;
+            if (!options.journal_path.empty()) {
+                journal = std::make_unique<ChangeJournal>(options.journal_path);
+                if (!journal->is_open()) {
+                    std::cerr << "Error: Cannot open change journal: " << options.journal_path << std::endl;
+                    return 1;
+                }
+                if (options.verbose) {
+                    const auto snapshot = journal->snapshot();
+                    if (snapshot.full_scan) {
+                        std::cout << "Change journal requires a full scan" << std::endl;
+                    } else {
+                        std::cout << "Change journal: " << snapshot.entries.size() << " changed path(s)" << std::endl;
+                    }
+                }
+            }
+            const auto run_backup = [&](Device& target) {
+                if (journal) {
+                    if (!controller.run_backup(sources.front().device, target, *journal)) {
+                        std::cerr << "Warning: incremental backup incomplete; the change journal was kept" << std::endl;
+                    }
+                } else if (sources.size() == 1 && sources.front().prefix.empty()) {
+                    controller.run_backup(sources.front().device, target);
+                } else if (!controller.run_backup(sources, target)) {
+                    std::cerr << "Warning: some entries could not be backed up" << std::endl;
+                }
+            };
 
             // Create target device
             if (options.use_tar) {
-                TarDevice target_device(options.target_path, TarDevice::Mode::WriteOnly);
+                TarDevice target_device(options.target_path, options.tar_append ? TarDevice::Mode::Append : TarDevice::Mode::WriteOnly,
+                                        index_backend(options));
                 if (!target_device.is_open()) {
-                    std::cerr << "Error: Cannot create TAR file: " << options.target_path << std::endl;
+                    std::cerr << "Error: Cannot " << (options.tar_append ? "append to" : "create") << " TAR file: " << options.target_path << std::endl;
                     return 1;
                 }
 
@@ -484,14 +828,28 @@ int main(int argc, char* argv[]) {
                 } else if (options.tar_standard == "pax") {
                     tar_std = tar::TarStandard::POSIX_2001_PAX;
                 }
-                target_device.set_standard(tar_std);
+                // 追加时沿用已有归档的格式
+                if (!options.tar_append || target_device.get_standard() == tar::TarStandard::UNKNOWN) {
+                    target_device.set_standard(tar_std);
+                }
+                if (!options.tar_frames.empty()) {
+                    const auto frame_size = parse_size(options.tar_frames);
+                    if (frame_size == 0) {
+                        std::cerr << "Error: invalid --tar-frames: " << options.tar_frames << std::endl;
+                        return 1;
+                    }
+                    if (!target_device.set_frame_compression(static_cast<size_t>(frame_size))) {
+                        std::cerr << "Error: frame compression cannot be used when appending to an existing TAR file" << std::endl;
+                        return 1;
+                    }
+                }
 
                 if (options.verbose) {
-                    std::cout << "Creating TAR backup..." << std::endl;
+                    std::cout << (options.tar_append ? "Appending to TAR backup..." : "Creating TAR backup...") << std::endl;
                     std::cout << "TAR format: " << options.tar_standard << std::endl;
                 }
 
-                controller.run_backup(source_device, target_device);
+                run_backup(target_device);
                 target_device.close();
 
                 if (options.verbose) {
@@ -503,17 +861,29 @@ int main(int argc, char* argv[]) {
                     password_vec.assign(options.password.begin(), options.password.end());
                 }
 
-                ZipDevice target_device(options.target_path, ZipDevice::Mode::WriteOnly, password_vec);
+                ZipDevice target_device(options.target_path, options.zip_stream ? ZipDevice::Mode::Stream :
+                                        options.zip_update ? ZipDevice::Mode::Update : ZipDevice::Mode::WriteOnly,
+                                        password_vec, index_backend(options));
                 if (!target_device.is_open()) {
-                    std::cerr << "Error: Cannot create ZIP file: " << options.target_path << std::endl;
+                    std::cerr << "Error: Cannot " << (options.zip_update ? "update" : "create") << " ZIP file: " << options.target_path << std::endl;
                     return 1;
                 }
 
+                if (options.zip_level == 0) {
+                    target_device.set_compression_method(zip::header::ZipCompressionMethod::Store);
+                } else {
+                    target_device.set_compression_level(options.zip_level);
+                }
+                target_device.set_compression_threads(options.zip_threads > 0
+                    ? static_cast<size_t>(options.zip_threads) : std::max(1u, std::thread::hardware_concurrency()));
+
                 if (options.use_encryption) {
                     // 设置加密方法
                     zip::header::ZipEncryptionMethod encryption_method = zip::header::ZipEncryptionMethod::ZipCrypto;
                     if (options.zip_encryption == "rc4") {
                         encryption_method = zip::header::ZipEncryptionMethod::RC4;
+                    } else if (options.zip_encryption == "aes") {
+                        encryption_method = zip::header::ZipEncryptionMethod::AES256;
                     } else if (options.zip_encryption == "zipcrypto") {
                         encryption_method = zip::header::ZipEncryptionMethod::ZipCrypto;
                     }
@@ -525,11 +895,14 @@ int main(int argc, char* argv[]) {
                 }
 
                 if (options.verbose) {
-                    std::cout << "Creating ZIP backup..." << std::endl;
+                    std::cout << (options.zip_update ? "Updating ZIP backup..." : "Creating ZIP backup...") << std::endl;
                 }
 
-                controller.run_backup(source_device, target_device);
-                target_device.close();
+                run_backup(target_device);
+                if (!target_device.close()) {
+                    std::cerr << "Error: Failed to write ZIP file: " << options.target_path << std::endl;
+                    return 1;
+                }
 
                 if (options.verbose) {
                     std::cout << "Backup completed!" << std::endl;
@@ -553,7 +926,7 @@ int main(int argc, char* argv[]) {
                     std::cout << "Creating 7Z backup..." << std::endl;
                 }
 
-                controller.run_backup(source_device, target_device);
+                run_backup(target_device);
                 target_device.close();
 
                 if (options.verbose) {
@@ -561,6 +934,36 @@ int main(int argc, char* argv[]) {
                 }
             }
 
+            if (options.verify && !verify_archive(options, sources)) {
+                std::cerr << "Error: backup verification failed" << std::endl;
+                return 1;
+            }
+        } else if (options.watch_mode) {
+            ChangeJournal journal(options.journal_path);
+            if (!journal.is_open()) {
+                std::cerr << "Error: Cannot open change journal: " << options.journal_path << std::endl;
+                return 1;
+            }
+            ChangeWatcher watcher(options.source_path, journal);
+            if (!watcher.start()) {
+                std::cerr << "Error: Cannot watch " << options.source_path << " (only supported on Linux)" << std::endl;
+                return 1;
+            }
+            std::cout << "Watching " << options.source_path << " (" << watcher.watch_count()
+                      << " directories), press Ctrl+C to stop" << std::endl;
+            std::signal(SIGINT, request_stop);
+            std::signal(SIGTERM, request_stop);
+            watcher.run(g_stop_requested);
+        } else if (options.verify_mode) {
+            std::vector<std::unique_ptr<Device>> source_devices;
+            std::vector<BackupSource> sources;
+            if (!open_sources(options, source_devices, sources)) {
+                return 1;
+            }
+            if (!verify_archive(options, sources)) {
+                std::cerr << "Error: verification failed" << std::endl;
+                return 1;
+            }
         } else if (options.restore_mode) {
             if (options.verbose) {
                 std::cout << "Restore begin..." << std::endl;
@@ -583,7 +986,7 @@ int main(int argc, char* argv[]) {
             SystemDevice target_device(options.target_path);
 
             if (options.use_tar) {
-                TarDevice source_device(options.source_path, TarDevice::Mode::ReadOnly);
+                TarDevice source_device(options.source_path, TarDevice::Mode::ReadOnly, index_backend(options));
                 if (!source_device.is_open()) {
                     std::cerr << "Error: fail to open TAR file: " << options.source_path << std::endl;
                     return 1;
@@ -608,7 +1011,7 @@ int main(int argc, char* argv[]) {
                 // 检查ZIP文件是否需要密码
                 std::vector<uint8_t> password_vec{options.password.begin(), options.password.end()};
                 {
-                    ZipDevice temp_device(options.source_path, ZipDevice::Mode::ReadOnly);
+                    ZipDevice temp_device(options.source_path, ZipDevice::Mode::ReadOnly, {}, index_backend(options));
                         if (!temp_device.is_open()) {
                             std::cerr << "Error: Cannot open ZIP file: " << options.source_path << std::endl;
                             return 1;
@@ -624,7 +1027,7 @@ int main(int argc, char* argv[]) {
                     }
                 }
 
-                ZipDevice source_device(options.source_path, ZipDevice::Mode::ReadOnly, password_vec);
+                ZipDevice source_device(options.source_path, ZipDevice::Mode::ReadOnly, password_vec, index_backend(options));
                 if (!source_device.is_open()) {
                     if (source_device.is_invalid_password()) {
                         std::cerr << "Error: Incorrect password or no password provided" << std::endl;
@@ -11,7 +11,12 @@
 #include <chrono>
 
 #include "api.h"
+#include "backup/change_journal.h"
+#include "backup/task_scheduler.h"
 #include "filesystem/device.h"
+#include "utils/bounded_queue.h"
+
+class SmallFileBatcher;
 
 struct BackupConfig
 {
@@ -47,6 +52,25 @@ struct BackupConfig
     std::vector<std::string> exclude_users;   // 排除的用户名
     std::vector<std::string> include_groups;  // 包含的组名
     std::vector<std::string> exclude_groups;  // 排除的组名
+
+    // 小文件聚合: 不大于阈值的普通文件按批读入内存后整批写入目标, 0 表示关闭
+    size_t small_file_threshold = 64 * 1024;
+    size_t small_file_batch_bytes = 4 * 1024 * 1024;
+
+    // 多源备份: 遍历线程预读不大于该阈值的文件, 预读内容总量不超过 prefetch_bytes
+    size_t prefetch_file_threshold = 1024 * 1024;
+    size_t prefetch_bytes = 64 * 1024 * 1024;
+    // 多源备份的读取线程数, 其中一个专门处理小文件; 源支持按偏移读取时, 大于 prefetch_file_threshold 的文件
+    // 按 chunk_bytes 分块读取, 每个文件最多 2 * read_workers 个分块驻留内存; 预算不足时减少分块数并缩小分块
+    size_t read_workers = 4;
+    size_t chunk_bytes = 4 * 1024 * 1024;
+};
+
+// 多源备份中的一个源, 其内容写入归档中的 prefix 目录下(如 "etc", "var/lib/app")
+struct BackupSource
+{
+    Device& device;
+    std::filesystem::path prefix;
 };
 
 class BACKUP_SUITE_API BackupController
@@ -57,9 +81,27 @@ public:
     // ReSharper disable once CppNonExplicitConvertingConstructor
     explicit BackupController(BackupConfig cfg);
     void run_backup(Device& from, Device& to) const;
+    /**
+     * @brief 多个源并发遍历, 共享同一个写出阶段, 最终写入同一个归档(同一份索引)
+     * @param sources 源设备及其在归档中的路径前缀
+     * @param to 目标设备, 只在调用线程中写入
+     * @return 所有条目都写入成功时返回 true
+     */
+    [[nodiscard]] bool run_backup(const std::vector<BackupSource>& sources, Device& to) const;
+    /**
+     * @brief 增量备份: 只处理变更日志中记录的路径; 日志要求全量扫描(事件溢出或尚无基线)时遍历整棵树
+     * @return 写入成功并已清除本次处理的日志记录时返回 true
+     */
+    [[nodiscard]] bool run_backup(Device& from, Device& to, ChangeJournal& journal) const;
     [[nodiscard]] bool run_restore(Device& from, Device& to) const;
 private:
     [[nodiscard]] bool copy_folder_recursive(Device& from, Device& to, const std::filesystem::path& path) const;
+    void backup_tree(Device& from, Device& to, const std::filesystem::path& root, SmallFileBatcher& batcher) const;
+    struct WriteItem;
+    void walk_source(size_t index, const BackupSource& source, concurrency::BoundedQueue<WriteItem>& queue,
+                     TaskScheduler& scheduler) const;
+    void read_task(const std::vector<BackupSource>& sources, TaskScheduler& scheduler, const TaskScheduler::Task& task,
+                   concurrency::BoundedQueue<WriteItem>& queue) const;
     [[nodiscard]] bool should_backup_file(const FileEntityMeta& meta) const;  // 检查文件是否应该备份
     [[nodiscard]] bool match_pattern(const std::string& path, const std::string& pattern) const;  // 路径模式匹配
 };
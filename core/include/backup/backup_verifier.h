@@ -0,0 +1,50 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_BACKUP_VERIFIER_H
+#define BACKUPSUITE_BACKUP_VERIFIER_H
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "filesystem/device.h"
+
+// 一条校验失败记录, path 为归档中的路径
+struct VerifyIssue
+{
+    std::filesystem::path path;
+    std::string reason;
+};
+
+struct VerifyReport
+{
+    size_t files_checked = 0;
+    uint64_t bytes_checked = 0;
+    std::vector<VerifyIssue> issues;
+    [[nodiscard]] bool ok() const { return issues.empty(); }
+};
+
+// 备份后校验: 逐个重读归档成员与对应的源文件, 比较大小与 CRC32
+class BACKUP_SUITE_API BackupVerifier
+{
+    size_t workers_;
+public:
+    // workers 为读取源文件的线程数, 0 表示使用硬件并发数
+    explicit BackupVerifier(size_t workers = 0);
+    /**
+     * @brief 校验归档中 prefix 目录下的所有普通文件与源设备中的对应文件一致
+     * @param source 源设备, 会被多个线程并发 get_file(物理设备满足)
+     * @param archive 归档设备, 只在调用线程中按顺序读取
+     * @param prefix 源在归档中的路径前缀, 为空表示归档根目录
+     * @param excluded 不属于该源的归档路径(如同一归档中其他源的前缀), 只有位于 prefix 之下的才会跳过
+     */
+    [[nodiscard]] VerifyReport verify(Device& source, Device& archive, const std::filesystem::path& prefix = {},
+                                      const std::vector<std::filesystem::path>& excluded = {}) const;
+};
+
+#endif // BACKUPSUITE_BACKUP_VERIFIER_H
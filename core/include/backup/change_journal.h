@@ -0,0 +1,82 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_CHANGE_JOURNAL_H
+#define BACKUPSUITE_CHANGE_JOURNAL_H
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "api.h"
+#include "utils/database.h"
+
+// 持久化的变更日志: 监视进程记录源目录下发生变化的路径(相对源根目录),
+// 下一次备份只处理这些路径, 不再遍历整棵目录树
+class BACKUP_SUITE_API ChangeJournal
+{
+    db::Database db_;
+public:
+    struct Entry
+    {
+        std::filesystem::path path;
+        bool recursive = false; // 需要扫描整个子树, 如新建或移入的目录
+    };
+    struct Snapshot
+    {
+        bool valid = false;
+        int64_t seq = 0;        // 读取时的最新序号, 备份成功后交给 consume
+        bool full_scan = true;  // 日志不完整(事件溢出或尚无基线), 必须全量扫描
+        std::vector<Entry> entries; // 按路径排序
+    };
+
+    explicit ChangeJournal(const std::filesystem::path& journal_path);
+    [[nodiscard]] bool is_open() const { return db_.is_open(); }
+    // 在一个事务中记录一批变化的路径
+    bool record(const std::vector<Entry>& entries);
+    // 监视丢失了事件(队列溢出、监视数量不足等), 下一次备份退化为全量扫描
+    bool mark_overflow();
+    [[nodiscard]] Snapshot snapshot() const;
+    /**
+     * @brief 备份成功后清除序号不大于 seq 的记录与全量扫描标记
+     * 备份期间新记录的路径序号更大, 会保留到下一次备份
+     */
+    bool consume(int64_t seq);
+};
+
+// Linux 下基于递归 inotify 的变更监视器, 把 root 下变化的路径累积后批量写入 ChangeJournal
+class BACKUP_SUITE_API ChangeWatcher
+{
+public:
+    ChangeWatcher(std::filesystem::path root, ChangeJournal& journal);
+    ~ChangeWatcher();
+    ChangeWatcher(const ChangeWatcher&) = delete;
+    ChangeWatcher& operator=(const ChangeWatcher&) = delete;
+
+    // 为 root 下的所有目录建立监视, 并标记下一次备份完整扫描(启动之前的变化无从得知); 平台不支持或初始化失败时返回 false
+    bool start();
+    // 处理事件直到 stop 为 true, 每隔 flush_interval 把累积的路径写入日志
+    void run(const std::atomic<bool>& stop, std::chrono::milliseconds flush_interval = std::chrono::milliseconds(1000));
+    [[nodiscard]] size_t watch_count() const { return watches_.size(); }
+
+private:
+    std::filesystem::path root_;
+    ChangeJournal& journal_;
+    int fd_ = -1;
+    std::unordered_map<int, std::filesystem::path> watches_; // watch 描述符 -> 相对路径
+    std::set<std::filesystem::path> dirty_;
+    std::set<std::filesystem::path> dirty_recursive_;
+    bool overflow_ = false;
+
+    void add_watch_recursive(const std::filesystem::path& relative);
+    void handle_events();
+    void flush();
+};
+
+#endif // BACKUPSUITE_CHANGE_JOURNAL_H
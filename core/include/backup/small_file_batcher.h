@@ -0,0 +1,64 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_SMALL_FILE_BATCHER_H
+#define BACKUPSUITE_SMALL_FILE_BATCHER_H
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "api.h"
+#include "filesystem/device.h"
+#include "utils/buffer_pool.h"
+
+// 位于 BackupController 与归档设备之间的小文件聚合阶段:
+// 把小文件内容读进一块连续缓冲区, 攒满一批后通过 Device::write_files 整批交给目标设备
+class BACKUP_SUITE_API SmallFileBatcher
+{
+public:
+    static constexpr size_t DEFAULT_THRESHOLD = 64 * 1024;
+    static constexpr size_t DEFAULT_BATCH_BYTES = 4 * 1024 * 1024;
+    static constexpr size_t DEFAULT_BATCH_FILES = 4096;
+
+    explicit SmallFileBatcher(Device& to, size_t threshold = DEFAULT_THRESHOLD,
+                              size_t batch_bytes = DEFAULT_BATCH_BYTES, size_t batch_files = DEFAULT_BATCH_FILES);
+    ~SmallFileBatcher();
+    SmallFileBatcher(const SmallFileBatcher&) = delete;
+    SmallFileBatcher& operator=(const SmallFileBatcher&) = delete;
+
+    // 是否应交给本阶段处理(普通文件且不超过阈值)
+    [[nodiscard]] bool accepts(const FileEntityMeta& meta) const;
+    /**
+     * @brief 读入文件内容并暂存, 批次满时自动 flush
+     * @return 读取或 flush 失败时返回 false
+     */
+    bool add(ReadableFile& file);
+    /**
+     * @brief 从 from 读入一组小文件(均应满足 accepts), 在批次中保持给定的逻辑顺序
+     * 每一批先按逻辑顺序预留缓冲区位置, 再按物理位置(区段或 inode)的顺序打开并读入, 减少机械盘寻道
+     */
+    bool add_files(Device& from, const std::vector<FileEntityMeta>& files);
+    // 将暂存的文件整批写入目标设备
+    bool flush();
+    [[nodiscard]] size_t pending() const { return entries_.size(); }
+
+private:
+    struct Entry
+    {
+        FileEntityMeta meta;
+        size_t offset;
+    };
+    void read_window(Device& from, const std::vector<FileEntityMeta>& files, size_t begin, size_t end);
+    Device& to_;
+    size_t threshold_;
+    size_t batch_bytes_;
+    size_t batch_files_;
+    // 批次缓冲区非阻塞地占用全局内存预算并留出一个 slab, 预算不足时缩小批次, 没有预算时禁用聚合
+    buffer_pool::Reservation reservation_;
+    std::vector<std::byte> buffer_;
+    std::vector<Entry> entries_;
+};
+
+#endif // BACKUPSUITE_SMALL_FILE_BATCHER_H
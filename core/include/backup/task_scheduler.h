@@ -0,0 +1,134 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_TASK_SCHEDULER_H
+#define BACKUPSUITE_TASK_SCHEDULER_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <vector>
+
+#include "api.h"
+#include "filesystem/entities.h"
+
+/**
+ * @brief 多源备份读取阶段的按大小调度
+ * - 小文件道: 按遍历顺序处理, 由专用的读取线程优先领取, 小文件持续流入写出阶段
+ * - 大文件道: 遍历结束、全部大小已知后从大到小开始, 最大的文件不会拖到最后才开始
+ * - 可分块的文件(源支持按偏移读取)在写出时由所有空闲线程并行读取各个分块, 任务尾部仍然并行
+ */
+class BACKUP_SUITE_API TaskScheduler
+{
+public:
+    enum class Lane
+    {
+        Small,
+        Large,
+    };
+
+    // 一个分块文件的读取进度: 读取线程在窗口内按序领取分块, 写出线程按序取走
+    struct ChunkStream
+    {
+        size_t source = 0;
+        std::filesystem::path path;
+        uint64_t size = 0;
+        size_t chunk_bytes = 0;
+        size_t chunks = 0;
+        size_t next_claim = 0;
+        size_t next_take = 0;
+        bool active = false;
+        std::map<size_t, std::vector<std::byte>> ready;
+        // 所有分块共用一个输入流, 由第一次读取时打开; 读取线程之间以 input_mutex 串行定位与读取
+        std::mutex input_mutex;
+        std::unique_ptr<std::istream> input;
+        // 打不开或读取出错时置位, 写出阶段据此放弃这个条目
+        std::atomic<bool> failed{false};
+
+        [[nodiscard]] uint64_t offset(const size_t chunk) const { return static_cast<uint64_t>(chunk) * chunk_bytes; }
+        [[nodiscard]] size_t length(const size_t chunk) const
+        {
+            return static_cast<size_t>(std::min<uint64_t>(chunk_bytes, size - offset(chunk)));
+        }
+    };
+
+    struct Task
+    {
+        size_t source = 0;
+        FileEntityMeta meta;                  // 源中的路径与遍历时得到的大小
+        bool chunked = false;                 // 文件任务: 交给写出阶段后按分块读取
+        std::shared_ptr<ChunkStream> stream;  // 非空时为 stream 的一个分块任务
+        size_t chunk = 0;
+    };
+
+    /**
+     * @param small_threshold 不大于该值的文件进入小文件道
+     * @param chunk_bytes 分块大小
+     * @param window_chunks 每个分块文件最多读入内存(尚未写出)的分块数
+     * @param drained 遍历结束且所有文件任务都已完成时调用一次, 用于关闭写出队列
+     */
+    TaskScheduler(size_t small_threshold, size_t chunk_bytes, size_t window_chunks, std::function<void()> drained);
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // 遍历线程登记一个文件
+    void add(size_t source, const FileEntityMeta& meta, bool chunked);
+    // 所有遍历线程结束
+    void finish();
+    /**
+     * @brief 领取一个任务, 没有任务时阻塞
+     * 小文件道: 小文件 > 分块 > 大文件; 大文件道: 分块 > 大文件(遍历结束后) > 小文件
+     * @return shutdown 之后返回 std::nullopt
+     */
+    std::optional<Task> next(Lane lane);
+    // 文件任务处理完毕(分块任务不需要调用)
+    void complete();
+    // 所有读取线程退出
+    void shutdown();
+
+    [[nodiscard]] std::shared_ptr<ChunkStream> open_stream(const Task& task) const;
+    // 写出线程开始写该文件, 此后读取线程才会领取它的分块
+    void activate(const std::shared_ptr<ChunkStream>& stream);
+    // 写出结束或放弃, 丢弃尚未取走的分块
+    void release(const std::shared_ptr<ChunkStream>& stream);
+    // 读取线程交回一个分块
+    void put(const std::shared_ptr<ChunkStream>& stream, size_t chunk, std::vector<std::byte> data);
+    /**
+     * @brief 写出线程按序取走下一个分块; 若该分块尚未被领取则直接用 read_inline 在当前线程读取, 保证总能前进
+     * @return 全部分块已取走时返回 std::nullopt
+     */
+    std::optional<std::vector<std::byte>> take(const std::shared_ptr<ChunkStream>& stream,
+                                               const std::function<std::vector<std::byte>(size_t)>& read_inline);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t small_threshold_;
+    size_t chunk_bytes_;
+    size_t window_chunks_;
+    std::function<void()> drained_;
+    std::queue<Task> small_;
+    std::vector<std::pair<size_t, Task>> large_; // (登记序号, 任务) 的堆, 大小相同时先登记的先出
+    size_t sequence_ = 0;
+    std::vector<std::shared_ptr<ChunkStream>> active_;
+    size_t outstanding_ = 0;
+    bool finished_ = false;
+    bool drained_called_ = false;
+    bool shutdown_ = false;
+
+    std::optional<Task> claim_chunk();
+    bool take_drained();
+};
+
+#endif // BACKUPSUITE_TASK_SCHEDULER_H
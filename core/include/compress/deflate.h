@@ -0,0 +1,157 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_DEFLATE_H
+#define BACKUPSUITE_DEFLATE_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "api.h"
+#include "compress/huffman.h"
+
+/**
+ * @brief Deflate(RFC 1951) 原始流的压缩与解压, zip 的压缩方法 8
+ */
+namespace compress::deflate
+{
+    constexpr int DEFAULT_LEVEL = 6;
+    constexpr size_t WINDOW_SIZE = 32768;
+    constexpr size_t MIN_MATCH = 3;
+    constexpr size_t MAX_MATCH = 258;
+
+    /**
+     * @brief 流式压缩
+     * 0 级只写存储块; 1-3 级贪心匹配, 4-9 级惰性匹配, 级别越高哈希链搜索越深;
+     * 每个块在动态哈夫曼、固定哈夫曼和存储三种编码中选最短的一种
+     */
+    class BACKUP_SUITE_API Deflater
+    {
+    public:
+        explicit Deflater(int level = DEFAULT_LEVEL);
+
+        // 追加输入, 已经确定的压缩数据追加到 out
+        void update(const std::byte* data, size_t size, std::vector<std::byte>& out);
+        // 结束压缩流, 写出剩余数据和最后一个块
+        void finish(std::vector<std::byte>& out);
+        /**
+         * @brief 同步刷新: 结束当前块并用一个空的存储块对齐到字节边界
+         * 输出可以直接与另一段独立压缩的数据拼接成一个流; 之后仍可继续 update
+         */
+        void flush(std::vector<std::byte>& out);
+        // 以 data 的最后 WINDOW_SIZE 字节作为历史窗口, 只能在第一次 update 之前调用
+        void set_dictionary(const std::byte* data, size_t size);
+
+    private:
+        struct Token
+        {
+            uint16_t length; // 0 表示字面量
+            uint16_t value;  // 字面量或距离
+        };
+        int level_;
+        size_t max_chain_;
+        size_t nice_length_;
+        bool lazy_;
+        bool finished_ = false;
+
+        std::vector<uint8_t> buffer_;  // 历史窗口 + 待处理的输入
+        uint64_t buffer_start_ = 0;    // buffer_[0] 在整个输入中的位置
+        uint64_t pos_ = 0;             // 下一个待编码的位置
+        uint64_t block_start_ = 0;     // 当前块的第一个字节
+        uint64_t covered_ = 0;         // 已经转换为记号的字节之后的位置
+        // 惰性匹配中尚未输出的前一位置(pos_ - 1)的匹配
+        bool match_available_ = false;
+        size_t prev_length_ = 0;
+        size_t prev_distance_ = 0;
+        std::vector<int64_t> head_;    // 哈希 -> 最近的位置
+        std::vector<int64_t> prev_;    // 位置 & (WINDOW_SIZE - 1) -> 同哈希的上一个位置
+        std::vector<Token> tokens_;
+
+        uint64_t bit_buffer_ = 0;
+        int bit_count_ = 0;
+
+        void compress(bool flush, std::vector<std::byte>& out);
+        void insert(uint64_t position);
+        [[nodiscard]] size_t longest_match(uint64_t position, size_t limit, size_t& distance) const;
+        void emit_block(bool final, std::vector<std::byte>& out);
+        void put_bits(uint32_t value, int count, std::vector<std::byte>& out);
+        void align(std::vector<std::byte>& out);
+    };
+
+    /**
+     * @brief 流式解压
+     * 通过 source 按需拉取压缩数据, 只保留 32 KiB 的历史窗口
+     */
+    class BACKUP_SUITE_API Inflater
+    {
+    public:
+        // 把最多 size 字节压缩数据读到 buffer, 返回 0 表示没有更多数据
+        using Source = std::function<size_t(std::byte* buffer, size_t size)>;
+        explicit Inflater(Source source);
+
+        /**
+         * @brief 解压最多 size 字节到 out
+         * @return 实际写入的字节数, 流结束或出错时返回 0(见 done / failed)
+         */
+        size_t read(std::byte* out, size_t size);
+        [[nodiscard]] bool done() const { return state_ == State::Done; }
+        [[nodiscard]] bool failed() const { return state_ == State::Error; }
+        // 已经解压的总字节数
+        [[nodiscard]] uint64_t total_out() const { return total_out_; }
+
+        // 供哈夫曼解码器使用的位读取接口
+        uint32_t peek(int count);
+        void consume(int count);
+
+    private:
+        enum class State
+        {
+            Header,
+            Stored,
+            Codes,
+            Done,
+            Error,
+        };
+        using LiteralDecoder = huffman::LsbDecoder<288, 15, 10>;
+        using DistanceDecoder = huffman::LsbDecoder<32, 15, 8>;
+
+        Source source_;
+        State state_ = State::Header;
+        bool last_block_ = false;
+        std::vector<std::byte> input_;
+        size_t input_pos_ = 0;
+        size_t input_end_ = 0;
+        bool input_eof_ = false;
+        uint64_t bit_buffer_ = 0;
+        int bit_count_ = 0;
+
+        std::vector<std::byte> window_;
+        size_t window_pos_ = 0;
+        uint64_t total_out_ = 0;
+        size_t stored_left_ = 0;
+        size_t copy_length_ = 0;
+        size_t copy_distance_ = 0;
+
+        LiteralDecoder literal_;
+        DistanceDecoder distance_;
+
+        bool fill_input();
+        void refill();
+        bool read_header();
+        bool read_dynamic_tables();
+        void push_window(const std::byte* data, size_t size);
+        size_t copy_match(std::byte* out, size_t size);
+        size_t read_stored(std::byte* out, size_t size);
+    };
+
+    // 一次性压缩整段数据
+    BACKUP_SUITE_API std::vector<std::byte> compress(const std::byte* data, size_t size, int level = DEFAULT_LEVEL);
+    // 一次性解压整段数据, 数据损坏时返回 false
+    BACKUP_SUITE_API bool decompress(const std::byte* data, size_t size, std::vector<std::byte>& out);
+}
+
+#endif // BACKUPSUITE_DEFLATE_H
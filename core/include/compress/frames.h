@@ -0,0 +1,121 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_FRAMES_H
+#define BACKUPSUITE_FRAMES_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <vector>
+
+#include "api.h"
+#include "compress/deflate.h"
+#include "utils/streams.h"
+
+/**
+ * @brief 可随机访问的分帧压缩流
+ * 数据按固定大小切成帧, 每帧单独压缩为一个 gzip 成员, 整个文件仍是合法的多成员 gzip(可以直接 tar -xzf);
+ * 帧表放在末尾几个空 gzip 成员的 FEXTRA 字段里(与 dictzip 的做法相同), 最后一个固定长度的成员记录帧表的位置。
+ * 读取时按未压缩偏移二分查找帧表, 只解压需要的帧
+ */
+namespace compress::frames
+{
+    constexpr size_t DEFAULT_FRAME_SIZE = 4 * 1024 * 1024;
+
+    struct Frame
+    {
+        uint64_t offset = 0;            // 未压缩数据中的起点
+        uint64_t compressed_offset = 0; // gzip 成员在文件中的起点
+        uint32_t size = 0;
+        uint32_t compressed_size = 0;
+    };
+
+    /**
+     * @brief 写出分帧压缩流, 压缩后的数据写入 sink
+     * 只支持顺序写入; tellp 返回未压缩的位置, 上层记录的偏移因此与不压缩时一致
+     */
+    class BACKUP_SUITE_API FrameWriterBuf : public std::streambuf
+    {
+    public:
+        explicit FrameWriterBuf(std::streambuf& sink, size_t frame_size = DEFAULT_FRAME_SIZE, int level = deflate::DEFAULT_LEVEL);
+        // 写出最后一帧、帧表和定位成员, 之后不能再写入; 任何一次写出失败时返回 false
+        bool finish();
+
+    protected:
+        int_type overflow(int_type ch) override;
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+
+    private:
+        std::streambuf& sink_;
+        int level_;
+        std::vector<char> buffer_;      // 当前帧, 作为 put 区
+        uint64_t position_ = 0;         // 已经写成帧的未压缩字节数
+        uint64_t sink_offset_ = 0;
+        std::vector<Frame> frames_;
+        bool finished_ = false;
+        bool failed_ = false;
+
+        void flush_frame();
+        void write(const std::vector<uint8_t>& bytes);
+    };
+
+    /**
+     * @brief 读取分帧压缩流, 对外表现为可以任意定位的未压缩数据
+     * 只缓存当前帧, 顺序读取时每帧只解压一次
+     */
+    class BACKUP_SUITE_API FrameReaderBuf : public std::streambuf
+    {
+    public:
+        // source 不是分帧压缩流(没有定位成员或帧表损坏)时返回 nullptr
+        static std::unique_ptr<FrameReaderBuf> open(std::streambuf& source);
+
+        [[nodiscard]] uint64_t size() const { return size_; }
+        [[nodiscard]] const std::vector<Frame>& frames() const { return frames_; }
+
+    protected:
+        int_type underflow() override;
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+    private:
+        static constexpr size_t NO_FRAME = static_cast<size_t>(-1);
+        std::streambuf& source_;
+        std::vector<Frame> frames_;
+        uint64_t size_ = 0;
+        size_t current_ = NO_FRAME;
+        std::vector<std::byte> data_;
+        uint64_t position_ = 0;         // 没有加载帧时的读取位置
+
+        FrameReaderBuf(std::streambuf& source, std::vector<Frame> frames, uint64_t size);
+        [[nodiscard]] uint64_t tell() const;
+        bool load(size_t index);
+    };
+
+    /**
+     * @brief 以未压缩的偏移按位置读取分帧压缩文件
+     * 所有读取共享一份帧缓存, 在锁内定位并读取
+     */
+    class BACKUP_SUITE_API FrameSource final : public PositionalSource
+    {
+    public:
+        // 文件不是分帧压缩流时返回 nullptr
+        static std::shared_ptr<FrameSource> open(const std::filesystem::path& path);
+        size_t read_at(uint64_t offset, char* buffer, size_t size) override;
+
+    private:
+        std::ifstream file_;
+        std::unique_ptr<FrameReaderBuf> reader_;
+        std::mutex mutex_;
+
+        FrameSource() = default;
+    };
+}
+
+#endif // BACKUPSUITE_FRAMES_H
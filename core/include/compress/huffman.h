@@ -5,8 +5,12 @@
 #ifndef BACKUPSUITE_HUFFMAN_H
 #define BACKUPSUITE_HUFFMAN_H
 
-#include <vector>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <vector>
 
 #include "utils/streams.h"
 
@@ -122,6 +126,198 @@ public:
         }
     }
 };
+
+    /**
+     * @brief 由符号频率构造码长, 最长不超过 max_bits
+     * 先构造普通的哈夫曼树, 超长时把码长截断到 max_bits 再调整使 Kraft 和恰好为 1;
+     * 频率为 0 的符号码长为 0, 只有一个符号时码长为 1
+     */
+    inline std::vector<uint8_t> build_lengths(const std::vector<uint32_t>& freqs, const int max_bits)
+    {
+        std::vector<uint8_t> lens(freqs.size(), 0);
+        std::vector<size_t> used;
+        for (size_t i = 0; i < freqs.size(); i++)
+            if (freqs[i])
+                used.push_back(i);
+        if (used.empty())
+            return lens;
+        if (used.size() == 1)
+        {
+            lens[used[0]] = 1;
+            return lens;
+        }
+        // 叶子在前, 内部节点按合并顺序追加, 最后一个是根
+        std::vector<size_t> parent(used.size() * 2 - 1, 0);
+        using Item = std::pair<uint64_t, size_t>;
+        std::priority_queue<Item, std::vector<Item>, std::greater<>> heap;
+        for (size_t i = 0; i < used.size(); i++)
+            heap.emplace(freqs[used[i]], i);
+        size_t next = used.size();
+        while (heap.size() > 1)
+        {
+            const auto [fa, a] = heap.top();
+            heap.pop();
+            const auto [fb, b] = heap.top();
+            heap.pop();
+            parent[a] = parent[b] = next;
+            heap.emplace(fa + fb, next++);
+        }
+        std::vector<int> depth(parent.size(), 0);
+        std::vector<size_t> counts(max_bits + 1, 0);
+        for (size_t i = parent.size() - 1; i-- > 0;)
+            depth[i] = depth[parent[i]] + 1;
+        for (size_t i = 0; i < used.size(); i++)
+            ++counts[std::min(depth[i], max_bits)];
+        // 截断后 Kraft 和可能大于 1: 每次去掉一个最长的码, 再把一个较短的码拆成两个长一位的码
+        uint64_t total = 0;
+        for (int i = 1; i <= max_bits; i++)
+            total += static_cast<uint64_t>(counts[i]) << (max_bits - i);
+        while (total > (uint64_t{1} << max_bits))
+        {
+            --counts[max_bits];
+            for (int i = max_bits - 1; i > 0; i--)
+            {
+                if (counts[i])
+                {
+                    --counts[i];
+                    counts[i + 1] += 2;
+                    break;
+                }
+            }
+            --total;
+        }
+        // 频率高的符号分到短码
+        std::stable_sort(used.begin(), used.end(), [&](const size_t a, const size_t b) { return freqs[a] > freqs[b]; });
+        size_t k = 0;
+        for (int len = 1; len <= max_bits; len++)
+            for (size_t c = 0; c < counts[len]; c++)
+                lens[used[k++]] = static_cast<uint8_t>(len);
+        return lens;
+    }
+
+    /**
+     * @brief 由码长计算规范哈夫曼码(RFC 1951 3.2.2)
+     * @param reversed 为 true 时按位反转, 用于 LSB 优先写出的位流
+     */
+    inline std::vector<uint16_t> canonical_codes(const std::vector<uint8_t>& lens, const bool reversed)
+    {
+        uint16_t counts[16] = {}, next_code[16] = {};
+        for (const auto len : lens)
+            ++counts[len];
+        counts[0] = 0;
+        uint16_t code = 0;
+        for (int bits = 1; bits < 16; bits++)
+        {
+            code = static_cast<uint16_t>((code + counts[bits - 1]) << 1);
+            next_code[bits] = code;
+        }
+        std::vector<uint16_t> codes(lens.size(), 0);
+        for (size_t i = 0; i < lens.size(); i++)
+        {
+            const int len = lens[i];
+            if (!len)
+                continue;
+            uint16_t value = next_code[len]++;
+            if (reversed)
+            {
+                uint16_t r = 0;
+                for (int b = 0; b < len; b++, value >>= 1)
+                    r = static_cast<uint16_t>((r << 1) | (value & 1));
+                value = r;
+            }
+            codes[i] = value;
+        }
+        return codes;
+    }
+
+    /**
+     * @brief LSB 优先位流(Deflate)使用的解码器
+     * 码长不超过 kNumTableBits 的符号直接查表; 更长的码逐位按规范码的计数查找
+     * BitReader 需要提供 peek(n) 与 consume(n)
+     */
+    template<size_t kNumSymbols, size_t kNumBitsMax, size_t kNumTableBits>
+    class LsbDecoder
+    {
+        // 高位为符号, 低 4 位为码长, 0 表示不在表中
+        uint16_t table_[1 << kNumTableBits] = {};
+        uint16_t counts_[kNumBitsMax + 1] = {};
+        uint16_t symbols_[kNumSymbols] = {}; // 按规范码顺序排列的符号
+    public:
+        bool build(const uint8_t* lens, const size_t n)
+        {
+            if (n > kNumSymbols)
+                return false;
+            std::memset(table_, 0, sizeof(table_));
+            std::memset(counts_, 0, sizeof(counts_));
+            for (size_t i = 0; i < n; i++)
+            {
+                if (lens[i] > kNumBitsMax)
+                    return false;
+                ++counts_[lens[i]];
+            }
+            counts_[0] = 0;
+            // 码过多(Kraft 和大于 1)时无法解码; 不完整的码允许, 未使用的码在解码时报错
+            int left = 1;
+            for (size_t len = 1; len <= kNumBitsMax; len++)
+            {
+                left = (left << 1) - counts_[len];
+                if (left < 0)
+                    return false;
+            }
+            uint16_t offsets[kNumBitsMax + 2] = {};
+            for (size_t len = 1; len <= kNumBitsMax; len++)
+                offsets[len + 1] = offsets[len] + counts_[len];
+            for (size_t i = 0; i < n; i++)
+                if (lens[i])
+                    symbols_[offsets[lens[i]]++] = static_cast<uint16_t>(i);
+            // 快速表: 规范码反转后作为下标, 高位任意
+            uint32_t code = 0;
+            size_t index = 0;
+            for (size_t len = 1; len <= kNumTableBits; len++)
+            {
+                for (size_t c = 0; c < counts_[len]; c++, code++, index++)
+                {
+                    uint32_t reversed = 0;
+                    for (size_t b = 0; b < len; b++)
+                        reversed |= ((code >> b) & 1) << (len - 1 - b);
+                    const auto entry = static_cast<uint16_t>((symbols_[index] << 4) | len);
+                    for (uint32_t k = reversed; k < (1u << kNumTableBits); k += 1u << len)
+                        table_[k] = entry;
+                }
+                code <<= 1;
+            }
+            return true;
+        }
+        /**
+         * @return 符号, 遇到未定义的码时返回 -1
+         */
+        template<class BitReader>
+        int decode(BitReader& br) const
+        {
+            const uint32_t bits = br.peek(kNumBitsMax);
+            if (const auto entry = table_[bits & ((1u << kNumTableBits) - 1)])
+            {
+                br.consume(entry & 0xF);
+                return entry >> 4;
+            }
+            // 慢速路径: 与 zlib puff 相同, 逐位比较每个码长的首个规范码
+            int code = 0, first = 0, index = 0;
+            for (size_t len = 1; len <= kNumBitsMax; len++)
+            {
+                code |= static_cast<int>((bits >> (len - 1)) & 1);
+                const int count = counts_[len];
+                if (code - first < count)
+                {
+                    br.consume(static_cast<int>(len));
+                    return symbols_[index + code - first];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+    };
 }
 
 #endif // BACKUPSUITE_HUFFMAN_H
@@ -0,0 +1,47 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_AES_H
+#define BACKUPSUITE_AES_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "api.h"
+
+namespace encryption
+{
+    /**
+     * @brief AES 分组加密(只有加密方向, 供 CTR 模式使用)
+     * 支持 128/192/256 位密钥; CPU 支持 AES-NI 时使用硬件指令, 否则使用查表实现, 两者输出一致
+     */
+    class BACKUP_SUITE_API Aes
+    {
+    public:
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        Aes() = default;
+        // key_size 为 16/24/32 字节, 其他长度时 is_valid 为 false
+        Aes(const uint8_t* key, size_t key_size);
+        [[nodiscard]] bool is_valid() const { return rounds_ != 0; }
+
+        void encrypt_block(const uint8_t in[BLOCK_SIZE], uint8_t out[BLOCK_SIZE]) const;
+        // 连续加密 blocks 个分组, in 和 out 可以相同
+        void encrypt_blocks(const uint8_t* in, uint8_t* out, size_t blocks) const;
+
+        // 当前是否使用 AES-NI
+        static bool hardware_accelerated();
+        // 关闭后强制使用查表实现, 用于测试和性能对比; 不支持 AES-NI 时开启无效
+        static void set_hardware_enabled(bool enabled);
+
+    private:
+        int rounds_ = 0;
+        // 轮密钥: 大端序的字, 以及同样内容的字节序列(AES-NI 直接加载)
+        uint32_t round_keys_[60]{};
+        alignas(16) uint8_t round_key_bytes_[240]{};
+    };
+}
+
+#endif // BACKUPSUITE_AES_H
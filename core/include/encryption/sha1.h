@@ -0,0 +1,63 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_SHA1_H
+#define BACKUPSUITE_SHA1_H
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "api.h"
+
+namespace encryption
+{
+    class BACKUP_SUITE_API Sha1
+    {
+    public:
+        static constexpr size_t DIGEST_SIZE = 20;
+        static constexpr size_t BLOCK_SIZE = 64;
+        using Digest = std::array<uint8_t, DIGEST_SIZE>;
+
+        Sha1() { reset(); }
+        void reset();
+        void update(const uint8_t* data, size_t size);
+        // 补位并输出摘要, 之后需要 reset 才能复用
+        Digest finalize();
+
+    private:
+        uint32_t state_[5]{};
+        uint64_t length_ = 0;
+        uint8_t buffer_[BLOCK_SIZE]{};
+        size_t buffered_ = 0;
+        void transform(const uint8_t* block);
+    };
+
+    /**
+     * @brief HMAC-SHA1
+     * 构造时算好带密钥的内外两层初始状态, finalize 后回到初始状态, 可以继续计算下一条消息
+     */
+    class BACKUP_SUITE_API HmacSha1
+    {
+    public:
+        HmacSha1() = default;
+        HmacSha1(const uint8_t* key, size_t size);
+        void update(const uint8_t* data, size_t size) { inner_.update(data, size); }
+        Sha1::Digest finalize();
+
+    private:
+        Sha1 inner_key_, outer_key_, inner_;
+    };
+
+    /**
+     * @brief PBKDF2 (RFC 2898), 伪随机函数为 HMAC-SHA1
+     * @return length 字节的派生密钥
+     */
+    BACKUP_SUITE_API std::vector<uint8_t> pbkdf2_hmac_sha1(const std::vector<uint8_t>& password, const uint8_t* salt, size_t salt_size,
+                                                           uint32_t iterations, size_t length);
+}
+
+#endif // BACKUPSUITE_SHA1_H
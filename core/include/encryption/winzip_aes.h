@@ -0,0 +1,68 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_WINZIP_AES_H
+#define BACKUPSUITE_WINZIP_AES_H
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "api.h"
+#include "encryption/aes.h"
+#include "encryption/sha1.h"
+
+namespace encryption
+{
+    /**
+     * @brief WinZip AES 加密(AE-1/AE-2)
+     * 口令和盐经 PBKDF2-HMAC-SHA1(1000 次)派生出加密密钥、认证密钥和 2 字节的口令校验值;
+     * 数据用 AES-CTR(小端序计数器, 从 1 开始)加密, 对密文计算 HMAC-SHA1, 取前 10 字节作为认证码
+     * 条目数据的布局: 盐 | 口令校验值 | 密文 | 认证码
+     */
+    class BACKUP_SUITE_API WinZipAes
+    {
+    public:
+        static constexpr size_t VERIFIER_SIZE = 2;
+        static constexpr size_t AUTH_CODE_SIZE = 10;
+        static constexpr uint32_t ITERATIONS = 1000;
+        // strength 1/2/3 对应 AES-128/192/256, 其他值返回 0
+        static size_t salt_size(int strength);
+        static size_t key_size(int strength);
+        // 生成 strength 对应长度的随机盐
+        static std::vector<uint8_t> random_salt(int strength);
+
+        WinZipAes() = default;
+        // salt 的长度必须为 salt_size(strength)
+        WinZipAes(int strength, const std::vector<uint8_t>& password, const uint8_t* salt);
+        [[nodiscard]] bool is_valid() const { return strength_ != 0; }
+        [[nodiscard]] int strength() const { return strength_; }
+        [[nodiscard]] const std::vector<uint8_t>& salt() const { return salt_; }
+        [[nodiscard]] const std::array<uint8_t, VERIFIER_SIZE>& verifier() const { return verifier_; }
+
+        // 就地加密, 再把密文计入认证码
+        void encrypt(uint8_t* data, size_t size);
+        // 先把密文计入认证码, 再就地解密
+        void decrypt(uint8_t* data, size_t size);
+        // 全部密文的认证码, 在数据结束后调用一次
+        std::array<uint8_t, AUTH_CODE_SIZE> auth_code();
+
+    private:
+        static constexpr size_t KEYSTREAM_BLOCKS = 64;
+        int strength_ = 0;
+        std::vector<uint8_t> salt_;
+        std::array<uint8_t, VERIFIER_SIZE> verifier_{};
+        Aes aes_;
+        HmacSha1 hmac_;
+        uint8_t counter_[Aes::BLOCK_SIZE]{};
+        // 批量生成的密钥流, 使 AES-NI 一次能处理多个分组
+        uint8_t keystream_[KEYSTREAM_BLOCKS * Aes::BLOCK_SIZE]{};
+        size_t keystream_pos_ = sizeof(keystream_);
+        void apply_keystream(uint8_t* data, size_t size);
+    };
+}
+
+#endif // BACKUPSUITE_WINZIP_AES_H
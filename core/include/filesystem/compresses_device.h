@@ -9,6 +9,7 @@
 #include <utility>
 
 #include "device.h"
+#include "utils/buffer_pool.h"
 #include "utils/tar.h"
 #include "utils/zip.h"
 #include "filesystem/entities.h"
@@ -24,6 +25,10 @@ public:
     {
         if (!is_)
             return nullptr;
+        // 与 PhysicalDeviceReadableFile 一致, 整文件读取期间占用等量的全局内存预算
+        const buffer_pool::Reservation reservation(buffer_pool::BufferPool::instance(), meta.size);
+        if (!reservation)
+            return nullptr;
         std::vector<std::byte> buffer;
         buffer.resize(meta.size);
         is_->read(reinterpret_cast<char*>(buffer.data()), meta.size);
@@ -44,6 +49,14 @@ public:
             return nullptr;
         return std::make_unique<std::vector<std::byte>>(std::move(buffer));
     }
+    [[nodiscard]] size_t read_into(std::byte* buffer, const size_t size) override
+    {
+        if (!is_ || size == 0)
+            return 0;
+        is_->read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(size));
+        const auto read_bytes = is_->gcount();
+        return read_bytes > 0 ? static_cast<size_t>(read_bytes) : 0;
+    }
 };
 
 using TarIstreamReadableFile = IstreamReadableFile<tar::TarFile::TarIstream>;
@@ -55,11 +68,16 @@ public:
     enum class Mode
     {
         ReadOnly,
-        WriteOnly
+        WriteOnly,
+        Append  // 在已有归档末尾继续写入
     };
 
-    explicit TarDevice(const std::filesystem::path& path, const Mode mode = Mode::ReadOnly)
-        : mode_(mode), tar_file_(path, mode == Mode::ReadOnly ? tar::TarFile::TarMode::input : tar::TarFile::TarMode::output)
+    // index_backend 选择归档路径索引的存储方式
+    explicit TarDevice(const std::filesystem::path& path, const Mode mode = Mode::ReadOnly,
+                       const db::IndexBackend index_backend = db::IndexBackend::Sqlite)
+        : mode_(mode), tar_file_(path, mode == Mode::ReadOnly ? tar::TarFile::TarMode::input :
+                                       mode == Mode::Append ? tar::TarFile::TarMode::append : tar::TarFile::TarMode::output,
+                                 index_backend)
     { }
 
     [[nodiscard]] std::unique_ptr<Folder> get_folder(const std::filesystem::path& path) override;
@@ -70,6 +88,7 @@ public:
     bool write_file(ReadableFile& file) override;
     bool write_file_force(ReadableFile& file) override;
     bool write_folder(Folder& folder) override;
+    bool write_files(const std::vector<ReadableFile*>& files) override;
     void set_standard(tar::TarStandard standard)
     {
         tar_file_.set_standard(standard);
@@ -78,6 +97,14 @@ public:
     {
         return tar_file_.get_standard();
     }
+    void set_embed_index(const bool embed)
+    {
+        tar_file_.set_embed_index(embed);
+    }
+    bool set_frame_compression(const size_t frame_size, const int level = compress::deflate::DEFAULT_LEVEL)
+    {
+        return tar_file_.set_frame_compression(frame_size, level);
+    }
     void close()
     {
         tar_file_.close();
@@ -87,7 +114,7 @@ private:
     Mode mode_;
     tar::TarFile tar_file_;
 
-    [[nodiscard]] std::vector<std::pair<FileEntityMeta, int>> list_all_files() const;
+    [[nodiscard]] std::vector<std::pair<FileEntityMeta, uint64_t>> list_all_files() const;
 };
 
 class BACKUP_SUITE_API ZipDevice : public Device
@@ -96,12 +123,18 @@ public:
     enum class Mode
     {
         ReadOnly,
-        WriteOnly
+        WriteOnly,
+        Stream, // 只顺序写出, 不回写已写的内容, path 可以是管道或 /dev/stdout
+        Update  // 在已有归档中添加新文件、替换有变化的文件, 不重写其余条目
     };
 
     explicit ZipDevice(const std::filesystem::path& path, const Mode mode = Mode::ReadOnly,
-                       const std::vector<uint8_t>& password ={})
-        : mode_(mode), zip_file_(path, mode == Mode::ReadOnly ? zip::ZipFile::ZipMode::input : zip::ZipFile::ZipMode::output)
+                       const std::vector<uint8_t>& password ={},
+                       const db::IndexBackend index_backend = db::IndexBackend::Sqlite)
+        : mode_(mode), zip_file_(path, mode == Mode::ReadOnly ? zip::ZipFile::ZipMode::input :
+                                       mode == Mode::Stream ? zip::ZipFile::ZipMode::stream :
+                                       mode == Mode::Update ? zip::ZipFile::ZipMode::update : zip::ZipFile::ZipMode::output,
+                                 index_backend)
     {
         zip_file_.set_password(password);
     }
@@ -115,9 +148,15 @@ public:
     bool write_file(ReadableFile& file, zip::header::ZipCompressionMethod compression_method, zip::header::ZipEncryptionMethod encryption_method);
     bool write_file_force(ReadableFile& file) override;
     bool write_folder(Folder& folder) override;
-    void close()
+    // 更新模式下大小和修改时间都没有变化的文件保留原条目
+    [[nodiscard]] bool has_unchanged(const FileEntityMeta& meta) override
+    {
+        return mode_ == Mode::Update && zip_file_.has_unchanged_entry(meta);
+    }
+    // 归档未能完整写出时返回 false
+    bool close()
     {
-        zip_file_.close();
+        return zip_file_.close();
     }
     void set_password(const std::vector<uint8_t>& password)
     {
@@ -127,6 +166,20 @@ public:
     {
         encryption_method_ = method;
     }
+    // 默认使用 Deflate; Store 不压缩
+    void set_compression_method(const zip::header::ZipCompressionMethod method)
+    {
+        compression_method_ = method;
+    }
+    void set_compression_level(const int level)
+    {
+        zip_file_.set_compression_level(level);
+    }
+    // 大于 1 时由多个线程并行压缩, 必须在写入第一个文件之前设置
+    void set_compression_threads(const size_t threads)
+    {
+        zip_file_.set_compression_threads(threads);
+    }
     [[nodiscard]] bool is_invalid_password() const
     {
         return zip_file_.is_invalid_password();
@@ -135,7 +188,7 @@ public:
 private:
     Mode mode_;
     zip::ZipFile zip_file_;
-    zip::header::ZipCompressionMethod compression_method_ = zip::header::ZipCompressionMethod::Store;
+    zip::header::ZipCompressionMethod compression_method_ = zip::header::ZipCompressionMethod::Deflate;
     zip::header::ZipEncryptionMethod encryption_method_ = zip::header::ZipEncryptionMethod::Unknown;
 
     [[nodiscard]] std::vector<zip::ZipFile::CentralDirectoryEntry> list_all_files() const;
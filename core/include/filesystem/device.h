@@ -11,6 +11,7 @@
 
 #include "api.h"
 #include "entities.h"
+#include "utils/read_order.h"
 
 // 取消 MSVC 中定义的 min 和 max 宏
 #undef min
@@ -35,6 +36,7 @@ public:
     [[nodiscard]] std::ifstream &get_stream() const { return *stream; }
     [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read() override;
     [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read(size_t size) override;
+    [[nodiscard]] size_t read_into(std::byte* buffer, size_t size) override;
     void close() override
     {
         if (stream && stream->is_open())
@@ -54,6 +56,25 @@ public:
     virtual bool write_file(ReadableFile &file) = 0;
     virtual bool write_file_force(ReadableFile &file) = 0;
     virtual bool write_folder(Folder &folder) = 0;
+    // 批量写入一组(通常是小)文件, 默认逐个 write_file; 归档设备可覆盖为整批一次写出
+    virtual bool write_files(const std::vector<ReadableFile*> &files)
+    {
+        bool ok = true;
+        for (const auto file : files)
+            if (file)
+                ok = write_file(*file) && ok;
+        return ok;
+    }
+    // 文件的物理位置, 用于安排读取顺序以减少磁盘寻道; 默认未知
+    [[nodiscard]] virtual read_order::Location read_location(const std::filesystem::path &)
+    {
+        return {};
+    }
+    // 目标中已有相同的条目、写入时会被跳过(如 zip 的更新模式), 调用方可以不必读取文件内容; 默认没有
+    [[nodiscard]] virtual bool has_unchanged(const FileEntityMeta &)
+    {
+        return false;
+    }
 };
 
 class BACKUP_SUITE_API PhysicalDevice: public Device
@@ -103,6 +124,18 @@ public:
     {
         return device->write_folder(folder);
     }
+    bool write_files(const std::vector<ReadableFile*> &files) override
+    {
+        return device->write_files(files);
+    }
+    [[nodiscard]] read_order::Location read_location(const std::filesystem::path& path) override
+    {
+        return device->read_location(path);
+    }
+    [[nodiscard]] bool has_unchanged(const FileEntityMeta& meta) override
+    {
+        return device->has_unchanged(meta);
+    }
     void set_device(const std::shared_ptr<Device>& new_device)
     {
         device = new_device;
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstring>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -112,6 +113,18 @@ public:
     explicit ReadableFile(const FileEntityMeta& metaData): File(metaData) {}
     [[nodiscard]] virtual std::unique_ptr<std::vector<std::byte>> read() = 0;
     [[nodiscard]] virtual std::unique_ptr<std::vector<std::byte>> read(size_t size) = 0;
+    // 读取至多 size 字节到调用方的缓冲区(通常是 BufferPool 借出的 slab), 返回实际字节数, 0 表示读完或失败
+    [[nodiscard]] virtual size_t read_into(std::byte* buffer, const size_t size)
+    {
+        const auto data = read(size);
+        if (!data || data->empty())
+            return 0;
+        const auto n = data->size() < size ? data->size() : size;
+        std::memcpy(buffer, data->data(), n);
+        return n;
+    }
+    // 读取出错时为真, 用来区分 read_into 返回 0 或不足时是读到末尾还是读取失败
+    [[nodiscard]] virtual bool failed() const { return false; }
     virtual void close() {};
 };
 
@@ -124,6 +137,7 @@ public:
     explicit EmptyReadableFile(const FileEntityMeta& meta) : ReadableFile(meta) {}
     [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read() override { return nullptr; }
     [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read(size_t) override { return nullptr; }
+    [[nodiscard]] size_t read_into(std::byte*, size_t) override { return 0; }
 };
 
 #endif //FILE_ENTITY_H
\ No newline at end of file
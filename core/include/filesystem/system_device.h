@@ -46,6 +46,10 @@ public:
     [[nodiscard]] std::unique_ptr<std::ifstream> get_file_stream(const std::filesystem::path& path) const override;
     [[nodiscard]] std::unique_ptr<FileEntityMeta> get_meta(const std::filesystem::path& path) override;
     [[nodiscard]] bool exists(const std::filesystem::path& path) override;
+    [[nodiscard]] read_order::Location read_location(const std::filesystem::path& path) override
+    {
+        return read_order::physical_location(root / path);
+    }
     bool write_file(ReadableFile&) override;
     bool write_file_force(ReadableFile &file) override;
     bool write_folder(Folder &folder) override;
@@ -0,0 +1,300 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_ARCHIVE_INDEX_H
+#define BACKUPSUITE_ARCHIVE_INDEX_H
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils/database.h"
+
+namespace db
+{
+    // 归档索引的存储后端
+    enum class IndexBackend
+    {
+        Sqlite, // 内存中的 SQLite 数据库, 默认
+        Memory  // 有序路径数组 + 哈希表, 打开和查找都不经过 SQL
+    };
+
+    /**
+     * @brief 归档内路径到成员记录(偏移和元数据)的索引
+     * path 为归档中保存的原始路径(目录可以带结尾的 '/'); 同一路径写入多次时以最后一次为准, 与解包时后者覆盖前者一致
+     * 成员归属的目录按 PathCatalog::split 计算, 如 "a/b/" 是目录 "a" 下的 "b"
+     */
+    template<typename Record>
+    class ArchiveIndex
+    {
+    public:
+        using Visitor = std::function<void(const Record&)>;
+
+        virtual ~ArchiveIndex() = default;
+        // 写入一条记录, 可能先留在当前批次中
+        virtual bool insert(const std::string& path, const Record& record) = 0;
+        // 提交当前批次
+        virtual bool flush() = 0;
+        // 打开归档、一次写入全部记录的前后调用, 后端可以暂停维护二级索引, 最后一次建好
+        virtual void begin_load() {}
+        virtual bool end_load() { return flush(); }
+        // 路径上最后写入的记录
+        [[nodiscard]] virtual std::optional<Record> find(const std::string& path) const = 0;
+        // 依次访问 [prefix/, prefix0) 中的记录('0' 是 '/' 的下一个字符), 空前缀为全部; 按路径排序, 同一路径按写入顺序
+        virtual void visit_subtree(const std::string& prefix, const Visitor& visit) const = 0;
+        // 目录的直接子节点, 按名字排序, 同名时取最后写入的; 目录不存在时为空
+        [[nodiscard]] virtual std::vector<Record> list_children(const std::string& directory) const = 0;
+        // 清空全部记录
+        virtual void clear() = 0;
+
+        [[nodiscard]] std::vector<Record> list_subtree(const std::string& prefix) const
+        {
+            std::vector<Record> records;
+            visit_subtree(prefix, [&records](const Record& record) { records.push_back(record); });
+            return records;
+        }
+    };
+
+    /**
+     * @brief 以 SQLite 表保存的索引, 表结构由 Codec::Strategy 给出
+     * Codec 提供: Strategy(TableName/PathColumn/SQLEntityColumns/SQLIndexes/SQLDropIndexes)、行类型 Row、记录类型 Record、
+     * 列数 Columns, 以及 bind(绑定前 Columns 个参数) 和 decode(从一行还原记录)
+     */
+    template<typename Codec>
+    class SqliteArchiveIndex final : public ArchiveIndex<typename Codec::Record>
+    {
+        using Record = typename Codec::Record;
+        using Row = typename Codec::Row;
+        using Strategy = typename Codec::Strategy;
+        using Visitor = typename ArchiveIndex<Record>::Visitor;
+
+        Database db_;
+        // 写入复用同一条语句, 分批提交
+        std::unique_ptr<BulkInserter> inserter_;
+        // 成员所在目录的编号, 列出直接子节点时使用
+        PathCatalog catalog_{db_};
+        bool indexes_dropped_ = false;
+
+        [[nodiscard]] std::string select_sql(const std::string& condition) const
+        {
+            return "SELECT " + Strategy::SQLEntityColumns + " FROM " + Strategy::TableName + " " + condition;
+        }
+    public:
+        SqliteArchiveIndex() : db_(std::make_unique<Strategy>().get()) {}
+
+        bool insert(const std::string& path, const Record& record) override
+        {
+            if (!inserter_)
+            {
+                std::string values;
+                for (int i = 0; i < Codec::Columns + 2; ++i)
+                    values += i ? ",?" : "?";
+                inserter_ = std::make_unique<BulkInserter>(db_, "INSERT INTO " + Strategy::TableName + " (" +
+                                                                Strategy::SQLEntityColumns + ", parent_id, name) VALUES (" + values + ");");
+            }
+            const auto stmt = inserter_->statement();
+            if (!stmt)
+                return false;
+            const auto [parent, name] = PathCatalog::split(path);
+            const auto parent_id = catalog_.ensure_directory(parent);
+            if (parent_id < 0)
+                return false;
+            Codec::bind(stmt, record);
+            bind_parameter(stmt, Codec::Columns + 1, parent_id);
+            bind_parameter(stmt, Codec::Columns + 2, name);
+            return inserter_->insert();
+        }
+        bool flush() override
+        {
+            return !inserter_ || inserter_->flush();
+        }
+        void begin_load() override
+        {
+            indexes_dropped_ = db_.exec(Strategy::SQLDropIndexes);
+        }
+        bool end_load() override
+        {
+            const bool flushed = flush();
+            if (!indexes_dropped_)
+                return flushed;
+            indexes_dropped_ = false;
+            return db_.exec(Strategy::SQLIndexes) && flushed;
+        }
+        [[nodiscard]] std::optional<Record> find(const std::string& path) const override
+        {
+            try {
+                auto stmt = db_.create_statement(select_sql("WHERE " + Strategy::PathColumn + " = ? ORDER BY id DESC LIMIT 1;"));
+                bind_parameter(stmt.get(), 1, path);
+                return Codec::decode(db_.query_one<Row>(std::move(stmt)));
+            } catch ([[maybe_unused]] const std::exception& e) {
+                return std::nullopt;
+            }
+        }
+        void visit_subtree(const std::string& prefix, const Visitor& visit) const override
+        {
+            const auto normalized = PathCatalog::normalize(prefix);
+            const auto& column = Strategy::PathColumn;
+            try {
+                auto stmt = db_.create_statement(select_sql(
+                    (normalized.empty() ? "" : "WHERE " + column + " >= ? AND " + column + " < ? ") +
+                    "ORDER BY " + column + " ASC, id ASC;"));
+                if (!normalized.empty())
+                {
+                    bind_parameter(stmt.get(), 1, normalized + '/');
+                    bind_parameter(stmt.get(), 2, normalized + static_cast<char>('/' + 1));
+                }
+                for (const auto& row : db_.query<Row>(std::move(stmt)))
+                    visit(Codec::decode(row));
+            } catch ([[maybe_unused]] const std::exception& e) {
+            }
+        }
+        [[nodiscard]] std::vector<Record> list_children(const std::string& directory) const override
+        {
+            std::vector<Record> records;
+            const auto parent_id = catalog_.find_directory(directory);
+            if (parent_id < 0)
+                return records;
+            try {
+                auto stmt = db_.create_statement(select_sql(
+                    "WHERE id IN (SELECT MAX(id) FROM " + Strategy::TableName + " WHERE parent_id = ? GROUP BY name) ORDER BY name ASC;"));
+                bind_parameter(stmt.get(), 1, parent_id);
+                for (const auto& row : db_.query<Row>(std::move(stmt)))
+                    records.push_back(Codec::decode(row));
+            } catch ([[maybe_unused]] const std::exception& e) {
+                records.clear();
+            }
+            return records;
+        }
+        void clear() override
+        {
+            inserter_.reset();
+            [[maybe_unused]] const auto cleared = db_.exec("DELETE FROM " + Strategy::TableName + ";");
+            catalog_.clear();
+        }
+    };
+
+    /**
+     * @brief 内存中的索引: 记录按写入顺序保存, 哈希表按路径找最后一条, 有序下标数组按路径二分查找子树
+     * 有序数组在写入后的第一次列出时补齐(新写入的部分排序后与已有部分归并), 只读时可以多线程并发查询
+     */
+    template<typename Record>
+    class MemoryArchiveIndex final : public ArchiveIndex<Record>
+    {
+        using Visitor = typename ArchiveIndex<Record>::Visitor;
+
+        struct Entry
+        {
+            std::string path;
+            Record record;
+        };
+        // deque 追加时不移动已有元素, 哈希表的键直接引用其中的路径
+        std::deque<Entry> entries_;
+        std::unordered_map<std::string_view, size_t> latest_;
+        // 规范化的目录路径 -> 直接子节点的下标
+        std::unordered_map<std::string, std::vector<size_t>> children_;
+        mutable std::mutex sort_mutex_;
+        // 按 (路径, 下标) 排序的下标
+        mutable std::vector<size_t> sorted_;
+
+        [[nodiscard]] bool less(const size_t a, const size_t b) const
+        {
+            const int order = entries_[a].path.compare(entries_[b].path);
+            return order < 0 || (order == 0 && a < b);
+        }
+        // 调用时持有 sort_mutex_
+        void sort_pending() const
+        {
+            const auto sorted = sorted_.size();
+            if (sorted == entries_.size())
+                return;
+            for (auto i = sorted; i < entries_.size(); ++i)
+                sorted_.push_back(i);
+            const auto by_path = [this](const size_t a, const size_t b) { return less(a, b); };
+            std::sort(sorted_.begin() + static_cast<std::ptrdiff_t>(sorted), sorted_.end(), by_path);
+            std::inplace_merge(sorted_.begin(), sorted_.begin() + static_cast<std::ptrdiff_t>(sorted), sorted_.end(), by_path);
+        }
+    public:
+        bool insert(const std::string& path, const Record& record) override
+        {
+            const auto& entry = entries_.emplace_back(Entry{path, record});
+            const auto id = entries_.size() - 1;
+            latest_.insert_or_assign(std::string_view(entry.path), id);
+            children_[PathCatalog::split(path).first].push_back(id);
+            return true;
+        }
+        bool flush() override { return true; }
+        [[nodiscard]] std::optional<Record> find(const std::string& path) const override
+        {
+            const auto it = latest_.find(path);
+            if (it == latest_.end())
+                return std::nullopt;
+            return entries_[it->second].record;
+        }
+        void visit_subtree(const std::string& prefix, const Visitor& visit) const override
+        {
+            const auto normalized = PathCatalog::normalize(prefix);
+            std::lock_guard lock(sort_mutex_);
+            sort_pending();
+            auto first = sorted_.begin(), last = sorted_.end();
+            if (!normalized.empty())
+            {
+                const auto path_less = [this](const size_t id, const std::string& bound) { return entries_[id].path < bound; };
+                first = std::lower_bound(sorted_.begin(), sorted_.end(), normalized + '/', path_less);
+                last = std::lower_bound(first, sorted_.end(), normalized + static_cast<char>('/' + 1), path_less);
+            }
+            for (; first != last; ++first)
+                visit(entries_[*first].record);
+        }
+        [[nodiscard]] std::vector<Record> list_children(const std::string& directory) const override
+        {
+            std::vector<Record> records;
+            const auto it = children_.find(PathCatalog::normalize(directory));
+            if (it == children_.end())
+                return records;
+            // 按 (名字, 下标) 排序后每组取最后一个, 即同名时最后写入的
+            std::vector<std::pair<std::string, size_t>> named;
+            named.reserve(it->second.size());
+            for (const auto id : it->second)
+                named.emplace_back(PathCatalog::split(entries_[id].path).second, id);
+            std::sort(named.begin(), named.end());
+            for (size_t i = 0; i < named.size(); ++i)
+            {
+                if (i + 1 < named.size() && named[i + 1].first == named[i].first)
+                    continue;
+                records.push_back(entries_[named[i].second].record);
+            }
+            return records;
+        }
+        void clear() override
+        {
+            std::lock_guard lock(sort_mutex_);
+            latest_.clear();
+            children_.clear();
+            sorted_.clear();
+            entries_.clear();
+        }
+    };
+
+    // 按后端创建索引
+    template<typename Codec>
+    std::unique_ptr<ArchiveIndex<typename Codec::Record>> make_archive_index(const IndexBackend backend)
+    {
+        if (backend == IndexBackend::Memory)
+            return std::make_unique<MemoryArchiveIndex<typename Codec::Record>>();
+        return std::make_unique<SqliteArchiveIndex<Codec>>();
+    }
+}
+
+#endif // BACKUPSUITE_ARCHIVE_INDEX_H
@@ -0,0 +1,80 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_BOUNDED_QUEUE_H
+#define BACKUPSUITE_BOUNDED_QUEUE_H
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace concurrency
+{
+    // 多生产者/多消费者的有界队列, 容量按每项的"代价"(如字节数)计算, 满时 push 阻塞(背压)
+    template<typename T>
+    class BoundedQueue
+    {
+        mutable std::mutex mutex_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+        std::deque<std::pair<T, size_t>> items_;
+        size_t capacity_;
+        size_t used_ = 0;
+        bool closed_ = false;
+    public:
+        explicit BoundedQueue(const size_t capacity) : capacity_(capacity ? capacity : 1) {}
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        // 队列为空时总是允许放入, 单项代价超过容量也不会死锁; 队列已关闭时返回 false
+        bool push(T item, const size_t cost = 1)
+        {
+            std::unique_lock lock(mutex_);
+            not_full_.wait(lock, [&] { return closed_ || items_.empty() || used_ + cost <= capacity_; });
+            if (closed_)
+                return false;
+            used_ += cost;
+            items_.emplace_back(std::move(item), cost);
+            not_empty_.notify_one();
+            return true;
+        }
+
+        // 阻塞直到取到一项; 队列关闭且为空时返回 std::nullopt
+        std::optional<T> pop()
+        {
+            std::unique_lock lock(mutex_);
+            not_empty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+            if (items_.empty())
+                return std::nullopt;
+            auto [item, cost] = std::move(items_.front());
+            items_.pop_front();
+            used_ -= cost;
+            not_full_.notify_all();
+            return std::optional<T>(std::move(item));
+        }
+
+        // 关闭后不再接受新项, 已有的项仍可取出
+        void close()
+        {
+            {
+                std::lock_guard lock(mutex_);
+                closed_ = true;
+            }
+            not_full_.notify_all();
+            not_empty_.notify_all();
+        }
+
+        [[nodiscard]] size_t size() const
+        {
+            std::lock_guard lock(mutex_);
+            return items_.size();
+        }
+    };
+}
+
+#endif // BACKUPSUITE_BOUNDED_QUEUE_H
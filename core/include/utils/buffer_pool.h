@@ -0,0 +1,154 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_BUFFER_POOL_H
+#define BACKUPSUITE_BUFFER_POOL_H
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "api.h"
+
+namespace buffer_pool
+{
+    // 默认 slab 大小与 Device::CACHE_SIZE 保持一致
+    constexpr size_t DEFAULT_SLAB_SIZE = 1024 * 1024;
+    // 默认内存上限,可通过 BufferPool::set_memory_limit 或 CLI --memory-limit 调整
+    constexpr size_t DEFAULT_MEMORY_LIMIT = 128 * 1024 * 1024;
+    constexpr size_t PAGE_ALIGNMENT = 4096;
+
+    class BufferPool;
+
+    // 从 BufferPool 借出的定长缓冲区, 析构时自动归还
+    class BACKUP_SUITE_API Slab
+    {
+        friend class BufferPool;
+        BufferPool* pool_ = nullptr;
+        std::byte* data_ = nullptr;
+        size_t size_ = 0;
+        Slab(BufferPool* pool, std::byte* data, const size_t size) : pool_(pool), data_(data), size_(size) {}
+    public:
+        Slab() = default;
+        ~Slab() { release(); }
+        Slab(Slab&& other) noexcept;
+        Slab& operator=(Slab&& other) noexcept;
+        Slab(const Slab&) = delete;
+        Slab& operator=(const Slab&) = delete;
+
+        [[nodiscard]] std::byte* data() const { return data_; }
+        [[nodiscard]] size_t size() const { return size_; }
+        [[nodiscard]] bool valid() const { return data_ != nullptr; }
+        explicit operator bool() const { return valid(); }
+        // 提前归还给 pool
+        void release();
+    };
+
+    class BACKUP_SUITE_API BufferPool
+    {
+        friend class Slab;
+        mutable std::mutex mutex_;
+        std::condition_variable released_;
+        std::vector<std::byte*> free_slabs_;
+        size_t slab_size_;
+        size_t memory_limit_;
+        bool page_aligned_;
+        // allocated_ = 借出中 + 空闲缓存的字节数, reserved_ 为 reserve() 占用的预算
+        size_t allocated_ = 0;
+        size_t in_use_ = 0;
+        size_t reserved_ = 0;
+
+        [[nodiscard]] std::byte* allocate_slab() const;
+        void free_slab(std::byte* data) const;
+        [[nodiscard]] bool has_budget_locked(size_t bytes) const;
+        [[nodiscard]] std::byte* take_locked();
+        void give_back(std::byte* data);
+    public:
+        explicit BufferPool(size_t slab_size = DEFAULT_SLAB_SIZE, size_t memory_limit = DEFAULT_MEMORY_LIMIT,
+                            bool page_aligned = true);
+        ~BufferPool();
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        // 进程级共享实例, 所有读取/变换/写出阶段从这里借 slab
+        static BufferPool& instance();
+
+        /**
+         * @brief 借出一个 slab, 预算耗尽时阻塞直到其他阶段归还(背压)
+         * @return 借出的 slab, 其大小为 slab_size()
+         */
+        [[nodiscard]] Slab acquire();
+        /**
+         * @brief 非阻塞借出, 预算耗尽时返回无效 slab
+         */
+        [[nodiscard]] Slab try_acquire();
+        /**
+         * @brief 限时借出, 超时返回无效 slab
+         */
+        [[nodiscard]] Slab acquire_for(std::chrono::milliseconds timeout);
+
+        /**
+         * @brief 为无法切分的整块分配(如整文件读取)占用预算, 阻塞直到预算足够
+         * @param bytes 需要的字节数
+         * @return bytes 超过内存上限时返回 false, 此时不占用预算
+         */
+        [[nodiscard]] bool reserve(size_t bytes);
+        /**
+         * @brief 非阻塞地占用至多 bytes 的预算, 并为之后的 acquire() 留出 headroom 字节
+         * 预算不足时只占用剩余的部分, 调用方据此缩小缓冲区
+         * @return 实际占用的字节数, 0 表示没有占用
+         */
+        [[nodiscard]] size_t try_reserve(size_t bytes, size_t headroom = 0);
+        void unreserve(size_t bytes);
+
+        // 调低上限时, 多出的空闲 slab 会立即释放, 借出的 slab 在归还时释放
+        void set_memory_limit(size_t bytes);
+        [[nodiscard]] size_t memory_limit() const;
+        [[nodiscard]] size_t slab_size() const { return slab_size_; }
+        [[nodiscard]] size_t in_use() const;
+        [[nodiscard]] size_t allocated() const;
+        // 释放所有空闲的缓存 slab
+        void trim();
+    };
+
+    // reserve()/unreserve() 的 RAII 包装
+    class BACKUP_SUITE_API Reservation
+    {
+        BufferPool* pool_ = nullptr;
+        size_t bytes_ = 0;
+    public:
+        Reservation(BufferPool& pool, const size_t bytes)
+        {
+            if (pool.reserve(bytes))
+            {
+                pool_ = &pool;
+                bytes_ = bytes;
+            }
+        }
+        // 非阻塞: 预算不足时占用的字节数可能小于 bytes, 见 BufferPool::try_reserve
+        Reservation(BufferPool& pool, const size_t bytes, std::try_to_lock_t, const size_t headroom = 0)
+        {
+            if (const auto granted = pool.try_reserve(bytes, headroom))
+            {
+                pool_ = &pool;
+                bytes_ = granted;
+            }
+        }
+        ~Reservation()
+        {
+            if (pool_)
+                pool_->unreserve(bytes_);
+        }
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+        [[nodiscard]] size_t size() const { return bytes_; }
+        [[nodiscard]] bool valid() const { return pool_ != nullptr; }
+        explicit operator bool() const { return valid(); }
+    };
+}
+
+#endif // BACKUPSUITE_BUFFER_POOL_H
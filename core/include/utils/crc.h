@@ -18,17 +18,26 @@ namespace crc
      * for Zip Encrypto
      */
     BACKUP_SUITE_API uint32_t crc32_update(uint32_t crc, uint8_t data);
+    /*
+     * 对未取反的中间值 crc 追加一段数据, 使用 slicing-by-8 或硬件 CRC 指令
+     */
+    BACKUP_SUITE_API uint32_t crc32_block(uint32_t crc, const std::byte* data, size_t length);
+    /*
+     * 由两段数据各自的 CRC32(已取反的最终值)和第二段的长度得到拼接后的 CRC32, 分段并行计算时使用
+     */
+    BACKUP_SUITE_API uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t length2);
     class BACKUP_SUITE_API CRC32
     {
         uint32_t crc32_ = 0xFFFFFFFF;
     public:
         CRC32() = default;
         void update(uint8_t data);
+        void update(const std::byte* data, size_t length);
         [[nodiscard]] uint32_t finalize() const;
         template<typename T>
-        std::enable_if_t<(std::is_integral_v<T> && sizeof(T)==1) || std::is_same_v<T, std::byte>> update(const T* data, const size_t length)
+        std::enable_if_t<std::is_integral_v<T> && sizeof(T)==1> update(const T* data, const size_t length)
         {
-            for (size_t i = 0; i < length; i++) update(static_cast<uint8_t>(data[i]));
+            update(reinterpret_cast<const std::byte*>(data), length);
         }
     };
 }
@@ -5,6 +5,7 @@
 #ifndef BACKUPSUITE_DATABASE_H
 #define BACKUPSUITE_DATABASE_H
 
+#include <cstdint>
 #include <memory>
 #include <sqlite3.h>
 #include <stdexcept>
@@ -12,6 +13,8 @@
 #include <vector>
 #include <type_traits>
 #include <filesystem>
+#include <unordered_map>
+#include <utility>
 
 #include "api.h"
 
@@ -147,11 +150,11 @@ namespace db
                     sqlite3_finalize(p);
             }
         };
-        using stmtPointer = std::unique_ptr<sqlite3_stmt, StatementDeleter>;
-
         std::unique_ptr<sqlite3, SqliteDeleter> db_handle_ = nullptr;
         std::string db_path_{};
+        bool temporary_ = true;
     public:
+        using stmtPointer = std::unique_ptr<sqlite3_stmt, StatementDeleter>;
         template<typename T>
         class ResultSetIterator
         {
@@ -232,7 +235,9 @@ namespace db
             // : Database("test.db", strategy)
             : Database(":memory:", strategy)
         { }
-        explicit Database(const std::string& db_path, const DatabaseInitializationStrategy *strategy = nullptr): db_path_(db_path!=":memory:" ? db_path : "")
+        // temporary 为 false 时数据库文件在析构后保留(如持久化的变更日志)
+        explicit Database(const std::string& db_path, const DatabaseInitializationStrategy *strategy = nullptr, const bool temporary = true)
+            : db_path_(db_path!=":memory:" ? db_path : ""), temporary_(temporary)
         {
             sqlite3 *conn;
             if (const int rc = sqlite3_open(db_path.c_str(), &conn); rc != SQLITE_OK)
@@ -251,7 +256,7 @@ namespace db
         virtual ~Database()
         {
             db_handle_.reset();
-            if (!db_path_.empty() && db_path_ != ":memory:")
+            if (temporary_ && !db_path_.empty() && db_path_ != ":memory:")
             {
                 if (std::filesystem::exists(db_path_))
                 {
@@ -263,8 +268,10 @@ namespace db
         }
         [[nodiscard]] bool is_open() const { return db_handle_ != nullptr; }
         [[nodiscard]] bool is_initialized() const;
-        [[nodiscard]] bool exec(const std::string& sql, bool commit = false) const;
-        [[nodiscard]] bool execute(const sqlite3_stmt& stmt, bool commit = false) const;
+        // 连接当前是否处于显式事务中
+        [[nodiscard]] bool in_transaction() const { return is_open() && !sqlite3_get_autocommit(db_handle_.get()); }
+        [[nodiscard]] bool exec(const std::string& sql) const;
+        [[nodiscard]] bool execute(const sqlite3_stmt& stmt) const;
         template<typename T>
         ResultSet<T> query(const std::string& sql) const
         {
@@ -320,5 +327,86 @@ namespace db
         }
     };
 
+    // RAII 事务: 析构时尚未提交则回滚; 连接已处于事务中时不再开启, 由外层事务负责提交
+    class BACKUP_SUITE_API Transaction
+    {
+        const Database& db_;
+        bool owned_ = false;
+    public:
+        explicit Transaction(const Database& db, const std::string& begin = "BEGIN;");
+        ~Transaction();
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+        // 是否处于事务中(自己开启的或外层的)
+        [[nodiscard]] bool active() const { return db_.in_transaction(); }
+        bool commit();
+        bool rollback();
+    };
+
+    /**
+     * @brief 批量写入: 一条预编译语句逐行复用(sqlite3_reset), 在事务中每 batch_rows 行提交一次
+     * 用法: 绑定 statement() 的参数后调用 insert(); 析构时提交剩余的行
+     */
+    class BACKUP_SUITE_API BulkInserter
+    {
+        const Database& db_;
+        Database::stmtPointer stmt_;
+        size_t batch_rows_;
+        size_t pending_ = 0;
+        std::unique_ptr<Transaction> transaction_;
+    public:
+        static constexpr size_t DEFAULT_BATCH_ROWS = 10000;
+
+        BulkInserter(const Database& db, const std::string& sql, size_t batch_rows = DEFAULT_BATCH_ROWS);
+        ~BulkInserter();
+        BulkInserter(const BulkInserter&) = delete;
+        BulkInserter& operator=(const BulkInserter&) = delete;
+
+        // 语句准备失败时为空
+        [[nodiscard]] sqlite3_stmt* statement() const { return stmt_.get(); }
+        // 执行已绑定参数的一行, 然后重置语句与参数
+        bool insert();
+        // 提交当前批次
+        bool flush();
+    };
+
+    /**
+     * @brief 归档内路径的目录树
+     * 目录按 (parent_id, name) 唯一编号, 成员表记录所在目录的编号和自己的名字,
+     * 列出某个目录的直接子节点只需一次索引查找; 根目录编号为 0, 不出现在表中
+     */
+    class BACKUP_SUITE_API PathCatalog
+    {
+        const Database& db_;
+        Database::stmtPointer insert_;
+        Database::stmtPointer select_;
+        // 写入时已知目录的编号, 避免每个成员都逐级查询
+        std::unordered_map<std::string, int64_t> ids_;
+    public:
+        static constexpr int64_t ROOT_ID = 0;
+        inline const static std::string TableSQL = (
+            "CREATE TABLE IF NOT EXISTS directory("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+            "parent_id INTEGER NOT NULL,"
+            "name TEXT NOT NULL,"
+            "UNIQUE(parent_id, name)"
+            ");"
+        );
+
+        explicit PathCatalog(const Database& db);
+        PathCatalog(const PathCatalog&) = delete;
+        PathCatalog& operator=(const PathCatalog&) = delete;
+
+        // 去掉开头的 "./" 和 '/' 以及末尾的 '/', 根目录为空串
+        [[nodiscard]] static std::string normalize(const std::string& path);
+        // 拆分为所在目录和名字, 如 "a/b/c.txt" -> ("a/b", "c.txt"), "a/b/" -> ("a", "b")
+        [[nodiscard]] static std::pair<std::string, std::string> split(const std::string& path);
+        // 返回目录编号, 不存在时逐级创建; 失败时返回 -1
+        [[nodiscard]] int64_t ensure_directory(const std::string& path);
+        // 逐级按索引查找目录编号, 不存在时返回 -1
+        [[nodiscard]] int64_t find_directory(const std::string& path) const;
+        // 清空目录表
+        void clear();
+    };
 }
 #endif // BACKUPSUITE_DATABASE_H
@@ -16,8 +16,8 @@ class BACKUP_SUITE_API TarInitializationStrategy final : public db::DatabaseInit
     public: using SQLEntity = std::tuple<
             std::string,    // path
             int,            // type
-            int,            // size
-            int,            // offset
+            long long,      // size
+            long long,      // offset
             long long,      // creation_time
             long long,      // modification_time
             long long,      // access_time
@@ -37,6 +37,17 @@ class BACKUP_SUITE_API TarInitializationStrategy final : public db::DatabaseInit
             "windows_attributes, symbolic_link_target, device_major, "
             "device_minor "
         );
+        inline const static std::string TableName = "entity";
+        inline const static std::string PathColumn = "path";
+        // 按路径查找与按目录列出直接子节点都走索引; 打开归档时先删除, 全部记录写入后再一次建好
+        inline const static std::string SQLIndexes = (
+            "CREATE INDEX IF NOT EXISTS entity_path ON entity(path);"
+            "CREATE INDEX IF NOT EXISTS entity_parent ON entity(parent_id, name);"
+        );
+        inline const static std::string SQLDropIndexes = (
+            "DROP INDEX IF EXISTS entity_path;"
+            "DROP INDEX IF EXISTS entity_parent;"
+        );
     protected:
         [[nodiscard]] std::string get_initialization_sql() const override
         {
@@ -75,9 +86,11 @@ class BACKUP_SUITE_API TarInitializationStrategy final : public db::DatabaseInit
                 "symbolic_link_target TEXT,"
                 "device_major INTEGER DEFAULT 0,"
                 "device_minor INTEGER DEFAULT 0,"
+                "parent_id INTEGER NOT NULL DEFAULT 0,"
+                "name TEXT NOT NULL DEFAULT '',"
                 "FOREIGN KEY(type) REFERENCES entity_type(id) ON DELETE CASCADE"
                 ");"
-            );
+            ) + SQLIndexes + PathCatalog::TableSQL;
         }
     };
 
@@ -91,12 +104,12 @@ class BACKUP_SUITE_API TarInitializationStrategy final : public db::DatabaseInit
             uint16_t,            // compression_method
             long long,           // last_modified
             uint32_t,            // crc32
-            uint32_t,            // compressed_size
-            uint32_t,            // uncompressed_size
+            uint64_t,            // compressed_size
+            uint64_t,            // uncompressed_size
             uint16_t,            // disk_number
             uint16_t,            // internal_attributes
             uint32_t,            // external_attributes
-            uint32_t,            // local_header_offset
+            uint64_t,            // local_header_offset
             std::string,         // filename
             std::vector<uint8_t>,// extra_field
             std::string          // file_comment
@@ -109,6 +122,18 @@ class BACKUP_SUITE_API TarInitializationStrategy final : public db::DatabaseInit
             "filename, extra_field, file_comment "
         );
 
+        inline const static std::string TableName = "zip_entity";
+        inline const static std::string PathColumn = "filename";
+        // 打开已有归档时先删除索引, 全部记录写入后再一次建好, 比逐行维护索引快
+        inline const static std::string SQLIndexes = (
+            "CREATE INDEX IF NOT EXISTS zip_entity_filename ON zip_entity(filename);"
+            "CREATE INDEX IF NOT EXISTS zip_entity_parent ON zip_entity(parent_id, name);"
+        );
+        inline const static std::string SQLDropIndexes = (
+            "DROP INDEX IF EXISTS zip_entity_filename;"
+            "DROP INDEX IF EXISTS zip_entity_parent;"
+        );
+
         [[nodiscard]] std::string get_initialization_sql() const override {
             return (
                 "CREATE TABLE IF NOT EXISTS zip_entity("
@@ -128,8 +153,43 @@ class BACKUP_SUITE_API TarInitializationStrategy final : public db::DatabaseInit
 
                 "filename TEXT NOT NULL DEFAULT '',"
                 "extra_field BLOB,"
-                "file_comment TEXT DEFAULT ''"
+                "file_comment TEXT DEFAULT '',"
+                "parent_id INTEGER NOT NULL DEFAULT 0,"
+                "name TEXT NOT NULL DEFAULT ''"
+                ");"
+
+            ) + SQLIndexes + PathCatalog::TableSQL;
+        }
+    };
+
+    // 变更日志数据库初始化策略
+    // journal_path: 变化的路径及记录时的序号, recursive 表示需要扫描整个子树(如新建的目录)
+    // journal_state: seq 为最新序号, full_scan_seq 非 0 表示该序号前发生过事件丢失, 需要全量扫描
+    class BACKUP_SUITE_API JournalInitializationStrategy final : public DatabaseInitializationStrategy
+    {
+    public:
+        using SQLEntity = std::tuple<
+            std::string,    // path
+            long long,      // seq
+            int             // recursive
+        >;
+    protected:
+        [[nodiscard]] std::string get_initialization_sql() const override
+        {
+            return (
+                "CREATE TABLE IF NOT EXISTS journal_path("
+                "path TEXT PRIMARY KEY,"
+                "seq INTEGER NOT NULL,"
+                "recursive INTEGER NOT NULL DEFAULT 0"
                 ");"
+
+                "CREATE TABLE IF NOT EXISTS journal_state("
+                "key TEXT PRIMARY KEY,"
+                "value INTEGER NOT NULL"
+                ");"
+
+                // 新建的日志没有基线, 第一次备份必须全量扫描
+                "INSERT OR IGNORE INTO journal_state (key, value) VALUES ('seq', 1), ('full_scan_seq', 1);"
             );
         }
     };
@@ -0,0 +1,38 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_READ_ORDER_H
+#define BACKUPSUITE_READ_ORDER_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "api.h"
+
+namespace read_order
+{
+    // 文件在物理介质上的位置, 0 表示未知
+    struct Location
+    {
+        uint64_t extent = 0; // 首个物理区段(Linux FIEMAP / Windows 首个 LCN)
+        uint64_t inode = 0;  // inode 号 / NTFS 文件索引
+    };
+
+    /**
+     * @brief 查询文件的物理位置
+     * Linux 上使用 FIEMAP 与 inode 号, Windows 上使用 FSCTL_GET_RETRIEVAL_POINTERS 与文件索引, 其他平台返回空位置
+     */
+    BACKUP_SUITE_API Location physical_location(const std::filesystem::path& path);
+
+    /**
+     * @brief 计算一批文件的读取顺序(下标的排列)
+     * 全部文件都有区段位置时按区段排序, 否则全部有 inode 时按 inode 排序, 否则保持原顺序; 排序是稳定的
+     */
+    BACKUP_SUITE_API std::vector<size_t> schedule(const std::vector<Location>& locations);
+}
+
+#endif // BACKUPSUITE_READ_ORDER_H
@@ -5,11 +5,16 @@
 #ifndef BACKUPSUITE_BSTREAM_H
 #define BACKUPSUITE_BSTREAM_H
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <utility>
+#include <vector>
 #include <filesystem/entities.h>
 
 #include "api.h"
+#include "utils/trace.h"
 
 class BACKUP_SUITE_API ibstream
 {
@@ -136,22 +141,58 @@ public:
     }
 };
 
+/**
+ * @brief 按位置读取的数据源: 没有共享的读取位置, 同一个源可以同时被多个流使用
+ */
+class BACKUP_SUITE_API PositionalSource
+{
+public:
+    virtual ~PositionalSource() = default;
+    // 从 offset 开始读取至多 size 字节, 返回实际读取的字节数, 0 表示到达末尾或失败
+    virtual size_t read_at(uint64_t offset, char* buffer, size_t size) = 0;
+};
+
+// 以 pread(Windows 上为带偏移的 ReadFile)读取文件, 文件描述符由所有读取共享
+class BACKUP_SUITE_API FileSource final : public PositionalSource
+{
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+public:
+    explicit FileSource(const std::filesystem::path& path);
+    ~FileSource() override;
+    FileSource(const FileSource&) = delete;
+    FileSource& operator=(const FileSource&) = delete;
+    [[nodiscard]] bool is_open() const;
+    size_t read_at(uint64_t offset, char* buffer, size_t size) override;
+};
+
 class BACKUP_SUITE_API IstreamBuf: public std::streambuf
 {
-    std::ifstream &file_;
-    int offset_;
+    std::shared_ptr<PositionalSource> source_;
+    uint64_t offset_;
     size_t size_;
-    static constexpr size_t buffer_size_ = 8192;
-    char buffer_[buffer_size_] = {};
+    size_t max_buffer_;
+    std::vector<char> buffer_;
 public:
-    explicit IstreamBuf(std::ifstream &ifs, int offset, size_t size):
-        file_(ifs), offset_(offset), size_(size)
+    static constexpr size_t MIN_BUFFER_SIZE = 8192;
+    static constexpr size_t DEFAULT_MAX_BUFFER_SIZE = 1024 * 1024;
+    /**
+     * @param source 数据源, 可以与其他流共享
+     * @param offset 数据在源中的起点
+     * @param size 数据长度
+     * @param max_buffer 缓冲区上限: 从 MIN_BUFFER_SIZE 开始, 每次补充时翻倍
+     */
+    IstreamBuf(std::shared_ptr<PositionalSource> source, const uint64_t offset, const size_t size,
+               const size_t max_buffer = DEFAULT_MAX_BUFFER_SIZE):
+        source_(std::move(source)), offset_(offset), size_(size), max_buffer_(std::max(max_buffer, MIN_BUFFER_SIZE))
     {
         setg(nullptr, nullptr, nullptr);
-        if (offset < 0 || size == 0 || !ifs.is_open() || ifs.eof())
+        if (!source_ || size == 0)
         {
             offset_ = size_ = 0;
-            return;
         }
     }
     ~IstreamBuf() override = default;
@@ -162,17 +203,36 @@ public:
         {
             return traits_type::to_int_type(*gptr());
         }
-        file_.seekg(offset_, std::ios::beg);
-        const size_t to_read = std::min(buffer_size_, size_);
-        file_.read(buffer_, to_read);
-        offset_ += to_read;
-        size_ -= to_read;
-        process_buffer(buffer_, to_read);
-        if (to_read == 0 || file_.fail() || file_.bad() || file_.gcount() != static_cast<std::streamsize>(to_read))
+        if (size_ == 0)
+        {
+            return traits_type::eof();
+        }
+        TRACE_SPAN(Device, "stream.underflow");
+        // 流只能顺序读取, 每次补充时缓冲区翻倍直到上限, 但不超过剩余的长度
+        const size_t target = buffer_.empty() ? MIN_BUFFER_SIZE : std::min(buffer_.size() * 2, max_buffer_);
+        if (buffer_.size() < target)
+        {
+            buffer_.resize(std::min(target, size_));
+        }
+        const size_t to_read = std::min(buffer_.size(), size_);
+        size_t done = 0;
+        while (done < to_read)
+        {
+            const auto n = source_->read_at(offset_ + done, buffer_.data() + done, to_read - done);
+            if (n == 0)
+                break;
+            done += n;
+        }
+        offset_ += done;
+        size_ -= done;
+        process_buffer(buffer_.data(), done);
+        if (done != to_read)
         {
+            // 数据被截断, 与读取失败一样结束
+            size_ = 0;
             return traits_type::eof();
         }
-        setg(buffer_, buffer_, buffer_ + to_read);
+        setg(buffer_.data(), buffer_.data(), buffer_.data() + done);
         return traits_type::to_int_type(*gptr());
     }
 };
@@ -181,8 +241,9 @@ class BACKUP_SUITE_API FileEntityIstream: public std::istream
     FileEntityMeta meta_;
     std::unique_ptr<IstreamBuf> buffer_;
 public:
-    FileEntityIstream(std::ifstream &ifs, const int offset, const FileEntityMeta &meta):
-        FileEntityIstream(std::make_unique<IstreamBuf>(ifs, offset, meta.size), meta)
+    FileEntityIstream(std::shared_ptr<PositionalSource> source, const uint64_t offset, const FileEntityMeta &meta,
+                      const size_t max_buffer = IstreamBuf::DEFAULT_MAX_BUFFER_SIZE):
+        FileEntityIstream(std::make_unique<IstreamBuf>(std::move(source), offset, meta.size, max_buffer), meta)
     { }
     FileEntityIstream(std::unique_ptr<IstreamBuf> &&ifs, FileEntityMeta meta) : std::istream(nullptr), meta_(std::move(meta)), buffer_(std::move(ifs))
     {
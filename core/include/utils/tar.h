@@ -10,13 +10,16 @@
 #include <fstream>
 #include <utility>
 #include <map>
+#include <tuple>
 #include <algorithm>
 // ReSharper disable once CppUnusedIncludeDirective
 #include <cstring>
 
 #include "api.h"
+#include "compress/frames.h"
 #include "filesystem/entities.h"
 #include "database.h"
+#include "utils/archive_index.h"
 #include "utils/fs_deleter.h"
 #include "utils/streams.h"
 #include "utils/database_strategies.h"
@@ -76,6 +79,17 @@ namespace tar
         char block[512];
     };
 
+    // 索引中的成员记录(元数据, 头部偏移), 以及 SQLite 后端的行格式
+    struct BACKUP_SUITE_API TarIndexCodec
+    {
+        using Strategy = TarInitializationStrategy;
+        using Row = TarInitializationStrategy::SQLEntity;
+        using Record = std::pair<FileEntityMeta, uint64_t>;
+        static constexpr int Columns = std::tuple_size_v<Row>;
+        static void bind(sqlite3_stmt* stmt, const Record& record);
+        static Record decode(const Row& row);
+    };
+
     class BACKUP_SUITE_API TarFile
     {
     public:
@@ -84,37 +98,61 @@ namespace tar
 
         static constexpr int TarBlockSize = sizeof(TarBlock);   // 512 bytes
     private:
-        db::Database db_;
+        // 路径 -> 成员记录
+        std::unique_ptr<db::ArchiveIndex<TarIndexCodec::Record>> index_;
         IFStreamPointer ifs_;
         OFStreamPointer ofs_;
         bool is_valid_ = true;
+        bool embed_index_ = true;
+        bool has_index_ = false;        // 打开时是否加载了内嵌索引
+        uint64_t data_end_ = 0;         // 最后一个成员的结束位置, 即结束标记的起点
+        std::filesystem::path append_path_; // 追加模式下的归档路径, 关闭时据此截掉旧结束标记和索引的残留
+        // 分帧压缩时替换文件流的缓冲区, 上层看到的始终是未压缩的 tar 流与偏移
+        std::unique_ptr<compress::frames::FrameWriterBuf> frame_writer_;
+        std::unique_ptr<compress::frames::FrameReaderBuf> frame_reader_;
+        // 成员流通过它按位置读取, 互不影响, 也不使用 ifs_ 的读取位置
+        std::shared_ptr<PositionalSource> source_;
+        size_t read_buffer_limit_ = IstreamBuf::DEFAULT_MAX_BUFFER_SIZE;
         TarStandard standard_ = TarStandard::UNKNOWN;
     protected:
         static FileEntityMeta tar_header2file_meta(const TarFileHeader &header, TarStandard standard = TarStandard::GNU);
         static TarFileHeader file_meta2tar_header(const FileEntityMeta &meta, TarStandard standard = TarStandard::GNU);
-        static std::pair<FileEntityMeta, int> sql_entity2file_meta(const TarInitializationStrategy::SQLEntity& entity);
-        [[nodiscard]] bool insert_entity(const FileEntityMeta& meta, int offset) const;
+        [[nodiscard]] bool insert_entity(const FileEntityMeta& meta, uint64_t offset) const;
+        [[nodiscard]] bool insert_entities(const std::vector<std::pair<FileEntityMeta, uint64_t>>& entities) const;
+        // 生成一个条目的全部头部块(PAX/GNU 扩展头 + tar 头), 最后 512 字节总是 tar 头; 长路径的占位名只出现在 tar 头中
+        [[nodiscard]] std::string make_entry_headers(const FileEntityMeta& meta);
         void init_db_from_tar();
+        // 在结束标记之后写入按路径排序的索引和末尾的定位块; 其他 tar 工具读到结束标记即停止, 不会看到它们
+        void write_index();
+        // 通过末尾的定位块加载内嵌索引, 打开的代价只与索引大小有关; 没有索引或校验失败时返回 false
+        [[nodiscard]] bool load_index();
+        // 建立索引后改为从结束标记处继续写入
+        void open_for_append(const std::filesystem::path& path);
+        void open_source(const std::filesystem::path& path);
     public:
         enum TarMode
         {
             input,
-            output
+            output,
+            append  // 在已有归档的末尾继续写入, 归档不存在时等同于 output
         };
         explicit TarFile(const std::filesystem::path& path, const FStreamDeleter<std::ifstream>& ifsDeleter = FStreamDeleter<std::ifstream>(),
                        const FStreamDeleter<std::ofstream>& ofsDeleter = FStreamDeleter<std::ofstream>())
+          : index_(db::make_archive_index<TarIndexCodec>(db::IndexBackend::Sqlite))
         {
             if (std::filesystem::exists(path))
             {
-                TarFile(path, TarMode::input, ifsDeleter, ofsDeleter);
+                TarFile(path, TarMode::input, db::IndexBackend::Sqlite, ifsDeleter, ofsDeleter);
             } else
             {
-                TarFile(path, TarMode::output, ifsDeleter, ofsDeleter);
+                TarFile(path, TarMode::output, db::IndexBackend::Sqlite, ifsDeleter, ofsDeleter);
             }
         }
-        TarFile(const std::filesystem::path& path, const TarMode mode, const FStreamDeleter<std::ifstream>& ifsDeleter = FStreamDeleter<std::ifstream>(),
+        // backend 选择索引的存储方式, 打开时即建立索引
+        TarFile(const std::filesystem::path& path, const TarMode mode, const db::IndexBackend backend = db::IndexBackend::Sqlite,
+                const FStreamDeleter<std::ifstream>& ifsDeleter = FStreamDeleter<std::ifstream>(),
                        const FStreamDeleter<std::ofstream>& ofsDeleter = FStreamDeleter<std::ofstream>()) :
-          db_(std::move(std::make_unique<TarInitializationStrategy>()).get()), ifs_(nullptr, ifsDeleter), ofs_(nullptr, ofsDeleter)
+          index_(db::make_archive_index<TarIndexCodec>(backend)), ifs_(nullptr, ifsDeleter), ofs_(nullptr, ofsDeleter)
         {
             if (mode == TarMode::input)
             {
@@ -124,7 +162,14 @@ namespace tar
                     is_valid_ = false;
                     return;
                 }
+                index_->begin_load();
                 init_db_from_tar();
+                if (!index_->end_load())
+                    is_valid_ = false;
+                open_source(path);
+            } else if (mode == TarMode::append && std::filesystem::exists(path))
+            {
+                open_for_append(path);
             } else
             {
                 ofs_ = OFStreamPointer(new std::ofstream(path, std::ios::binary | std::ios::trunc), FStreamDeleter<std::ofstream>());
@@ -136,11 +181,27 @@ namespace tar
         // Ensure output tar is properly finalized when TarFile is destroyed
         ~TarFile();
         [[nodiscard]] std::unique_ptr<TarIstream> get_file_stream(const std::filesystem::path& path) const;
-        [[nodiscard]] std::vector<std::pair<FileEntityMeta, int>> list_dir(const std::filesystem::path& path) const;
+        // 列出目录下的整棵子树, 按路径排序
+        [[nodiscard]] std::vector<std::pair<FileEntityMeta, uint64_t>> list_dir(const std::filesystem::path& path) const;
+        // 只列出目录的直接子节点, 按名字排序; 同名成员追加过多次时取最后一个
+        [[nodiscard]] std::vector<std::pair<FileEntityMeta, uint64_t>> list_children(const std::filesystem::path& path) const;
         void set_standard(const TarStandard standard){standard_ = standard;}
+        // 关闭时是否写入内嵌索引, 默认写入
+        void set_embed_index(const bool embed) { embed_index_ = embed; }
         [[nodiscard]] TarStandard get_standard() const { return standard_; }
+        /**
+         * @brief 以分帧压缩(多成员 gzip + 帧表)写出归档, 读取单个文件时只解压它所在的帧
+         * 只能在 output 模式下写入第一个成员之前调用; 读取时自动识别, 不需要设置
+         */
+        bool set_frame_compression(size_t frame_size = compress::frames::DEFAULT_FRAME_SIZE,
+                                   int level = compress::deflate::DEFAULT_LEVEL);
+        [[nodiscard]] bool frame_compressed() const { return frame_writer_ || frame_reader_; }
+        // 成员流的读取缓冲区上限, 只影响之后打开的流
+        void set_read_buffer_limit(const size_t limit) { read_buffer_limit_ = limit; }
 
         bool add_entity(ReadableFile& file);
+        // 批量写入(适合小文件): 整批只做一次写出和一次索引事务
+        bool add_entities(const std::vector<ReadableFile*>& files);
         // 关闭文件流,在output模式中表示将数据写入文件中,在input模式中表示单纯的关闭文件流,应当在~TarFile()中自动调用
         void close();
         [[nodiscard]] bool is_open() const { return is_valid_; }
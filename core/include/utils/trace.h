@@ -0,0 +1,96 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_TRACE_H
+#define BACKUPSUITE_TRACE_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#include "api.h"
+
+// 由 CMake 选项 BACKUPSUITE_ENABLE_TRACE 控制,关闭时所有埋点宏展开为空语句
+#ifndef BACKUPSUITE_ENABLE_TRACE
+#define BACKUPSUITE_ENABLE_TRACE 0
+#endif
+
+namespace trace
+{
+    enum class Category : uint8_t
+    {
+        Device,
+        Controller,
+        Tar,
+        Zip,
+        Database,
+        Crypto,
+        Checksum,
+        Compress,
+    };
+
+    // 一条完整的 span 记录, name 必须是静态生命周期的字符串(字面量)
+    struct SpanRecord
+    {
+        const char* name = nullptr;
+        uint64_t begin_ns = 0;
+        uint64_t end_ns = 0;
+        Category category = Category::Device;
+    };
+
+    // 每个线程的环形缓冲区容量,写满后覆盖最旧的记录
+    constexpr size_t RING_BUFFER_CAPACITY = 1 << 16;
+
+    BACKUP_SUITE_API const char* category_name(Category category);
+    // 库本身是否以 BACKUPSUITE_ENABLE_TRACE=1 编译
+    BACKUP_SUITE_API bool is_compiled_in();
+    // 运行期开关,默认关闭;关闭时 span 只做一次原子读
+    BACKUP_SUITE_API void set_enabled(bool enabled);
+    BACKUP_SUITE_API bool is_enabled();
+    // 相对进程内首次调用的单调时钟,单位纳秒
+    BACKUP_SUITE_API uint64_t now_ns();
+    BACKUP_SUITE_API void record(Category category, const char* name, uint64_t begin_ns, uint64_t end_ns);
+    // 清空所有线程的缓冲区(线程需处于静止状态)
+    BACKUP_SUITE_API void clear();
+    [[nodiscard]] BACKUP_SUITE_API size_t span_count();
+    /**
+     * @brief 将所有线程缓冲区中的 span 以 Chrome trace JSON 格式写出,可直接在 Perfetto / chrome://tracing 中打开
+     * @param path 输出文件路径
+     * @return 是否写出成功
+     */
+    BACKUP_SUITE_API bool dump_chrome_trace(const std::filesystem::path& path);
+
+    class BACKUP_SUITE_API Span
+    {
+        const char* name_;
+        uint64_t begin_ns_ = 0;
+        Category category_;
+        bool active_;
+    public:
+        Span(const Category category, const char* name) : name_(name), category_(category), active_(is_enabled())
+        {
+            if (active_)
+                begin_ns_ = now_ns();
+        }
+        ~Span()
+        {
+            if (active_)
+                record(category_, name_, begin_ns_, now_ns());
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
+}
+
+#if BACKUPSUITE_ENABLE_TRACE
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// 在当前作用域内记录一个 span, 例如 TRACE_SPAN(Tar, "tar.add_entity");
+#define TRACE_SPAN(category, name) const ::trace::Span TRACE_CONCAT(trace_span_, __LINE__)(::trace::Category::category, name)
+#else
+#define TRACE_SPAN(category, name) ((void)0)
+#endif
+
+#endif // BACKUPSUITE_TRACE_H
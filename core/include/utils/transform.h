@@ -0,0 +1,154 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#ifndef BACKUPSUITE_TRANSFORM_H
+#define BACKUPSUITE_TRANSFORM_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "api.h"
+#include "compress/deflate.h"
+#include "filesystem/entities.h"
+#include "utils/crc.h"
+
+/**
+ * @brief 归档写出时的数据变换流水线
+ * 每一级消费一段字节并把结果交给下一级, 例如 CRC32 -> Deflate -> 加密 -> 输出;
+ * 数据按 buffer pool 的 slab 大小成块流动, 新的编码或加密方式只需要实现一个 Stage
+ */
+namespace transform
+{
+    class BACKUP_SUITE_API Stage
+    {
+    public:
+        virtual ~Stage() = default;
+        // 处理一段输入, 任何一级失败时返回 false
+        virtual bool write(const std::byte* data, size_t size) = 0;
+        // 输入结束: 写出缓存的数据, 再结束下一级
+        virtual bool finish() { return forward_finish(); }
+        void set_next(Stage* next) { next_ = next; }
+
+    protected:
+        bool forward(const std::byte* data, const size_t size) { return !next_ || size == 0 || next_->write(data, size); }
+        bool forward_finish() { return !next_ || next_->finish(); }
+
+    private:
+        Stage* next_ = nullptr;
+    };
+
+    // 计算经过的数据的 CRC32, 数据原样传给下一级
+    class BACKUP_SUITE_API Crc32Stage final : public Stage
+    {
+    public:
+        bool write(const std::byte* data, size_t size) override;
+        [[nodiscard]] uint32_t value() const { return crc_.finalize(); }
+
+    private:
+        crc::CRC32 crc_;
+    };
+
+    /**
+     * @brief Deflate 压缩
+     * final 为 false 时结束时只做同步刷新, 输出可以与后面独立压缩的数据拼接成一个流
+     */
+    class BACKUP_SUITE_API DeflateStage final : public Stage
+    {
+    public:
+        explicit DeflateStage(int level = compress::deflate::DEFAULT_LEVEL, bool final = true);
+        bool write(const std::byte* data, size_t size) override;
+        bool finish() override;
+        // 用于在第一次写入前设置字典
+        compress::deflate::Deflater& deflater() { return deflater_; }
+
+    private:
+        compress::deflate::Deflater deflater_;
+        bool final_;
+        std::vector<std::byte> out_;
+    };
+
+    // 流加密: 输入复制到内部缓冲区后由 cipher 就地加密
+    class BACKUP_SUITE_API CipherStage final : public Stage
+    {
+    public:
+        using Cipher = std::function<void(std::byte* data, size_t size)>;
+        explicit CipherStage(Cipher cipher) : cipher_(std::move(cipher)) {}
+        bool write(const std::byte* data, size_t size) override;
+
+    private:
+        Cipher cipher_;
+        std::vector<std::byte> buffer_;
+    };
+
+    // 写入输出流, 记录写出的字节数
+    class BACKUP_SUITE_API OstreamSink final : public Stage
+    {
+    public:
+        explicit OstreamSink(std::ostream& os) : os_(os) {}
+        bool write(const std::byte* data, size_t size) override;
+        bool finish() override;
+        [[nodiscard]] uint64_t bytes() const { return bytes_; }
+
+    private:
+        std::ostream& os_;
+        uint64_t bytes_ = 0;
+    };
+
+    // 追加到内存缓冲区
+    class BACKUP_SUITE_API VectorSink final : public Stage
+    {
+    public:
+        explicit VectorSink(std::vector<std::byte>& out) : out_(out) {}
+        bool write(const std::byte* data, size_t size) override;
+
+    private:
+        std::vector<std::byte>& out_;
+    };
+
+    /**
+     * @brief 按顺序连接的各级, 数据从第一级写入
+     */
+    class BACKUP_SUITE_API Pipeline
+    {
+    public:
+        Pipeline() = default;
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        // 在末尾追加一级, 返回它的引用以便读取结果(如 CRC、写出字节数)
+        template<typename S, typename... Args>
+        S& emplace(Args&&... args)
+        {
+            auto stage = std::make_unique<S>(std::forward<Args>(args)...);
+            S& ref = *stage;
+            if (!stages_.empty())
+                stages_.back()->set_next(&ref);
+            stages_.push_back(std::move(stage));
+            return ref;
+        }
+        bool write(const std::byte* data, size_t size);
+        bool finish();
+        // 写入第一级的字节数
+        [[nodiscard]] uint64_t bytes_in() const { return bytes_in_; }
+
+    private:
+        std::vector<std::unique_ptr<Stage>> stages_;
+        uint64_t bytes_in_ = 0;
+    };
+
+    /**
+     * @brief 用 buffer pool 的 slab 读取文件, 把最多 limit 字节送入流水线, 不调用 finish
+     * @return 流水线中任何一级失败时返回 false; 读到的字节数见 bytes_in
+     */
+    BACKUP_SUITE_API bool pump(ReadableFile& file, Pipeline& pipeline, uint64_t limit = std::numeric_limits<uint64_t>::max());
+}
+
+#endif // BACKUPSUITE_TRANSFORM_H
@@ -5,19 +5,32 @@
 #ifndef BACKUPSUITE_ZIP_H
 #define BACKUPSUITE_ZIP_H
 
+#include <atomic>
 #include <cstdint>
 #include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include "api.h"
+#include "compress/deflate.h"
 #include "encryption/rc.h"
+#include "encryption/winzip_aes.h"
 #include "encryption/zip_crypto.h"
 #include "filesystem/entities.h"
+#include "utils/archive_index.h"
+#include "utils/bounded_queue.h"
+#include "utils/buffer_pool.h"
 #include "utils/database.h"
 #include "utils/database_strategies.h"
 #include "utils/fs_deleter.h"
 #include "utils/streams.h"
+#include "utils/trace.h"
 
 #ifdef _MSC_VER
 #pragma warning(disable : 4200) // 禁用 MSVC 零数组警告
@@ -49,6 +62,7 @@ namespace zip
             Zip64EndOfCentralDirectoryLocator = 0x07064b50,
             Zip64EndOfCentralDirectoryRecord = 0x06064b50,
             FileDescriptor = 0x02014b50,
+            DataDescriptor = 0x08074b50,
         };
         enum class ZipVersionMadeBy : uint8_t
         {
@@ -221,7 +235,8 @@ namespace zip
         {
             ZipFileHeaderSignature signature = ZipFileHeaderSignature::Zip64EndOfCentralDirectoryRecord;
             // 0x06064b50
-            uint64_t size_of_zip64_end_of_central_directory_record{}; // zip64
+            uint64_t size_of_zip64_end_of_central_directory_record{}; // 本记录去掉前 12 字节后的大小
+            uint8_t generator_version{};
             ZipVersionMadeBy version_made_by{};
             ZipVersionNeeded version_needed{};
             uint32_t disk_number{};
@@ -232,14 +247,26 @@ namespace zip
             uint64_t central_directory_offset{};
             // 后面跟着可选的扩展数据
         };
+        struct BACKUP_SUITE_API Zip64EndOfCentralDirectoryLocator
+        {
+            ZipFileHeaderSignature signature = ZipFileHeaderSignature::Zip64EndOfCentralDirectoryLocator;
+            // 0x07064b50, 紧挨在 EOCD 之前
+            uint32_t zip64_end_of_central_directory_disk{};
+            uint64_t zip64_end_of_central_directory_offset{};
+            uint32_t total_disks{};
+        };
+        // 通用位标志第 3 位置位时跟在条目数据之后, 签名可选, 这里总是写出
         struct BACKUP_SUITE_API ZipDataDescriptor
         {
+            ZipFileHeaderSignature signature = ZipFileHeaderSignature::DataDescriptor;
             uint32_t crc32; // CRC-32 校验码
             uint32_t compressed_size; // 压缩后的大小
             uint32_t uncompressed_size; // 未压缩的大小
         };
+        // 本地文件头带 Zip64 扩展字段时, 数据描述符中的大小为 8 字节
         struct BACKUP_SUITE_API Zip64DataDescriptor
         {
+            ZipFileHeaderSignature signature = ZipFileHeaderSignature::DataDescriptor;
             uint32_t crc32; // CRC-32 校验码
             uint64_t compressed_size; // 压缩后的大小
             uint64_t uncompressed_size; // 未压缩的大小
@@ -251,6 +278,17 @@ namespace zip
             // ZERO_ARRAY(uint8_t, data); // 数据，长度为 data_size
         };
 #pragma pack(pop)
+        static_assert(sizeof(Zip64EndOfCentralDirectory) == 56, "unexpected zip64 EOCD size");
+        static_assert(sizeof(Zip64EndOfCentralDirectoryLocator) == 20, "unexpected zip64 locator size");
+        static_assert(sizeof(ZipDataDescriptor) == 16, "unexpected data descriptor size");
+        static_assert(sizeof(Zip64DataDescriptor) == 24, "unexpected zip64 data descriptor size");
+
+        // 32/16 位字段写成全 1 时, 真实值放在 Zip64 扩展字段或 Zip64 EOCD 中
+        constexpr uint32_t ZIP64_MARK_32 = 0xFFFFFFFF;
+        constexpr uint16_t ZIP64_MARK_16 = 0xFFFF;
+        constexpr uint16_t ZIP64_EXTRA_FIELD_ID = 0x0001;
+        // WinZip AES 扩展字段, 条目的压缩方法写成 AES_Encryption, 真实的压缩方法记在这里
+        constexpr uint16_t AES_EXTRA_FIELD_ID = 0x9901;
     } // namespace header
 
 #ifdef _WIN32
@@ -275,10 +313,13 @@ namespace zip
         {
             T encryptor_{};
         public:
-            StreamEncryptorIstreamBuf(std::ifstream& ifs, T encryptor, int offset, size_t size) : IstreamBuf(ifs, offset, size), encryptor_(encryptor)
+            StreamEncryptorIstreamBuf(std::shared_ptr<PositionalSource> source, T encryptor, uint64_t offset, size_t size,
+                                      size_t max_buffer = DEFAULT_MAX_BUFFER_SIZE)
+                : IstreamBuf(std::move(source), offset, size, max_buffer), encryptor_(encryptor)
             { }
             void process_buffer(char* buffer, size_t size) override
             {
+                TRACE_SPAN(Crypto, "zip.decrypt_buffer");
                 for (size_t i = 0; i < size; i++)
                 {
                     buffer[i] = encryptor_.decrypt(buffer[i]);
@@ -304,34 +345,117 @@ namespace zip
         };
         using ZipCryptoIstreamBuf = StreamEncryptorIstreamBuf<encryption::ZipCrypto>;
         using RC4IstreamBuf = StreamEncryptorIstreamBuf<encryption::RC4>;
+        // WinZip AES 条目: 解密的同时计算认证码, 数据读完后与条目末尾的认证码核对
+        class AesIstreamBuf : public ZipIstreamBuf
+        {
+            encryption::WinZipAes decryptor_;
+            std::shared_ptr<PositionalSource> source_;
+            uint64_t auth_offset_;
+            size_t remaining_;
+            bool verified_ = false;
+        public:
+            AesIstreamBuf(std::shared_ptr<PositionalSource> source, encryption::WinZipAes decryptor, const uint64_t offset, const size_t size,
+                          const size_t max_buffer = DEFAULT_MAX_BUFFER_SIZE)
+                : IstreamBuf(source, offset, size, max_buffer), decryptor_(std::move(decryptor)), source_(std::move(source)),
+                  auth_offset_(offset + size), remaining_(size)
+            { }
+            void process_buffer(char* buffer, const size_t size) override
+            {
+                TRACE_SPAN(Crypto, "zip.aes_decrypt_buffer");
+                decryptor_.decrypt(reinterpret_cast<uint8_t*>(buffer), size);
+                remaining_ -= std::min(remaining_, size);
+            }
+            int_type underflow() override
+            {
+                const bool refill = gptr() >= egptr();
+                const auto result = IstreamBuf::underflow();
+                if (result == traits_type::eof() || !refill || remaining_ > 0 || verified_)
+                {
+                    return result;
+                }
+                // 最后一段数据在认证码核对通过后才交出, 不通过时流提前结束
+                verified_ = true;
+                const auto expected = decryptor_.auth_code();
+                uint8_t code[encryption::WinZipAes::AUTH_CODE_SIZE];
+                if (source_->read_at(auth_offset_, reinterpret_cast<char*>(code), sizeof(code)) != sizeof(code) ||
+                    !std::equal(expected.begin(), expected.end(), code))
+                {
+                    setg(nullptr, nullptr, nullptr);
+                    return traits_type::eof();
+                }
+                return result;
+            }
+        };
+        // 解压 Deflate 条目: 从 source(原始或已解密的压缩数据)拉取, 输出解压后的数据
+        class InflateIstreamBuf : public ZipIstreamBuf
+        {
+            std::unique_ptr<ZipIstreamBuf> source_;
+            compress::deflate::Inflater inflater_;
+            static constexpr size_t buffer_size_ = 64 * 1024;
+            std::vector<char> buffer_;
+        public:
+            explicit InflateIstreamBuf(std::unique_ptr<ZipIstreamBuf> source)
+                : IstreamBuf(nullptr, 0, 0), source_(std::move(source)),
+                  inflater_([this](std::byte* data, const size_t size)
+                  {
+                      return static_cast<size_t>(source_->sgetn(reinterpret_cast<char*>(data), static_cast<std::streamsize>(size)));
+                  }),
+                  buffer_(buffer_size_)
+            { }
+            int_type underflow() override
+            {
+                if (gptr() < egptr())
+                {
+                    return traits_type::to_int_type(*gptr());
+                }
+                TRACE_SPAN(Compress, "zip.inflate_buffer");
+                const auto n = inflater_.read(reinterpret_cast<std::byte*>(buffer_.data()), buffer_.size());
+                if (n == 0)
+                {
+                    return traits_type::eof();
+                }
+                setg(buffer_.data(), buffer_.data(), buffer_.data() + n);
+                return traits_type::to_int_type(*gptr());
+            }
+        };
 
         // 中央目录记录结构体，包含文件名
         // 这里必须保证不要直接将CentralDirectoryEntry写入内存，ZipCentralDirectoryFileHeader的file_name由开头的std::string管理
+        // record 中的大小和偏移超过 32 位时为 ZIP64_MARK_32, 以后面的 64 位字段为准; extra_field 不含 Zip64 扩展字段
         struct CentralDirectoryEntry
         {
             std::string file_name;
             std::vector<uint8_t> extra_field;
             std::string file_comment;
             header::ZipCentralDirectoryFileHeader record;
+            uint64_t compressed_size = 0;
+            uint64_t uncompressed_size = 0;
+            uint64_t local_header_offset = 0;
         };
         enum ZipMode
         {
             input,
-            output
+            output,
+            // 只顺序写出: CRC 和大小写在每个条目后的数据描述符中, 不回写本地文件头, 输出可以是管道或标准输出
+            stream,
+            // 读入已有的中央目录, 新条目从旧中央目录处写入, 关闭时写出新的中央目录, 同一路径只保留最后写入的; 归档不存在时等同于 output
+            update
         };
         explicit ZipFile(const std::filesystem::path& path, const FStreamDeleter<std::ifstream>& ifsDeleter = FStreamDeleter<std::ifstream>(),
-                         const FStreamDeleter<std::ofstream>& ofsDeleter = FStreamDeleter<std::ofstream>()) : db_(std::move(std::make_unique<db::ZipInitializationStrategy>()).get()), ifs_(nullptr, ifsDeleter), ofs_(nullptr, ofsDeleter)
+                         const FStreamDeleter<std::ofstream>& ofsDeleter = FStreamDeleter<std::ofstream>()) : ifs_(nullptr, ifsDeleter), ofs_(nullptr, ofsDeleter), index_(make_index(db::IndexBackend::Sqlite))
         {
             if (std::filesystem::exists(path))
             {
-                ZipFile(path, ZipMode::input, ifsDeleter, ofsDeleter);
+                ZipFile(path, ZipMode::input, db::IndexBackend::Sqlite, ifsDeleter, ofsDeleter);
             } else
             {
-                ZipFile(path, ZipMode::output, ifsDeleter, ofsDeleter);
+                ZipFile(path, ZipMode::output, db::IndexBackend::Sqlite, ifsDeleter, ofsDeleter);
             }
         }
-        ZipFile(const std::filesystem::path& path, const ZipMode mode, const FStreamDeleter<std::ifstream>& ifsDeleter = FStreamDeleter<std::ifstream>(),
-            const FStreamDeleter<std::ofstream>& ofsDeleter = FStreamDeleter<std::ofstream>()) : db_(std::move(std::make_unique<db::ZipInitializationStrategy>()).get()), ifs_(nullptr, ifsDeleter), ofs_(nullptr, ofsDeleter)
+        // backend 选择索引的存储方式, 打开时即建立索引
+        ZipFile(const std::filesystem::path& path, const ZipMode mode, const db::IndexBackend backend = db::IndexBackend::Sqlite,
+            const FStreamDeleter<std::ifstream>& ifsDeleter = FStreamDeleter<std::ifstream>(),
+            const FStreamDeleter<std::ofstream>& ofsDeleter = FStreamDeleter<std::ofstream>()) : ifs_(nullptr, ifsDeleter), ofs_(nullptr, ofsDeleter), index_(make_index(backend))
             {
                 if (mode == ZipMode::input)
                 {
@@ -341,9 +465,24 @@ namespace zip
                         is_valid_ = false;
                         return;
                     }
+                    // 建立索引时也通过 source_ 按位置读取
+                    if (auto file = std::make_shared<FileSource>(path); file->is_open())
+                        source_ = std::move(file);
+                    else
+                    {
+                        is_valid_ = false;
+                        return;
+                    }
+                    index_->begin_load();
                     init_db_from_zip();
+                    if (!index_->end_load())
+                        is_valid_ = false;
+                } else if (mode == ZipMode::update && std::filesystem::exists(path))
+                {
+                    open_for_update(path);
                 } else
                 {
+                    streaming_ = mode == ZipMode::stream;
                     ofs_ = OFStreamPointer(new std::ofstream(path, std::ios::binary | std::ios::trunc), FStreamDeleter<std::ofstream>());
                     // Check if the file was successfully opened
                     if (!ofs_ || !ofs_->is_open())
@@ -376,6 +515,13 @@ namespace zip
          */
         [[nodiscard]] std::vector<CentralDirectoryEntry> list_dir(const std::filesystem::path& path) const;
 
+        /**
+         * @brief 只列出指定目录的直接子节点
+         * @param path 目录路径, 空路径或 "." 表示根目录
+         * @return 按名字排序的条目列表, 目录不存在时为空
+         */
+        [[nodiscard]] std::vector<CentralDirectoryEntry> list_children(const std::filesystem::path& path) const;
+
         /**
          * @brief 获取指定路径的文件流
          * @param path 文件路径
@@ -383,17 +529,40 @@ namespace zip
          */
         [[nodiscard]] std::unique_ptr<ZipIstream> get_file_stream(const std::filesystem::path& path);
 
+        /**
+         * @brief 归档中是否已有与 meta 相同的条目
+         * 路径、未压缩大小以及按 DOS 时间换算后的修改时间都相同时认为相同, 更新时据此跳过未变化的文件
+         * @param meta 待写入文件的元数据
+         * @return 存在相同的条目时返回true
+         */
+        [[nodiscard]] bool has_unchanged_entry(const FileEntityMeta& meta) const;
+
         /**
          * @brief 完成zip归档创建
+         * @return 写出失败时返回 false; 并行写出的条目出错时不再写中央目录, 归档不完整
          */
-        void close();
+        bool close();
         [[nodiscard]] bool is_open() const { return is_valid_; }
         [[nodiscard]] bool is_readable() const { return is_valid_ && ifs_ && ifs_->is_open(); }
         [[nodiscard]] bool is_writable() const { return is_valid_ && ofs_ && ofs_->is_open(); }
+        [[nodiscard]] bool is_streaming() const { return streaming_; }
         [[nodiscard]] std::string comment() const { return comment_; }
         void set_password(const std::vector<uint8_t>& password) { password_ = password; invalid_password_ = false; }
         bool is_invalid_password() const { return invalid_password_;}
 
+        // Deflate 压缩级别 0-9
+        void set_compression_level(const int level) { compression_level_ = level; }
+        [[nodiscard]] int compression_level() const { return compression_level_; }
+        /**
+         * @brief 压缩线程数, 大于 1 时并行写出, 必须在第一次 add_entity 之前设置
+         * 调用线程读取文件并切成分块, 工作线程压缩各个分块(条目的第一个分块同时加密),
+         * 唯一的写出线程按提交顺序追加并记录偏移; add_entity 返回时条目可能尚未写出, 写出失败在之后的调用中返回
+         */
+        void set_compression_threads(const size_t threads) { compression_threads_ = threads; }
+        [[nodiscard]] size_t compression_threads() const { return compression_threads_; }
+        // 成员流的读取缓冲区上限, 只影响之后打开的流
+        void set_read_buffer_limit(const size_t limit) { read_buffer_limit_ = limit; }
+
         void set_version_made_by(const header::ZipVersionNeeded version)
         {
             version_make_by_ = version;
@@ -404,12 +573,24 @@ namespace zip
       private:
         IFStreamPointer ifs_;
         OFStreamPointer ofs_;
+        // 流式写出时输出不可定位, 偏移按已写出的条目累计
+        bool streaming_ = false;
+        uint64_t stream_offset_ = 0;
+        // 成员流通过它按位置读取, 互不影响, 也不使用 ifs_ 的读取位置
+        std::shared_ptr<PositionalSource> source_;
+        size_t read_buffer_limit_ = IstreamBuf::DEFAULT_MAX_BUFFER_SIZE;
         bool is_valid_ = true;
         std::vector<uint8_t> password_{};
         bool invalid_password_ = false;
 
-        // 数据库成员变量
-        db::Database db_;
+        // 路径 -> 中央目录记录
+        std::unique_ptr<db::ArchiveIndex<CentralDirectoryEntry>> index_;
+        // 并行写出时写出线程插入索引, 调用线程可能同时查找
+        mutable std::mutex index_mutex_;
+        // 中央目录在归档中的偏移, 打开已有归档时读出
+        uint64_t central_directory_offset_ = 0;
+        // 更新模式下的归档路径, 关闭时据此截掉旧中央目录的残留
+        std::filesystem::path update_path_;
 
         // 中央目录记录
         std::vector<CentralDirectoryEntry> m_central_directory{};
@@ -419,11 +600,88 @@ namespace zip
         std::string comment_{};
         // zip相关信息
         header::ZipVersionNeeded version_make_by_ = header::ZipVersionNeeded::Version20;
+        int compression_level_ = compress::deflate::DEFAULT_LEVEL;
 
+        static std::unique_ptr<db::ArchiveIndex<CentralDirectoryEntry>> make_index(db::IndexBackend backend);
         void init_db_from_zip();
-        [[nodiscard]] bool insert_entity(const header::ZipCentralDirectoryFileHeader*, const std::string& file_name,
-                                         const std::vector<uint8_t>& extra_field,
-                                         const std::string& file_comment) const;
+        // 建立索引后改为从旧中央目录处继续写入
+        void open_for_update(const std::filesystem::path& path);
+        // 逐条解析已读入内存的中央目录并写入索引
+        [[nodiscard]] bool load_central_directory(const std::vector<char>& directory, uint64_t total_records) const;
+        [[nodiscard]] bool insert_entity(const CentralDirectoryEntry& entry) const;
+
+        // 条目数据的流加密, ZipCrypto 和 RC4 都从只由口令决定的初始状态开始, 与加密头无关; AES 使用随机生成的盐
+        struct PayloadCipher
+        {
+            header::ZipEncryptionMethod method = header::ZipEncryptionMethod::Unknown;
+            encryption::ZipCrypto zip_crypto{};
+            encryption::RC4 rc4{};
+            std::optional<encryption::WinZipAes> aes{};
+            PayloadCipher() = default;
+            PayloadCipher(header::ZipEncryptionMethod method, const std::vector<uint8_t>& password);
+            void apply(std::byte* data, size_t size);
+        };
+        // 写出一个条目所需的信息: 文件头在调用线程准备, 数据和回写由写出线程(或串行时的调用线程)完成
+        struct PendingEntry
+        {
+            std::string filename;
+            std::vector<uint8_t> extra_field;       // 中央目录中的扩展字段
+            std::vector<uint8_t> local_extra_field; // 本地文件头中的扩展字段
+            header::ZipLocalFileHeader local_header{}; // 主机字节序
+            header::ZipCompressionMethod compression_method = header::ZipCompressionMethod::Store; // AES 条目的头中写 AES_Encryption
+            header::ZipVersionMadeBy version_made_by = header::ZipVersionMadeBy::Unknown;
+            header::ZipEncryptionMethod encryption_method = header::ZipEncryptionMethod::Unknown;
+            uint32_t external_file_attributes = 0;
+            bool regular_file = false;     // 只有普通文件写加密头
+            bool zip64_local = false;
+            uint16_t aes_version = 0;      // 1 为 AE-1, 2 为 AE-2(不写 CRC), 0 表示不是 AES 条目
+            uint64_t size = 0;
+            // 写出过程中的状态
+            uint64_t local_header_offset = 0;
+            uint64_t compressed_size = 0;
+            uint32_t crc32 = 0;
+            uint16_t rc4_bit_len = 0;
+            PayloadCipher cipher{};
+        };
+        [[nodiscard]] bool prepare_entry(ReadableFile& file, header::ZipCompressionMethod compression_method,
+                                         header::ZipEncryptionMethod encryption_method, PendingEntry& entry) const;
+        // 写出本地文件头和加密头, entry.cipher 未按加密方法初始化时在这里初始化
+        [[nodiscard]] bool begin_entry(PendingEntry& entry);
+        // 写出一段存储或压缩后的数据, encrypted 为 false 时先就地加密
+        [[nodiscard]] bool write_payload(PendingEntry& entry, std::byte* data, size_t size, bool encrypted);
+        // 回写 CRC 和大小(流式写出时改为写数据描述符), 插入索引
+        [[nodiscard]] bool finish_entry(PendingEntry& entry);
+        // 下一条记录在输出中的偏移
+        [[nodiscard]] uint64_t output_offset() const;
+
+        // 并行写出
+        struct CompressedChunk
+        {
+            std::vector<std::byte> payload;
+            uint32_t crc32 = 0;
+            uint64_t size = 0;
+            bool encrypted = false;
+            // 条目的第一个分块在工作线程里加密, 之后的加密状态由写出线程接着使用
+            std::optional<PayloadCipher> cipher;
+        };
+        struct WriteTask
+        {
+            std::shared_ptr<PendingEntry> entry;
+            std::future<CompressedChunk> chunk; // 无效表示条目没有数据
+            bool last = false;
+        };
+        size_t compression_threads_ = 0;
+        std::unique_ptr<concurrency::BoundedQueue<std::packaged_task<CompressedChunk()>>> jobs_;
+        std::unique_ptr<concurrency::BoundedQueue<WriteTask>> writes_;
+        // 队列中的分块与压缩结果占用的全局内存预算, 写出队列的容量由它决定
+        std::unique_ptr<buffer_pool::Reservation> pipeline_budget_;
+        std::vector<std::thread> workers_;
+        std::thread writer_;
+        std::atomic<bool> write_failed_{false};
+        bool add_entity_parallel(ReadableFile& file, const std::shared_ptr<PendingEntry>& entry);
+        void start_pipeline();
+        void stop_pipeline();
+        void write_loop();
 
         // 扩展字段解读
         static std::vector<std::vector<uint8_t>> get_extra_field_list(const std::vector<uint8_t>& extra_field);
@@ -468,6 +726,17 @@ namespace zip
         static std::pair<UnixExtraField, bool> extra_field2unix(const std::vector<uint8_t>& extra_field);
         static std::vector<uint8_t> unix2extra_field(uint32_t a_time=0, uint32_t m_time=0, uint16_t uid=0, uint16_t gid=0);
     };
+
+    // 索引 SQLite 后端的行格式, 记录即中央目录记录
+    struct BACKUP_SUITE_API ZipIndexCodec
+    {
+        using Strategy = db::ZipInitializationStrategy;
+        using Row = db::ZipInitializationStrategy::SQLZipEntity;
+        using Record = ZipFile::CentralDirectoryEntry;
+        static constexpr int Columns = std::tuple_size_v<Row>;
+        static void bind(sqlite3_stmt* stmt, const Record& record);
+        static Record decode(const Row& row) { return ZipFile::sql_entity_to_cdfh(row); }
+    };
 } // namespace zip
 
 #endif // BACKUPSUITE_ZIP_H
@@ -5,9 +5,168 @@
 #include <filesystem>
 #include <regex>
 #include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <set>
+#include <thread>
 #include <utility>
 
+#include "backup/small_file_batcher.h"
 #include "utils/admin_privilege.h"
+#include "utils/buffer_pool.h"
+#include "utils/trace.h"
+
+namespace
+{
+    // 遍历线程预读到内存中的文件, 由写出阶段消费
+    class PrefetchedFile final : public ReadableFile
+    {
+        std::vector<std::byte> data_;
+        size_t cursor_ = 0;
+    public:
+        PrefetchedFile(const FileEntityMeta& meta, std::vector<std::byte> data)
+            : ReadableFile(meta), data_(std::move(data)) {}
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read() override
+        {
+            auto out = std::make_unique<std::vector<std::byte>>(data_.begin() + static_cast<long long>(cursor_), data_.end());
+            cursor_ = data_.size();
+            return out;
+        }
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read(const size_t size) override
+        {
+            if (cursor_ >= data_.size() || size == 0)
+                return nullptr;
+            const auto n = std::min(size, data_.size() - cursor_);
+            auto out = std::make_unique<std::vector<std::byte>>(data_.begin() + static_cast<long long>(cursor_),
+                                                                data_.begin() + static_cast<long long>(cursor_ + n));
+            cursor_ += n;
+            return out;
+        }
+        [[nodiscard]] size_t read_into(std::byte* buffer, const size_t size) override
+        {
+            const auto n = std::min(size, data_.size() - cursor_);
+            if (n)
+                std::copy_n(data_.data() + cursor_, n, buffer);
+            cursor_ += n;
+            return n;
+        }
+    };
+
+    // 分块文件: 写出阶段按序从调度器取走分块, 分块由空闲的读取线程并行读入
+    class ChunkedFile final : public ReadableFile
+    {
+        TaskScheduler& scheduler_;
+        std::shared_ptr<TaskScheduler::ChunkStream> stream_;
+        std::function<std::vector<std::byte>(size_t)> read_chunk_;
+        std::vector<std::byte> chunk_;
+        size_t cursor_ = 0;
+    public:
+        ChunkedFile(const FileEntityMeta& meta, TaskScheduler& scheduler, std::shared_ptr<TaskScheduler::ChunkStream> stream,
+                    std::function<std::vector<std::byte>(size_t)> read_chunk)
+            : ReadableFile(meta), scheduler_(scheduler), stream_(std::move(stream)), read_chunk_(std::move(read_chunk)) {}
+        ~ChunkedFile() override { scheduler_.release(stream_); }
+        ChunkedFile(const ChunkedFile&) = delete;
+        ChunkedFile& operator=(const ChunkedFile&) = delete;
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read() override
+        {
+            return read(stream_->size);
+        }
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read(const size_t size) override
+        {
+            auto out = std::make_unique<std::vector<std::byte>>(size);
+            out->resize(read_into(out->data(), size));
+            if (out->empty())
+                return nullptr;
+            return out;
+        }
+        [[nodiscard]] size_t read_into(std::byte* buffer, const size_t size) override
+        {
+            scheduler_.activate(stream_);
+            size_t done = 0;
+            while (done < size)
+            {
+                if (cursor_ == chunk_.size())
+                {
+                    auto next = scheduler_.take(stream_, read_chunk_);
+                    if (!next || stream_->failed)
+                        break;
+                    chunk_ = std::move(*next);
+                    cursor_ = 0;
+                    continue;
+                }
+                const auto n = std::min(size - done, chunk_.size() - cursor_);
+                std::copy_n(chunk_.data() + cursor_, n, buffer + done);
+                cursor_ += n;
+                done += n;
+            }
+            return done;
+        }
+        [[nodiscard]] bool failed() const override { return stream_->failed; }
+        void close() override { scheduler_.release(stream_); }
+    };
+
+    // 按偏移读取一个分块; 源文件在遍历之后变短时以 0 补齐, 与已经写出的头部大小保持一致;
+    // 打不开或读取出错时标记整个流失败, 不把一段全 0 的内容当作文件数据写出
+    std::vector<std::byte> read_chunk(const std::vector<BackupSource>& sources, TaskScheduler::ChunkStream& stream,
+                                      const size_t chunk)
+    {
+        TRACE_SPAN(Controller, "controller.read_chunk");
+        try {
+            std::lock_guard lock(stream.input_mutex);
+            if (stream.failed)
+                return {};
+            if (!stream.input)
+                stream.input = dynamic_cast<PhysicalDevice&>(sources[stream.source].device).get_file_stream(stream.path);
+            if (!stream.input)
+            {
+                stream.failed = true;
+                return {};
+            }
+            std::vector<std::byte> data(stream.length(chunk));
+            // 上一个分块读到末尾后需要清除状态才能继续定位
+            stream.input->clear();
+            if (stream.input->seekg(static_cast<std::streamoff>(stream.offset(chunk))))
+                stream.input->read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (stream.input->bad())
+            {
+                stream.failed = true;
+                return {};
+            }
+            return data;
+        } catch ([[maybe_unused]] const std::exception& e) {
+            stream.failed = true;
+        }
+        return {};
+    }
+
+    // 在作用域的任意退出路径(包括异常)上执行清理
+    template<typename F>
+    class ScopeExit
+    {
+        F f_;
+    public:
+        explicit ScopeExit(F f) : f_(std::move(f)) {}
+        ~ScopeExit() { f_(); }
+        ScopeExit(const ScopeExit&) = delete;
+        ScopeExit& operator=(const ScopeExit&) = delete;
+    };
+
+    std::filesystem::path with_prefix(const std::filesystem::path& prefix, const std::filesystem::path& path)
+    {
+        if (prefix.empty())
+            return path;
+        if (path.empty() || path == ".")
+            return prefix;
+        return prefix / path.relative_path();
+    }
+}
+
+// 写出阶段的一项: 目录或文件(二者之一)
+struct BackupController::WriteItem
+{
+    std::unique_ptr<Folder> folder;
+    std::unique_ptr<ReadableFile> file;
+};
 
 BackupController::BackupController(BackupConfig cfg): config(std::move(cfg))
 {
@@ -18,9 +177,17 @@ BackupController::BackupController(BackupConfig cfg): config(std::move(cfg))
 }
 
 void BackupController::run_backup(Device& from, Device& to) const
+{
+    TRACE_SPAN(Controller, "controller.run_backup");
+    SmallFileBatcher batcher(to, config.small_file_threshold, config.small_file_batch_bytes);
+    backup_tree(from, to, "", batcher);
+    batcher.flush();
+}
+
+void BackupController::backup_tree(Device& from, Device& to, const std::filesystem::path& root, SmallFileBatcher& batcher) const
 {
     std::queue<std::unique_ptr<Folder>> queue;
-    queue.push(from.get_folder(""));
+    queue.push(from.get_folder(root));
 
     while (!queue.empty())
     {
@@ -28,7 +195,19 @@ void BackupController::run_backup(Device& from, Device& to) const
         queue.pop();
         if (!folder)
             continue;
+        TRACE_SPAN(Controller, "controller.folder");
+        // 暂存在 batcher 中的小文件先于其后的目录与大文件写出, 归档中的条目顺序与遍历顺序一致
+        batcher.flush();
         to.write_folder(*folder);
+        // 连续的小文件交给 batcher 按物理位置安排读取顺序, 归档中的条目顺序不变
+        std::vector<FileEntityMeta> small_files;
+        const auto flush_small_files = [&]
+        {
+            if (small_files.empty())
+                return;
+            batcher.add_files(from, small_files);
+            small_files.clear();
+        };
         for (auto &child: folder->get_children())
         {
             const auto meta = child.get_meta();
@@ -42,20 +221,319 @@ void BackupController::run_backup(Device& from, Device& to) const
                 queue.push(from.get_folder(meta.path));
                 continue;
             }
+            if (batcher.accepts(meta))
+            {
+                small_files.push_back(meta);
+                continue;
+            }
+            flush_small_files();
+            TRACE_SPAN(Controller, "controller.copy_file");
             std::unique_ptr<ReadableFile> tmp_file = from.get_file(meta.path);
             if (!tmp_file)
                 continue;
-            if (tmp_file->get_meta().type != FileEntityType::Directory)
+            if (batcher.accepts(tmp_file->get_meta()))
             {
+                batcher.add(*tmp_file);
+            }
+            else if (tmp_file->get_meta().type != FileEntityType::Directory)
+            {
+                batcher.flush();
                 to.write_file(*tmp_file);
             }
             tmp_file->close();
         }
+        flush_small_files();
+    }
+}
+
+bool BackupController::run_backup(Device& from, Device& to, ChangeJournal& journal) const
+{
+    TRACE_SPAN(Controller, "controller.run_backup_journal");
+    const auto snapshot = journal.snapshot();
+    if (!snapshot.valid)
+        return false;
+    if (snapshot.full_scan)
+    {
+        run_backup(from, to);
+        return journal.consume(snapshot.seq);
+    }
+
+    bool ok = true;
+    SmallFileBatcher batcher(to, config.small_file_threshold, config.small_file_batch_bytes);
+    std::set<std::filesystem::path> written_folders;
+    std::set<std::filesystem::path> scanned_trees;
+    const auto write_folder = [&](const std::filesystem::path& path)
+    {
+        if (!written_folders.insert(path).second)
+            return;
+        if (const auto folder = from.get_folder(path))
+        {
+            ok = batcher.flush() && ok;
+            ok = to.write_folder(*folder) && ok;
+        }
+    };
+    for (const auto& [path, recursive] : snapshot.entries)
+    {
+        // 已随上级目录整体扫描过
+        bool covered = false;
+        for (auto parent = path.parent_path(); !covered && !parent.empty(); parent = parent.parent_path())
+            covered = scanned_trees.count(parent) > 0;
+        if (covered)
+            continue;
+        // 已被删除的路径无法写入归档, 直接跳过
+        const auto meta = from.get_meta(path);
+        if (!meta || !(static_cast<unsigned int>(meta->type) & static_cast<unsigned int>(config.backup_file_types)))
+            continue;
+        if (!should_backup_file(*meta))
+            continue;
+        // 先补齐上级目录
+        std::filesystem::path parent;
+        for (const auto& part : path.parent_path())
+            write_folder(parent /= part);
+        if (meta->type == FileEntityType::Directory)
+        {
+            if (recursive)
+            {
+                scanned_trees.insert(path);
+                backup_tree(from, to, path, batcher);
+            }
+            else
+            {
+                write_folder(path);
+            }
+            continue;
+        }
+        TRACE_SPAN(Controller, "controller.copy_file");
+        const auto file = from.get_file(path);
+        if (!file)
+            continue;
+        if (batcher.accepts(file->get_meta()))
+        {
+            ok = batcher.add(*file) && ok;
+        }
+        else
+        {
+            ok = batcher.flush() && ok;
+            ok = to.write_file(*file) && ok;
+        }
+        file->close();
+    }
+    ok = batcher.flush() && ok;
+    // 只有写入成功才清除日志, 否则下一次备份重新处理这些路径
+    return ok && journal.consume(snapshot.seq);
+}
+
+void BackupController::walk_source(const size_t index, const BackupSource& source,
+                                   concurrency::BoundedQueue<WriteItem>& queue, TaskScheduler& scheduler) const
+{
+    TRACE_SPAN(Controller, "controller.walk_source");
+    // 只有能按偏移读取的源才能分块
+    const bool splittable = dynamic_cast<PhysicalDevice*>(&source.device) != nullptr;
+    std::queue<std::unique_ptr<Folder>> folders;
+    folders.push(source.device.get_folder(""));
+
+    while (!folders.empty())
+    {
+        auto folder = std::move(folders.front());
+        folders.pop();
+        if (!folder)
+            continue;
+        TRACE_SPAN(Controller, "controller.folder");
+        auto folder_meta = folder->get_meta();
+        folder_meta.path = with_prefix(source.prefix, folder_meta.path);
+        // 目录先于其中的文件进入写出队列
+        queue.push({std::make_unique<Folder>(folder_meta, std::vector<FileEntity>{}), nullptr});
+        for (auto& child : folder->get_children())
+        {
+            const auto meta = child.get_meta();
+            if (!(static_cast<unsigned int>(meta.type) & static_cast<unsigned int>(config.backup_file_types)))
+                continue;
+            if (!should_backup_file(meta))
+                continue;
+            if (meta.type == FileEntityType::Directory)
+                folders.push(source.device.get_folder(meta.path));
+            else
+                scheduler.add(index, meta, splittable && meta.type == FileEntityType::RegularFile &&
+                                           meta.size > config.prefetch_file_threshold);
+        }
+    }
+}
+
+void BackupController::read_task(const std::vector<BackupSource>& sources, TaskScheduler& scheduler,
+                                  const TaskScheduler::Task& task, concurrency::BoundedQueue<WriteItem>& queue) const
+{
+    TRACE_SPAN(Controller, "controller.prefetch");
+    const auto& source = sources[task.source];
+    if (task.chunked)
+    {
+        auto file_meta = task.meta;
+        file_meta.path = with_prefix(source.prefix, file_meta.path);
+        auto stream = scheduler.open_stream(task);
+        auto reader = [&sources, stream = stream.get()](const size_t chunk) { return read_chunk(sources, *stream, chunk); };
+        queue.push({nullptr, std::make_unique<ChunkedFile>(file_meta, scheduler, std::move(stream), std::move(reader))});
+        return;
+    }
+    std::unique_ptr<ReadableFile> file = source.device.get_file(task.meta.path);
+    if (!file)
+        return;
+    auto file_meta = file->get_meta();
+    file_meta.path = with_prefix(source.prefix, file_meta.path);
+    // 小文件在读取线程中读完, 不同源(磁盘)的读取因此并行; 大文件交给写出阶段流式读取
+    if (file_meta.type == FileEntityType::RegularFile && file_meta.size <= config.prefetch_file_threshold)
+    {
+        std::vector<std::byte> data(file_meta.size);
+        size_t done = 0;
+        while (done < data.size())
+        {
+            const auto n = file->read_into(data.data() + done, data.size() - done);
+            if (n == 0)
+                break;
+            done += n;
+        }
+        file->close();
+        data.resize(done);
+        file_meta.size = done;
+        queue.push({nullptr, std::make_unique<PrefetchedFile>(file_meta, std::move(data))}, done);
+    }
+    else
+    {
+        // 按一个 slab 计入队列代价, 限制同时打开的大文件数量
+        const auto cost = std::min(file_meta.size, buffer_pool::BufferPool::instance().slab_size());
+        file->get_meta() = file_meta;
+        queue.push({nullptr, std::move(file)}, cost);
+    }
+}
+
+bool BackupController::run_backup(const std::vector<BackupSource>& sources, Device& to) const
+{
+    TRACE_SPAN(Controller, "controller.run_backup_multi");
+    auto& pool = buffer_pool::BufferPool::instance();
+    // 预读内容占用全局内存预算的一部分; 写出线程之后还要为小文件批次与 acquire() 占用预算,
+    // 阻塞地占用可能永远等不到归还, 因此非阻塞地占用并留出这部分余量, 预算不足时缩小预读队列
+    const auto headroom = std::min(config.small_file_batch_bytes + pool.slab_size(), pool.memory_limit() / 2);
+    // 分块读取窗口与写出线程手中的一个分块同样计入预算; 预算不足时先减少窗口中的分块数, 再缩小分块
+    const auto read_workers = std::max<size_t>(config.read_workers, 1);
+    const buffer_pool::Reservation window_budget(pool, std::min((2 * read_workers + 1) * config.chunk_bytes, pool.memory_limit() / 2),
+                                                 std::try_to_lock, headroom);
+    const auto chunk_bytes = std::min(config.chunk_bytes, std::max(window_budget.size() / 2, pool.slab_size()));
+    const auto window_chunks = std::max<size_t>(window_budget.size() / std::max<size_t>(chunk_bytes, 1), 2) - 1;
+    const buffer_pool::Reservation reservation(pool, std::min(config.prefetch_bytes, pool.memory_limit() / 2),
+                                               std::try_to_lock, headroom);
+    concurrency::BoundedQueue<WriteItem> queue(std::max<size_t>(reservation.size(), 1));
+    // 所有文件任务都交给写出阶段后关闭队列
+    TaskScheduler scheduler(config.small_file_threshold, chunk_bytes, window_chunks, [&queue] { queue.close(); });
+
+    std::atomic<size_t> running{sources.size()};
+    std::vector<std::thread> walkers;
+    std::vector<std::thread> readers;
+    // 写出阶段抛出异常时同样要让遍历与读取线程退出并回收, 否则 std::thread 析构时 std::terminate;
+    // 队列中剩余的 ChunkedFile 引用 scheduler, 需要在它析构之前丢弃
+    const ScopeExit stop_threads([&]
+    {
+        queue.close();
+        scheduler.shutdown();
+        for (auto& thread : walkers)
+            if (thread.joinable())
+                thread.join();
+        for (auto& thread : readers)
+            if (thread.joinable())
+                thread.join();
+        while (queue.pop())
+        {
+        }
+    });
+    walkers.reserve(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        walkers.emplace_back([this, i, &sources, &queue, &scheduler, &running]
+        {
+            try {
+                walk_source(i, sources[i], queue, scheduler);
+            } catch ([[maybe_unused]] const std::exception& e) {
+                // 单个源失败不影响其他源
+            }
+            if (running.fetch_sub(1) == 1)
+                scheduler.finish();
+        });
+    }
+    if (sources.empty())
+        scheduler.finish();
+
+    // 第一个读取线程专门处理小文件, 其余线程从最大的文件开始
+    readers.reserve(read_workers);
+    for (size_t i = 0; i < read_workers; ++i)
+    {
+        const auto lane = i == 0 ? TaskScheduler::Lane::Small : TaskScheduler::Lane::Large;
+        readers.emplace_back([this, lane, &sources, &queue, &scheduler]
+        {
+            while (auto task = scheduler.next(lane))
+            {
+                if (task->stream)
+                {
+                    scheduler.put(task->stream, task->chunk, read_chunk(sources, *task->stream, task->chunk));
+                    continue;
+                }
+                try {
+                    read_task(sources, scheduler, *task, queue);
+                } catch ([[maybe_unused]] const std::exception& e) {
+                    // 单个文件失败不影响其他文件
+                }
+                scheduler.complete();
+            }
+        });
+    }
+
+    // 写出阶段: 只有当前线程访问目标设备
+    bool ok = true;
+    std::set<std::filesystem::path> written_prefixes;
+    for (const auto& source : sources)
+    {
+        // 补齐前缀的上级目录, 如 "var/lib/app" 需要 "var" 与 "var/lib"
+        std::filesystem::path parent;
+        for (auto it = source.prefix.begin(); it != source.prefix.end(); ++it)
+        {
+            parent /= *it;
+            if (parent == source.prefix || !written_prefixes.insert(parent).second)
+                continue;
+            FileEntityMeta meta{};
+            meta.path = parent;
+            meta.type = FileEntityType::Directory;
+            meta.creation_time = meta.modification_time = meta.access_time = std::chrono::system_clock::now();
+            Folder folder(meta, {});
+            ok = to.write_folder(folder) && ok;
+        }
+    }
+    SmallFileBatcher batcher(to, config.small_file_threshold, config.small_file_batch_bytes);
+    while (auto item = queue.pop())
+    {
+        // 暂存的小文件先于其后出队的目录与大文件写出, 保持条目的出队顺序
+        if (item->folder)
+        {
+            ok = batcher.flush() && ok;
+            ok = to.write_folder(*item->folder) && ok;
+            continue;
+        }
+        if (!item->file)
+            continue;
+        TRACE_SPAN(Controller, "controller.copy_file");
+        if (batcher.accepts(item->file->get_meta()))
+        {
+            ok = batcher.add(*item->file) && ok;
+        }
+        else
+        {
+            ok = batcher.flush() && ok;
+            ok = to.write_file(*item->file) && ok;
+        }
+        item->file->close();
     }
+    ok = batcher.flush() && ok;
+    return ok;
 }
 
 bool BackupController::run_restore(Device& from, Device& to) const
 {
+    TRACE_SPAN(Controller, "controller.run_restore");
     try {
         // 确保目标目录为空或存在
         const auto target_meta = to.get_meta("");
@@ -115,6 +593,7 @@ bool BackupController::copy_folder_recursive(Device& from, Device& to, const std
         // 再处理文件
         for (auto& child : files) {
             const auto& child_meta = child.get_meta();
+            TRACE_SPAN(Controller, "controller.copy_file");
             auto source_file = from.get_file(child_meta.path);
             if (!source_file) {
                 continue;
@@ -135,6 +614,7 @@ bool BackupController::copy_folder_recursive(Device& from, Device& to, const std
 
 bool BackupController::should_backup_file(const FileEntityMeta& meta) const
 {
+    TRACE_SPAN(Controller, "controller.filter");
     // 使用正斜杠进行路径匹配（跨平台）
     std::string path_str = meta.path.generic_u8string();
 
@@ -0,0 +1,170 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "backup/backup_verifier.h"
+
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "utils/bounded_queue.h"
+#include "utils/buffer_pool.h"
+#include "utils/crc.h"
+#include "utils/trace.h"
+
+namespace
+{
+    struct Digest
+    {
+        bool readable = false;
+        uint64_t size = 0;
+        uint32_t crc32 = 0;
+    };
+
+    // 一个归档成员及两侧的摘要; source 由工作线程填写
+    struct Member
+    {
+        std::filesystem::path path;
+        Digest archived;
+        Digest source;
+    };
+
+    // 每次摘要临时借一个 slab, 等待队列时不占用预算, 线程数超过预算时也不会互相等待
+    Digest digest(ReadableFile* file)
+    {
+        Digest result;
+        if (!file)
+            return result;
+        TRACE_SPAN(Checksum, "verify.digest");
+        const auto slab = buffer_pool::BufferPool::instance().acquire();
+        crc::CRC32 crc;
+        while (const auto n = file->read_into(slab.data(), slab.size()))
+        {
+            crc.update(slab.data(), n);
+            result.size += n;
+        }
+        file->close();
+        result.readable = true;
+        result.crc32 = crc.finalize();
+        return result;
+    }
+
+    std::string describe(const Digest& archived, const Digest& source)
+    {
+        std::ostringstream ss;
+        if (archived.size != source.size)
+            ss << "size mismatch (archive " << archived.size << ", source " << source.size << ")";
+        else
+            ss << std::hex << std::uppercase << "CRC32 mismatch (archive " << archived.crc32 << ", source " << source.crc32 << ")";
+        return ss.str();
+    }
+
+    // path 是否为 ancestor 本身或位于其下
+    bool is_within(const std::filesystem::path& path, const std::filesystem::path& ancestor)
+    {
+        const auto [it, _] = std::mismatch(ancestor.begin(), ancestor.end(), path.begin(), path.end());
+        return it == ancestor.end();
+    }
+}
+
+BackupVerifier::BackupVerifier(const size_t workers)
+    : workers_(workers ? workers : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+VerifyReport BackupVerifier::verify(Device& source, Device& archive, const std::filesystem::path& prefix,
+                                    const std::vector<std::filesystem::path>& excluded) const
+{
+    TRACE_SPAN(Controller, "verify.run");
+    // 只排除 prefix 之下的路径, 上级前缀会覆盖整个源
+    std::vector<std::filesystem::path> skipped;
+    for (const auto& path : excluded)
+        if (path != prefix && is_within(path, prefix))
+            skipped.push_back(path);
+    const auto is_skipped = [&](const std::filesystem::path& path)
+    {
+        return std::any_of(skipped.begin(), skipped.end(), [&](const auto& other) { return is_within(path, other); });
+    };
+
+    // 归档设备不是线程安全的: 调用线程按存储顺序遍历并读取归档成员, 同时把成员交给工作线程并行读取对应源文件
+    std::deque<Member> members;
+    concurrency::BoundedQueue<Member*> pending(workers_ * 64);
+    std::vector<std::thread> workers;
+    workers.reserve(workers_);
+    for (size_t w = 0; w < workers_; ++w)
+    {
+        workers.emplace_back([&]
+        {
+            while (const auto member = pending.pop())
+            {
+                const auto path = prefix.empty() ? (*member)->path : (*member)->path.lexically_relative(prefix);
+                try {
+                    const auto file = source.get_file(path);
+                    (*member)->source = digest(file.get());
+                } catch ([[maybe_unused]] const std::exception& e) {
+                    // 保持 readable = false, 记为源文件不可读
+                }
+            }
+        });
+    }
+
+    // zip 的目录列表包含所有后代, 用 visited 去重
+    std::set<std::filesystem::path> visited;
+    std::queue<std::unique_ptr<Folder>> folders;
+    folders.push(archive.get_folder(prefix));
+    while (!folders.empty())
+    {
+        const auto folder = std::move(folders.front());
+        folders.pop();
+        if (!folder)
+            continue;
+        for (auto& child : folder->get_children())
+        {
+            const auto& meta = child.get_meta();
+            if (!visited.insert(meta.path).second || is_skipped(meta.path))
+                continue;
+            if (meta.type == FileEntityType::Directory)
+            {
+                folders.push(archive.get_folder(meta.path));
+                continue;
+            }
+            if (meta.type != FileEntityType::RegularFile)
+                continue;
+            try {
+                // 目录成员在部分格式中不带目录类型(如 zip), 以打开后的元数据为准
+                const auto file = archive.get_file(meta.path);
+                if (!file || file->get_meta().type == FileEntityType::Directory)
+                {
+                    folders.push(archive.get_folder(meta.path));
+                    continue;
+                }
+                auto& member = members.emplace_back();
+                member.path = meta.path;
+                member.archived = digest(file.get());
+                pending.push(&member);
+            } catch ([[maybe_unused]] const std::exception& e) {
+                members.push_back({meta.path, {}, {}});
+            }
+        }
+    }
+    pending.close();
+    for (auto& worker : workers)
+        worker.join();
+
+    VerifyReport report;
+    for (const auto& [path, archived, original] : members)
+    {
+        ++report.files_checked;
+        report.bytes_checked += archived.size;
+        if (!archived.readable)
+            report.issues.push_back({path, "unreadable in archive"});
+        else if (!original.readable)
+            report.issues.push_back({path, "missing or unreadable in source"});
+        else if (archived.size != original.size || archived.crc32 != original.crc32)
+            report.issues.push_back({path, describe(archived, original)});
+    }
+    return report;
+}
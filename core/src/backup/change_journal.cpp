@@ -0,0 +1,288 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "backup/change_journal.h"
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+
+#include "utils/database_strategies.h"
+#include "utils/trace.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ChangeJournal::ChangeJournal(const std::filesystem::path& journal_path)
+    : db_(journal_path.u8string(), std::make_unique<db::JournalInitializationStrategy>().get(), false)
+{
+    // 监视进程与备份进程同时访问同一个日志文件
+    if (db_.is_open() && db_.exec("PRAGMA busy_timeout = 10000;"))
+    {
+        [[maybe_unused]] const auto wal = db_.exec("PRAGMA journal_mode = WAL;");
+    }
+}
+
+bool ChangeJournal::record(const std::vector<Entry>& entries)
+{
+    TRACE_SPAN(Database, "journal.record");
+    if (!is_open())
+        return false;
+    if (entries.empty())
+        return true;
+    if (!db_.exec("BEGIN IMMEDIATE;"))
+        return false;
+    bool ok = db_.exec("UPDATE journal_state SET value = value + 1 WHERE key = 'seq';");
+    try {
+        const auto stmt = db_.create_statement(
+            "INSERT INTO journal_path (path, seq, recursive) "
+            "SELECT ?, value, ? FROM journal_state WHERE key = 'seq' "
+            "ON CONFLICT(path) DO UPDATE SET seq = excluded.seq, recursive = MAX(recursive, excluded.recursive);"
+        );
+        for (const auto& [path, recursive] : entries)
+        {
+            db::bind_parameter(stmt.get(), 1, path.generic_u8string());
+            db::bind_parameter(stmt.get(), 2, recursive ? 1 : 0);
+            ok = ok && db_.execute(*stmt);
+            sqlite3_reset(stmt.get());
+            sqlite3_clear_bindings(stmt.get());
+        }
+    } catch ([[maybe_unused]] const std::exception& e) {
+        ok = false;
+    }
+    return db_.exec(ok ? "COMMIT;" : "ROLLBACK;") && ok;
+}
+
+bool ChangeJournal::mark_overflow()
+{
+    TRACE_SPAN(Database, "journal.overflow");
+    if (!is_open() || !db_.exec("BEGIN IMMEDIATE;"))
+        return false;
+    const bool ok = db_.exec("UPDATE journal_state SET value = value + 1 WHERE key = 'seq';") &&
+                    db_.exec("UPDATE journal_state SET value = (SELECT value FROM journal_state WHERE key = 'seq') "
+                             "WHERE key = 'full_scan_seq';");
+    return db_.exec(ok ? "COMMIT;" : "ROLLBACK;") && ok;
+}
+
+ChangeJournal::Snapshot ChangeJournal::snapshot() const
+{
+    TRACE_SPAN(Database, "journal.snapshot");
+    Snapshot snapshot;
+    // 在同一个读事务中读取序号与路径, 两者保持一致
+    if (!is_open() || !db_.exec("BEGIN;"))
+        return snapshot;
+    try {
+        snapshot.seq = std::get<0>(db_.query_one<std::tuple<long long>>(
+            "SELECT value FROM journal_state WHERE key = 'seq';"));
+        snapshot.full_scan = std::get<0>(db_.query_one<std::tuple<long long>>(
+            "SELECT value FROM journal_state WHERE key = 'full_scan_seq';")) != 0;
+        if (!snapshot.full_scan)
+        {
+            for (const auto [path, seq, recursive] : db_.query<db::JournalInitializationStrategy::SQLEntity>(
+                     "SELECT path, seq, recursive FROM journal_path ORDER BY path ASC;"))
+                snapshot.entries.push_back({std::filesystem::path(path), recursive != 0});
+        }
+        snapshot.valid = true;
+    } catch ([[maybe_unused]] const std::exception& e) {
+        snapshot.valid = false;
+    }
+    if (!db_.exec("COMMIT;"))
+        snapshot.valid = false;
+    return snapshot;
+}
+
+bool ChangeJournal::consume(const int64_t seq)
+{
+    TRACE_SPAN(Database, "journal.consume");
+    if (!is_open() || !db_.exec("BEGIN IMMEDIATE;"))
+        return false;
+    bool ok = true;
+    try {
+        const auto remove_paths = db_.create_statement("DELETE FROM journal_path WHERE seq <= ?;");
+        db::bind_parameter(remove_paths.get(), 1, static_cast<long long>(seq));
+        ok = db_.execute(*remove_paths);
+        const auto reset_full_scan = db_.create_statement(
+            "UPDATE journal_state SET value = 0 WHERE key = 'full_scan_seq' AND value <= ?;");
+        db::bind_parameter(reset_full_scan.get(), 1, static_cast<long long>(seq));
+        ok = ok && db_.execute(*reset_full_scan);
+    } catch ([[maybe_unused]] const std::exception& e) {
+        ok = false;
+    }
+    return db_.exec(ok ? "COMMIT;" : "ROLLBACK;") && ok;
+}
+
+ChangeWatcher::ChangeWatcher(std::filesystem::path root, ChangeJournal& journal)
+    : root_(std::move(root)), journal_(journal)
+{
+}
+
+#ifdef __linux__
+
+namespace
+{
+    constexpr uint32_t WATCH_MASK = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                                    IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+}
+
+ChangeWatcher::~ChangeWatcher()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+bool ChangeWatcher::start()
+{
+    TRACE_SPAN(Controller, "watcher.start");
+    if (fd_ >= 0)
+        return true;
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0)
+        return false;
+    add_watch_recursive({});
+    if (watches_.empty())
+    {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    // 建立监视之前(包括上一次停止之后)的变化无法得知, 下一次备份需要完整扫描; 监视数量不足时同样会丢失事件
+    overflow_ = true;
+    flush();
+    return true;
+}
+
+void ChangeWatcher::add_watch_recursive(const std::filesystem::path& relative)
+{
+    const auto add = [this](const std::filesystem::path& rel)
+    {
+        if (const int wd = inotify_add_watch(fd_, (root_ / rel).c_str(), WATCH_MASK); wd >= 0)
+            watches_[wd] = rel;
+        else if (errno == ENOSPC || errno == ENOMEM)
+            overflow_ = true; // 超过 max_user_watches, 这部分目录的变化会丢失
+    };
+    add(relative);
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(
+             root_ / relative, std::filesystem::directory_options::skip_permission_denied, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (it->is_directory(ec) && !it->is_symlink(ec))
+            add(it->path().lexically_relative(root_));
+    }
+}
+
+void ChangeWatcher::handle_events()
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true)
+    {
+        const auto length = ::read(fd_, buffer, sizeof(buffer));
+        if (length <= 0)
+            return;
+        for (const char* p = buffer; p < buffer + length;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                overflow_ = true;
+                continue;
+            }
+            const auto it = watches_.find(event->wd);
+            if (it == watches_.end())
+                continue;
+            if (event->mask & IN_IGNORED)
+            {
+                watches_.erase(it);
+                continue;
+            }
+            const auto path = event->len ? it->second / event->name : it->second;
+            if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) && path.empty())
+            {
+                overflow_ = true; // 源根目录本身被删除或移动
+                continue;
+            }
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+            {
+                // 新目录中在建立监视之前产生的文件只能通过扫描该子树得到
+                add_watch_recursive(path);
+                dirty_recursive_.insert(path);
+                continue;
+            }
+            if (!path.empty())
+                dirty_.insert(path);
+        }
+    }
+}
+
+void ChangeWatcher::run(const std::atomic<bool>& stop, const std::chrono::milliseconds flush_interval)
+{
+    if (fd_ < 0 && !start())
+        return;
+    auto last_flush = std::chrono::steady_clock::now();
+    while (!stop)
+    {
+        pollfd pfd{fd_, POLLIN, 0};
+        // 定期醒来检查 stop, 避免信号到达后长时间阻塞
+        const auto timeout = static_cast<int>(std::min<long long>(flush_interval.count(), 200));
+        if (::poll(&pfd, 1, timeout) > 0)
+            handle_events();
+        if (std::chrono::steady_clock::now() - last_flush >= flush_interval)
+        {
+            flush();
+            last_flush = std::chrono::steady_clock::now();
+        }
+    }
+    handle_events();
+    flush();
+}
+
+#else
+
+ChangeWatcher::~ChangeWatcher() = default;
+
+bool ChangeWatcher::start()
+{
+    // 目前只支持 Linux(inotify)
+    return false;
+}
+
+void ChangeWatcher::add_watch_recursive(const std::filesystem::path&)
+{
+}
+
+void ChangeWatcher::handle_events()
+{
+}
+
+void ChangeWatcher::run(const std::atomic<bool>&, std::chrono::milliseconds)
+{
+}
+
+#endif
+
+void ChangeWatcher::flush()
+{
+    TRACE_SPAN(Controller, "watcher.flush");
+    if (overflow_ && journal_.mark_overflow())
+        overflow_ = false;
+    if (dirty_.empty() && dirty_recursive_.empty())
+        return;
+    std::vector<ChangeJournal::Entry> entries;
+    entries.reserve(dirty_.size() + dirty_recursive_.size());
+    for (const auto& path : dirty_recursive_)
+        entries.push_back({path, true});
+    for (const auto& path : dirty_)
+        if (!dirty_recursive_.count(path))
+            entries.push_back({path, false});
+    // 写入失败时保留, 下一次再试
+    if (journal_.record(entries))
+    {
+        dirty_.clear();
+        dirty_recursive_.clear();
+    }
+}
@@ -0,0 +1,213 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "backup/small_file_batcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "utils/trace.h"
+
+namespace
+{
+    // 指向批次缓冲区中一段数据的只读文件, 生命周期不超过一次 flush
+    class BatchedReadableFile final : public ReadableFile
+    {
+        const std::byte* data_;
+        size_t size_;
+        size_t cursor_ = 0;
+    public:
+        BatchedReadableFile(const FileEntityMeta& meta, const std::byte* data, const size_t size)
+            : ReadableFile(meta), data_(data), size_(size) {}
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read() override
+        {
+            auto out = std::make_unique<std::vector<std::byte>>(data_ + cursor_, data_ + size_);
+            cursor_ = size_;
+            return out;
+        }
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read(const size_t size) override
+        {
+            if (cursor_ >= size_ || size == 0)
+                return nullptr;
+            const auto n = std::min(size, size_ - cursor_);
+            auto out = std::make_unique<std::vector<std::byte>>(data_ + cursor_, data_ + cursor_ + n);
+            cursor_ += n;
+            return out;
+        }
+        [[nodiscard]] size_t read_into(std::byte* buffer, const size_t size) override
+        {
+            const auto n = std::min(size, size_ - cursor_);
+            if (n)
+                std::memcpy(buffer, data_ + cursor_, n);
+            cursor_ += n;
+            return n;
+        }
+    };
+}
+
+SmallFileBatcher::SmallFileBatcher(Device& to, const size_t threshold, const size_t batch_bytes, const size_t batch_files)
+    : to_(to), threshold_(threshold), batch_bytes_(batch_bytes), batch_files_(batch_files),
+      reservation_(buffer_pool::BufferPool::instance(), batch_bytes, std::try_to_lock, buffer_pool::BufferPool::instance().slab_size())
+{
+    // 同一线程写出非聚合文件时还要 acquire() 一个 slab, 阻塞地占用预算可能永远等不到归还
+    batch_bytes_ = reservation_.size();
+    threshold_ = std::min(threshold_, batch_bytes_);
+    if (reservation_)
+        buffer_.reserve(batch_bytes_);
+    entries_.reserve(batch_files_);
+}
+
+SmallFileBatcher::~SmallFileBatcher()
+{
+    try {
+        flush();
+    } catch (...) {
+        // Suppress exceptions during destruction
+    }
+}
+
+bool SmallFileBatcher::accepts(const FileEntityMeta& meta) const
+{
+    return reservation_ && threshold_ > 0 && meta.type == FileEntityType::RegularFile && meta.size <= threshold_;
+}
+
+bool SmallFileBatcher::add(ReadableFile& file)
+{
+    TRACE_SPAN(Controller, "batcher.add");
+    auto meta = file.get_meta();
+    // 目标会跳过的文件(如 zip 更新时未变化的文件)不必读入批次
+    if (to_.has_unchanged(meta))
+        return true;
+    if (buffer_.size() + meta.size > batch_bytes_ || entries_.size() >= batch_files_)
+    {
+        if (!flush())
+            return false;
+    }
+    const auto offset = buffer_.size();
+    buffer_.resize(offset + meta.size);
+    size_t done = 0;
+    while (done < meta.size)
+    {
+        const auto n = file.read_into(buffer_.data() + offset + done, meta.size - done);
+        if (n == 0)
+            break;
+        done += n;
+    }
+    // 读取出错的文件不进入批次
+    if (file.failed())
+    {
+        buffer_.resize(offset);
+        return false;
+    }
+    // 以实际读到的大小为准, 文件在遍历后被截断时不会写出垃圾数据
+    buffer_.resize(offset + done);
+    meta.size = done;
+    entries_.push_back({std::move(meta), offset});
+    return true;
+}
+
+bool SmallFileBatcher::add_files(Device& from, const std::vector<FileEntityMeta>& all_files)
+{
+    TRACE_SPAN(Controller, "batcher.add_files");
+    // 目标会跳过的文件(如 zip 更新时未变化的文件)不必打开和读取
+    std::vector<FileEntityMeta> files;
+    files.reserve(all_files.size());
+    std::copy_if(all_files.begin(), all_files.end(), std::back_inserter(files),
+                 [this](const FileEntityMeta& meta) { return !to_.has_unchanged(meta); });
+    bool ok = true;
+    for (size_t begin = 0; begin < files.size();)
+    {
+        // 取不超过一个批次容量的一段
+        size_t end = begin;
+        size_t bytes = 0;
+        while (end < files.size() && end - begin < batch_files_ && (end == begin || bytes + files[end].size <= batch_bytes_))
+            bytes += files[end++].size;
+        if (buffer_.size() + bytes > batch_bytes_ || entries_.size() + (end - begin) > batch_files_)
+            ok = flush() && ok;
+        read_window(from, files, begin, end);
+        begin = end;
+    }
+    return ok;
+}
+
+void SmallFileBatcher::read_window(Device& from, const std::vector<FileEntityMeta>& files, const size_t begin, const size_t end)
+{
+    const auto count = end - begin;
+    std::vector<read_order::Location> locations;
+    locations.reserve(count);
+    for (size_t i = begin; i < end; ++i)
+        locations.push_back(from.read_location(files[i].path));
+    const auto order = read_order::schedule(locations);
+
+    // 按逻辑顺序预留位置
+    const auto base = buffer_.size();
+    std::vector<size_t> offsets(count);
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        offsets[i] = base + total;
+        total += files[begin + i].size;
+    }
+    buffer_.resize(base + total);
+
+    // 按物理顺序读入各自的位置
+    std::vector<std::unique_ptr<FileEntityMeta>> metas(count);
+    for (const auto i : order)
+    {
+        TRACE_SPAN(Controller, "batcher.read");
+        const auto file = from.get_file(files[begin + i].path);
+        if (!file)
+            continue;
+        const auto capacity = files[begin + i].size;
+        size_t done = 0;
+        while (done < capacity)
+        {
+            const auto n = file->read_into(buffer_.data() + offsets[i] + done, capacity - done);
+            if (n == 0)
+                break;
+            done += n;
+        }
+        file->close();
+        if (file->failed())
+            continue;
+        metas[i] = std::make_unique<FileEntityMeta>(file->get_meta());
+        metas[i]->size = done;
+    }
+
+    // 按逻辑顺序压实, 去掉打开或读取失败、读取不足留下的空隙
+    size_t cursor = base;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!metas[i])
+            continue;
+        if (cursor != offsets[i] && metas[i]->size)
+            std::memmove(buffer_.data() + cursor, buffer_.data() + offsets[i], metas[i]->size);
+        const auto size = metas[i]->size;
+        entries_.push_back({std::move(*metas[i]), cursor});
+        cursor += size;
+    }
+    buffer_.resize(cursor);
+}
+
+bool SmallFileBatcher::flush()
+{
+    if (entries_.empty())
+        return true;
+    TRACE_SPAN(Controller, "batcher.flush");
+    std::vector<BatchedReadableFile> files;
+    files.reserve(entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i)
+    {
+        const auto end = i + 1 < entries_.size() ? entries_[i + 1].offset : buffer_.size();
+        files.emplace_back(entries_[i].meta, buffer_.data() + entries_[i].offset, end - entries_[i].offset);
+    }
+    std::vector<ReadableFile*> batch;
+    batch.reserve(files.size());
+    for (auto& file : files)
+        batch.push_back(&file);
+    const bool ok = to_.write_files(batch);
+    entries_.clear();
+    buffer_.clear();
+    return ok;
+}
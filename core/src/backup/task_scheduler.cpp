@@ -0,0 +1,205 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "backup/task_scheduler.h"
+
+#include <utility>
+
+#include "utils/trace.h"
+
+namespace
+{
+    // 堆顶为最大的文件, 大小相同时登记序号小的优先
+    bool smaller_or_later(const std::pair<size_t, TaskScheduler::Task>& a, const std::pair<size_t, TaskScheduler::Task>& b)
+    {
+        if (a.second.meta.size != b.second.meta.size)
+            return a.second.meta.size < b.second.meta.size;
+        return a.first > b.first;
+    }
+}
+
+TaskScheduler::TaskScheduler(const size_t small_threshold, const size_t chunk_bytes, const size_t window_chunks,
+                             std::function<void()> drained)
+    : small_threshold_(small_threshold), chunk_bytes_(chunk_bytes ? chunk_bytes : 1),
+      window_chunks_(window_chunks ? window_chunks : 1), drained_(std::move(drained))
+{
+}
+
+void TaskScheduler::add(const size_t source, const FileEntityMeta& meta, const bool chunked)
+{
+    {
+        std::lock_guard lock(mutex_);
+        Task task{source, meta, chunked, nullptr, 0};
+        ++outstanding_;
+        if (!chunked && meta.size <= small_threshold_)
+            small_.push(std::move(task));
+        else
+        {
+            large_.emplace_back(sequence_++, std::move(task));
+            std::push_heap(large_.begin(), large_.end(), smaller_or_later);
+        }
+    }
+    cv_.notify_one();
+}
+
+void TaskScheduler::finish()
+{
+    bool drained;
+    {
+        std::lock_guard lock(mutex_);
+        finished_ = true;
+        drained = take_drained();
+    }
+    cv_.notify_all();
+    if (drained && drained_)
+        drained_();
+}
+
+std::optional<TaskScheduler::Task> TaskScheduler::next(const Lane lane)
+{
+    std::unique_lock lock(mutex_);
+    while (true)
+    {
+        if (shutdown_)
+            return std::nullopt;
+        if (lane == Lane::Small && !small_.empty())
+            break;
+        if (auto task = claim_chunk())
+            return task;
+        // 大文件要等遍历结束、知道全部大小之后才开始
+        if (finished_ && !large_.empty())
+        {
+            std::pop_heap(large_.begin(), large_.end(), smaller_or_later);
+            auto task = std::move(large_.back().second);
+            large_.pop_back();
+            return task;
+        }
+        if (!small_.empty())
+            break;
+        cv_.wait(lock);
+    }
+    auto task = std::move(small_.front());
+    small_.pop();
+    return task;
+}
+
+void TaskScheduler::complete()
+{
+    bool drained;
+    {
+        std::lock_guard lock(mutex_);
+        --outstanding_;
+        drained = take_drained();
+    }
+    if (drained && drained_)
+        drained_();
+}
+
+void TaskScheduler::shutdown()
+{
+    {
+        std::lock_guard lock(mutex_);
+        shutdown_ = true;
+    }
+    cv_.notify_all();
+}
+
+std::shared_ptr<TaskScheduler::ChunkStream> TaskScheduler::open_stream(const Task& task) const
+{
+    auto stream = std::make_shared<ChunkStream>();
+    stream->source = task.source;
+    stream->path = task.meta.path;
+    stream->size = task.meta.size;
+    stream->chunk_bytes = chunk_bytes_;
+    stream->chunks = static_cast<size_t>((task.meta.size + chunk_bytes_ - 1) / chunk_bytes_);
+    return stream;
+}
+
+void TaskScheduler::activate(const std::shared_ptr<ChunkStream>& stream)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (stream->active)
+            return;
+        stream->active = true;
+        active_.push_back(stream);
+    }
+    cv_.notify_all();
+}
+
+void TaskScheduler::release(const std::shared_ptr<ChunkStream>& stream)
+{
+    std::lock_guard lock(mutex_);
+    stream->active = false;
+    stream->ready.clear();
+    active_.erase(std::remove(active_.begin(), active_.end(), stream), active_.end());
+}
+
+void TaskScheduler::put(const std::shared_ptr<ChunkStream>& stream, const size_t chunk, std::vector<std::byte> data)
+{
+    {
+        std::lock_guard lock(mutex_);
+        // 写出已经放弃该文件
+        if (!stream->active)
+            return;
+        stream->ready.emplace(chunk, std::move(data));
+    }
+    cv_.notify_all();
+}
+
+std::optional<std::vector<std::byte>> TaskScheduler::take(const std::shared_ptr<ChunkStream>& stream,
+                                                          const std::function<std::vector<std::byte>(size_t)>& read_inline)
+{
+    TRACE_SPAN(Controller, "scheduler.take");
+    std::unique_lock lock(mutex_);
+    const auto chunk = stream->next_take;
+    if (chunk >= stream->chunks)
+        return std::nullopt;
+    std::vector<std::byte> data;
+    if (stream->next_claim == chunk)
+    {
+        // 没有空闲的读取线程领取它, 由写出线程自己读
+        ++stream->next_claim;
+        lock.unlock();
+        data = read_inline(chunk);
+        lock.lock();
+    }
+    else
+    {
+        cv_.wait(lock, [&] { return shutdown_ || stream->ready.count(chunk); });
+        const auto it = stream->ready.find(chunk);
+        if (it == stream->ready.end())
+            return std::nullopt;
+        data = std::move(it->second);
+        stream->ready.erase(it);
+    }
+    ++stream->next_take;
+    lock.unlock();
+    // 窗口前移, 读取线程可以领取后面的分块
+    cv_.notify_all();
+    return data;
+}
+
+std::optional<TaskScheduler::Task> TaskScheduler::claim_chunk()
+{
+    for (const auto& stream : active_)
+    {
+        if (stream->next_claim < stream->chunks && stream->next_claim < stream->next_take + window_chunks_)
+        {
+            Task task;
+            task.source = stream->source;
+            task.stream = stream;
+            task.chunk = stream->next_claim++;
+            return task;
+        }
+    }
+    return std::nullopt;
+}
+
+bool TaskScheduler::take_drained()
+{
+    if (!finished_ || outstanding_ || drained_called_)
+        return false;
+    drained_called_ = true;
+    return true;
+}
@@ -0,0 +1,825 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "compress/deflate.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "utils/trace.h"
+
+namespace compress::deflate
+{
+    namespace
+    {
+        constexpr size_t WINDOW_MASK = WINDOW_SIZE - 1;
+        constexpr size_t HASH_BITS = 15;
+        constexpr size_t HASH_SIZE = size_t{1} << HASH_BITS;
+        constexpr size_t STORED_BLOCK_MAX = 65535;
+        // 一个块最多的记号数与原始字节数, 达到后结束当前块并重新统计频率
+        constexpr size_t BLOCK_TOKENS = 16384;
+        constexpr size_t BLOCK_BYTES = 256 * 1024;
+        // 超过该距离的 3 字节匹配不如字面量划算
+        constexpr size_t TOO_FAR = 4096;
+
+        constexpr uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                              35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                              3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        constexpr uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                                8193, 12289, 16385, 24577};
+        constexpr uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        // 码长码的码长按此顺序写出
+        constexpr uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        // 各级别的搜索参数: 哈希链最多比较次数, 足够长就停止搜索的匹配长度, 是否惰性匹配
+        struct LevelConfig
+        {
+            size_t max_chain;
+            size_t nice_length;
+            bool lazy;
+        };
+        constexpr LevelConfig LEVELS[10] = {
+            {0, 0, false},
+            {4, 8, false}, {8, 16, false}, {16, 32, false},
+            {16, 16, true}, {32, 32, true}, {128, 128, true},
+            {256, MAX_MATCH, true}, {1024, MAX_MATCH, true}, {4096, MAX_MATCH, true},
+        };
+
+        // 长度(3-258)与距离(1-32768)到码号的查找表
+        struct CodeTables
+        {
+            uint8_t length_code[MAX_MATCH + 1] = {};
+            uint8_t distance_code[512] = {}; // 距离 <= 256 按 d - 1, 更大的按 256 + ((d - 1) >> 7)
+            CodeTables()
+            {
+                for (uint8_t code = 0; code < 29; code++)
+                {
+                    const size_t end = code == 28 ? MAX_MATCH + 1 : LENGTH_BASE[code + 1];
+                    for (size_t length = LENGTH_BASE[code]; length < end; length++)
+                        length_code[length] = code;
+                }
+                // 258 只能用码 285, 不能用 284 加满额外位
+                length_code[MAX_MATCH] = 28;
+                for (uint8_t code = 0; code < 30; code++)
+                {
+                    const size_t end = code == 29 ? WINDOW_SIZE + 1 : DISTANCE_BASE[code + 1];
+                    for (size_t distance = DISTANCE_BASE[code]; distance < end; distance++)
+                    {
+                        if (distance <= 256)
+                            distance_code[distance - 1] = code;
+                        else
+                            distance_code[256 + ((distance - 1) >> 7)] = code;
+                    }
+                }
+            }
+            [[nodiscard]] uint8_t distance(const size_t d) const
+            {
+                return d <= 256 ? distance_code[d - 1] : distance_code[256 + ((d - 1) >> 7)];
+            }
+        };
+        const CodeTables& code_tables()
+        {
+            static const CodeTables tables;
+            return tables;
+        }
+
+        std::vector<uint8_t> fixed_literal_lengths()
+        {
+            std::vector<uint8_t> lens(288);
+            std::fill(lens.begin(), lens.begin() + 144, 8);
+            std::fill(lens.begin() + 144, lens.begin() + 256, 9);
+            std::fill(lens.begin() + 256, lens.begin() + 280, 7);
+            std::fill(lens.begin() + 280, lens.end(), 8);
+            return lens;
+        }
+
+        // 码长序列的游程编码: (码长码, 额外位的值)
+        std::vector<std::pair<uint8_t, uint8_t>> encode_code_lengths(const std::vector<uint8_t>& lens)
+        {
+            std::vector<std::pair<uint8_t, uint8_t>> symbols;
+            for (size_t i = 0; i < lens.size();)
+            {
+                const uint8_t value = lens[i];
+                size_t run = 1;
+                while (i + run < lens.size() && lens[i + run] == value)
+                    ++run;
+                i += run;
+                if (value == 0)
+                {
+                    while (run >= 11)
+                    {
+                        const auto n = std::min<size_t>(run, 138);
+                        symbols.emplace_back(18, static_cast<uint8_t>(n - 11));
+                        run -= n;
+                    }
+                    if (run >= 3)
+                    {
+                        symbols.emplace_back(17, static_cast<uint8_t>(run - 3));
+                        run = 0;
+                    }
+                }
+                else
+                {
+                    symbols.emplace_back(value, 0);
+                    --run;
+                    while (run >= 3)
+                    {
+                        const auto n = std::min<size_t>(run, 6);
+                        symbols.emplace_back(16, static_cast<uint8_t>(n - 3));
+                        run -= n;
+                    }
+                }
+                for (; run > 0; --run)
+                    symbols.emplace_back(value, 0);
+            }
+            return symbols;
+        }
+
+        constexpr int code_length_extra(const uint8_t symbol)
+        {
+            return symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0;
+        }
+    }
+
+    // ---------------------------------------------------------------- Deflater
+
+    Deflater::Deflater(const int level)
+        : level_(std::clamp(level, 0, 9)),
+          max_chain_(LEVELS[level_].max_chain),
+          nice_length_(LEVELS[level_].nice_length),
+          lazy_(LEVELS[level_].lazy)
+    {
+        if (level_ > 0)
+        {
+            head_.assign(HASH_SIZE, -1);
+            prev_.assign(WINDOW_SIZE, -1);
+        }
+    }
+
+    void Deflater::update(const std::byte* data, const size_t size, std::vector<std::byte>& out)
+    {
+        if (finished_ || size == 0)
+            return;
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+        compress(false, out);
+    }
+
+    void Deflater::finish(std::vector<std::byte>& out)
+    {
+        if (finished_)
+            return;
+        compress(true, out);
+        emit_block(true, out);
+        align(out);
+        finished_ = true;
+    }
+
+    void Deflater::flush(std::vector<std::byte>& out)
+    {
+        if (finished_)
+            return;
+        compress(true, out);
+        if (covered_ > block_start_)
+            emit_block(false, out);
+        // 空的存储块: BFINAL=0, BTYPE=00, 对齐后 LEN=0, NLEN=0xFFFF
+        put_bits(0, 3, out);
+        align(out);
+        put_bits(0, 16, out);
+        put_bits(0xFFFF, 16, out);
+    }
+
+    void Deflater::set_dictionary(const std::byte* data, size_t size)
+    {
+        if (finished_ || !buffer_.empty())
+            return;
+        if (size > WINDOW_SIZE)
+        {
+            data += size - WINDOW_SIZE;
+            size = WINDOW_SIZE;
+        }
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+        buffer_.assign(bytes, bytes + size);
+        if (level_ > 0)
+            for (uint64_t p = 0; p + MIN_MATCH <= size; p++)
+                insert(p);
+        pos_ = block_start_ = covered_ = size;
+    }
+
+    void Deflater::insert(const uint64_t position)
+    {
+        const uint8_t* p = &buffer_[position - buffer_start_];
+        const uint32_t key = static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16;
+        const size_t hash = (key * 2654435761u) >> (32 - HASH_BITS);
+        prev_[position & WINDOW_MASK] = head_[hash];
+        head_[hash] = static_cast<int64_t>(position);
+    }
+
+    size_t Deflater::longest_match(const uint64_t position, const size_t limit, size_t& distance) const
+    {
+        const uint8_t* p = &buffer_[position - buffer_start_];
+        const uint32_t key = static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16;
+        const size_t hash = (key * 2654435761u) >> (32 - HASH_BITS);
+        const auto lowest = static_cast<int64_t>(std::max<uint64_t>(buffer_start_, position > WINDOW_SIZE ? position - WINDOW_SIZE : 0));
+        size_t best = MIN_MATCH - 1;
+        size_t chain = max_chain_;
+        for (int64_t candidate = head_[hash]; candidate >= lowest && candidate < static_cast<int64_t>(position) && chain--;)
+        {
+            const uint8_t* c = &buffer_[candidate - buffer_start_];
+            // 先比较当前最长长度处的字节, 大多数候选在这里就被排除
+            if (c[best] == p[best] && c[0] == p[0] && c[1] == p[1])
+            {
+                size_t length = 2;
+                while (length < limit && c[length] == p[length])
+                    ++length;
+                if (length > best)
+                {
+                    best = length;
+                    distance = position - candidate;
+                    if (length >= nice_length_ || length >= limit)
+                        break;
+                }
+            }
+            const int64_t next = prev_[candidate & WINDOW_MASK];
+            // 槽位可能已被更早的位置复用, 只接受更早的候选以保证终止
+            if (next >= candidate)
+                break;
+            candidate = next;
+        }
+        return best >= MIN_MATCH ? best : 0;
+    }
+
+    void Deflater::compress(const bool flush, std::vector<std::byte>& out)
+    {
+        TRACE_SPAN(Compress, "deflate.compress");
+        const uint64_t end = buffer_start_ + buffer_.size();
+        // 不是最后一次调用时保留 MAX_MATCH 字节的前瞻, 匹配长度不受输入分块影响
+        const uint64_t limit = flush ? end : (end > MAX_MATCH ? end - MAX_MATCH : 0);
+        if (level_ == 0)
+        {
+            while (pos_ < limit)
+            {
+                pos_ = std::min<uint64_t>(limit, block_start_ + BLOCK_BYTES);
+                covered_ = pos_;
+                if (covered_ - block_start_ >= BLOCK_BYTES)
+                    emit_block(false, out);
+            }
+        }
+        const auto push = [&](const Token token, const size_t length)
+        {
+            tokens_.push_back(token);
+            covered_ += length;
+            if (tokens_.size() >= BLOCK_TOKENS || covered_ - block_start_ >= BLOCK_BYTES)
+                emit_block(false, out);
+        };
+        const auto literal = [&](const uint64_t position)
+        {
+            push({0, buffer_[position - buffer_start_]}, 1);
+        };
+        while (level_ > 0 && pos_ < limit)
+        {
+            const size_t available = static_cast<size_t>(end - pos_);
+            const bool can_hash = available >= MIN_MATCH;
+            size_t distance = 0, length = 0;
+            if (!lazy_)
+            {
+                if (can_hash)
+                    length = longest_match(pos_, std::min(available, MAX_MATCH), distance);
+                if (length == MIN_MATCH && distance > TOO_FAR)
+                    length = 0;
+                if (length)
+                {
+                    push({static_cast<uint16_t>(length), static_cast<uint16_t>(distance)}, length);
+                    for (size_t i = 0; i < length; i++)
+                        if (end - (pos_ + i) >= MIN_MATCH)
+                            insert(pos_ + i);
+                    pos_ += length;
+                }
+                else
+                {
+                    if (can_hash)
+                        insert(pos_);
+                    literal(pos_);
+                    ++pos_;
+                }
+                continue;
+            }
+            // 惰性匹配: 当前位置的匹配不比前一位置长时才输出前一位置的匹配
+            if (can_hash && !(match_available_ && prev_length_ >= nice_length_))
+            {
+                length = longest_match(pos_, std::min(available, MAX_MATCH), distance);
+                if (length == MIN_MATCH && distance > TOO_FAR)
+                    length = 0;
+            }
+            if (can_hash)
+                insert(pos_);
+            if (match_available_ && prev_length_ >= MIN_MATCH && length <= prev_length_)
+            {
+                const uint64_t match_start = pos_ - 1;
+                push({static_cast<uint16_t>(prev_length_), static_cast<uint16_t>(prev_distance_)}, prev_length_);
+                for (uint64_t p = pos_ + 1; p < match_start + prev_length_; p++)
+                    if (end - p >= MIN_MATCH)
+                        insert(p);
+                pos_ = match_start + prev_length_;
+                match_available_ = false;
+            }
+            else
+            {
+                if (match_available_)
+                    literal(pos_ - 1);
+                prev_length_ = length;
+                prev_distance_ = distance;
+                match_available_ = true;
+                ++pos_;
+            }
+        }
+        if (flush && match_available_)
+        {
+            // 最后一个位置之后没有更长的匹配
+            if (prev_length_ >= MIN_MATCH)
+                push({static_cast<uint16_t>(prev_length_), static_cast<uint16_t>(prev_distance_)}, prev_length_);
+            else
+                literal(pos_ - 1);
+            match_available_ = false;
+        }
+        if (flush)
+            return;
+        // 丢弃窗口之外且已经编码的数据; 攒够一定量再移动, 避免每次调用都搬移整个缓冲区
+        const uint64_t pending = std::min(block_start_, pos_ - (match_available_ ? 1 : 0));
+        if (pending > buffer_start_ + WINDOW_SIZE + BLOCK_BYTES)
+        {
+            const uint64_t keep = pending - WINDOW_SIZE;
+            buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(keep - buffer_start_));
+            buffer_start_ = keep;
+        }
+    }
+
+    void Deflater::put_bits(const uint32_t value, const int count, std::vector<std::byte>& out)
+    {
+        bit_buffer_ |= static_cast<uint64_t>(value) << bit_count_;
+        bit_count_ += count;
+        while (bit_count_ >= 8)
+        {
+            out.push_back(static_cast<std::byte>(bit_buffer_ & 0xFF));
+            bit_buffer_ >>= 8;
+            bit_count_ -= 8;
+        }
+    }
+
+    void Deflater::align(std::vector<std::byte>& out)
+    {
+        if (bit_count_ > 0)
+            out.push_back(static_cast<std::byte>(bit_buffer_ & 0xFF));
+        bit_buffer_ = 0;
+        bit_count_ = 0;
+    }
+
+    void Deflater::emit_block(const bool final, std::vector<std::byte>& out)
+    {
+        TRACE_SPAN(Compress, "deflate.block");
+        const auto& tables = code_tables();
+        const uint8_t* raw = buffer_.data() + (block_start_ - buffer_start_);
+        const size_t raw_size = static_cast<size_t>(covered_ - block_start_);
+
+        // 统计频率
+        std::vector<uint32_t> literal_freqs(286, 0), distance_freqs(30, 0);
+        uint64_t extra_bits = 0;
+        for (const auto& [length, value] : tokens_)
+        {
+            if (!length)
+            {
+                ++literal_freqs[value];
+                continue;
+            }
+            const auto length_code = tables.length_code[length];
+            const auto distance_code = tables.distance(value);
+            ++literal_freqs[257 + length_code];
+            ++distance_freqs[distance_code];
+            extra_bits += LENGTH_EXTRA[length_code] + DISTANCE_EXTRA[distance_code];
+        }
+        literal_freqs[256] = 1;
+
+        auto literal_lens = huffman::build_lengths(literal_freqs, 15);
+        auto distance_lens = huffman::build_lengths(distance_freqs, 15);
+        // 没有匹配时仍需要一个距离码
+        if (std::all_of(distance_lens.begin(), distance_lens.end(), [](const uint8_t l) { return !l; }))
+            distance_lens[0] = 1;
+        size_t hlit = 286, hdist = 30;
+        while (hlit > 257 && !literal_lens[hlit - 1])
+            --hlit;
+        while (hdist > 1 && !distance_lens[hdist - 1])
+            --hdist;
+        std::vector<uint8_t> all_lens(literal_lens.begin(), literal_lens.begin() + static_cast<std::ptrdiff_t>(hlit));
+        all_lens.insert(all_lens.end(), distance_lens.begin(), distance_lens.begin() + static_cast<std::ptrdiff_t>(hdist));
+        const auto cl_symbols = encode_code_lengths(all_lens);
+        std::vector<uint32_t> cl_freqs(19, 0);
+        for (const auto& symbol : cl_symbols)
+            ++cl_freqs[symbol.first];
+        const auto cl_lens = huffman::build_lengths(cl_freqs, 7);
+        size_t hclen = 19;
+        while (hclen > 4 && !cl_lens[CODE_LENGTH_ORDER[hclen - 1]])
+            --hclen;
+
+        // 三种编码的位数
+        static const auto fixed_literal = fixed_literal_lengths();
+        uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * hclen + extra_bits;
+        uint64_t fixed_bits = 3 + extra_bits;
+        for (const auto& [symbol, extra] : cl_symbols)
+            dynamic_bits += cl_lens[symbol] + code_length_extra(symbol);
+        for (size_t i = 0; i < 286; i++)
+        {
+            dynamic_bits += static_cast<uint64_t>(literal_freqs[i]) * literal_lens[i];
+            fixed_bits += static_cast<uint64_t>(literal_freqs[i]) * fixed_literal[i];
+        }
+        for (size_t i = 0; i < 30; i++)
+        {
+            dynamic_bits += static_cast<uint64_t>(distance_freqs[i]) * distance_lens[i];
+            fixed_bits += static_cast<uint64_t>(distance_freqs[i]) * 5;
+        }
+        const size_t stored_blocks = std::max<size_t>(1, (raw_size + STORED_BLOCK_MAX - 1) / STORED_BLOCK_MAX);
+        const uint64_t stored_bits = stored_blocks * (3 + 7 + 32) + static_cast<uint64_t>(raw_size) * 8;
+
+        if (level_ == 0 || (stored_bits < dynamic_bits && stored_bits < fixed_bits))
+        {
+            size_t offset = 0;
+            do
+            {
+                const size_t n = std::min(raw_size - offset, STORED_BLOCK_MAX);
+                put_bits(final && offset + n == raw_size ? 1 : 0, 1, out);
+                put_bits(0, 2, out);
+                align(out);
+                put_bits(static_cast<uint32_t>(n), 16, out);
+                put_bits(static_cast<uint32_t>(~n & 0xFFFF), 16, out);
+                out.insert(out.end(), reinterpret_cast<const std::byte*>(raw + offset), reinterpret_cast<const std::byte*>(raw + offset + n));
+                offset += n;
+            } while (offset < raw_size);
+        }
+        else
+        {
+            const bool dynamic = dynamic_bits < fixed_bits;
+            std::vector<uint8_t> fixed_distance(30, 5);
+            if (!dynamic)
+            {
+                literal_lens = fixed_literal;
+                distance_lens = fixed_distance;
+            }
+            put_bits(final ? 1 : 0, 1, out);
+            put_bits(dynamic ? 2 : 1, 2, out);
+            const auto literal_codes = huffman::canonical_codes(literal_lens, true);
+            const auto distance_codes = huffman::canonical_codes(distance_lens, true);
+            if (dynamic)
+            {
+                const auto cl_codes = huffman::canonical_codes(cl_lens, true);
+                put_bits(static_cast<uint32_t>(hlit - 257), 5, out);
+                put_bits(static_cast<uint32_t>(hdist - 1), 5, out);
+                put_bits(static_cast<uint32_t>(hclen - 4), 4, out);
+                for (size_t i = 0; i < hclen; i++)
+                    put_bits(cl_lens[CODE_LENGTH_ORDER[i]], 3, out);
+                for (const auto& [symbol, extra] : cl_symbols)
+                {
+                    put_bits(cl_codes[symbol], cl_lens[symbol], out);
+                    if (const int bits = code_length_extra(symbol))
+                        put_bits(extra, bits, out);
+                }
+            }
+            for (const auto& [length, value] : tokens_)
+            {
+                if (!length)
+                {
+                    put_bits(literal_codes[value], literal_lens[value], out);
+                    continue;
+                }
+                const auto length_code = tables.length_code[length];
+                const auto distance_code = tables.distance(value);
+                put_bits(literal_codes[257 + length_code], literal_lens[257 + length_code], out);
+                put_bits(length - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code], out);
+                put_bits(distance_codes[distance_code], distance_lens[distance_code], out);
+                put_bits(value - DISTANCE_BASE[distance_code], DISTANCE_EXTRA[distance_code], out);
+            }
+            put_bits(literal_codes[256], literal_lens[256], out);
+        }
+        tokens_.clear();
+        block_start_ = covered_;
+    }
+
+    // ---------------------------------------------------------------- Inflater
+
+    Inflater::Inflater(Source source)
+        : source_(std::move(source)), input_(64 * 1024), window_(WINDOW_SIZE)
+    {
+    }
+
+    bool Inflater::fill_input()
+    {
+        if (input_eof_)
+            return false;
+        input_pos_ = 0;
+        input_end_ = source_(input_.data(), input_.size());
+        if (input_end_ == 0)
+        {
+            input_eof_ = true;
+            return false;
+        }
+        return true;
+    }
+
+    void Inflater::refill()
+    {
+        while (bit_count_ <= 56)
+        {
+            if (input_pos_ == input_end_ && !fill_input())
+                return;
+            bit_buffer_ |= static_cast<uint64_t>(input_[input_pos_++]) << bit_count_;
+            bit_count_ += 8;
+        }
+    }
+
+    uint32_t Inflater::peek(const int count)
+    {
+        if (bit_count_ < count)
+            refill();
+        // 输入不足时高位补 0, 真正取用时由 consume 报错
+        return static_cast<uint32_t>(bit_buffer_ & ((uint64_t{1} << count) - 1));
+    }
+
+    void Inflater::consume(const int count)
+    {
+        if (count > bit_count_)
+        {
+            state_ = State::Error;
+            bit_buffer_ = 0;
+            bit_count_ = 0;
+            return;
+        }
+        bit_buffer_ >>= count;
+        bit_count_ -= count;
+    }
+
+    bool Inflater::read_header()
+    {
+        const auto bits = [this](const int count)
+        {
+            const auto value = peek(count);
+            consume(count);
+            return value;
+        };
+        last_block_ = bits(1) != 0;
+        const auto type = bits(2);
+        if (state_ == State::Error)
+            return false;
+        if (type == 0)
+        {
+            // 存储块从下一个字节边界开始
+            consume(bit_count_ % 8);
+            const auto length = bits(16);
+            const auto inverse = bits(16);
+            if (state_ == State::Error || (length ^ 0xFFFF) != inverse)
+                return false;
+            stored_left_ = length;
+            state_ = State::Stored;
+            return true;
+        }
+        if (type == 1)
+        {
+            static const auto fixed_literal = fixed_literal_lengths();
+            static const std::vector<uint8_t> fixed_distance(32, 5);
+            if (!literal_.build(fixed_literal.data(), fixed_literal.size()) ||
+                !distance_.build(fixed_distance.data(), fixed_distance.size()))
+                return false;
+        }
+        else if (type != 2 || !read_dynamic_tables())
+        {
+            return false;
+        }
+        state_ = State::Codes;
+        return true;
+    }
+
+    bool Inflater::read_dynamic_tables()
+    {
+        const auto bits = [this](const int count)
+        {
+            const auto value = peek(count);
+            consume(count);
+            return value;
+        };
+        const size_t hlit = bits(5) + 257, hdist = bits(5) + 1, hclen = bits(4) + 4;
+        if (hlit > 286 || hdist > 30)
+            return false;
+        uint8_t cl_lens[19] = {};
+        for (size_t i = 0; i < hclen; i++)
+            cl_lens[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(bits(3));
+        huffman::LsbDecoder<19, 7, 7> cl_decoder;
+        if (state_ == State::Error || !cl_decoder.build(cl_lens, 19))
+            return false;
+        uint8_t lens[286 + 30] = {};
+        const size_t total = hlit + hdist;
+        for (size_t n = 0; n < total;)
+        {
+            const int symbol = cl_decoder.decode(*this);
+            if (symbol < 0 || state_ == State::Error)
+                return false;
+            if (symbol < 16)
+            {
+                lens[n++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            uint8_t value = 0;
+            size_t repeat;
+            if (symbol == 16)
+            {
+                if (n == 0)
+                    return false;
+                value = lens[n - 1];
+                repeat = 3 + bits(2);
+            }
+            else if (symbol == 17)
+                repeat = 3 + bits(3);
+            else
+                repeat = 11 + bits(7);
+            if (state_ == State::Error || n + repeat > total)
+                return false;
+            std::fill_n(lens + n, repeat, value);
+            n += repeat;
+        }
+        // 块必须能够结束
+        if (!lens[256])
+            return false;
+        return literal_.build(lens, hlit) && distance_.build(lens + hlit, hdist);
+    }
+
+    void Inflater::push_window(const std::byte* data, size_t size)
+    {
+        total_out_ += size;
+        if (size >= WINDOW_SIZE)
+        {
+            std::memcpy(window_.data(), data + size - WINDOW_SIZE, WINDOW_SIZE);
+            window_pos_ = 0;
+            return;
+        }
+        const size_t first = std::min(size, WINDOW_SIZE - window_pos_);
+        std::memcpy(window_.data() + window_pos_, data, first);
+        std::memcpy(window_.data(), data + first, size - first);
+        window_pos_ = (window_pos_ + size) & WINDOW_MASK;
+    }
+
+    size_t Inflater::copy_match(std::byte* out, const size_t size)
+    {
+        const size_t n = std::min(copy_length_, size);
+        // 距离可能小于长度(重复模式), 只能逐字节复制
+        for (size_t i = 0; i < n; i++)
+        {
+            const auto value = window_[(window_pos_ - copy_distance_) & WINDOW_MASK];
+            out[i] = value;
+            window_[window_pos_] = value;
+            window_pos_ = (window_pos_ + 1) & WINDOW_MASK;
+        }
+        copy_length_ -= n;
+        total_out_ += n;
+        return n;
+    }
+
+    size_t Inflater::read_stored(std::byte* out, const size_t size)
+    {
+        size_t done = 0;
+        // 位缓冲中可能还预读了整字节
+        while (done < size && bit_count_ >= 8)
+        {
+            out[done++] = static_cast<std::byte>(bit_buffer_ & 0xFF);
+            bit_buffer_ >>= 8;
+            bit_count_ -= 8;
+        }
+        while (done < size)
+        {
+            if (input_pos_ == input_end_ && !fill_input())
+                break;
+            const size_t n = std::min(size - done, input_end_ - input_pos_);
+            std::memcpy(out + done, input_.data() + input_pos_, n);
+            input_pos_ += n;
+            done += n;
+        }
+        push_window(out, done);
+        return done;
+    }
+
+    size_t Inflater::read(std::byte* out, const size_t size)
+    {
+        TRACE_SPAN(Compress, "inflate.read");
+        size_t produced = 0;
+        while (produced < size && state_ != State::Done && state_ != State::Error)
+        {
+            if (copy_length_)
+            {
+                produced += copy_match(out + produced, size - produced);
+                continue;
+            }
+            switch (state_)
+            {
+            case State::Header:
+                if (last_block_)
+                    state_ = State::Done;
+                else if (!read_header())
+                    state_ = State::Error;
+                break;
+            case State::Stored:
+            {
+                if (!stored_left_)
+                {
+                    state_ = State::Header;
+                    break;
+                }
+                const size_t n = read_stored(out + produced, std::min(size - produced, stored_left_));
+                if (!n)
+                {
+                    state_ = State::Error;
+                    break;
+                }
+                produced += n;
+                stored_left_ -= n;
+                break;
+            }
+            case State::Codes:
+            {
+                const int symbol = literal_.decode(*this);
+                if (symbol < 0 || state_ == State::Error)
+                {
+                    state_ = State::Error;
+                    break;
+                }
+                if (symbol < 256)
+                {
+                    const auto value = static_cast<std::byte>(symbol);
+                    out[produced++] = value;
+                    window_[window_pos_] = value;
+                    window_pos_ = (window_pos_ + 1) & WINDOW_MASK;
+                    ++total_out_;
+                    break;
+                }
+                if (symbol == 256)
+                {
+                    state_ = State::Header;
+                    break;
+                }
+                const int length_code = symbol - 257;
+                if (length_code >= 29)
+                {
+                    state_ = State::Error;
+                    break;
+                }
+                const uint32_t length_extra = peek(LENGTH_EXTRA[length_code]);
+                consume(LENGTH_EXTRA[length_code]);
+                const int distance_code = distance_.decode(*this);
+                if (distance_code < 0 || distance_code >= 30 || state_ == State::Error)
+                {
+                    state_ = State::Error;
+                    break;
+                }
+                const uint32_t distance_extra = peek(DISTANCE_EXTRA[distance_code]);
+                consume(DISTANCE_EXTRA[distance_code]);
+                copy_length_ = LENGTH_BASE[length_code] + length_extra;
+                copy_distance_ = DISTANCE_BASE[distance_code] + distance_extra;
+                // 不能引用流开始之前的数据
+                if (state_ == State::Error || copy_distance_ > total_out_)
+                {
+                    copy_length_ = 0;
+                    state_ = State::Error;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        return produced;
+    }
+
+    // ---------------------------------------------------------------- 一次性接口
+
+    std::vector<std::byte> compress(const std::byte* data, const size_t size, const int level)
+    {
+        std::vector<std::byte> out;
+        Deflater deflater(level);
+        deflater.update(data, size, out);
+        deflater.finish(out);
+        return out;
+    }
+
+    bool decompress(const std::byte* data, const size_t size, std::vector<std::byte>& out)
+    {
+        size_t offset = 0;
+        Inflater inflater([&](std::byte* buffer, const size_t capacity)
+        {
+            const size_t n = std::min(capacity, size - offset);
+            std::memcpy(buffer, data + offset, n);
+            offset += n;
+            return n;
+        });
+        std::byte chunk[64 * 1024];
+        while (const size_t n = inflater.read(chunk, sizeof(chunk)))
+            out.insert(out.end(), chunk, chunk + n);
+        return inflater.done();
+    }
+}
@@ -0,0 +1,346 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "compress/frames.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "utils/crc.h"
+#include "utils/trace.h"
+
+namespace compress::frames
+{
+    namespace
+    {
+        constexpr size_t MAX_FRAME_SIZE = size_t{1} << 30;
+        constexpr size_t GZIP_HEADER_SIZE = 10;
+        constexpr size_t GZIP_TRAILER_SIZE = 8;
+        constexpr uint8_t FLAG_EXTRA = 0x04;
+        // FEXTRA 子字段: 'B' 'T' 为帧表, 'B' 'L' 为定位信息
+        constexpr uint8_t SUBFIELD_ID = 'B';
+        constexpr uint8_t SUBFIELD_TABLE = 'T';
+        constexpr uint8_t SUBFIELD_LOCATOR = 'L';
+        constexpr size_t TABLE_ENTRY_SIZE = 8;   // 压缩大小 + 未压缩大小
+        constexpr size_t TABLE_ENTRIES_PER_MEMBER = (65535 - 4) / TABLE_ENTRY_SIZE;
+        constexpr size_t LOCATOR_PAYLOAD_SIZE = 28; // 帧表位置 + 帧数 + 未压缩总大小 + 帧表 CRC32
+        // 空 gzip 成员: 头部 + XLEN + 子字段头 + 负载 + 空的固定哈夫曼块 + CRC32 和 ISIZE
+        constexpr size_t empty_member_size(const size_t payload) { return GZIP_HEADER_SIZE + 2 + 4 + payload + 2 + GZIP_TRAILER_SIZE; }
+        constexpr size_t LOCATOR_SIZE = empty_member_size(LOCATOR_PAYLOAD_SIZE);
+
+        void put_le(std::vector<uint8_t>& out, uint64_t value, const int bytes)
+        {
+            for (int i = 0; i < bytes; ++i, value >>= 8)
+                out.push_back(static_cast<uint8_t>(value & 0xFF));
+        }
+        uint64_t get_le(const uint8_t* data, const int bytes)
+        {
+            uint64_t value = 0;
+            for (int i = bytes; i-- > 0;)
+                value = (value << 8) | data[i];
+            return value;
+        }
+        void put_header(std::vector<uint8_t>& out, const uint8_t flags)
+        {
+            // 方法 8, 无文件名和时间戳, OS 为 255(未知)
+            const uint8_t header[GZIP_HEADER_SIZE] = {0x1F, 0x8B, 8, flags, 0, 0, 0, 0, 0, 0xFF};
+            out.insert(out.end(), header, header + GZIP_HEADER_SIZE);
+        }
+        bool check_header(const uint8_t* data, const uint8_t flags)
+        {
+            return data[0] == 0x1F && data[1] == 0x8B && data[2] == 8 && data[3] == flags;
+        }
+        // 解压后为空、只在 FEXTRA 中携带数据的 gzip 成员
+        std::vector<uint8_t> empty_member(const uint8_t subfield, const std::vector<uint8_t>& payload)
+        {
+            std::vector<uint8_t> member;
+            member.reserve(empty_member_size(payload.size()));
+            put_header(member, FLAG_EXTRA);
+            put_le(member, 4 + payload.size(), 2);
+            member.push_back(SUBFIELD_ID);
+            member.push_back(subfield);
+            put_le(member, payload.size(), 2);
+            member.insert(member.end(), payload.begin(), payload.end());
+            member.push_back(0x03); // 最后一个块, 固定哈夫曼, 只有块结束码
+            member.push_back(0x00);
+            put_le(member, 0, 8);
+            return member;
+        }
+        // 解析 empty_member 写出的成员, 返回负载的起点
+        const uint8_t* parse_empty_member(const uint8_t* data, const size_t size, const uint8_t subfield, size_t& payload_size)
+        {
+            if (size < empty_member_size(0) || !check_header(data, FLAG_EXTRA))
+                return nullptr;
+            const auto extra_size = static_cast<size_t>(get_le(data + GZIP_HEADER_SIZE, 2));
+            payload_size = static_cast<size_t>(get_le(data + GZIP_HEADER_SIZE + 4, 2));
+            if (extra_size != payload_size + 4 || size < empty_member_size(payload_size) ||
+                data[GZIP_HEADER_SIZE + 2] != SUBFIELD_ID || data[GZIP_HEADER_SIZE + 3] != subfield)
+                return nullptr;
+            const uint8_t* tail = data + GZIP_HEADER_SIZE + 6 + payload_size;
+            if (tail[0] != 0x03 || tail[1] != 0x00 || get_le(tail + 2, 8) != 0)
+                return nullptr;
+            return data + GZIP_HEADER_SIZE + 6;
+        }
+        bool read_at(std::streambuf& source, const uint64_t offset, void* buffer, const size_t size)
+        {
+            if (source.pubseekpos(static_cast<std::streamoff>(offset), std::ios::in) != static_cast<std::streamoff>(offset))
+                return false;
+            return source.sgetn(static_cast<char*>(buffer), static_cast<std::streamsize>(size)) == static_cast<std::streamsize>(size);
+        }
+    }
+
+    FrameWriterBuf::FrameWriterBuf(std::streambuf& sink, const size_t frame_size, const int level)
+        : sink_(sink), level_(level)
+    {
+        buffer_.resize(frame_size == 0 ? DEFAULT_FRAME_SIZE : std::min(frame_size, MAX_FRAME_SIZE));
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    void FrameWriterBuf::write(const std::vector<uint8_t>& bytes)
+    {
+        if (failed_ || bytes.empty())
+            return;
+        if (sink_.sputn(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())) !=
+            static_cast<std::streamsize>(bytes.size()))
+            failed_ = true;
+        sink_offset_ += bytes.size();
+    }
+
+    void FrameWriterBuf::flush_frame()
+    {
+        const auto size = static_cast<size_t>(pptr() - pbase());
+        if (size == 0)
+            return;
+        TRACE_SPAN(Compress, "frames.compress");
+        const auto data = reinterpret_cast<const std::byte*>(pbase());
+        const auto compressed = deflate::compress(data, size, level_);
+        crc::CRC32 crc;
+        crc.update(data, size);
+
+        std::vector<uint8_t> member;
+        member.reserve(GZIP_HEADER_SIZE + compressed.size() + GZIP_TRAILER_SIZE);
+        put_header(member, 0);
+        const auto payload = reinterpret_cast<const uint8_t*>(compressed.data());
+        member.insert(member.end(), payload, payload + compressed.size());
+        put_le(member, crc.finalize(), 4);
+        put_le(member, size, 4);
+
+        frames_.push_back({position_, sink_offset_, static_cast<uint32_t>(size), static_cast<uint32_t>(member.size())});
+        write(member);
+        position_ += size;
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    FrameWriterBuf::int_type FrameWriterBuf::overflow(const int_type ch)
+    {
+        if (finished_ || failed_)
+            return traits_type::eof();
+        flush_frame();
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return failed_ ? traits_type::eof() : traits_type::not_eof(ch);
+    }
+
+    FrameWriterBuf::pos_type FrameWriterBuf::seekoff(const off_type off, const std::ios_base::seekdir dir, const std::ios_base::openmode which)
+    {
+        // 只支持查询当前位置
+        if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out))
+            return {off_type(-1)};
+        return {static_cast<off_type>(position_ + static_cast<uint64_t>(pptr() - pbase()))};
+    }
+
+    bool FrameWriterBuf::finish()
+    {
+        if (finished_)
+            return !failed_;
+        flush_frame();
+        finished_ = true;
+        setp(nullptr, nullptr);
+
+        const auto table_offset = sink_offset_;
+        crc::CRC32 crc;
+        // FEXTRA 最长 65535 字节, 帧表按此拆成多个成员; 没有帧时也写出一个空表
+        size_t first = 0;
+        do
+        {
+            std::vector<uint8_t> entries;
+            for (size_t i = first; i < std::min(frames_.size(), first + TABLE_ENTRIES_PER_MEMBER); ++i)
+            {
+                put_le(entries, frames_[i].compressed_size, 4);
+                put_le(entries, frames_[i].size, 4);
+            }
+            crc.update(entries.data(), entries.size());
+            write(empty_member(SUBFIELD_TABLE, entries));
+            first += TABLE_ENTRIES_PER_MEMBER;
+        } while (first < frames_.size());
+        std::vector<uint8_t> locator;
+        put_le(locator, table_offset, 8);
+        put_le(locator, frames_.size(), 8);
+        put_le(locator, position_, 8);
+        put_le(locator, crc.finalize(), 4);
+        write(empty_member(SUBFIELD_LOCATOR, locator));
+        if (sink_.pubsync() != 0)
+            failed_ = true;
+        return !failed_;
+    }
+
+    FrameReaderBuf::FrameReaderBuf(std::streambuf& source, std::vector<Frame> frames, const uint64_t size)
+        : source_(source), frames_(std::move(frames)), size_(size)
+    {
+        setg(nullptr, nullptr, nullptr);
+    }
+
+    std::unique_ptr<FrameReaderBuf> FrameReaderBuf::open(std::streambuf& source)
+    {
+        TRACE_SPAN(Compress, "frames.open");
+        const auto end = source.pubseekoff(0, std::ios::end, std::ios::in);
+        if (end < static_cast<std::streamoff>(LOCATOR_SIZE))
+            return nullptr;
+        const auto file_size = static_cast<uint64_t>(end);
+        uint8_t locator[LOCATOR_SIZE];
+        size_t payload_size = 0;
+        const uint8_t* payload = nullptr;
+        if (!read_at(source, file_size - LOCATOR_SIZE, locator, LOCATOR_SIZE) ||
+            !((payload = parse_empty_member(locator, LOCATOR_SIZE, SUBFIELD_LOCATOR, payload_size))) ||
+            payload_size != LOCATOR_PAYLOAD_SIZE)
+            return nullptr;
+        const auto table_offset = get_le(payload, 8);
+        const auto count = get_le(payload + 8, 8);
+        const auto size = get_le(payload + 16, 8);
+        const auto expected_crc = static_cast<uint32_t>(get_le(payload + 24, 4));
+        const auto table_end = file_size - LOCATOR_SIZE;
+        if (table_offset > table_end || count > (table_end - table_offset) / TABLE_ENTRY_SIZE)
+            return nullptr;
+
+        std::vector<uint8_t> table(static_cast<size_t>(table_end - table_offset));
+        if (!table.empty() && !read_at(source, table_offset, table.data(), table.size()))
+            return nullptr;
+        std::vector<Frame> frames;
+        frames.reserve(static_cast<size_t>(count));
+        crc::CRC32 crc;
+        uint64_t offset = 0, compressed_offset = 0;
+        for (size_t pos = 0; pos < table.size();)
+        {
+            const auto entries = parse_empty_member(table.data() + pos, table.size() - pos, SUBFIELD_TABLE, payload_size);
+            if (!entries || payload_size % TABLE_ENTRY_SIZE != 0)
+                return nullptr;
+            crc.update(entries, payload_size);
+            for (size_t i = 0; i < payload_size; i += TABLE_ENTRY_SIZE)
+            {
+                Frame frame;
+                frame.compressed_size = static_cast<uint32_t>(get_le(entries + i, 4));
+                frame.size = static_cast<uint32_t>(get_le(entries + i + 4, 4));
+                frame.offset = offset;
+                frame.compressed_offset = compressed_offset;
+                if (frame.size == 0 || frame.compressed_size < GZIP_HEADER_SIZE + GZIP_TRAILER_SIZE)
+                    return nullptr;
+                offset += frame.size;
+                compressed_offset += frame.compressed_size;
+                frames.push_back(frame);
+            }
+            pos += empty_member_size(payload_size);
+        }
+        if (frames.size() != count || offset != size || compressed_offset != table_offset || crc.finalize() != expected_crc)
+            return nullptr;
+        return std::unique_ptr<FrameReaderBuf>(new FrameReaderBuf(source, std::move(frames), size));
+    }
+
+    uint64_t FrameReaderBuf::tell() const
+    {
+        return eback() ? frames_[current_].offset + static_cast<uint64_t>(gptr() - eback()) : position_;
+    }
+
+    bool FrameReaderBuf::load(const size_t index)
+    {
+        TRACE_SPAN(Compress, "frames.load");
+        current_ = NO_FRAME;
+        const auto& frame = frames_[index];
+        std::vector<uint8_t> member(frame.compressed_size);
+        if (!read_at(source_, frame.compressed_offset, member.data(), member.size()) || !check_header(member.data(), 0))
+            return false;
+        data_.clear();
+        data_.reserve(frame.size);
+        const auto trailer = member.data() + member.size() - GZIP_TRAILER_SIZE;
+        if (!deflate::decompress(reinterpret_cast<const std::byte*>(member.data() + GZIP_HEADER_SIZE),
+                                 member.size() - GZIP_HEADER_SIZE - GZIP_TRAILER_SIZE, data_) ||
+            data_.size() != frame.size || get_le(trailer + 4, 4) != frame.size)
+            return false;
+        crc::CRC32 crc;
+        crc.update(data_.data(), data_.size());
+        if (crc.finalize() != static_cast<uint32_t>(get_le(trailer, 4)))
+            return false;
+        current_ = index;
+        return true;
+    }
+
+    FrameReaderBuf::int_type FrameReaderBuf::underflow()
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        const auto position = tell();
+        if (position >= size_)
+            return traits_type::eof();
+        const auto index = static_cast<size_t>(std::upper_bound(frames_.begin(), frames_.end(), position,
+            [](const uint64_t value, const Frame& frame) { return value < frame.offset; }) - frames_.begin()) - 1;
+        if (index != current_ && !load(index))
+        {
+            setg(nullptr, nullptr, nullptr);
+            position_ = position;
+            return traits_type::eof();
+        }
+        const auto base = reinterpret_cast<char*>(data_.data());
+        setg(base, base + (position - frames_[index].offset), base + data_.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+    FrameReaderBuf::pos_type FrameReaderBuf::seekpos(const pos_type pos, const std::ios_base::openmode which)
+    {
+        const auto target = static_cast<off_type>(pos);
+        if (!(which & std::ios_base::in) || target < 0 || static_cast<uint64_t>(target) > size_)
+            return {off_type(-1)};
+        const auto position = static_cast<uint64_t>(target);
+        // 目标仍在已解压的帧内时只移动读取指针
+        if (current_ != NO_FRAME && position >= frames_[current_].offset && position < frames_[current_].offset + frames_[current_].size)
+        {
+            const auto base = reinterpret_cast<char*>(data_.data());
+            setg(base, base + (position - frames_[current_].offset), base + data_.size());
+        }
+        else
+        {
+            setg(nullptr, nullptr, nullptr);
+            position_ = position;
+        }
+        return pos;
+    }
+
+    FrameReaderBuf::pos_type FrameReaderBuf::seekoff(const off_type off, const std::ios_base::seekdir dir, const std::ios_base::openmode which)
+    {
+        off_type base = 0;
+        if (dir == std::ios_base::cur)
+            base = static_cast<off_type>(tell());
+        else if (dir == std::ios_base::end)
+            base = static_cast<off_type>(size_);
+        return seekpos(pos_type(base + off), which);
+    }
+
+    std::shared_ptr<FrameSource> FrameSource::open(const std::filesystem::path& path)
+    {
+        std::shared_ptr<FrameSource> source(new FrameSource());
+        source->file_.open(path, std::ios::binary);
+        if (!source->file_.is_open() || !((source->reader_ = FrameReaderBuf::open(*source->file_.rdbuf()))))
+            return nullptr;
+        return source;
+    }
+
+    size_t FrameSource::read_at(const uint64_t offset, char* buffer, const size_t size)
+    {
+        std::lock_guard lock(mutex_);
+        if (reader_->pubseekpos(static_cast<std::streamoff>(offset), std::ios::in) != static_cast<std::streamoff>(offset))
+            return 0;
+        const auto n = reader_->sgetn(buffer, static_cast<std::streamsize>(size));
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+}
@@ -0,0 +1,217 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "encryption/aes.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BACKUPSUITE_AES_X86 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define BACKUPSUITE_AES_TARGET
+#else
+#include <cpuid.h>
+// 只给这个函数开启 AES 指令, 其余代码仍按默认目标编译, 在不支持的 CPU 上由运行时检测跳过
+#define BACKUPSUITE_AES_TARGET __attribute__((target("aes,sse2")))
+#endif
+#endif
+
+using namespace encryption;
+
+namespace
+{
+    constexpr uint8_t SBOX[256] = {
+        0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+        0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+        0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+        0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+        0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+        0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+        0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+        0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+        0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+        0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+        0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+        0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+        0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+        0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+        0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+        0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+    };
+
+    constexpr uint8_t xtime(const uint8_t x) { return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0)); }
+    constexpr uint32_t rotr(const uint32_t x, const int n) { return (x >> n) | (x << (32 - n)); }
+
+    // T 表: SubBytes + MixColumns 的一列, 其余三张表是它的循环移位
+    struct Tables
+    {
+        uint32_t te[256];
+    };
+    constexpr Tables make_tables()
+    {
+        Tables tables{};
+        for (int i = 0; i < 256; ++i)
+        {
+            const uint8_t s = SBOX[i];
+            const uint8_t s2 = xtime(s);
+            const uint8_t s3 = s2 ^ s;
+            tables.te[i] = static_cast<uint32_t>(s2) << 24 | static_cast<uint32_t>(s) << 16 | static_cast<uint32_t>(s) << 8 | s3;
+        }
+        return tables;
+    }
+    constexpr Tables TABLES = make_tables();
+
+    uint32_t load_be32(const uint8_t* p)
+    {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+    }
+    void store_be32(uint8_t* p, const uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+    uint32_t sub_word(const uint32_t w)
+    {
+        return static_cast<uint32_t>(SBOX[w >> 24]) << 24 | static_cast<uint32_t>(SBOX[(w >> 16) & 0xff]) << 16 |
+               static_cast<uint32_t>(SBOX[(w >> 8) & 0xff]) << 8 | SBOX[w & 0xff];
+    }
+
+    void encrypt_block_portable(const uint32_t* rk, const int rounds, const uint8_t* in, uint8_t* out)
+    {
+        const auto& te = TABLES.te;
+        uint32_t s0 = load_be32(in) ^ rk[0];
+        uint32_t s1 = load_be32(in + 4) ^ rk[1];
+        uint32_t s2 = load_be32(in + 8) ^ rk[2];
+        uint32_t s3 = load_be32(in + 12) ^ rk[3];
+        for (int r = 1; r < rounds; ++r)
+        {
+            rk += 4;
+            const uint32_t t0 = te[s0 >> 24] ^ rotr(te[(s1 >> 16) & 0xff], 8) ^ rotr(te[(s2 >> 8) & 0xff], 16) ^ rotr(te[s3 & 0xff], 24) ^ rk[0];
+            const uint32_t t1 = te[s1 >> 24] ^ rotr(te[(s2 >> 16) & 0xff], 8) ^ rotr(te[(s3 >> 8) & 0xff], 16) ^ rotr(te[s0 & 0xff], 24) ^ rk[1];
+            const uint32_t t2 = te[s2 >> 24] ^ rotr(te[(s3 >> 16) & 0xff], 8) ^ rotr(te[(s0 >> 8) & 0xff], 16) ^ rotr(te[s1 & 0xff], 24) ^ rk[2];
+            const uint32_t t3 = te[s3 >> 24] ^ rotr(te[(s0 >> 16) & 0xff], 8) ^ rotr(te[(s1 >> 8) & 0xff], 16) ^ rotr(te[s2 & 0xff], 24) ^ rk[3];
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+        // 最后一轮没有 MixColumns
+        rk += 4;
+        const auto last = [](const uint32_t a, const uint32_t b, const uint32_t c, const uint32_t d)
+        {
+            return static_cast<uint32_t>(SBOX[a >> 24]) << 24 | static_cast<uint32_t>(SBOX[(b >> 16) & 0xff]) << 16 |
+                   static_cast<uint32_t>(SBOX[(c >> 8) & 0xff]) << 8 | SBOX[d & 0xff];
+        };
+        store_be32(out, last(s0, s1, s2, s3) ^ rk[0]);
+        store_be32(out + 4, last(s1, s2, s3, s0) ^ rk[1]);
+        store_be32(out + 8, last(s2, s3, s0, s1) ^ rk[2]);
+        store_be32(out + 12, last(s3, s0, s1, s2) ^ rk[3]);
+    }
+
+#ifdef BACKUPSUITE_AES_X86
+    bool cpu_supports_aesni()
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 25)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            return false;
+        return (ecx & (1u << 25)) != 0;
+#endif
+    }
+
+    BACKUPSUITE_AES_TARGET
+    void encrypt_blocks_aesni(const uint8_t* round_keys, const int rounds, const uint8_t* in, uint8_t* out, size_t blocks)
+    {
+        __m128i keys[15];
+        for (int r = 0; r <= rounds; ++r)
+            keys[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(round_keys + r * 16));
+        // 一次处理 8 个分组, 让 aesenc 的流水线保持满载
+        for (; blocks >= 8; blocks -= 8, in += 128, out += 128)
+        {
+            __m128i b[8];
+            for (int i = 0; i < 8; ++i)
+                b[i] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 16)), keys[0]);
+            for (int r = 1; r < rounds; ++r)
+                for (auto& block : b)
+                    block = _mm_aesenc_si128(block, keys[r]);
+            for (int i = 0; i < 8; ++i)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 16), _mm_aesenclast_si128(b[i], keys[rounds]));
+        }
+        for (; blocks > 0; --blocks, in += 16, out += 16)
+        {
+            __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), keys[0]);
+            for (int r = 1; r < rounds; ++r)
+                block = _mm_aesenc_si128(block, keys[r]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_aesenclast_si128(block, keys[rounds]));
+        }
+    }
+    const bool HAS_AESNI = cpu_supports_aesni();
+#else
+    constexpr bool HAS_AESNI = false;
+#endif
+    std::atomic<bool> hardware_enabled{true};
+}
+
+Aes::Aes(const uint8_t* key, const size_t key_size)
+{
+    if (key_size != 16 && key_size != 24 && key_size != 32)
+        return;
+    const int nk = static_cast<int>(key_size / 4);
+    rounds_ = nk + 6;
+    const int words = 4 * (rounds_ + 1);
+    for (int i = 0; i < nk; ++i)
+        round_keys_[i] = load_be32(key + i * 4);
+    uint8_t rcon = 0x01;
+    for (int i = nk; i < words; ++i)
+    {
+        uint32_t temp = round_keys_[i - 1];
+        if (i % nk == 0)
+        {
+            temp = sub_word(rotr(temp, 24)) ^ static_cast<uint32_t>(rcon) << 24;
+            rcon = xtime(rcon);
+        } else if (nk > 6 && i % nk == 4)
+        {
+            temp = sub_word(temp);
+        }
+        round_keys_[i] = round_keys_[i - nk] ^ temp;
+    }
+    for (int i = 0; i < words; ++i)
+        store_be32(round_key_bytes_ + i * 4, round_keys_[i]);
+}
+
+void Aes::encrypt_block(const uint8_t in[BLOCK_SIZE], uint8_t out[BLOCK_SIZE]) const
+{
+    encrypt_blocks(in, out, 1);
+}
+
+void Aes::encrypt_blocks(const uint8_t* in, uint8_t* out, size_t blocks) const
+{
+#ifdef BACKUPSUITE_AES_X86
+    if (hardware_accelerated())
+    {
+        encrypt_blocks_aesni(round_key_bytes_, rounds_, in, out, blocks);
+        return;
+    }
+#endif
+    for (; blocks > 0; --blocks, in += BLOCK_SIZE, out += BLOCK_SIZE)
+        encrypt_block_portable(round_keys_, rounds_, in, out);
+}
+
+bool Aes::hardware_accelerated()
+{
+    return HAS_AESNI && hardware_enabled.load(std::memory_order_relaxed);
+}
+
+void Aes::set_hardware_enabled(const bool enabled)
+{
+    hardware_enabled = enabled;
+}
@@ -2,9 +2,13 @@
 // Created by ycm on 2025/12/28.
 //
 #include "encryption/rc.h"
+
+#include "utils/trace.h"
+
 using namespace encryption;
 
 RC4::RC4(const std::vector<uint8_t>& key)  {
+    TRACE_SPAN(Crypto, "rc4.key_schedule");
     bit_length_ = key.size();
     for (int i = 0; i < 256; ++i) {
         S[i] = static_cast<uint8_t>(i);
@@ -32,6 +36,7 @@ uint8_t RC4::process_byte(const uint8_t input) {
     return input ^ k;
 }
 void RC4::process(uint8_t* data, const size_t len) {
+    TRACE_SPAN(Crypto, "rc4.process");
     for (size_t k = 0; k < len; ++k) {
         data[k] = process_byte(data[k]);
     }
@@ -0,0 +1,178 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "encryption/sha1.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "utils/trace.h"
+
+using namespace encryption;
+
+namespace
+{
+    constexpr uint32_t rotl(const uint32_t x, const int n) { return (x << n) | (x >> (32 - n)); }
+
+    uint32_t load_be32(const uint8_t* p)
+    {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+    }
+}
+
+void Sha1::reset()
+{
+    state_[0] = 0x67452301;
+    state_[1] = 0xEFCDAB89;
+    state_[2] = 0x98BADCFE;
+    state_[3] = 0x10325476;
+    state_[4] = 0xC3D2E1F0;
+    length_ = 0;
+    buffered_ = 0;
+}
+
+void Sha1::transform(const uint8_t* block)
+{
+    // 消息扩展只保留最近 16 个字, 四组轮函数分开展开, 避免每轮判断所在的组
+    uint32_t w[16];
+    for (int i = 0; i < 16; ++i)
+        w[i] = load_be32(block + i * 4);
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3], e = state_[4];
+    const auto schedule = [&w](const int i)
+    {
+        return w[i & 15] = rotl(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+    };
+    const auto round = [&](const uint32_t f, const uint32_t k, const uint32_t wi)
+    {
+        const uint32_t t = rotl(a, 5) + f + e + k + wi;
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    };
+    for (int i = 0; i < 16; ++i)
+        round((b & c) | (~b & d), 0x5A827999, w[i]);
+    for (int i = 16; i < 20; ++i)
+        round((b & c) | (~b & d), 0x5A827999, schedule(i));
+    for (int i = 20; i < 40; ++i)
+        round(b ^ c ^ d, 0x6ED9EBA1, schedule(i));
+    for (int i = 40; i < 60; ++i)
+        round((b & c) | (b & d) | (c & d), 0x8F1BBCDC, schedule(i));
+    for (int i = 60; i < 80; ++i)
+        round(b ^ c ^ d, 0xCA62C1D6, schedule(i));
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+}
+
+void Sha1::update(const uint8_t* data, size_t size)
+{
+    length_ += size;
+    if (buffered_)
+    {
+        const auto take = std::min(size, BLOCK_SIZE - buffered_);
+        std::memcpy(buffer_ + buffered_, data, take);
+        buffered_ += take;
+        data += take;
+        size -= take;
+        if (buffered_ < BLOCK_SIZE)
+            return;
+        transform(buffer_);
+        buffered_ = 0;
+    }
+    for (; size >= BLOCK_SIZE; data += BLOCK_SIZE, size -= BLOCK_SIZE)
+        transform(data);
+    if (size)
+    {
+        std::memcpy(buffer_, data, size);
+        buffered_ = size;
+    }
+}
+
+Sha1::Digest Sha1::finalize()
+{
+    const uint64_t bits = length_ * 8;
+    // 补一个 0x80, 再补 0 直到余下 8 字节, 最后是大端序的比特长度
+    uint8_t padding[BLOCK_SIZE * 2]{0x80};
+    const size_t pad = (buffered_ < 56 ? 56 : 120) - buffered_;
+    for (int i = 0; i < 8; ++i)
+        padding[pad + i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    update(padding, pad + 8);
+
+    Digest digest{};
+    for (int i = 0; i < 5; ++i)
+    {
+        digest[i * 4] = static_cast<uint8_t>(state_[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state_[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state_[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state_[i]);
+    }
+    return digest;
+}
+
+HmacSha1::HmacSha1(const uint8_t* key, const size_t size)
+{
+    uint8_t block[Sha1::BLOCK_SIZE]{};
+    // 超过分组长度的密钥先做一次摘要
+    if (size > Sha1::BLOCK_SIZE)
+    {
+        Sha1 hash;
+        hash.update(key, size);
+        const auto digest = hash.finalize();
+        std::memcpy(block, digest.data(), digest.size());
+    } else if (size)
+    {
+        std::memcpy(block, key, size);
+    }
+    uint8_t pad[Sha1::BLOCK_SIZE];
+    for (size_t i = 0; i < Sha1::BLOCK_SIZE; ++i)
+        pad[i] = block[i] ^ 0x36;
+    inner_key_.update(pad, sizeof(pad));
+    for (size_t i = 0; i < Sha1::BLOCK_SIZE; ++i)
+        pad[i] = block[i] ^ 0x5C;
+    outer_key_.update(pad, sizeof(pad));
+    inner_ = inner_key_;
+}
+
+Sha1::Digest HmacSha1::finalize()
+{
+    const auto inner = inner_.finalize();
+    auto outer = outer_key_;
+    outer.update(inner.data(), inner.size());
+    inner_ = inner_key_;
+    return outer.finalize();
+}
+
+std::vector<uint8_t> encryption::pbkdf2_hmac_sha1(const std::vector<uint8_t>& password, const uint8_t* salt, const size_t salt_size,
+                                                  const uint32_t iterations, const size_t length)
+{
+    TRACE_SPAN(Crypto, "pbkdf2.derive");
+    HmacSha1 prf(password.data(), password.size());
+    std::vector<uint8_t> key;
+    key.reserve(length);
+    for (uint32_t block = 1; key.size() < length; ++block)
+    {
+        // U1 = PRF(P, S || INT(i)), Ui = PRF(P, Ui-1), T = U1 ^ ... ^ Uc
+        const uint8_t index[4] = {
+            static_cast<uint8_t>(block >> 24), static_cast<uint8_t>(block >> 16),
+            static_cast<uint8_t>(block >> 8), static_cast<uint8_t>(block)
+        };
+        prf.update(salt, salt_size);
+        prf.update(index, sizeof(index));
+        auto u = prf.finalize();
+        auto t = u;
+        for (uint32_t i = 1; i < iterations; ++i)
+        {
+            prf.update(u.data(), u.size());
+            u = prf.finalize();
+            for (size_t j = 0; j < t.size(); ++j)
+                t[j] ^= u[j];
+        }
+        const auto take = std::min(t.size(), length - key.size());
+        key.insert(key.end(), t.begin(), t.begin() + static_cast<std::ptrdiff_t>(take));
+    }
+    return key;
+}
@@ -0,0 +1,96 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "encryption/winzip_aes.h"
+
+#include <algorithm>
+#include <random>
+
+#include "utils/trace.h"
+
+using namespace encryption;
+
+size_t WinZipAes::salt_size(const int strength)
+{
+    return strength >= 1 && strength <= 3 ? static_cast<size_t>(4 + strength * 4) : 0;
+}
+
+size_t WinZipAes::key_size(const int strength)
+{
+    return strength >= 1 && strength <= 3 ? static_cast<size_t>(8 + strength * 8) : 0;
+}
+
+std::vector<uint8_t> WinZipAes::random_salt(const int strength)
+{
+    std::random_device rd;
+    std::uniform_int_distribution<uint16_t> dist(0, 255);
+    std::vector<uint8_t> salt(salt_size(strength));
+    for (auto& byte : salt)
+        byte = static_cast<uint8_t>(dist(rd));
+    return salt;
+}
+
+WinZipAes::WinZipAes(const int strength, const std::vector<uint8_t>& password, const uint8_t* salt)
+{
+    const auto key_length = key_size(strength);
+    if (!key_length)
+        return;
+    TRACE_SPAN(Crypto, "winzip_aes.derive_keys");
+    salt_.assign(salt, salt + salt_size(strength));
+    // 派生结果依次为加密密钥、认证密钥和口令校验值
+    const auto keys = pbkdf2_hmac_sha1(password, salt_.data(), salt_.size(), ITERATIONS, key_length * 2 + VERIFIER_SIZE);
+    aes_ = Aes(keys.data(), key_length);
+    hmac_ = HmacSha1(keys.data() + key_length, key_length);
+    std::copy_n(keys.data() + key_length * 2, VERIFIER_SIZE, verifier_.begin());
+    strength_ = strength;
+}
+
+void WinZipAes::apply_keystream(uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        if (keystream_pos_ == sizeof(keystream_))
+        {
+            // 依次写出 KEYSTREAM_BLOCKS 个计数器值, 一次加密
+            for (size_t block = 0; block < KEYSTREAM_BLOCKS; ++block)
+            {
+                for (auto& byte : counter_)
+                {
+                    if (++byte != 0)
+                        break;
+                }
+                std::copy_n(counter_, Aes::BLOCK_SIZE, keystream_ + block * Aes::BLOCK_SIZE);
+            }
+            aes_.encrypt_blocks(keystream_, keystream_, KEYSTREAM_BLOCKS);
+            keystream_pos_ = 0;
+        }
+        const auto take = std::min(size, sizeof(keystream_) - keystream_pos_);
+        for (size_t i = 0; i < take; ++i)
+            data[i] ^= keystream_[keystream_pos_ + i];
+        keystream_pos_ += take;
+        data += take;
+        size -= take;
+    }
+}
+
+void WinZipAes::encrypt(uint8_t* data, const size_t size)
+{
+    TRACE_SPAN(Crypto, "winzip_aes.encrypt");
+    apply_keystream(data, size);
+    hmac_.update(data, size);
+}
+
+void WinZipAes::decrypt(uint8_t* data, const size_t size)
+{
+    TRACE_SPAN(Crypto, "winzip_aes.decrypt");
+    hmac_.update(data, size);
+    apply_keystream(data, size);
+}
+
+std::array<uint8_t, WinZipAes::AUTH_CODE_SIZE> WinZipAes::auth_code()
+{
+    const auto digest = hmac_.finalize();
+    std::array<uint8_t, AUTH_CODE_SIZE> code{};
+    std::copy_n(digest.begin(), AUTH_CODE_SIZE, code.begin());
+    return code;
+}
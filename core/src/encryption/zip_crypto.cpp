@@ -2,6 +2,9 @@
 // Created by ycm on 2025/12/28.
 //
 #include "encryption/zip_crypto.h"
+
+#include "utils/trace.h"
+
 using namespace encryption;
 
 void ZipCrypto::update_keys(const uint8_t byte) {
@@ -14,6 +17,7 @@ uint8_t ZipCrypto::decrypt_byte() const {
     return static_cast<uint8_t>((temp * (temp ^ 1)) >> 8);
 }
 void ZipCrypto::init(const std::vector<uint8_t>& password) {
+    TRACE_SPAN(Crypto, "zipcrypto.init");
     for (const uint8_t c : password) {
         update_keys(c);
     }
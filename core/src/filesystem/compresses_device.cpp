@@ -6,9 +6,9 @@
 #include <algorithm>
 #include <chrono>
 
-std::vector<std::pair<FileEntityMeta, int>> TarDevice::list_all_files() const
+std::vector<std::pair<FileEntityMeta, uint64_t>> TarDevice::list_all_files() const
 {
-    std::vector<std::pair<FileEntityMeta, int>> result;
+    std::vector<std::pair<FileEntityMeta, uint64_t>> result;
     if (mode_ != Mode::ReadOnly) {
         return result;
     }
@@ -30,25 +30,9 @@ std::unique_ptr<Folder> TarDevice::get_folder(const std::filesystem::path& path)
     // 我们需要对根目录做特殊处理,因为tar中不存在一个根目录,我们需要伪造一个根目录
     if (path.empty() || path == "." || path == "./")
     {
-        const auto files = tar_file_.list_dir({});
         std::vector<FileEntity> children;
-        for (auto &[entity, offset] : files) {
-            const std::string entity_path = entity.path.generic_u8string();
-            const auto l_pos = entity_path.find('/'),
-            r_pos = entity_path.rfind('/');
-            if (l_pos == std::string::npos)
-            {
-                // 根目录下的目录
-                children.emplace_back(entity);
-                continue;
-            }
-            if (l_pos == r_pos && l_pos == entity_path.size() - 1)
-            {
-                // 直接子节点
-                children.emplace_back(entity);
-                continue;
-            }
-        }
+        for (auto &[entity, offset] : tar_file_.list_children({}))
+            children.emplace_back(entity);
         FileEntityMeta root_meta;
         root_meta.path = ".";
         root_meta.type = FileEntityType::Directory;
@@ -63,15 +47,9 @@ std::unique_ptr<Folder> TarDevice::get_folder(const std::filesystem::path& path)
     const auto fstream = tar_file_.get_file_stream(real_path);
     if (fstream == nullptr) return nullptr;
     FileEntityMeta meta = fstream->get_meta();
-    auto files = tar_file_.list_dir(real_path);
     std::vector<FileEntity> children;
-    for (auto &[entity, offset] : files) {
-        if (real_path == entity.path)
-        {
-            continue;
-        }
+    for (auto &[entity, offset] : tar_file_.list_children(real_path))
         children.emplace_back(entity);
-    }
     return std::make_unique<Folder>(meta, children);
 }
 std::unique_ptr<ReadableFile> TarDevice::get_file(const std::filesystem::path& path)
@@ -117,18 +95,25 @@ bool TarDevice::exists(const std::filesystem::path& path)
 }
 bool TarDevice::write_file(ReadableFile& file)
 {
-    if (!is_open() || mode_ != Mode::WriteOnly) {
+    if (!is_open() || mode_ == Mode::ReadOnly) {
         return false;
     }
     return tar_file_.add_entity(file);
 }
+bool TarDevice::write_files(const std::vector<ReadableFile*>& files)
+{
+    if (!is_open() || mode_ == Mode::ReadOnly) {
+        return false;
+    }
+    return tar_file_.add_entities(files);
+}
 bool TarDevice::write_file_force(ReadableFile& file)
 {
     return write_file(file); // Tar格式不支持强制覆盖，使用相同的实现
 }
 bool TarDevice::write_folder(Folder& folder)
 {
-    if (!is_open() || mode_ != Mode::WriteOnly) {
+    if (!is_open() || mode_ == Mode::ReadOnly) {
         return false;
     }
 
@@ -156,25 +141,9 @@ std::unique_ptr<Folder> ZipDevice::get_folder(const std::filesystem::path& path)
     // 我们需要对根目录做特殊处理,因为zip中不存在一个根目录,我们需要伪造一个根目录
     if (path.empty() || path == "." || path == "./")
     {
-        const auto files = zip_file_.list_dir({});
         std::vector<FileEntity> children;
-        for (const auto& entry : files)
-        {
-            const std::string entry_path = entry.file_name;
-            const auto l_pos = entry_path.find('/'),
-            r_pos = entry_path.rfind('/');
-            if (l_pos == std::string::npos)
-            {
-                // 根目录下的目录
-                children.emplace_back(zip::ZipFile::cdfh_to_file_meta(entry));
-                continue;
-            }
-            if (l_pos == r_pos && l_pos == entry_path.size() - 1)
-            {
-                // 直接子节点
-                children.emplace_back(zip::ZipFile::cdfh_to_file_meta(entry));
-            }
-        }
+        for (const auto& entry : zip_file_.list_children({}))
+            children.emplace_back(zip::ZipFile::cdfh_to_file_meta(entry));
         FileEntityMeta root_meta;
         root_meta.path = ".";
         root_meta.type = FileEntityType::Directory;
@@ -183,15 +152,9 @@ std::unique_ptr<Folder> ZipDevice::get_folder(const std::filesystem::path& path)
     const auto fstream = zip_file_.get_file_stream(path);
     if (fstream == nullptr) return nullptr;
     FileEntityMeta meta = fstream->get_meta();
-    const auto files = zip_file_.list_dir(path);
     std::vector<FileEntity> children;
-    for (auto &entry : files)
-    {
-        if (entry.file_name == path){
-            continue;
-        }
+    for (const auto& entry : zip_file_.list_children(path))
         children.emplace_back(zip::ZipFile::cdfh_to_file_meta(entry));
-    }
     return std::make_unique<Folder>(meta, children);
 }
 std::unique_ptr<ReadableFile> ZipDevice::get_file(const std::filesystem::path& path)
@@ -233,9 +196,13 @@ bool ZipDevice::exists(const std::filesystem::path& path)
 }
 bool ZipDevice::write_file(ReadableFile& file, const zip::header::ZipCompressionMethod compression_method, const zip::header::ZipEncryptionMethod encryption_method)
 {
-    if (!is_open() || mode_ != Mode::WriteOnly) {
+    if (!is_open() || mode_ == Mode::ReadOnly) {
         return false;
     }
+    // 更新时大小和修改时间都没有变化的文件保留原条目, 只写出变化的部分
+    if (has_unchanged(file.get_meta())) {
+        return true;
+    }
     return zip_file_.add_entity(file, compression_method, encryption_method_);
 }
 bool ZipDevice::write_file(ReadableFile& file)
@@ -244,17 +211,22 @@ bool ZipDevice::write_file(ReadableFile& file)
 }
 bool ZipDevice::write_file_force(ReadableFile& file)
 {
-    return write_file(file); // Zip格式不支持强制覆盖，使用相同的实现
+    if (!is_open() || mode_ == Mode::ReadOnly) {
+        return false;
+    }
+    // 总是写入新条目; 更新模式下关闭时替换同一路径的旧条目
+    return zip_file_.add_entity(file, compression_method_, encryption_method_);
 }
 bool ZipDevice::write_folder(Folder& folder)
 {
-    if (!is_open() || mode_ != Mode::WriteOnly) {
+    if (!is_open() || mode_ == Mode::ReadOnly) {
         return false;
     }
 
     // 我们需要对根目录做特殊处理,因为zip中不存在一个根目录,我们拦截根目录的写入请求
     // 如果是根目录,直接返回**成功**,因为zip本身就是根目录
     if (const auto path = folder.get_meta().path; path.empty() || path == "." || path == "./") return true;
+    if (has_unchanged(folder.get_meta())) return true;
     EmptyReadableFile folder_file{folder.get_meta()};
     return zip_file_.add_entity(folder_file, zip::header::ZipCompressionMethod::Store);
 }
\ No newline at end of file
@@ -3,8 +3,12 @@
 //
 #include "filesystem/device.h"
 
+#include "utils/buffer_pool.h"
+#include "utils/trace.h"
+
 std::unique_ptr<ReadableFile> PhysicalDevice::get_file(const std::filesystem::path& path)
 {
+    TRACE_SPAN(Device, "device.open");
     const auto meta = get_meta(path);
     if (!meta || meta->type != FileEntityType::RegularFile)
         return nullptr;
@@ -17,8 +21,14 @@ std::unique_ptr<ReadableFile> PhysicalDevice::get_file(const std::filesystem::pa
 
 std::unique_ptr<std::vector<std::byte>> PhysicalDeviceReadableFile::read()
 {
+    TRACE_SPAN(Device, "device.read");
     if (!stream || !stream->good())
         return nullptr;
+    // 整文件读取无法切分, 超过内存上限时直接失败而不是被 OOM; 大文件应使用 read(size)/read_into 分块读取.
+    // 分配与读取期间占用等量的预算, 并发的整文件读取因此排队而不是各自占满上限
+    const buffer_pool::Reservation reservation(buffer_pool::BufferPool::instance(), meta.size);
+    if (!reservation)
+        return nullptr;
     auto buffer = std::make_unique<std::vector<std::byte>>(meta.size);
     stream->read(reinterpret_cast<char*>(buffer->data()), meta.size);
     if (stream->gcount() != static_cast<std::streamsize>(meta.size))
@@ -28,6 +38,7 @@ std::unique_ptr<std::vector<std::byte>> PhysicalDeviceReadableFile::read()
 
 std::unique_ptr<std::vector<std::byte>> PhysicalDeviceReadableFile::read(size_t size)
 {
+    TRACE_SPAN(Device, "device.read");
     if (!stream || !stream->good() || size == 0)
         return nullptr;
     size = std::min(size, meta.size);
@@ -38,3 +49,13 @@ std::unique_ptr<std::vector<std::byte>> PhysicalDeviceReadableFile::read(size_t
     buffer->resize(real_read_bytes);
     return buffer;
 }
+
+size_t PhysicalDeviceReadableFile::read_into(std::byte* buffer, const size_t size)
+{
+    TRACE_SPAN(Device, "device.read");
+    if (!stream || !stream->good() || size == 0)
+        return 0;
+    stream->read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(size));
+    const auto real_read_bytes = stream->gcount();
+    return real_read_bytes > 0 ? static_cast<size_t>(real_read_bytes) : 0;
+}
@@ -7,6 +7,8 @@
 #include "filesystem/system_device.h"
 
 #include "utils/admin_privilege.h"
+#include "utils/buffer_pool.h"
+#include "utils/trace.h"
 
 using namespace utils::time_converter;
 
@@ -14,6 +16,7 @@ using namespace utils::time_converter;
 
 std::unique_ptr<Folder> WindowsDevice::get_folder(const std::filesystem::path& path, bool recursion)
 {
+    TRACE_SPAN(Device, "device.list_dir");
     const std::unique_ptr<FileEntityMeta> meta = get_meta(path);
     if (!meta || meta->type != FileEntityType::Directory)
     {
@@ -59,6 +62,7 @@ std::unique_ptr<Folder> WindowsDevice::get_folder(const std::filesystem::path& p
 
 std::unique_ptr<ReadableFile> WindowsDevice::get_file(const std::filesystem::path& path)
 {
+    TRACE_SPAN(Device, "device.open");
     const std::unique_ptr<FileEntityMeta> meta = get_meta(path);
     if (!meta || meta->type != FileEntityType::RegularFile)
     {
@@ -86,6 +90,7 @@ std::unique_ptr<std::ifstream> WindowsDevice::get_file_stream(const std::filesys
  */
 std::unique_ptr<FileEntityMeta> WindowsDevice::get_meta(const std::filesystem::path& path)
 {
+    TRACE_SPAN(Device, "device.stat");
     const auto realpath = root / path;
     // get file attributes
     const DWORD attributes = GetFileAttributesW(realpath.wstring().c_str());
@@ -314,6 +319,7 @@ bool WindowsDevice::write_file_force(ReadableFile &file)
 
 bool WindowsDevice::_write_file(ReadableFile &file, const bool force)
 {
+    TRACE_SPAN(Device, "device.write_file");
     const auto meta = file.get_meta();
     const auto realpath = root / meta.path;
     if (exists(meta.path) && !force) {
@@ -346,19 +352,23 @@ bool WindowsDevice::_write_file(ReadableFile &file, const bool force)
         if (!ofs.is_open()) {
             return false;
         }
-        std::unique_ptr<std::vector<std::byte>> data = file.read(CACHE_SIZE);
-        while (data && !data->empty())
+        // 从全局 pool 借 slab 复用, 内存预算耗尽时在此等待
+        const auto slab = buffer_pool::BufferPool::instance().acquire();
+        size_t n = file.read_into(slab.data(), slab.size());
+        while (n > 0)
         {
             if (!ofs.is_open() || !ofs.good())
             {
                 ofs.close();
                 return false;
             }
-            ofs.write(reinterpret_cast<const char*>(data->data()), data->size());
-            data = file.read(CACHE_SIZE);
+            ofs.write(reinterpret_cast<const char*>(slab.data()), static_cast<std::streamsize>(n));
+            n = file.read_into(slab.data(), slab.size());
         }
         ofs.flush();
         ofs.close();
+        if (file.failed())
+            return false;
     }
 
     // 尝试设置文件属性，但如果失败不影响恢复操作的成功
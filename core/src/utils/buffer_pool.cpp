@@ -0,0 +1,237 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#include "utils/buffer_pool.h"
+
+#include <algorithm>
+#include <new>
+
+namespace buffer_pool
+{
+    Slab::Slab(Slab&& other) noexcept : pool_(other.pool_), data_(other.data_), size_(other.size_)
+    {
+        other.pool_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    Slab& Slab::operator=(Slab&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            pool_ = other.pool_;
+            data_ = other.data_;
+            size_ = other.size_;
+            other.pool_ = nullptr;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    void Slab::release()
+    {
+        if (pool_ && data_)
+            pool_->give_back(data_);
+        pool_ = nullptr;
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    BufferPool::BufferPool(const size_t slab_size, const size_t memory_limit, const bool page_aligned)
+        : slab_size_(slab_size ? slab_size : DEFAULT_SLAB_SIZE), memory_limit_(memory_limit), page_aligned_(page_aligned)
+    {
+    }
+
+    BufferPool::~BufferPool()
+    {
+        // 借出中的 slab 必须先于 pool 归还, 这里只释放空闲缓存
+        for (const auto data : free_slabs_)
+            free_slab(data);
+    }
+
+    BufferPool& BufferPool::instance()
+    {
+        static BufferPool pool;
+        return pool;
+    }
+
+    std::byte* BufferPool::allocate_slab() const
+    {
+        if (page_aligned_)
+            return static_cast<std::byte*>(::operator new(slab_size_, std::align_val_t{PAGE_ALIGNMENT}));
+        return static_cast<std::byte*>(::operator new(slab_size_));
+    }
+
+    void BufferPool::free_slab(std::byte* data) const
+    {
+        if (page_aligned_)
+            ::operator delete(data, std::align_val_t{PAGE_ALIGNMENT});
+        else
+            ::operator delete(data);
+    }
+
+    bool BufferPool::has_budget_locked(const size_t bytes) const
+    {
+        // 上限小于单个请求时, 只要没有其他占用就放行, 保证总能前进
+        if (allocated_ == 0 && reserved_ == 0)
+            return true;
+        return allocated_ + reserved_ + bytes <= memory_limit_;
+    }
+
+    std::byte* BufferPool::take_locked()
+    {
+        std::byte* data = nullptr;
+        if (!free_slabs_.empty())
+        {
+            data = free_slabs_.back();
+            free_slabs_.pop_back();
+        }
+        else if (has_budget_locked(slab_size_))
+        {
+            data = allocate_slab();
+            allocated_ += slab_size_;
+        }
+        if (data)
+            in_use_ += slab_size_;
+        return data;
+    }
+
+    void BufferPool::give_back(std::byte* data)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            in_use_ -= slab_size_;
+            if (allocated_ + reserved_ > memory_limit_)
+            {
+                free_slab(data);
+                allocated_ -= slab_size_;
+            }
+            else
+            {
+                free_slabs_.push_back(data);
+            }
+        }
+        released_.notify_all();
+    }
+
+    Slab BufferPool::acquire()
+    {
+        std::unique_lock lock(mutex_);
+        std::byte* data = nullptr;
+        released_.wait(lock, [&] { return (data = take_locked()) != nullptr; });
+        return {this, data, slab_size_};
+    }
+
+    Slab BufferPool::try_acquire()
+    {
+        std::lock_guard lock(mutex_);
+        if (const auto data = take_locked())
+            return {this, data, slab_size_};
+        return {};
+    }
+
+    Slab BufferPool::acquire_for(const std::chrono::milliseconds timeout)
+    {
+        std::unique_lock lock(mutex_);
+        std::byte* data = nullptr;
+        if (!released_.wait_for(lock, timeout, [&] { return (data = take_locked()) != nullptr; }))
+            return {};
+        return {this, data, slab_size_};
+    }
+
+    bool BufferPool::reserve(const size_t bytes)
+    {
+        std::unique_lock lock(mutex_);
+        if (bytes > memory_limit_)
+            return false;
+        released_.wait(lock, [&]
+        {
+            if (has_budget_locked(bytes))
+                return true;
+            // 优先回收空闲 slab 腾出预算
+            while (!free_slabs_.empty() && !has_budget_locked(bytes))
+            {
+                free_slab(free_slabs_.back());
+                free_slabs_.pop_back();
+                allocated_ -= slab_size_;
+            }
+            return has_budget_locked(bytes);
+        });
+        reserved_ += bytes;
+        return true;
+    }
+
+    size_t BufferPool::try_reserve(const size_t bytes, const size_t headroom)
+    {
+        std::lock_guard lock(mutex_);
+        const auto available = [&]
+        {
+            const auto used = allocated_ + reserved_ + headroom;
+            return used < memory_limit_ ? memory_limit_ - used : 0;
+        };
+        // 先回收空闲 slab, 它们随时可以重新分配, 不必占着预算
+        while (!free_slabs_.empty() && available() < bytes)
+        {
+            free_slab(free_slabs_.back());
+            free_slabs_.pop_back();
+            allocated_ -= slab_size_;
+        }
+        const auto granted = std::min(bytes, available());
+        reserved_ += granted;
+        return granted;
+    }
+
+    void BufferPool::unreserve(const size_t bytes)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            reserved_ -= bytes < reserved_ ? bytes : reserved_;
+        }
+        released_.notify_all();
+    }
+
+    void BufferPool::set_memory_limit(const size_t bytes)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            memory_limit_ = bytes;
+            while (!free_slabs_.empty() && allocated_ + reserved_ > memory_limit_)
+            {
+                free_slab(free_slabs_.back());
+                free_slabs_.pop_back();
+                allocated_ -= slab_size_;
+            }
+        }
+        released_.notify_all();
+    }
+
+    size_t BufferPool::memory_limit() const
+    {
+        std::lock_guard lock(mutex_);
+        return memory_limit_;
+    }
+
+    size_t BufferPool::in_use() const
+    {
+        std::lock_guard lock(mutex_);
+        return in_use_;
+    }
+
+    size_t BufferPool::allocated() const
+    {
+        std::lock_guard lock(mutex_);
+        return allocated_;
+    }
+
+    void BufferPool::trim()
+    {
+        std::lock_guard lock(mutex_);
+        for (const auto data : free_slabs_)
+            free_slab(data);
+        allocated_ -= free_slabs_.size() * slab_size_;
+        free_slabs_.clear();
+    }
+}
@@ -3,6 +3,15 @@
 //
 #include "utils/crc.h"
 
+#include <array>
+#include <cstring>
+
+#include "utils/endian.h"
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 namespace crc
 {
 
@@ -53,13 +62,98 @@ static constexpr uint32_t crc32_table[256] = {
     0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
 };
 
+// slicing-by-8 查表: slice_table[k][b] 为字节 b 之后再经过 k 个零字节的 CRC
+static constexpr std::array<std::array<uint32_t, 256>, 8> make_slice_table()
+{
+    std::array<std::array<uint32_t, 256>, 8> table{};
+    for (size_t b = 0; b < 256; ++b)
+        table[0][b] = crc32_table[b];
+    for (size_t k = 1; k < 8; ++k)
+        for (size_t b = 0; b < 256; ++b)
+            table[k][b] = (table[k - 1][b] >> 8) ^ crc32_table[table[k - 1][b] & 0xFF];
+    return table;
+}
+static constexpr auto slice_table = make_slice_table();
+
+uint32_t crc32_block(uint32_t crc, const std::byte* data, size_t length)
+{
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+#if defined(__ARM_FEATURE_CRC32)
+    // ARMv8 的 CRC32 指令与 zip 使用同一多项式
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc = __crc32d(crc, le64toh(word));
+    }
+    for (; length; ++p, --length)
+        crc = __crc32b(crc, *p);
+    return crc;
+#else
+    // 每次处理 8 字节, 按小端序读入后查 8 张表
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        word = le64toh(word);
+        const auto low = static_cast<uint32_t>(word) ^ crc;
+        const auto high = static_cast<uint32_t>(word >> 32);
+        crc = slice_table[7][low & 0xFF] ^ slice_table[6][(low >> 8) & 0xFF] ^
+              slice_table[5][(low >> 16) & 0xFF] ^ slice_table[4][low >> 24] ^
+              slice_table[3][high & 0xFF] ^ slice_table[2][(high >> 8) & 0xFF] ^
+              slice_table[1][(high >> 16) & 0xFF] ^ slice_table[0][high >> 24];
+    }
+    for (; length; ++p, --length)
+        crc = (crc >> 8) ^ crc32_table[(crc ^ *p) & 0xFF];
+    return crc;
+#endif
+}
+
+// GF(2) 上模生成多项式的乘法, 多项式按反射位序表示(最高位为 x^0)
+static constexpr uint32_t multiply_mod_poly(const uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31, p = 0;
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+    }
+    return p;
+}
+
+// x2n_table[k] = x^(2^k) mod P
+static constexpr std::array<uint32_t, 32> make_x2n_table()
+{
+    std::array<uint32_t, 32> table{};
+    uint32_t p = 1u << 30; // x^1
+    for (auto& entry : table)
+    {
+        entry = p;
+        p = multiply_mod_poly(p, p);
+    }
+    return table;
+}
+static constexpr auto x2n_table = make_x2n_table();
+
+uint32_t crc32_combine(const uint32_t crc1, const uint32_t crc2, uint64_t length2)
+{
+    // crc1 后面接 length2 个字节相当于乘以 x^(8 * length2)
+    uint32_t p = 1u << 31; // x^0
+    for (unsigned k = 3; length2; length2 >>= 1, ++k)
+        if (length2 & 1)
+            p = multiply_mod_poly(x2n_table[k & 31], p);
+    return multiply_mod_poly(p, crc1) ^ crc2;
+}
+
 // CRC32 计算
 uint32_t crc32(const char* data, const size_t length) {
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < length; ++i) {
-        crc = (crc >> 8) ^ crc32_table[(crc ^ data[i]) & 0xFF];
-    }
-    return crc ^ 0xFFFFFFFF;
+    return crc32_block(0xFFFFFFFF, reinterpret_cast<const std::byte*>(data), length) ^ 0xFFFFFFFF;
 }
 uint32_t crc32_update(uint32_t crc, uint8_t data)
 {
@@ -70,6 +164,10 @@ void CRC32::update(const uint8_t data)
 {
     crc32_ = (crc32_ >> 8) ^ crc32_table[(crc32_ ^ data) & 0xFF];
 }
+void CRC32::update(const std::byte* data, const size_t length)
+{
+    crc32_ = crc32_block(crc32_, data, length);
+}
 uint32_t CRC32::finalize() const {
     return crc32_ ^ 0xFFFFFFFF;
 }
@@ -4,6 +4,8 @@
 
 #include "utils/database.h"
 
+#include "utils/trace.h"
+
 using namespace db;
 
 [[nodiscard]] bool Database::is_initialized() const
@@ -29,8 +31,9 @@ void Database::initialize(const DatabaseInitializationStrategy &strategy) const
         sqlite3_free(errMsg);
 }
 
-[[nodiscard]] bool Database::exec(const std::string& sql, const bool commit) const
+[[nodiscard]] bool Database::exec(const std::string& sql) const
 {
+    TRACE_SPAN(Database, "db.exec");
     if (!is_open())
         return false;
     char* errMsg = nullptr;
@@ -40,18 +43,191 @@ void Database::initialize(const DatabaseInitializationStrategy &strategy) const
             sqlite3_free(errMsg);
         return false;
     }
-    if (commit)
-        sqlite3_exec(db_handle_.get(), "COMMIT;", nullptr, nullptr, &errMsg);
     return true;
 }
 
-[[nodiscard]] bool Database::execute(const sqlite3_stmt& stmt, const bool commit) const
+[[nodiscard]] bool Database::execute(const sqlite3_stmt& stmt) const
 {
+    TRACE_SPAN(Database, "db.execute");
     if (!is_open())
         return false;
     if (const int rc = sqlite3_step(const_cast<sqlite3_stmt*>(&stmt)); rc != SQLITE_DONE && rc != SQLITE_ROW)
         return false;
-    if (commit)
-        sqlite3_exec(db_handle_.get(), "COMMIT;", nullptr, nullptr, nullptr);
     return true;
 }
+
+Transaction::Transaction(const Database& db, const std::string& begin) : db_(db)
+{
+    owned_ = !db_.in_transaction() && db_.exec(begin);
+}
+
+Transaction::~Transaction()
+{
+    if (owned_)
+        rollback();
+}
+
+bool Transaction::commit()
+{
+    if (!owned_)
+        return db_.is_open();
+    owned_ = false;
+    return db_.exec("COMMIT;");
+}
+
+bool Transaction::rollback()
+{
+    if (!owned_)
+        return false;
+    owned_ = false;
+    return db_.exec("ROLLBACK;");
+}
+
+BulkInserter::BulkInserter(const Database& db, const std::string& sql, const size_t batch_rows)
+    : db_(db), batch_rows_(batch_rows ? batch_rows : 1)
+{
+    try {
+        stmt_ = db_.create_statement(sql);
+    } catch ([[maybe_unused]] const std::exception& e) {
+        stmt_.reset();
+    }
+}
+
+BulkInserter::~BulkInserter()
+{
+    flush();
+}
+
+bool BulkInserter::insert()
+{
+    TRACE_SPAN(Database, "db.bulk_insert");
+    if (!stmt_)
+        return false;
+    if (!transaction_)
+        transaction_ = std::make_unique<Transaction>(db_);
+    const bool ok = db_.execute(*stmt_);
+    sqlite3_reset(stmt_.get());
+    sqlite3_clear_bindings(stmt_.get());
+    if (++pending_ >= batch_rows_)
+        return flush() && ok;
+    return ok;
+}
+
+bool BulkInserter::flush()
+{
+    pending_ = 0;
+    if (!transaction_)
+        return true;
+    const bool ok = transaction_->commit();
+    transaction_.reset();
+    return ok;
+}
+
+PathCatalog::PathCatalog(const Database& db) : db_(db)
+{
+    try {
+        insert_ = db_.create_statement("INSERT INTO directory (parent_id, name) VALUES (?, ?);");
+        select_ = db_.create_statement("SELECT id FROM directory WHERE parent_id = ? AND name = ?;");
+    } catch ([[maybe_unused]] const std::exception& e) {
+        insert_.reset();
+        select_.reset();
+    }
+}
+
+std::string PathCatalog::normalize(const std::string& path)
+{
+    size_t begin = 0;
+    while (begin < path.size())
+    {
+        if (path[begin] == '/')
+            begin++;
+        else if (path.compare(begin, 2, "./") == 0)
+            begin += 2;
+        else
+            break;
+    }
+    size_t end = path.size();
+    while (end > begin && path[end - 1] == '/')
+        end--;
+    auto result = path.substr(begin, end - begin);
+    return result == "." ? std::string{} : result;
+}
+
+std::pair<std::string, std::string> PathCatalog::split(const std::string& path)
+{
+    auto normalized = normalize(path);
+    const auto pos = normalized.rfind('/');
+    if (pos == std::string::npos)
+        return {std::string{}, std::move(normalized)};
+    return {normalized.substr(0, pos), normalized.substr(pos + 1)};
+}
+
+int64_t PathCatalog::ensure_directory(const std::string& path)
+{
+    const auto normalized = normalize(path);
+    if (normalized.empty())
+        return ROOT_ID;
+    if (const auto it = ids_.find(normalized); it != ids_.end())
+        return it->second;
+    if (!insert_ || !select_)
+        return -1;
+    const auto [parent, name] = split(normalized);
+    const auto parent_id = ensure_directory(parent);
+    if (parent_id < 0)
+        return -1;
+    // 目录可能由之前的实例写入, 先查再插
+    sqlite3_bind_int64(select_.get(), 1, parent_id);
+    bind_parameter(select_.get(), 2, name);
+    int64_t id = -1;
+    if (sqlite3_step(select_.get()) == SQLITE_ROW)
+        id = sqlite3_column_int64(select_.get(), 0);
+    sqlite3_reset(select_.get());
+    sqlite3_clear_bindings(select_.get());
+    if (id < 0)
+    {
+        sqlite3_bind_int64(insert_.get(), 1, parent_id);
+        bind_parameter(insert_.get(), 2, name);
+        if (db_.execute(*insert_))
+            id = sqlite3_last_insert_rowid(sqlite3_db_handle(insert_.get()));
+        sqlite3_reset(insert_.get());
+        sqlite3_clear_bindings(insert_.get());
+        if (id < 0)
+            return -1;
+    }
+    ids_.emplace(normalized, id);
+    return id;
+}
+
+int64_t PathCatalog::find_directory(const std::string& path) const
+{
+    const auto normalized = normalize(path);
+    if (normalized.empty())
+        return ROOT_ID;
+    if (!select_)
+        return -1;
+    int64_t id = ROOT_ID;
+    size_t begin = 0;
+    while (begin <= normalized.size())
+    {
+        auto end = normalized.find('/', begin);
+        if (end == std::string::npos)
+            end = normalized.size();
+        sqlite3_bind_int64(select_.get(), 1, id);
+        bind_parameter(select_.get(), 2, normalized.substr(begin, end - begin));
+        const bool found = sqlite3_step(select_.get()) == SQLITE_ROW;
+        if (found)
+            id = sqlite3_column_int64(select_.get(), 0);
+        sqlite3_reset(select_.get());
+        sqlite3_clear_bindings(select_.get());
+        if (!found)
+            return -1;
+        begin = end + 1;
+    }
+    return id;
+}
+
+void PathCatalog::clear()
+{
+    ids_.clear();
+    [[maybe_unused]] const auto cleared = db_.exec("DELETE FROM directory;");
+}
@@ -0,0 +1,100 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "utils/read_order.h"
+
+#include <algorithm>
+#include <numeric>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "utils/trace.h"
+
+namespace read_order
+{
+#ifdef _WIN32
+    Location physical_location(const std::filesystem::path& path)
+    {
+        Location location;
+        // 只需要读取属性, 不会触发文件内容的读取
+        const HANDLE handle = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                          nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+            return location;
+        BY_HANDLE_FILE_INFORMATION info{};
+        if (GetFileInformationByHandle(handle, &info))
+            location.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+        STARTING_VCN_INPUT_BUFFER input{};
+        RETRIEVAL_POINTERS_BUFFER output{};
+        DWORD returned = 0;
+        // 输出缓冲区只容纳一个区段时返回 ERROR_MORE_DATA, 首个区段仍然有效
+        if ((DeviceIoControl(handle, FSCTL_GET_RETRIEVAL_POINTERS, &input, sizeof(input), &output, sizeof(output), &returned, nullptr) ||
+             GetLastError() == ERROR_MORE_DATA) && output.ExtentCount > 0 && output.Extents[0].Lcn.QuadPart >= 0)
+            location.extent = static_cast<uint64_t>(output.Extents[0].Lcn.QuadPart);
+        CloseHandle(handle);
+        return location;
+    }
+#elif defined(__linux__)
+    Location physical_location(const std::filesystem::path& path)
+    {
+        Location location;
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0)
+            return location;
+        struct stat st{};
+        if (::fstat(fd, &st) == 0)
+            location.inode = static_cast<uint64_t>(st.st_ino);
+        // fiemap 以柔性数组结尾, 只请求第一个区段
+        alignas(fiemap) unsigned char request[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+        const auto map = reinterpret_cast<fiemap*>(request);
+        map->fm_start = 0;
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_extent_count = 1;
+        // 内联或尚未分配的区段没有可用的物理位置
+        if (::ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0 &&
+            !(map->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE)))
+            location.extent = map->fm_extents[0].fe_physical;
+        ::close(fd);
+        return location;
+    }
+#else
+    Location physical_location(const std::filesystem::path&)
+    {
+        return {};
+    }
+#endif
+
+    std::vector<size_t> schedule(const std::vector<Location>& locations)
+    {
+        TRACE_SPAN(Device, "read_order.schedule");
+        std::vector<size_t> order(locations.size());
+        std::iota(order.begin(), order.end(), size_t{0});
+        const auto all_known = [&](uint64_t Location::*key)
+        {
+            return !locations.empty() && std::all_of(locations.begin(), locations.end(),
+                                                      [&](const Location& location) { return location.*key != 0; });
+        };
+        // 两种位置不能混合比较, 只有整批都可用时才排序
+        uint64_t Location::*key = nullptr;
+        if (all_known(&Location::extent))
+            key = &Location::extent;
+        else if (all_known(&Location::inode))
+            key = &Location::inode;
+        if (key)
+            std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b)
+            {
+                return locations[a].*key < locations[b].*key;
+            });
+        return order;
+    }
+}
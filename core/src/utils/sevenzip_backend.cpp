@@ -22,6 +22,9 @@
 #include <archive.h>
 #include <archive_entry.h>
 
+#include "filesystem/device.h"
+#include "utils/buffer_pool.h"
+
 static bool file_exists(const std::filesystem::path& p)
 {
     try { return std::filesystem::exists(p) && std::filesystem::is_regular_file(p); }
@@ -149,9 +152,19 @@ static std::string to_string_password(const std::vector<uint8_t>& pw)
 {
     return {reinterpret_cast<const char*>(pw.data()), pw.size()};
 }
+// 先于 s_memData 构造全局 pool, 使 pool 晚于 s_memData 析构, 退出时归还预算不会访问已析构的 pool
+static buffer_pool::BufferPool& s_pool = buffer_pool::BufferPool::instance();
+// 没有 staging 目录时的内存副本, 每份数据在替换之前一直占用等量的全局内存预算, 总量因此受上限约束
+struct MemData
+{
+    std::shared_ptr<std::vector<std::byte>> data;
+    std::unique_ptr<buffer_pool::Reservation> reservation;
+};
 // Simple in-memory catalog as a temporary fallback until p7zip wiring is complete
-static std::unordered_map<std::filesystem::path, std::shared_ptr<std::vector<std::byte>>> s_memData;
+static std::unordered_map<std::filesystem::path, MemData> s_memData;
 static std::unordered_map<std::filesystem::path, FileEntityMeta> s_memMeta;
+// 写入 staging 目录的文件不再常驻内存, 读取时直接从 staging 副本流式读取
+static std::unordered_map<std::filesystem::path, std::filesystem::path> s_memStaged;
 static bool sevenz_cli_checked_ = false;
 static std::filesystem::path sevenz_cli_{};
 
@@ -595,9 +608,15 @@ std::unique_ptr<ReadableFile> P7zipBackend::get_file(const std::filesystem::path
     auto it = s_memMeta.find(path);
     if (it == s_memMeta.end()) return nullptr;
     if ((it->second.type & FileEntityType::RegularFile) != FileEntityType::RegularFile) return nullptr;
+    if (const auto stagedIt = s_memStaged.find(path); stagedIt != s_memStaged.end())
+    {
+        auto ifs = std::make_unique<std::ifstream>(stagedIt->second, std::ios::binary);
+        if (!ifs->is_open()) return nullptr;
+        return std::make_unique<PhysicalDeviceReadableFile>(it->second, std::move(ifs));
+    }
     const auto dataIt = s_memData.find(path);
     if (dataIt == s_memData.end()) return nullptr;
-    return std::make_unique<MemoryReadableFile>(it->second, dataIt->second);
+    return std::make_unique<MemoryReadableFile>(it->second, dataIt->second.data);
 }
 
 std::unique_ptr<FileEntityMeta> P7zipBackend::get_meta(const std::filesystem::path& path)
@@ -622,41 +641,78 @@ bool P7zipBackend::exists(const std::filesystem::path& path)
     return s_memMeta.find(path) != s_memMeta.end();
 }
 
-static std::shared_ptr<std::vector<std::byte>> to_bytes(ReadableFile& file)
+static MemData to_bytes(ReadableFile& file)
+{
+    // 仅在没有 staging 目录时使用; 数据常驻到进程结束, 阻塞地等待预算可能永远等不到,
+    // 因此非阻塞地按遍历时的大小占用, 并为下面借出的 slab 留出余量; 预算不足时失败
+    const auto size = file.get_meta().size;
+    auto reservation = std::make_unique<buffer_pool::Reservation>(s_pool, size, std::try_to_lock, s_pool.slab_size());
+    if (reservation->size() < size) return {};
+    auto data = std::make_shared<std::vector<std::byte>>();
+    data->reserve(size);
+    const auto slab = s_pool.acquire();
+    // 文件在遍历之后变大时只保留占用了预算的部分
+    while (data->size() < size)
+    {
+        const auto n = file.read_into(slab.data(), std::min(slab.size(), size - data->size()));
+        if (n == 0) break;
+        data->insert(data->end(), slab.data(), slab.data() + n);
+    }
+    if (file.failed()) return {};
+    return {std::move(data), std::move(reservation)};
+}
+
+// 以 slab 为单位把文件流式写入 staging 目录, written 为实际写入的字节数
+static bool stream_to_file(ReadableFile& file, const std::filesystem::path& out_path, size_t& written)
 {
-    const auto all = file.read();
-    if (!all) return {};
-    return std::make_shared<std::vector<std::byte>>(std::move(*all));
+    std::ofstream ofs(out_path, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) return false;
+    const auto slab = buffer_pool::BufferPool::instance().acquire();
+    written = 0;
+    size_t n = 0;
+    while ((n = file.read_into(slab.data(), slab.size())) > 0)
+    {
+        ofs.write(reinterpret_cast<const char*>(slab.data()), static_cast<std::streamsize>(n));
+        if (!ofs.good()) return false;
+        written += n;
+    }
+    ofs.close();
+    return !file.failed();
 }
 
 bool P7zipBackend::add_file(ReadableFile& file)
 {
     if (mode_ != Mode::WriteOnly) return false;
-    const auto data = to_bytes(file);
-    if (!data) return false;
     auto meta = file.get_meta();
-    meta.size = data->size();
     meta.type = FileEntityType::RegularFile;
-    s_memMeta[meta.path] = meta;
-    s_memData[meta.path] = data;
-    // Also mirror file into staging directory for real 7z creation on close()
+    // Stream the file into the staging directory for real 7z creation on close()
+    std::filesystem::path out_path;
     if (!staging_dir_.empty())
     {
         try {
-            const auto rel = normalize_rel(meta.path);
-            if (!rel.empty())
+            if (const auto rel = normalize_rel(meta.path); !rel.empty())
             {
-                const auto out_path = staging_dir_ / rel;
+                out_path = staging_dir_ / rel;
                 std::filesystem::create_directories(out_path.parent_path());
-                std::ofstream ofs(out_path, std::ios::binary | std::ios::trunc);
-                if (ofs.is_open())
-                {
-                    ofs.write(reinterpret_cast<const char*>(data->data()), static_cast<std::streamsize>(data->size()));
-                    ofs.close();
-                }
             }
-        } catch (...) { /* ignore staging errors */ }
+        } catch (...) { out_path.clear(); /* fall back to in-memory catalog */ }
     }
+    if (!out_path.empty())
+    {
+        size_t written = 0;
+        if (!stream_to_file(file, out_path, written)) return false;
+        meta.size = written;
+        s_memMeta[meta.path] = meta;
+        s_memStaged[meta.path] = out_path;
+        s_memData.erase(meta.path);
+        return true;
+    }
+    auto mem = to_bytes(file);
+    if (!mem.data) return false;
+    meta.size = mem.data->size();
+    s_memMeta[meta.path] = meta;
+    s_memData[meta.path] = std::move(mem);
+    s_memStaged.erase(meta.path);
     return true;
 }
 
@@ -0,0 +1,75 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include "utils/streams.h"
+
+#include <climits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+FileSource::FileSource(const std::filesystem::path& path)
+{
+    const HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                      nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    handle_ = handle == INVALID_HANDLE_VALUE ? nullptr : handle;
+}
+
+FileSource::~FileSource()
+{
+    if (handle_)
+        CloseHandle(handle_);
+}
+
+bool FileSource::is_open() const
+{
+    return handle_ != nullptr;
+}
+
+size_t FileSource::read_at(const uint64_t offset, char* buffer, const size_t size)
+{
+    if (!handle_ || size == 0)
+        return 0;
+    // 同步句柄上带 OVERLAPPED 偏移的 ReadFile 只使用给定的偏移, 多个线程可以同时读取
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD read = 0;
+    if (!ReadFile(handle_, buffer, static_cast<DWORD>(std::min<size_t>(size, 1u << 30)), &read, &overlapped))
+        return 0;
+    return read;
+}
+#else
+FileSource::FileSource(const std::filesystem::path& path)
+    : fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC))
+{ }
+
+FileSource::~FileSource()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+bool FileSource::is_open() const
+{
+    return fd_ >= 0;
+}
+
+size_t FileSource::read_at(const uint64_t offset, char* buffer, const size_t size)
+{
+    if (fd_ < 0 || size == 0)
+        return 0;
+    ssize_t n;
+    do
+    {
+        n = ::pread(fd_, buffer, std::min<size_t>(size, SSIZE_MAX), static_cast<off_t>(offset));
+    } while (n < 0 && errno == EINTR);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+}
+#endif
@@ -8,9 +8,167 @@
 #include <unordered_map>
 
 #include "utils/crc.h"
+#include "utils/trace.h"
+#include "utils/transform.h"
 
 using namespace tar;
 
+namespace
+{
+    // 内嵌索引的定位块, 位于归档的最后 512 字节
+    constexpr char INDEX_MAGIC[16] = "BACKUPSUITE-IDX";
+    constexpr uint32_t INDEX_VERSION = 1;
+
+    void put_le(std::string& out, uint64_t value, const int bytes)
+    {
+        for (int i = 0; i < bytes; ++i, value >>= 8)
+            out.push_back(static_cast<char>(value & 0xFF));
+    }
+
+    void put_string(std::string& out, const std::string& value)
+    {
+        const auto size = std::min<size_t>(value.size(), UINT16_MAX);
+        put_le(out, size, 2);
+        out.append(value, 0, size);
+    }
+
+    // 带边界检查的顺序读取, 越界后 ok 变为 false 并始终返回 0
+    struct IndexReader
+    {
+        const std::string& data;
+        size_t pos = 0;
+        bool ok = true;
+
+        uint64_t get(const int bytes)
+        {
+            if (!ok || pos + bytes > data.size())
+            {
+                ok = false;
+                return 0;
+            }
+            uint64_t value = 0;
+            for (int i = bytes - 1; i >= 0; --i)
+                value = (value << 8) | static_cast<unsigned char>(data[pos + i]);
+            pos += bytes;
+            return value;
+        }
+        std::string get_string()
+        {
+            const auto size = get(2);
+            if (!ok || pos + size > data.size())
+            {
+                ok = false;
+                return {};
+            }
+            auto value = data.substr(pos, size);
+            pos += size;
+            return value;
+        }
+    };
+}
+
+static TarStandard detect_standard(const TarFileHeader& header)
+{
+    if (strncmp(header.ustar.reserved, "ustar  ", 8) == 0)
+        return TarStandard::GNU;
+    if (strncmp(header.ustar.magic, "ustar", 6) == 0 && strncmp(header.ustar.version, "00", sizeof(header.ustar.version)) == 0)
+        return TarStandard::POSIX_2001_PAX;
+    return TarStandard::UNKNOWN;
+}
+
+// 成员数据补齐到整块后的长度
+static uint64_t padded_size(const uint64_t size)
+{
+    return (size + TarFile::TarBlockSize - 1) / TarFile::TarBlockSize * TarFile::TarBlockSize;
+}
+
+namespace
+{
+    /**
+     * @brief 建立索引时读取头部块的窗口
+     * 顺序读取时(成员都很小)每次填充一个大窗口; 跳过大成员的数据之后只填充一个小窗口,
+     * 因此大文件组成的归档只需要读取头部附近的少量数据
+     */
+    class HeaderWindow
+    {
+        static constexpr size_t SEQUENTIAL_FILL = 1024 * 1024;
+        static constexpr size_t SEEK_FILL = 16 * 1024;
+        std::ifstream& in_;
+        uint64_t end_;
+        std::vector<char> buffer_;
+        uint64_t window_offset_ = 0; // buffer_[0] 在文件中的偏移
+        size_t window_size_ = 0;
+        uint64_t offset_ = 0;        // 下一次读取的偏移
+    public:
+        HeaderWindow(std::ifstream& in, const uint64_t end) : in_(in), end_(end), buffer_(SEQUENTIAL_FILL) {}
+        [[nodiscard]] uint64_t offset() const { return offset_; }
+        void skip(const uint64_t size) { offset_ += size; }
+        bool read(char* out, size_t size)
+        {
+            while (size > 0)
+            {
+                if (offset_ < window_offset_ || offset_ >= window_offset_ + window_size_)
+                {
+                    const bool sequential = offset_ == window_offset_ + window_size_;
+                    const auto fill = std::min<uint64_t>(sequential ? SEQUENTIAL_FILL : SEEK_FILL, end_ > offset_ ? end_ - offset_ : 0);
+                    if (fill == 0)
+                        return false;
+                    in_.clear();
+                    if (!sequential || in_.tellg() != static_cast<std::streamoff>(offset_))
+                        in_.seekg(static_cast<std::streamoff>(offset_), std::ios::beg);
+                    in_.read(buffer_.data(), static_cast<std::streamsize>(fill));
+                    window_offset_ = offset_;
+                    window_size_ = static_cast<size_t>(in_.gcount());
+                    if (window_size_ == 0)
+                        return false;
+                }
+                const auto position = static_cast<size_t>(offset_ - window_offset_);
+                const auto n = std::min(size, window_size_ - position);
+                std::memcpy(out, buffer_.data() + position, n);
+                out += n;
+                offset_ += n;
+                size -= n;
+            }
+            return true;
+        }
+    };
+}
+
+// 以 0 补齐的八进制写入定长字段, 末尾保留 '\0', 等价于 snprintf("%0*o") 但没有格式化开销
+static void write_octal(char* field, const size_t width, uint64_t value)
+{
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i-- > 0;)
+    {
+        field[i] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+}
+// 定长数值字段: 放得下时写八进制, 否则写 GNU base-256(首字节最高位置 1, 其余为大端序二进制)
+static void write_number(char* field, const size_t width, uint64_t value)
+{
+    if ((width - 1) * 3 >= 64 || value >> ((width - 1) * 3) == 0)
+    {
+        write_octal(field, width, value);
+        return;
+    }
+    for (size_t i = width; i-- > 0;)
+    {
+        field[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+    field[0] = static_cast<char>(0x80);
+}
+// write_number 的逆操作, 同时接受八进制和 base-256 两种编码
+static uint64_t read_number(const char* field, const size_t width)
+{
+    if (!(static_cast<unsigned char>(field[0]) & 0x80))
+        return std::strtoull(std::string(field, strnlen(field, width)).c_str(), nullptr, 8);
+    uint64_t value = static_cast<unsigned char>(field[0]) & 0x7F;
+    for (size_t i = 1; i < width; ++i)
+        value = (value << 8) | static_cast<unsigned char>(field[i]);
+    return value;
+}
 static std::string key_value2pax_field(const std::string& key, const std::string& value)
 {
     if (value.empty() || key.empty()) return {};
@@ -72,26 +230,35 @@ static std::chrono::system_clock::time_point pax_string2time_point(const std::st
 
 void TarFile::init_db_from_tar()
 {
+    TRACE_SPAN(Tar, "tar.index");
     if (!is_valid_ || !ifs_ || !ifs_->is_open())
     {
         return;
     }
+    // 分帧压缩的归档改为通过帧表读取, 此后所有的定位和读取都使用未压缩的偏移
+    if ((frame_reader_ = compress::frames::FrameReaderBuf::open(*ifs_->rdbuf())))
+        static_cast<std::istream&>(*ifs_).rdbuf(frame_reader_.get());
+    if (load_index())
+    {
+        has_index_ = true;
+        return;
+    }
     char block[512];
     std::string long_name;
     std::map<std::string, std::string> pax_headers;
     bool previous_special_block = false;
     bool last_block_all_zero = false;
+    data_end_ = 0;
     ifs_->seekg(0, std::ios::end);
-    size_t end_of_archive_offset = ifs_->tellg(), current_offset = 0;
-    ifs_->seekg(0, std::ios::beg);
-    while (current_offset < end_of_archive_offset)
+    const uint64_t end_of_archive_offset = ifs_->tellg();
+    // 头部块通过窗口读取, 成员数据直接跳过, 不再整块读入
+    HeaderWindow window(*ifs_, end_of_archive_offset);
+    while (window.offset() < end_of_archive_offset)
     {
-        ifs_->read(block, 512);
-        current_offset += 512;
-        if (ifs_->gcount() != 512)
+        if (!window.read(block, 512))
         {
             is_valid_ = false;
-            return;
+            break;
         }
         if (std::all_of(std::begin(block), std::end(block), [](const char c){return !c;}))
         {
@@ -106,17 +273,7 @@ void TarFile::init_db_from_tar()
         last_block_all_zero = false;
 
         const auto* header = reinterpret_cast<TarFileHeader*>(block);
-
-        if (strncmp(header->ustar.reserved, "ustar  ", 8) == 0)
-        {
-            standard_ = TarStandard::GNU;
-        } else if (strncmp(header->ustar.magic, "ustar", 6) == 0 && strncmp(header->ustar.version, "00", sizeof(header->ustar.version)) == 0)
-        {
-            standard_ = TarStandard::POSIX_2001_PAX;
-        } else
-        {
-            standard_ = TarStandard::UNKNOWN;
-        }
+        standard_ = detect_standard(*header);
 
         auto meta = tar_header2file_meta(*header, standard_);
 
@@ -155,6 +312,10 @@ void TarFile::init_db_from_tar()
                 {
                     meta.symbolic_link_target = link_path->second;
                 }
+                if (const auto size = pax_headers.find("size"); size != pax_headers.end() && !size->second.empty())
+                {
+                    meta.size = static_cast<size_t>(std::strtoull(size->second.c_str(), nullptr, 10));
+                }
             }
             previous_special_block = false;
         }
@@ -169,53 +330,27 @@ void TarFile::init_db_from_tar()
                 if (header->type_flag == 'L')   // 长文件名标示
                 {
                     // ReSharper disable once CppDFAUnreachableCode
-                    auto name_size = meta.size;
-                    TarBlock name_buffer{};
-                    while (ifs_->read(name_buffer.block, sizeof(name_buffer)))
+                    std::string name_buffer(padded_size(meta.size), '\0');
+                    if (!window.read(name_buffer.data(), name_buffer.size()))
                     {
-                        const auto delta_offset = ifs_->gcount();
-                        if (delta_offset != sizeof(name_buffer))
-                        {
-                            is_valid_ = false;
-                            return;
-                        }
-                        current_offset += sizeof(name_buffer);
-                        long_name.append(name_buffer.block);
-                        if (delta_offset >= name_size)
-                        {
-                            break;
-                        }
+                        is_valid_ = false;
+                        break;
                     }
+                    long_name.assign(name_buffer.c_str(), strnlen(name_buffer.c_str(), meta.size));
                     previous_special_block = true;
                     continue;
                 }
-                // ReSharper disable once CppDFAUnreachableCode
-                if (header->size[0] & 0x80)
-                {
-                    // GNU 扩展的大文件头
-                    size_t b64size = 0;
-                    for (int i=0; i<sizeof(header->size); ++i)
-                    {
-                        b64size = (b64size << 8) | (i ? header->size[i] : (header->size[0] & 0x7F));
-                    }
-                    meta.size = b64size;
-                }
             }
             else if (standard_ == TarStandard::POSIX_2001_PAX)
             {
                 if (header->type_flag == 'x')   // PAX 扩展头
                 {
                     // ReSharper disable once CppDFAUnreachableCode
-                    int pax_size = static_cast<int>(meta.size);
-                    pax_size = ((pax_size / TarBlockSize) + static_cast<bool>(pax_size % TarBlockSize)) * TarBlockSize;
-                    std::string pax_buffer;
-                    pax_buffer.resize(pax_size);
-                    ifs_->read(&pax_buffer[0], pax_size);
-                    current_offset += pax_size;
-                    if (ifs_->gcount() != pax_size)
+                    std::string pax_buffer(padded_size(meta.size), '\0');
+                    if (!window.read(pax_buffer.data(), pax_buffer.size()))
                     {
                         is_valid_ = false;
-                        return;
+                        break;
                     }
                     size_t pos = 0;
                     while (pos < pax_buffer.size())
@@ -240,67 +375,83 @@ void TarFile::init_db_from_tar()
             }
         }
 
-        if (!insert_entity(meta, ifs_->tellg()))
+        if (!insert_entity(meta, window.offset()))
         {
             is_valid_ = false;
-            return;
+            break;
         }
-        auto size = meta.size;
-        while (!ifs_->eof() && size > 0)
+        // 按补齐到 512 字节的长度直接跳到下一个头部
+        window.skip(padded_size(meta.size));
+        if (window.offset() > end_of_archive_offset)
         {
-            ifs_->read(block, 512);
-            current_offset += 512;
-            const auto gcount = ifs_->gcount();
-            if (gcount != 512)
-            {
-                is_valid_ = false;
-                return;
-            }
-            if (size <= gcount)
-                break;
-            size -= gcount;
+            is_valid_ = false;
+            break;
         }
+        data_end_ = window.offset();
     }
+    ifs_->clear();
 }
 
-bool TarFile::insert_entity(const FileEntityMeta& meta, const int offset) const
+void TarIndexCodec::bind(sqlite3_stmt* stmt, const Record& record)
 {
-    const auto stmt = db_.create_statement("INSERT INTO entity (" + db::TarInitializationStrategy::SQLEntityColumns + ") "
-    "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);");
+    const auto& [meta, offset] = record;
     int i = 1;
     if (meta.type == FileEntityType::Directory)
     {
         if (auto path_str = meta.path.generic_u8string(); !path_str.empty() && path_str.back() != '/')
         {
             path_str += '/';
-            sqlite3_bind_text(stmt.get(), i++, reinterpret_cast<const char*>(path_str.c_str()), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, i++, reinterpret_cast<const char*>(path_str.c_str()), -1, SQLITE_TRANSIENT);
         } else
         {
-            sqlite3_bind_text(stmt.get(), i++, reinterpret_cast<const char*>(meta.path.generic_u8string().c_str()), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, i++, reinterpret_cast<const char*>(meta.path.generic_u8string().c_str()), -1, SQLITE_TRANSIENT);
         }
     } else
     {
-        sqlite3_bind_text(stmt.get(), i++, reinterpret_cast<const char*>(meta.path.generic_u8string().c_str()), -1, SQLITE_TRANSIENT);
-    }
-    sqlite3_bind_int(stmt.get(), i++, static_cast<int>(meta.type));
-    sqlite3_bind_int64(stmt.get(), i++, static_cast<sqlite3_int64>(meta.size));
-    sqlite3_bind_int(stmt.get(), i++, offset);
-    sqlite3_bind_int64(stmt.get(), i++, std::chrono::duration_cast<std::chrono::seconds>(meta.creation_time.time_since_epoch()).count());
-    sqlite3_bind_int64(stmt.get(), i++, std::chrono::duration_cast<std::chrono::seconds>(meta.modification_time.time_since_epoch()).count());
-    sqlite3_bind_int64(stmt.get(), i++, std::chrono::duration_cast<std::chrono::seconds>(meta.access_time.time_since_epoch()).count());
-    sqlite3_bind_int(stmt.get(), i++, static_cast<int>(meta.posix_mode));
-    sqlite3_bind_int(stmt.get(), i++, static_cast<int>(meta.uid));
-    sqlite3_bind_int(stmt.get(), i++, static_cast<int>(meta.gid));
-    sqlite3_bind_text(stmt.get(), i++, meta.user_name.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt.get(), i++, meta.group_name.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt.get(), i++, static_cast<int>(meta.windows_attributes));
+        sqlite3_bind_text(stmt, i++, reinterpret_cast<const char*>(meta.path.generic_u8string().c_str()), -1, SQLITE_TRANSIENT);
+    }
+    sqlite3_bind_int(stmt, i++, static_cast<int>(meta.type));
+    sqlite3_bind_int64(stmt, i++, static_cast<sqlite3_int64>(meta.size));
+    sqlite3_bind_int64(stmt, i++, static_cast<sqlite3_int64>(offset));
+    sqlite3_bind_int64(stmt, i++, std::chrono::duration_cast<std::chrono::seconds>(meta.creation_time.time_since_epoch()).count());
+    sqlite3_bind_int64(stmt, i++, std::chrono::duration_cast<std::chrono::seconds>(meta.modification_time.time_since_epoch()).count());
+    sqlite3_bind_int64(stmt, i++, std::chrono::duration_cast<std::chrono::seconds>(meta.access_time.time_since_epoch()).count());
+    sqlite3_bind_int(stmt, i++, static_cast<int>(meta.posix_mode));
+    sqlite3_bind_int(stmt, i++, static_cast<int>(meta.uid));
+    sqlite3_bind_int(stmt, i++, static_cast<int>(meta.gid));
+    sqlite3_bind_text(stmt, i++, meta.user_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, i++, meta.group_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, i++, static_cast<int>(meta.windows_attributes));
     if (meta.type == FileEntityType::SymbolicLink)
-        sqlite3_bind_text(stmt.get(), i++, reinterpret_cast<const char*>(meta.symbolic_link_target.generic_u8string().c_str()), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, i++, reinterpret_cast<const char*>(meta.symbolic_link_target.generic_u8string().c_str()), -1, SQLITE_TRANSIENT);
     else
-        sqlite3_bind_null(stmt.get(), i++);
-    sqlite3_bind_int(stmt.get(), i++, static_cast<int>(meta.device_major));
-    sqlite3_bind_int(stmt.get(), i++, static_cast<int>(meta.device_minor));
-    return db_.execute(*stmt, true);
+        sqlite3_bind_null(stmt, i++);
+    sqlite3_bind_int(stmt, i++, static_cast<int>(meta.device_major));
+    sqlite3_bind_int(stmt, i++, static_cast<int>(meta.device_minor));
+}
+
+bool TarFile::insert_entity(const FileEntityMeta& meta, const uint64_t offset) const
+{
+    TRACE_SPAN(Tar, "tar.insert_entity");
+    // 记录按 SQLite 后端还原出的样子保存: 目录以 '/' 结尾, 时间只保留到秒, 非符号链接不带链接目标
+    TarIndexCodec::Record record{meta, offset};
+    auto& stored = record.first;
+    if (auto path_str = stored.path.generic_u8string(); stored.type == FileEntityType::Directory && !path_str.empty() && path_str.back() != '/')
+        stored.path = std::filesystem::u8path(path_str + '/');
+    for (auto* time : {&stored.creation_time, &stored.modification_time, &stored.access_time})
+        *time = std::chrono::system_clock::from_time_t(std::chrono::duration_cast<std::chrono::seconds>(time->time_since_epoch()).count());
+    if (stored.type != FileEntityType::SymbolicLink)
+        stored.symbolic_link_target.clear();
+    return index_->insert(stored.path.generic_u8string(), record);
+}
+
+bool TarFile::insert_entities(const std::vector<std::pair<FileEntityMeta, uint64_t>>& entities) const
+{
+    TRACE_SPAN(Tar, "tar.insert_entities");
+    bool ok = true;
+    for (const auto& [meta, offset] : entities)
+        ok = insert_entity(meta, offset) && ok;
+    return ok;
 }
 
 FileEntityMeta TarFile::tar_header2file_meta(const TarFileHeader &header, TarStandard standard)
@@ -311,7 +462,7 @@ FileEntityMeta TarFile::tar_header2file_meta(const TarFileHeader &header, TarSta
     {
         path = prefix + path;
     }
-    const size_t size = std::strtoull(header.size, nullptr, 8);
+    const auto size = static_cast<size_t>(read_number(header.size, sizeof(header.size)));
     FileEntityType type;
     switch (header.type_flag)
     {
@@ -380,7 +531,8 @@ FileEntityMeta TarFile::tar_header2file_meta(const TarFileHeader &header, TarSta
 // return nullptr if it's not a file, or file not found
 std::unique_ptr<TarFile::TarIstream> TarFile::get_file_stream(const std::filesystem::path& path) const
 {
-    if (!is_valid_ || !ifs_ || !ifs_->is_open())
+    TRACE_SPAN(Tar, "tar.lookup");
+    if (!is_valid_ || !source_)
         return nullptr;
     // path like "/...", and not contain any driver letter
     if (path.has_root_name() || !path.is_relative())
@@ -398,37 +550,19 @@ std::unique_ptr<TarFile::TarIstream> TarFile::get_file_stream(const std::filesys
         path_str = path_str.substr(1);
     }
     if (path_str.empty()) return nullptr;
-    auto stmt = db_.create_statement(
-        "SELECT " + db::TarInitializationStrategy::SQLEntityColumns + " FROM entity WHERE path = ? LIMIT 1;"
-    );
-
+    // 同一路径追加过多次时取最后写入的成员, 与解包时后者覆盖前者一致
     // reinterpret_cast for C++20
     // ReSharper disable once CppRedundantCastExpression
-    sqlite3_bind_text(stmt.get(), 1, reinterpret_cast<const char*>(path_str.c_str()), -1, SQLITE_TRANSIENT);
-
-    std::unique_ptr<TarIstream> tar;
-    try
-    {
-        const auto entity = db_.query_one<db::TarInitializationStrategy::SQLEntity>(std::move(stmt));
-        auto [meta, offset] = sql_entity2file_meta(entity);
-        char block[512];
-        ifs_->seekg(offset, std::ios::beg);
-        ifs_->read(block, sizeof(TarFileHeader));
-        tar = std::make_unique<TarIstream>(*ifs_.get(), offset, meta);
-    } catch ([[maybe_unused]] const std::exception& e)
-    {
+    const auto record = index_->find(reinterpret_cast<const char*>(path_str.c_str()));
+    if (!record)
         return nullptr;
-    }
-    return tar;
+    const auto& [meta, offset] = *record;
+    return std::make_unique<TarIstream>(source_, offset, meta, read_buffer_limit_);
 }
 
-bool TarFile::add_entity(ReadableFile& file)
+std::string TarFile::make_entry_headers(const FileEntityMeta& meta)
 {
-    if (!ofs_ || !ofs_->is_open())
-        return false;
-
-    // Get the file metadata from ReadableFile
-    FileEntityMeta& meta = file.get_meta();
+    std::string out;
     auto full_path = meta.path.generic_u8string();
     bool is_long_path = false;
     std::unordered_map<std::string, std::string> pax_map;
@@ -466,13 +600,13 @@ bool TarFile::add_entity(ReadableFile& file)
         long_name_header.checksum[7] = ' ';
 
         // Write long filename header block
-        ofs_->write(reinterpret_cast<const char*>(&long_name_header), sizeof(long_name_header));
+        out.append(reinterpret_cast<const char*>(&long_name_header), sizeof(long_name_header));
 
         // Write long filename content
         size_t padding = ((long_name_entry_path.size() / TarBlockSize) + static_cast<bool>(long_name_entry_path.size() % TarBlockSize)) * TarBlockSize;
         std::vector<char> name_block(padding, 0);
         memcpy(name_block.data(), long_name_entry_path.c_str(), long_name_entry_path.size());
-        ofs_->write(name_block.data(), static_cast<long long>(name_block.size()));
+        out.append(name_block.data(), name_block.size());
 
         is_long_path = true;
     }
@@ -555,9 +689,17 @@ bool TarFile::add_entity(ReadableFile& file)
         {
             pax_map["gname"] = meta.group_name;
         }
+        // 超出 11 位八进制(8 GiB)的大小写入扩展记录, 头部字段中仍保留 base-256 编码
+        if (meta.type == FileEntityType::RegularFile && meta.size > 077777777777ULL)
+        {
+            pax_map["size"] = std::to_string(meta.size);
+        }
     }
 
     // generate a shortcut for long path and replace it (long path SHOULD be handled above)
+    // 占位路径只写进 tar 头, 调用方的 meta 保留真实路径供索引使用
+    const FileEntityMeta* header_meta = &meta;
+    FileEntityMeta short_meta;
     if (is_long_path)
     {
         // shortcut is like '@PathCut/_pc_crc32/01234567(CRC32)/filename'
@@ -574,7 +716,9 @@ bool TarFile::add_entity(ReadableFile& file)
         {
             new_path_ss << filename;
         }
-        meta.path = new_path_ss.str();
+        short_meta = meta;
+        short_meta.path = new_path_ss.str();
+        header_meta = &short_meta;
     }
 
     // 写入PAX扩展字段
@@ -591,7 +735,7 @@ bool TarFile::add_entity(ReadableFile& file)
         // The name field is set to "PaxHeader/@PaxHeader" for PAX extended header entries
         memset(reinterpret_cast<char*>(&pax_header_entry), 0, sizeof(pax_header_entry));
         strncpy_s(pax_header_entry.name, "PaxHeader/@PaxHeader", sizeof(pax_header_entry.name));
-        snprintf(pax_header_entry.size, sizeof(pax_header_entry.size), "%011o", static_cast<unsigned int>(pax_header.size()));
+        write_octal(pax_header_entry.size, sizeof(pax_header_entry.size), pax_header.size());
         pax_header_entry.type_flag = 'x'; // PAX extended header marker
         // USTAR magic and version
         strncpy_s(pax_header_entry.ustar.magic, "ustar", sizeof(pax_header_entry.ustar.magic));
@@ -605,53 +749,64 @@ bool TarFile::add_entity(ReadableFile& file)
         {
             checksum += bytes[i];
         }
-        snprintf(pax_header_entry.checksum, sizeof(pax_header_entry.checksum), "%06o", checksum);
-        pax_header_entry.checksum[6] = '\0';
+        write_octal(pax_header_entry.checksum, sizeof(pax_header_entry.checksum) - 1, checksum);
         pax_header_entry.checksum[7] = ' ';
 
         // Write PAX header block
-        ofs_->write(reinterpret_cast<const char*>(&pax_header_entry), sizeof(pax_header_entry));
+        out.append(reinterpret_cast<const char*>(&pax_header_entry), sizeof(pax_header_entry));
 
         // Write PAX header content
         size_t padding = ((pax_header.size() / TarBlockSize) + static_cast<bool>(pax_header.size() % TarBlockSize)) * TarBlockSize;
         std::vector<char> pax_block(padding, 0);
         memcpy(pax_block.data(), pax_header.c_str(), pax_header.size());
-        ofs_->write(pax_block.data(), static_cast<long long>(pax_block.size()));
+        out.append(pax_block.data(), pax_block.size());
     }
 
-    // Get the current offset for the entry
-    int entry_offset = static_cast<int>(ofs_->tellp());
+    // Generate the main tar header, it's always the last block of the returned headers
+    const TarFileHeader header = file_meta2tar_header(*header_meta, standard_);
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    return out;
+}
 
-    // Generate the main tar header
-    TarFileHeader header = file_meta2tar_header(meta, standard_);
+bool TarFile::add_entity(ReadableFile& file)
+{
+    TRACE_SPAN(Tar, "tar.add_entity");
+    if (!ofs_ || !ofs_->is_open())
+        return false;
 
-    // Write the tar header
-    ofs_->write(reinterpret_cast<const char*>(&header), sizeof(header));
+    // Get the file metadata from ReadableFile
+    FileEntityMeta& meta = file.get_meta();
+    const auto headers = make_entry_headers(meta);
+
+    // 与读取时建立的索引一致, 记录数据的起始偏移
+    uint64_t entry_offset = static_cast<uint64_t>(ofs_->tellp()) + headers.size();
+
+    // Write the extended headers and the tar header
+    ofs_->write(headers.data(), static_cast<long long>(headers.size()));
 
     // Write the file content if it's a regular file
     if (meta.type == FileEntityType::RegularFile)
     {
-        size_t remaining = meta.size;
-
-        while (remaining > 0)
-        {
-            constexpr size_t buffer_size = 8192;
-            size_t to_read = std::min(buffer_size, remaining);
-            auto buffer = file.read(to_read);
-            if (!buffer || buffer->empty())
-                break;
-
-            ofs_->write(reinterpret_cast<const char*>(buffer->data()), static_cast<long long>(buffer->size()));
-            remaining -= buffer->size();
-        }
+        TRACE_SPAN(Tar, "tar.write_data");
+        transform::Pipeline pipeline;
+        pipeline.emplace<transform::OstreamSink>(*ofs_);
+        if (!transform::pump(file, pipeline, meta.size))
+            return false;
 
-        // Pad to 512-byte boundary
-        size_t padding = (TarBlockSize - (meta.size % TarBlockSize)) % TarBlockSize;
-        if (padding > 0)
+        // 文件在读取过程中变短时以 0 补齐, 再补齐到 512 字节边界
+        const uint64_t padded = meta.size + (TarBlockSize - meta.size % TarBlockSize) % TarBlockSize;
+        if (pipeline.bytes_in() < padded)
         {
-            std::vector<char> pad_block(padding, 0);
-            ofs_->write(pad_block.data(), static_cast<long long>(pad_block.size()));
+            const std::vector<std::byte> zeros(static_cast<size_t>(std::min<uint64_t>(padded - pipeline.bytes_in(), 64 * 1024)));
+            while (pipeline.bytes_in() < padded)
+            {
+                const auto n = static_cast<size_t>(std::min<uint64_t>(zeros.size(), padded - pipeline.bytes_in()));
+                if (!pipeline.write(zeros.data(), n))
+                    return false;
+            }
         }
+        if (!pipeline.finish())
+            return false;
     }
     else if (meta.type == FileEntityType::Directory)
     {
@@ -663,8 +818,62 @@ bool TarFile::add_entity(ReadableFile& file)
     return insert_entity(meta, entry_offset);
 }
 
+bool TarFile::add_entities(const std::vector<ReadableFile*>& files)
+{
+    TRACE_SPAN(Tar, "tar.add_entities");
+    if (!ofs_ || !ofs_->is_open())
+        return false;
+    if (files.empty())
+        return true;
+
+    // 整批的头和数据先拼进一块连续缓冲区, 最后一次写出, 再一次性写入索引
+    const auto base_offset = static_cast<uint64_t>(ofs_->tellp());
+    std::string out;
+    std::vector<std::pair<FileEntityMeta, uint64_t>> entities;
+    entities.reserve(files.size());
+    for (const auto file : files)
+    {
+        if (!file)
+            continue;
+        const FileEntityMeta& meta = file->get_meta();
+        out += make_entry_headers(meta);
+        const uint64_t entry_offset = base_offset + out.size();
+
+        if (meta.type == FileEntityType::RegularFile && meta.size > 0)
+        {
+            const auto data_begin = out.size();
+            out.resize(data_begin + meta.size);
+            auto* dst = reinterpret_cast<std::byte*>(&out[data_begin]);
+            size_t done = 0;
+            while (done < meta.size)
+            {
+                const auto n = file->read_into(dst + done, meta.size - done);
+                if (n == 0)
+                    break;
+                done += n;
+            }
+            if (file->failed())
+                return false;
+            // 文件在读取过程中变短时以 0 补齐, 保证头中声明的大小与归档结构一致
+            if (done < meta.size)
+                std::memset(dst + done, 0, meta.size - done);
+            out.resize(out.size() + (TarBlockSize - meta.size % TarBlockSize) % TarBlockSize, '\0');
+        }
+        entities.emplace_back(meta, entry_offset);
+    }
+    {
+        TRACE_SPAN(Tar, "tar.write_data");
+        ofs_->write(out.data(), static_cast<long long>(out.size()));
+    }
+    if (!ofs_->good())
+        return false;
+    return insert_entities(entities);
+}
+
 void TarFile::close()
 {
+    TRACE_SPAN(Tar, "tar.close");
+    [[maybe_unused]] const auto flushed = index_->flush();
     if (ifs_)
     {
         if (ifs_->is_open()) ifs_->close();
@@ -678,7 +887,8 @@ void TarFile::close()
     }
 
     // Write two empty blocks to mark the end of archive (in PAX extension)
-    if (standard_ == TarStandard::POSIX_2001_PAX)
+    // 内嵌索引必须放在结束标记之后, 此时任何格式都写出结束标记; 追加时也总是写出, 保持原归档的结束标记
+    if (standard_ == TarStandard::POSIX_2001_PAX || embed_index_ || !append_path_.empty())
     {
         TarBlock empty_block{};
         memset(empty_block.block, 0, sizeof(empty_block.block));
@@ -690,8 +900,219 @@ void TarFile::close()
         ofs_->write(empty_block.block, sizeof(empty_block.block));
     }
 
+    if (embed_index_)
+        write_index();
+
+    if (frame_writer_)
+    {
+        if (!frame_writer_->finish())
+            ofs_->setstate(std::ios::badbit);
+        static_cast<std::ostream&>(*ofs_).rdbuf(ofs_->rdbuf());
+    }
+
     // Close the output file stream
+    const auto end = static_cast<uint64_t>(ofs_->tellp());
     ofs_->close();
+    // 追加的内容比原来的结束标记和索引短时, 截掉末尾残留的旧数据
+    if (!append_path_.empty())
+    {
+        std::error_code ec;
+        if (std::filesystem::file_size(append_path_, ec) > end && !ec)
+            std::filesystem::resize_file(append_path_, end, ec);
+        append_path_.clear();
+    }
+}
+
+void TarFile::open_for_append(const std::filesystem::path& path)
+{
+    TRACE_SPAN(Tar, "tar.open_append");
+    ifs_ = IFStreamPointer(new std::ifstream(path, std::ios::binary), FStreamDeleter<std::ifstream>());
+    if (!ifs_ || !ifs_->is_open())
+    {
+        is_valid_ = false;
+        return;
+    }
+    index_->begin_load();
+    init_db_from_tar();
+    if (!index_->end_load())
+        is_valid_ = false;
+    ifs_.reset();
+    // 扫描失败时不知道归档在哪里结束, 不能写入; 分帧压缩的归档不支持追加
+    if (!is_valid_ || frame_reader_)
+    {
+        is_valid_ = false;
+        return;
+    }
+    // 原归档有内嵌索引时在关闭时重写, 否则保持没有索引
+    embed_index_ = has_index_;
+    // in | out 打开不会截断文件
+    ofs_ = OFStreamPointer(new std::ofstream(path, std::ios::binary | std::ios::in | std::ios::out), FStreamDeleter<std::ofstream>());
+    if (!ofs_ || !ofs_->is_open())
+    {
+        is_valid_ = false;
+        return;
+    }
+    ofs_->seekp(static_cast<std::streamoff>(data_end_), std::ios::beg);
+    append_path_ = path;
+}
+
+void TarFile::open_source(const std::filesystem::path& path)
+{
+    if (!is_valid_)
+        return;
+    if (frame_reader_)
+        source_ = compress::frames::FrameSource::open(path);
+    else if (auto file = std::make_shared<FileSource>(path); file->is_open())
+        source_ = std::move(file);
+    if (!source_)
+        is_valid_ = false;
+}
+
+bool TarFile::set_frame_compression(const size_t frame_size, const int level)
+{
+    if (!writable() || !append_path_.empty() || frame_writer_ || ofs_->tellp() != 0)
+        return false;
+    frame_writer_ = std::make_unique<compress::frames::FrameWriterBuf>(*ofs_->rdbuf(), frame_size, level);
+    static_cast<std::ostream&>(*ofs_).rdbuf(frame_writer_.get());
+    return true;
+}
+
+void TarFile::write_index()
+{
+    TRACE_SPAN(Tar, "tar.write_index");
+    const auto index_offset = static_cast<uint64_t>(ofs_->tellp());
+    std::string index;
+    uint64_t count = 0;
+    // 路径有序, 每条只保存与上一条不同的后缀
+    std::string previous;
+    const auto seconds = [](const std::chrono::system_clock::time_point& time)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count());
+    };
+    index_->visit_subtree({}, [&](const TarIndexCodec::Record& record)
+    {
+        const auto& [meta, offset] = record;
+        const auto path = meta.path.generic_u8string();
+        size_t shared = 0;
+        while (shared < previous.size() && shared < path.size() && shared < UINT16_MAX && previous[shared] == path[shared])
+            ++shared;
+        put_le(index, shared, 2);
+        put_string(index, path.substr(shared));
+        put_le(index, static_cast<uint32_t>(meta.type), 1);
+        put_le(index, static_cast<uint64_t>(meta.size), 8);
+        put_le(index, offset, 8);
+        put_le(index, seconds(meta.creation_time), 8);
+        put_le(index, seconds(meta.modification_time), 8);
+        put_le(index, seconds(meta.access_time), 8);
+        put_le(index, meta.posix_mode, 4);
+        put_le(index, meta.uid, 4);
+        put_le(index, meta.gid, 4);
+        put_string(index, meta.user_name);
+        put_string(index, meta.group_name);
+        put_le(index, meta.windows_attributes, 4);
+        put_string(index, meta.symbolic_link_target.generic_u8string());
+        put_le(index, meta.device_major, 4);
+        put_le(index, meta.device_minor, 4);
+        previous = path;
+        ++count;
+    });
+    crc::CRC32 crc;
+    crc.update(reinterpret_cast<const std::byte*>(index.data()), index.size());
+    const auto index_size = index.size();
+    index.resize((index_size + TarBlockSize - 1) / TarBlockSize * TarBlockSize, '\0');
+
+    std::string footer(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    put_le(footer, INDEX_VERSION, 4);
+    put_le(footer, index_offset, 8);
+    put_le(footer, index_size, 8);
+    put_le(footer, count, 8);
+    put_le(footer, crc.finalize(), 4);
+    footer.resize(TarBlockSize, '\0');
+    ofs_->write(index.data(), static_cast<long long>(index.size()));
+    ofs_->write(footer.data(), static_cast<long long>(footer.size()));
+}
+
+bool TarFile::load_index()
+{
+    TRACE_SPAN(Tar, "tar.load_index");
+    ifs_->seekg(0, std::ios::end);
+    const auto file_size = static_cast<uint64_t>(ifs_->tellg());
+    if (file_size < 3 * TarBlockSize)
+        return false;
+    std::string footer(TarBlockSize, '\0');
+    ifs_->seekg(static_cast<std::streamoff>(file_size - TarBlockSize), std::ios::beg);
+    if (!ifs_->read(&footer[0], TarBlockSize) || footer.compare(0, sizeof(INDEX_MAGIC), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+    {
+        ifs_->clear();
+        return false;
+    }
+    IndexReader locator{footer, sizeof(INDEX_MAGIC)};
+    const auto version = locator.get(4);
+    const auto index_offset = locator.get(8);
+    const auto index_size = locator.get(8);
+    const auto count = locator.get(8);
+    const auto expected_crc = static_cast<uint32_t>(locator.get(4));
+    if (!locator.ok || version != INDEX_VERSION || index_offset > file_size - TarBlockSize ||
+        index_size > file_size - TarBlockSize - index_offset)
+        return false;
+
+    std::string index(index_size, '\0');
+    ifs_->seekg(static_cast<std::streamoff>(index_offset), std::ios::beg);
+    if (index_size && !ifs_->read(&index[0], static_cast<std::streamsize>(index_size)))
+    {
+        ifs_->clear();
+        return false;
+    }
+    crc::CRC32 crc;
+    crc.update(reinterpret_cast<const std::byte*>(index.data()), index.size());
+    if (crc.finalize() != expected_crc)
+        return false;
+    // 索引紧跟在两个结束块之后
+    data_end_ = index_offset >= 2 * TarBlockSize ? index_offset - 2 * TarBlockSize : 0;
+
+    std::vector<std::pair<FileEntityMeta, uint64_t>> entities;
+    entities.reserve(static_cast<size_t>(std::min<uint64_t>(count, index_size / 64 + 1)));
+    IndexReader reader{index};
+    std::string path;
+    for (uint64_t i = 0; i < count && reader.ok; ++i)
+    {
+        const auto shared = reader.get(2);
+        const auto suffix = reader.get_string();
+        if (shared > path.size())
+            return false;
+        path.resize(shared);
+        path += suffix;
+        FileEntityMeta meta{};
+        meta.path = std::filesystem::u8path(path);
+        meta.type = static_cast<FileEntityType>(reader.get(1));
+        meta.size = static_cast<size_t>(reader.get(8));
+        const auto offset = reader.get(8);
+        meta.creation_time = std::chrono::system_clock::from_time_t(static_cast<time_t>(reader.get(8)));
+        meta.modification_time = std::chrono::system_clock::from_time_t(static_cast<time_t>(reader.get(8)));
+        meta.access_time = std::chrono::system_clock::from_time_t(static_cast<time_t>(reader.get(8)));
+        meta.posix_mode = static_cast<uint32_t>(reader.get(4));
+        meta.uid = static_cast<uint32_t>(reader.get(4));
+        meta.gid = static_cast<uint32_t>(reader.get(4));
+        meta.user_name = reader.get_string();
+        meta.group_name = reader.get_string();
+        meta.windows_attributes = static_cast<uint32_t>(reader.get(4));
+        meta.symbolic_link_target = std::filesystem::u8path(reader.get_string());
+        meta.device_major = static_cast<uint32_t>(reader.get(4));
+        meta.device_minor = static_cast<uint32_t>(reader.get(4));
+        entities.emplace_back(std::move(meta), offset);
+    }
+    if (!reader.ok || reader.pos != index.size() || !insert_entities(entities))
+    {
+        index_->clear();
+        return false;
+    }
+    // 与扫描时一样, 以第一个头部块判断格式
+    TarBlock first{};
+    ifs_->seekg(0, std::ios::beg);
+    if (ifs_->read(first.block, sizeof(first.block)))
+        standard_ = detect_standard(first.header);
+    ifs_->clear();
+    return true;
 }
 
 TarFileHeader TarFile::file_meta2tar_header(const FileEntityMeta &meta, const TarStandard standard)
@@ -727,14 +1148,14 @@ TarFileHeader TarFile::file_meta2tar_header(const FileEntityMeta &meta, const Ta
     }
 
     // Set all metadata fields
-    snprintf(header.mode, sizeof(header.mode), "%07o", meta.posix_mode);
-    snprintf(header.uid, sizeof(header.uid), "%07o", meta.uid);
-    snprintf(header.gid, sizeof(header.gid), "%07o", meta.gid);
-    snprintf(header.size, sizeof(header.size), "%011o", static_cast<unsigned int>(meta.type == FileEntityType::Directory ? 0 : meta.size));
+    write_octal(header.mode, sizeof(header.mode), meta.posix_mode);
+    write_octal(header.uid, sizeof(header.uid), meta.uid);
+    write_octal(header.gid, sizeof(header.gid), meta.gid);
+    write_number(header.size, sizeof(header.size), meta.type == FileEntityType::Directory ? 0 : meta.size);
 
     // Set mtime based on modification time
     const auto mtime = std::chrono::duration_cast<std::chrono::seconds>(meta.modification_time.time_since_epoch()).count();
-    snprintf(header.mtime, sizeof(header.mtime), "%011o", static_cast<unsigned int>(mtime));
+    write_octal(header.mtime, sizeof(header.mtime), static_cast<unsigned int>(mtime));
     memset(header.checksum, ' ', sizeof(header.checksum));
     switch (meta.type)
     {
@@ -766,8 +1187,8 @@ TarFileHeader TarFile::file_meta2tar_header(const FileEntityMeta &meta, const Ta
     }
 
     // Set device information for device files
-    snprintf(header.device_major, sizeof(header.device_major), "%07o", meta.device_major);
-    snprintf(header.device_minor, sizeof(header.device_minor), "%07o", meta.device_minor);
+    write_octal(header.device_major, sizeof(header.device_major), meta.device_major);
+    write_octal(header.device_minor, sizeof(header.device_minor), meta.device_minor);
 
     // Set user and group names
     strncpy_s(header.uname, meta.user_name.c_str(), sizeof(header.uname));
@@ -789,17 +1210,16 @@ TarFileHeader TarFile::file_meta2tar_header(const FileEntityMeta &meta, const Ta
     {
         checksum += bytes[i];
     }
-    snprintf(header.checksum, sizeof(header.checksum), "%06o", checksum);
-    header.checksum[6] = '\0';
+    write_octal(header.checksum, sizeof(header.checksum) - 1, checksum);
     header.checksum[7] = ' ';
 
     return header;
 }
 
-std::pair<FileEntityMeta, int> TarFile::sql_entity2file_meta(const db::TarInitializationStrategy::SQLEntity& entity)
+TarIndexCodec::Record TarIndexCodec::decode(const Row& row)
 {
     auto [file_path, type, size, offset, ctime, mtime, atime, posix_mode, uid, gid,
-        user_name, group_name, windows_attributes, symbolic_link_target, device_major, device_minor] = entity;
+        user_name, group_name, windows_attributes, symbolic_link_target, device_major, device_minor] = row;
     return std::make_pair(FileEntityMeta({
         file_path,
         static_cast<FileEntityType>(type),
@@ -816,36 +1236,24 @@ std::pair<FileEntityMeta, int> TarFile::sql_entity2file_meta(const db::TarInitia
         symbolic_link_target,
         static_cast<uint32_t>(device_major),
         static_cast<uint32_t>(device_minor)
-    }), offset);
+    }), static_cast<uint64_t>(offset));
 }
 
-std::vector<std::pair<FileEntityMeta, int>> TarFile::list_dir(const std::filesystem::path& path) const
+std::vector<std::pair<FileEntityMeta, uint64_t>> TarFile::list_dir(const std::filesystem::path& path) const
 {
+    TRACE_SPAN(Tar, "tar.list_dir");
     // path like "/...", and not contain any driver letter
     if (path.has_root_name() || !path.is_relative())
         return {}; // cannot analyze a path starts with "C:\"
-    auto stmt = db_.create_statement(
-        "SELECT " + db::TarInitializationStrategy::SQLEntityColumns + " FROM entity WHERE path LIKE ? ORDER BY path ASC;"
-    );
-    std::string like_path = path.generic_u8string();
-    if (like_path == "." || like_path.empty())
-        like_path = "/%";
-    else if (like_path.back() == '/')
-        like_path += "%";
-    else
-        like_path += "/%";
-    if (like_path.front() == '/')
-        like_path = like_path.substr(1);
-    sqlite3_bind_text(stmt.get(), 1, like_path.c_str(), -1, SQLITE_TRANSIENT);
+    return index_->list_subtree(path.generic_u8string());
+}
 
-    std::vector<std::pair<FileEntityMeta, int>> results;
-    auto rs = db_.query<db::TarInitializationStrategy::SQLEntity>(std::move(stmt));
-    for (const auto& entity : rs)
-    {
-        auto [meta, offset] = sql_entity2file_meta(entity);
-        results.emplace_back(meta, offset);
-    }
-    return results;
+std::vector<std::pair<FileEntityMeta, uint64_t>> TarFile::list_children(const std::filesystem::path& path) const
+{
+    TRACE_SPAN(Tar, "tar.list_children");
+    if (path.has_root_name() || !path.is_relative())
+        return {};
+    return index_->list_children(path.generic_u8string());
 }
 
 TarFile::~TarFile()
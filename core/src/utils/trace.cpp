@@ -0,0 +1,186 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#include "utils/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace
+{
+    namespace
+    {
+        // 单个线程独占写入的环形缓冲区, 读取方(dump)只在写入方静止时访问
+        struct ThreadBuffer
+        {
+            uint32_t tid = 0;
+            std::vector<SpanRecord> slots;
+            std::atomic<uint64_t> written{0};
+            explicit ThreadBuffer(const uint32_t id) : tid(id), slots(RING_BUFFER_CAPACITY) {}
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+            uint32_t next_tid = 1;
+        };
+
+        Registry& registry()
+        {
+            static Registry instance;
+            return instance;
+        }
+
+        std::atomic<bool>& enabled_flag()
+        {
+            static std::atomic<bool> flag{false};
+            return flag;
+        }
+
+        ThreadBuffer& local_buffer()
+        {
+            // 缓冲区由 registry 共同持有, 线程退出后其记录仍可被导出
+            thread_local std::shared_ptr<ThreadBuffer> buffer = []
+            {
+                auto& reg = registry();
+                std::lock_guard lock(reg.mutex);
+                auto created = std::make_shared<ThreadBuffer>(reg.next_tid++);
+                reg.buffers.push_back(created);
+                return created;
+            }();
+            return *buffer;
+        }
+
+        void write_json_string(std::ostream& os, const char* str)
+        {
+            os << '"';
+            for (const char* p = str ? str : ""; *p; ++p)
+            {
+                switch (const char c = *p)
+                {
+                    case '"': os << "\\\""; break;
+                    case '\\': os << "\\\\"; break;
+                    case '\n': os << "\\n"; break;
+                    case '\t': os << "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20)
+                            os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+                        else
+                            os << c;
+                        break;
+                }
+            }
+            os << '"';
+        }
+    }
+
+    const char* category_name(const Category category)
+    {
+        switch (category)
+        {
+            case Category::Device: return "device";
+            case Category::Controller: return "controller";
+            case Category::Tar: return "tar";
+            case Category::Zip: return "zip";
+            case Category::Database: return "database";
+            case Category::Crypto: return "crypto";
+            case Category::Checksum: return "checksum";
+            case Category::Compress: return "compress";
+        }
+        return "unknown";
+    }
+
+    bool is_compiled_in()
+    {
+        return BACKUPSUITE_ENABLE_TRACE != 0;
+    }
+
+    void set_enabled(const bool enabled)
+    {
+        enabled_flag().store(enabled, std::memory_order_relaxed);
+    }
+
+    bool is_enabled()
+    {
+        return enabled_flag().load(std::memory_order_relaxed);
+    }
+
+    uint64_t now_ns()
+    {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+    }
+
+    void record(const Category category, const char* name, const uint64_t begin_ns, const uint64_t end_ns)
+    {
+        auto& buffer = local_buffer();
+        const auto index = buffer.written.load(std::memory_order_relaxed);
+        buffer.slots[index % RING_BUFFER_CAPACITY] = SpanRecord{name, begin_ns, end_ns, category};
+        buffer.written.store(index + 1, std::memory_order_release);
+    }
+
+    void clear()
+    {
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        for (const auto& buffer : reg.buffers)
+            buffer->written.store(0, std::memory_order_release);
+    }
+
+    size_t span_count()
+    {
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        size_t count = 0;
+        for (const auto& buffer : reg.buffers)
+        {
+            const auto written = buffer->written.load(std::memory_order_acquire);
+            count += static_cast<size_t>(std::min<uint64_t>(written, RING_BUFFER_CAPACITY));
+        }
+        return count;
+    }
+
+    bool dump_chrome_trace(const std::filesystem::path& path)
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open())
+            return false;
+
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        ofs << R"({"name":"process_name","ph":"M","pid":1,"tid":0,"args":{"name":"backup_suite"}})";
+        ofs << std::fixed << std::setprecision(3);
+        for (const auto& buffer : reg.buffers)
+        {
+            const auto written = buffer->written.load(std::memory_order_acquire);
+            if (!written)
+                continue;
+            ofs << ",\n" << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer->tid
+                << R"(,"args":{"name":"thread )" << buffer->tid << "\"}}";
+            // 环形缓冲区写满后, 从最旧的一条开始输出
+            const uint64_t first = written > RING_BUFFER_CAPACITY ? written - RING_BUFFER_CAPACITY : 0;
+            for (uint64_t i = first; i < written; ++i)
+            {
+                const auto& span = buffer->slots[i % RING_BUFFER_CAPACITY];
+                ofs << ",\n{\"name\":";
+                write_json_string(ofs, span.name);
+                ofs << ",\"cat\":\"" << category_name(span.category) << "\",\"ph\":\"X\""
+                    << ",\"ts\":" << static_cast<double>(span.begin_ns) / 1000.0
+                    << ",\"dur\":" << static_cast<double>(span.end_ns - span.begin_ns) / 1000.0
+                    << ",\"pid\":1,\"tid\":" << buffer->tid << "}";
+            }
+        }
+        ofs << "\n]}\n";
+        return ofs.good();
+    }
+}
@@ -0,0 +1,96 @@
+//
+// Created by ycm on 2026/1/6.
+//
+
+#include "utils/transform.h"
+
+#include <algorithm>
+
+#include "utils/buffer_pool.h"
+#include "utils/trace.h"
+
+namespace transform
+{
+    bool Crc32Stage::write(const std::byte* data, const size_t size)
+    {
+        {
+            TRACE_SPAN(Checksum, "crc32.update");
+            crc_.update(data, size);
+        }
+        return forward(data, size);
+    }
+
+    DeflateStage::DeflateStage(const int level, const bool final) : deflater_(level), final_(final)
+    {
+    }
+
+    bool DeflateStage::write(const std::byte* data, const size_t size)
+    {
+        deflater_.update(data, size, out_);
+        const bool ok = forward(out_.data(), out_.size());
+        out_.clear();
+        return ok;
+    }
+
+    bool DeflateStage::finish()
+    {
+        if (final_)
+            deflater_.finish(out_);
+        else
+            deflater_.flush(out_);
+        const bool ok = forward(out_.data(), out_.size());
+        out_.clear();
+        return ok && forward_finish();
+    }
+
+    bool CipherStage::write(const std::byte* data, const size_t size)
+    {
+        buffer_.assign(data, data + size);
+        cipher_(buffer_.data(), buffer_.size());
+        return forward(buffer_.data(), buffer_.size());
+    }
+
+    bool OstreamSink::write(const std::byte* data, const size_t size)
+    {
+        os_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        bytes_ += size;
+        return os_.good();
+    }
+
+    bool OstreamSink::finish()
+    {
+        return os_.good();
+    }
+
+    bool VectorSink::write(const std::byte* data, const size_t size)
+    {
+        out_.insert(out_.end(), data, data + size);
+        return true;
+    }
+
+    bool Pipeline::write(const std::byte* data, const size_t size)
+    {
+        bytes_in_ += size;
+        return stages_.empty() || stages_.front()->write(data, size);
+    }
+
+    bool Pipeline::finish()
+    {
+        return stages_.empty() || stages_.front()->finish();
+    }
+
+    bool pump(ReadableFile& file, Pipeline& pipeline, uint64_t limit)
+    {
+        const auto slab = buffer_pool::BufferPool::instance().acquire();
+        while (limit > 0)
+        {
+            const auto n = file.read_into(slab.data(), static_cast<size_t>(std::min<uint64_t>(slab.size(), limit)));
+            if (n == 0)
+                break;
+            if (!pipeline.write(slab.data(), n))
+                return false;
+            limit -= n;
+        }
+        return !file.failed();
+    }
+}
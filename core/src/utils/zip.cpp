@@ -10,13 +10,20 @@
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
+#include <functional>
+#include <optional>
 #include <random>
+#include <unordered_map>
 #include <utility>
 
 #include "encryption/rc.h"
+#include "encryption/winzip_aes.h"
 #include "encryption/zip_crypto.h"
+#include "utils/buffer_pool.h"
 #include "utils/crc.h"
 #include "utils/endian.h"
+#include "utils/trace.h"
+#include "utils/transform.h"
 
 using namespace zip;
 using namespace zip::header;
@@ -25,23 +32,63 @@ using namespace zip::header;
 static constexpr uint64_t WINDOWS_TICK = 10000000;
 static constexpr uint64_t SEC_TO_UNIX_EPOCH = 11644473600ULL;
 
+// 公历日期距 1970-01-01 的天数, 月和日超出范围时与 mktime 一样顺延(如 0 日为上个月最后一天)
+static int64_t days_from_civil(int64_t year, const unsigned month, const unsigned day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const auto year_of_era = static_cast<unsigned>(year - era * 400);
+    const unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+/**
+ * @brief DOS 时间是本地时间: 先按公历直接换算成秒, 再加上这半小时相对 UTC 的偏移
+ * 偏移按 (日期, 半小时) 用 mktime 求一次后缓存在线程内; 建立大量条目的索引时不再逐条调用 mktime, 它每次都要持有 libc 的时区锁
+ * 半小时首尾的偏移不同(时区在其中切换)时不缓存, 该时段内逐条调用 mktime
+ */
 static time_t dos_to_unix_time(const uint16_t dos_date, const uint16_t dos_time) {
-    tm t{};
-
-    // 清零以防受到本地时区/夏令时干扰
-    t.tm_isdst = -1;
-
-    // 解析时间
-    t.tm_sec  = (dos_time & 0x1F) * 2;      // Bit 0-4
-    t.tm_min  = (dos_time >> 5) & 0x3F;     // Bit 5-10
-    t.tm_hour = (dos_time >> 11) & 0x1F;    // Bit 11-15
-
-    // 解析日期
-    t.tm_mday = (dos_date & 0x1F);          // Bit 0-4
-    t.tm_mon  = ((dos_date >> 5) & 0x0F) - 1; // Bit 5-8 (tm_mon 是 0-11)
-    t.tm_year = ((dos_date >> 9) & 0x7F) + 80; // Bit 9-15 (1980偏移, tm_year 是从 1900 开始)
+    const int year = ((dos_date >> 9) & 0x7F) + 1980; // Bit 9-15 (1980偏移)
+    const int month = (dos_date >> 5) & 0x0F;         // Bit 5-8
+    const int day = dos_date & 0x1F;                  // Bit 0-4
+    const int hour = (dos_time >> 11) & 0x1F;         // Bit 11-15
+    const int minute = (dos_time >> 5) & 0x3F;        // Bit 5-10
+    const int second = (dos_time & 0x1F) * 2;         // Bit 0-4
+    const int half_hour = minute / 30;
+    const int64_t slot_start = days_from_civil(year, month, day) * 86400 + hour * 3600 + half_hour * 1800;
+    const int64_t elapsed = (minute - half_hour * 30) * 60 + second;
+    // 由 mktime 判断是否处于夏令时, 返回本地时间相对按 UTC 换算结果的偏移
+    const auto local_offset = [&](const int64_t seconds) -> std::optional<int64_t>
+    {
+        tm t{};
+        t.tm_isdst = -1;
+        t.tm_year = year - 1900;
+        t.tm_mon = month - 1;
+        t.tm_mday = day;
+        t.tm_hour = hour;
+        t.tm_min = half_hour * 30 + static_cast<int>(seconds / 60);
+        t.tm_sec = static_cast<int>(seconds % 60);
+        const time_t local = mktime(&t);
+        if (local == -1)
+            return std::nullopt;
+        return static_cast<int64_t>(local) - slot_start - seconds;
+    };
 
-    return mktime(&t); // 返回 Unix Timestamp
+    thread_local std::unordered_map<uint32_t, std::optional<int64_t>> offsets;
+    const uint32_t key = static_cast<uint32_t>(dos_date) << 6 | hour << 1 | half_hour;
+    auto it = offsets.find(key);
+    if (it == offsets.end())
+    {
+        if (offsets.size() >= 4096)
+            offsets.clear();
+        auto offset = local_offset(0);
+        if (offset != local_offset(30 * 60 - 2))
+            offset.reset();
+        it = offsets.emplace(key, offset).first;
+    }
+    if (const auto offset = it->second ? it->second : local_offset(elapsed))
+        return static_cast<time_t>(slot_start + *offset + elapsed);
+    return -1;
 }
 static std::pair<uint16_t, uint16_t> unix_time_to_dos(const time_t& time_point)
 {
@@ -157,6 +204,169 @@ static void cdfh_host_to_le(ZipCentralDirectoryFileHeader& cdfh)
     cdfh.external_file_attributes = htole32(cdfh.external_file_attributes);
     cdfh.local_header_offset = htole32(cdfh.local_header_offset);
 }
+static void zip64_eocd_le_to_host(Zip64EndOfCentralDirectory& eocd)
+{
+    eocd.signature = le32toh(eocd.signature);
+    eocd.size_of_zip64_end_of_central_directory_record = le64toh(eocd.size_of_zip64_end_of_central_directory_record);
+    eocd.version_needed = le16toh(eocd.version_needed);
+    eocd.disk_number = le32toh(eocd.disk_number);
+    eocd.central_directory_start_disk = le32toh(eocd.central_directory_start_disk);
+    eocd.num_central_directory_records_on_this_disk = le64toh(eocd.num_central_directory_records_on_this_disk);
+    eocd.total_central_directory_records = le64toh(eocd.total_central_directory_records);
+    eocd.central_directory_size = le64toh(eocd.central_directory_size);
+    eocd.central_directory_offset = le64toh(eocd.central_directory_offset);
+}
+static void zip64_eocd_host_to_le(Zip64EndOfCentralDirectory& eocd)
+{
+    eocd.signature = htole32(eocd.signature);
+    eocd.size_of_zip64_end_of_central_directory_record = htole64(eocd.size_of_zip64_end_of_central_directory_record);
+    eocd.version_needed = htole16(eocd.version_needed);
+    eocd.disk_number = htole32(eocd.disk_number);
+    eocd.central_directory_start_disk = htole32(eocd.central_directory_start_disk);
+    eocd.num_central_directory_records_on_this_disk = htole64(eocd.num_central_directory_records_on_this_disk);
+    eocd.total_central_directory_records = htole64(eocd.total_central_directory_records);
+    eocd.central_directory_size = htole64(eocd.central_directory_size);
+    eocd.central_directory_offset = htole64(eocd.central_directory_offset);
+}
+static void zip64_locator_le_to_host(Zip64EndOfCentralDirectoryLocator& locator)
+{
+    locator.signature = le32toh(locator.signature);
+    locator.zip64_end_of_central_directory_disk = le32toh(locator.zip64_end_of_central_directory_disk);
+    locator.zip64_end_of_central_directory_offset = le64toh(locator.zip64_end_of_central_directory_offset);
+    locator.total_disks = le32toh(locator.total_disks);
+}
+static void zip64_locator_host_to_le(Zip64EndOfCentralDirectoryLocator& locator)
+{
+    locator.signature = htole32(locator.signature);
+    locator.zip64_end_of_central_directory_disk = htole32(locator.zip64_end_of_central_directory_disk);
+    locator.zip64_end_of_central_directory_offset = htole64(locator.zip64_end_of_central_directory_offset);
+    locator.total_disks = htole32(locator.total_disks);
+}
+// 超出 32 位的值在头部中写成 ZIP64_MARK_32
+static uint32_t zip64_clamp(const uint64_t value)
+{
+    return value >= ZIP64_MARK_32 ? ZIP64_MARK_32 : static_cast<uint32_t>(value);
+}
+// 压缩后可能略大于原始大小(存储块与加密头), 接近 4 GiB 的条目在本地头中预留 Zip64 扩展字段
+static constexpr uint64_t ZIP64_LOCAL_THRESHOLD = ZIP64_MARK_32 - 64 * 1024 * 1024;
+/**
+ * @brief 生成中央目录的 Zip64 扩展字段(APPNOTE 4.5.3)
+ * 只按顺序包含 record 中写成 ZIP64_MARK_32 的字段; 都不需要时返回空
+ */
+static std::vector<uint8_t> make_zip64_extra_field(const ZipFile::CentralDirectoryEntry& entry)
+{
+    std::vector<uint64_t> values;
+    if (entry.record.uncompressed_size == ZIP64_MARK_32)
+        values.push_back(entry.uncompressed_size);
+    if (entry.record.compressed_size == ZIP64_MARK_32)
+        values.push_back(entry.compressed_size);
+    if (entry.record.local_header_offset == ZIP64_MARK_32)
+        values.push_back(entry.local_header_offset);
+    if (values.empty())
+        return {};
+    std::vector<uint8_t> field(4 + values.size() * 8);
+    *reinterpret_cast<uint16_t*>(&field[0]) = htole16(ZIP64_EXTRA_FIELD_ID);
+    *reinterpret_cast<uint16_t*>(&field[2]) = htole16(static_cast<uint16_t>(values.size() * 8));
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        const uint64_t value = htole64(values[i]);
+        memcpy(&field[4 + i * 8], &value, sizeof(value));
+    }
+    return field;
+}
+/**
+ * @brief 从 extra_field 中取出 Zip64 扩展字段, 用其中的值替换 record 中写成 ZIP64_MARK_32 的字段
+ * @return 需要的值缺失或字段长度不对时返回 false
+ */
+static bool take_zip64_extra_field(ZipFile::CentralDirectoryEntry& entry)
+{
+    auto& extra_field = entry.extra_field;
+    bool found = false;
+    for (size_t i = 0; i + 4 <= extra_field.size();)
+    {
+        const uint16_t id = le16toh(*reinterpret_cast<const uint16_t*>(&extra_field[i]));
+        const uint16_t length = le16toh(*reinterpret_cast<const uint16_t*>(&extra_field[i + 2]));
+        if (i + 4 + length > extra_field.size())
+            break;
+        if (id != ZIP64_EXTRA_FIELD_ID)
+        {
+            i += 4 + length;
+            continue;
+        }
+        size_t pos = i + 4;
+        const auto take = [&](uint64_t& value)
+        {
+            if (pos + 8 > i + 4 + length)
+                return false;
+            uint64_t raw;
+            memcpy(&raw, &extra_field[pos], sizeof(raw));
+            value = le64toh(raw);
+            pos += 8;
+            return true;
+        };
+        if ((entry.record.uncompressed_size == ZIP64_MARK_32 && !take(entry.uncompressed_size)) ||
+            (entry.record.compressed_size == ZIP64_MARK_32 && !take(entry.compressed_size)) ||
+            (entry.record.local_header_offset == ZIP64_MARK_32 && !take(entry.local_header_offset)))
+            return false;
+        extra_field.erase(extra_field.begin() + static_cast<std::ptrdiff_t>(i), extra_field.begin() + static_cast<std::ptrdiff_t>(i + 4 + length));
+        found = true;
+    }
+    if (!found)
+        return entry.record.uncompressed_size != ZIP64_MARK_32 && entry.record.compressed_size != ZIP64_MARK_32 &&
+               entry.record.local_header_offset != ZIP64_MARK_32;
+    return true;
+}
+// WinZip AES 扩展字段(0x9901)的内容, vendor_version 为 0 表示没有找到
+struct AesExtraField
+{
+    uint16_t vendor_version = 0;
+    int strength = 0;
+    ZipCompressionMethod method = ZipCompressionMethod::Unknown;
+};
+// AES128/192/256 对应的强度 1/2/3, 其他加密方法返回 0
+static int aes_strength(const ZipEncryptionMethod method)
+{
+    switch (method)
+    {
+        case ZipEncryptionMethod::AES128: return 1;
+        case ZipEncryptionMethod::AES192: return 2;
+        case ZipEncryptionMethod::AES256: return 3;
+        default: return 0;
+    }
+}
+// | Header ID 0x9901 | Size 7 | Vendor version (1 = AE-1, 2 = AE-2) | Vendor ID "AE" | Strength | Compression method |
+static std::vector<uint8_t> make_aes_extra_field(const AesExtraField& aes)
+{
+    std::vector<uint8_t> field(11);
+    *reinterpret_cast<uint16_t*>(&field[0]) = htole16(AES_EXTRA_FIELD_ID);
+    *reinterpret_cast<uint16_t*>(&field[2]) = htole16(7);
+    *reinterpret_cast<uint16_t*>(&field[4]) = htole16(aes.vendor_version);
+    field[6] = 'A';
+    field[7] = 'E';
+    field[8] = static_cast<uint8_t>(aes.strength);
+    *reinterpret_cast<uint16_t*>(&field[9]) = htole16(static_cast<uint16_t>(aes.method));
+    return field;
+}
+static AesExtraField find_aes_extra_field(const std::vector<uint8_t>& extra_field)
+{
+    for (size_t i = 0; i + 4 <= extra_field.size();)
+    {
+        const uint16_t id = le16toh(*reinterpret_cast<const uint16_t*>(&extra_field[i]));
+        const uint16_t length = le16toh(*reinterpret_cast<const uint16_t*>(&extra_field[i + 2]));
+        if (i + 4 + length > extra_field.size())
+            break;
+        if (id == AES_EXTRA_FIELD_ID && length >= 7 && extra_field[i + 6] == 'A' && extra_field[i + 7] == 'E')
+        {
+            return {
+                le16toh(*reinterpret_cast<const uint16_t*>(&extra_field[i + 4])),
+                extra_field[i + 8],
+                static_cast<ZipCompressionMethod>(le16toh(*reinterpret_cast<const uint16_t*>(&extra_field[i + 9])))
+            };
+        }
+        i += 4 + length;
+    }
+    return {};
+}
 static std::chrono::system_clock::time_point ntfs_u64_to_time_point(const uint64_t ntfs_time)
 {
     // 1. 先减去 1601 到 1970 的偏移量（以 100ns 为单位）
@@ -195,10 +405,13 @@ static uint32_t time_point_to_unix_u32(const std::chrono::system_clock::time_poi
         ).count()
     );
 }
-// 将SQLZipEntity转换为FileEntityMeta
-static FileEntityMeta sql_zip_entity2file_meta(const db::ZipInitializationStrategy::SQLZipEntity& entity)
+// 将索引中的中央目录记录转换为FileEntityMeta
+static FileEntityMeta entry2file_meta(const ZipFile::CentralDirectoryEntry& entry)
 {
-    auto [version_made_by, version_needed, general_purpose, compression_method, last_modified, crc32, compressed_size, uncompressed_size, disk_number, internal_attributes, external_attributes, local_header_offset, filename, extra_field, file_comment] = entity;
+    const auto& filename = entry.file_name;
+    const auto uncompressed_size = entry.uncompressed_size;
+    const auto external_attributes = entry.record.external_file_attributes;
+    const auto last_modified = dos_to_unix_time(entry.record.last_mod_date, entry.record.last_mod_time);
 
     // 根据外部属性判断文件类型
     auto type = FileEntityType::RegularFile;
@@ -235,207 +448,274 @@ ZipFile::~ZipFile() {
     if (is_valid_) {
         close();
     }
+    stop_pipeline();
+}
+// 从 source 的 offset 处读满 size 字节
+static bool read_fully(PositionalSource& source, const uint64_t offset, char* buffer, const size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        const auto n = source.read_at(offset + done, buffer + done, size - done);
+        if (n == 0)
+            return false;
+        done += n;
+    }
+    return true;
 }
 void ZipFile::init_db_from_zip()
 {
-    if (!is_valid_ || !ifs_ || !ifs_->is_open())
+    TRACE_SPAN(Zip, "zip.index");
+    if (!is_valid_ || !ifs_ || !ifs_->is_open() || !source_)
     {
         return;
     }
 
     // 获取文件大小
     ifs_->seekg(0, std::ios::end);
-    const size_t file_size = ifs_->tellg();
+    const uint64_t file_size = ifs_->tellg();
 
     // 查找中央目录结束记录 (End of Central Directory Record)
-    // EOCD记录通常在文件末尾，范围在文件最后22字节到文件最后65557字节之间
-
-    // 搜索EOCD签名
-    const ZipEndOfCentralDirectoryRecord *eocd_p = nullptr;
-    char buffer[2048];
-    size_t offset_from_end = 0;
-    size_t start_of_buffer = 0;
-    if (2048 > file_size)
-    {
-        start_of_buffer = 2048 - file_size;
-        ifs_->seekg(0, std::ios::beg);
-    } else
+    // EOCD 后面只有至多 65535 字节的注释: 一次读入这段尾部, 从后向前找签名, 并要求注释长度恰好到文件末尾
+    const auto tail_size = static_cast<size_t>(std::min<uint64_t>(file_size, sizeof(ZipEndOfCentralDirectoryRecord) + 0xFFFF));
+    std::vector<char> tail(tail_size);
+    if (tail_size < sizeof(ZipEndOfCentralDirectoryRecord) || !read_fully(*source_, file_size - tail_size, tail.data(), tail.size()))
     {
-        ifs_->seekg(-2048, std::ios::end);
+        std::cerr << "no EOCD, exit!" << std::endl;
+        is_valid_ = false;
+        return;
     }
-    ifs_->read(buffer + start_of_buffer, static_cast<long long>(2048 - start_of_buffer));
-    if (start_of_buffer)
+    bool found = false;
+    size_t eocd_pos = tail_size - sizeof(ZipEndOfCentralDirectoryRecord) + 1;
+    ZipEndOfCentralDirectoryRecord eocd{};
+    while (eocd_pos-- > 0)
     {
-        ifs_->seekg(0, std::ios::beg);
-    } else
+        memcpy(&eocd, tail.data() + eocd_pos, sizeof(eocd));
+        if (le32toh(eocd.signature) == ZipFileHeaderSignature::EndOfCentralDirectory &&
+            le16toh(eocd.comment_length) == tail_size - eocd_pos - sizeof(ZipEndOfCentralDirectoryRecord))
+        {
+            found = true;
+            break;
+        }
+    }
+    if (!found)
     {
-        ifs_->seekg(-2048, std::ios::cur);
+        std::cerr << "no EOCD, exit!" << std::endl;
+        is_valid_ = false;
+        return;
     }
-    while (!start_of_buffer && offset_from_end + 2048 < file_size)
+    eocd_ = eocd;
+    // 从小端序中转换
+    eocd_le_to_host(eocd_);
+    comment_.assign(tail.data() + eocd_pos + sizeof(ZipEndOfCentralDirectoryRecord), eocd_.comment_length);
+
+    // 记录数、中央目录大小或偏移超出范围时, 真实值在 Zip64 EOCD 中, 由紧挨在 EOCD 之前的定位记录指出
+    uint64_t total_records = eocd_.total_central_directory_records;
+    uint64_t central_directory_size = eocd_.central_directory_size;
+    uint64_t central_directory_offset = eocd_.central_directory_offset;
+    if (const uint64_t eocd_offset = file_size - tail_size + eocd_pos;
+        eocd_offset >= sizeof(Zip64EndOfCentralDirectoryLocator))
     {
-        size_t i;
-        for (i = 0; i <= 2048 - sizeof(ZipEndOfCentralDirectoryRecord); i++)
+        Zip64EndOfCentralDirectoryLocator locator{};
+        if (read_fully(*source_, eocd_offset - sizeof(locator), reinterpret_cast<char*>(&locator), sizeof(locator)) &&
+            le32toh(locator.signature) == ZipFileHeaderSignature::Zip64EndOfCentralDirectoryLocator)
         {
-            eocd_p = reinterpret_cast<ZipEndOfCentralDirectoryRecord*>(buffer + i);
-            if (le32toh(eocd_p->signature) == ZipFileHeaderSignature::EndOfCentralDirectory)
+            zip64_locator_le_to_host(locator);
+            Zip64EndOfCentralDirectory zip64_eocd{};
+            if (!read_fully(*source_, locator.zip64_end_of_central_directory_offset, reinterpret_cast<char*>(&zip64_eocd), sizeof(zip64_eocd)) ||
+                le32toh(zip64_eocd.signature) != ZipFileHeaderSignature::Zip64EndOfCentralDirectoryRecord)
             {
-                if (const auto real_comment_length =
-                        offset_from_end + 2048 - i - sizeof(ZipEndOfCentralDirectoryRecord);
-                    real_comment_length != le16toh(eocd_p->comment_length))
-                {
-                    std::cerr << "no EOCD, exit!" << std::endl;
-                    is_valid_ = false;
-                    return;
-                }
-                break;
-            }
-        }
-        if (i <= 2048 - sizeof(ZipEndOfCentralDirectoryRecord)) break;
-        eocd_p = nullptr;
-        memcpy_s(buffer+1024, 1024, buffer+1024, 1024);
-        offset_from_end += 1024;
-        if (auto next_read = file_size - offset_from_end - 1024; next_read > 1024)
-        {
-            next_read = 1024;
-            ifs_->seekg(-1024, std::ios::cur);
-            ifs_->read(buffer, 1024);
-            if (ifs_->gcount() != next_read)
-            {
-                std::cerr << "no EOCD, exit!" << std::endl;
-                is_valid_ = false;
-                return;
-            }
-        } else
-        {
-            ifs_->seekg(static_cast<long long>(-next_read), std::ios::cur);
-            ifs_->read(buffer, static_cast<long long>(next_read));
-            if (ifs_->gcount() != next_read)
-            {
-                std::cerr << "no EOCD, exit!" << std::endl;
+                std::cerr << "invalid zip64 EOCD, exit!" << std::endl;
                 is_valid_ = false;
                 return;
             }
-            start_of_buffer = 1024 - next_read;
+            zip64_eocd_le_to_host(zip64_eocd);
+            total_records = zip64_eocd.total_central_directory_records;
+            central_directory_size = zip64_eocd.central_directory_size;
+            central_directory_offset = zip64_eocd.central_directory_offset;
         }
     }
-    // 处理读到文件头的情况
-    if (!eocd_p)
+
+    // 整个中央目录一次读入内存后解析, 不再为每条记录做多次小读取
+    if (central_directory_offset > file_size || central_directory_size > file_size - central_directory_offset)
     {
-        size_t i;
-        for (i = start_of_buffer; i <= 2048 - sizeof(ZipEndOfCentralDirectoryRecord); i++)
-        {
-            eocd_p = reinterpret_cast<ZipEndOfCentralDirectoryRecord*>(buffer + i);
-            if (le32toh(eocd_p->signature) == ZipFileHeaderSignature::EndOfCentralDirectory)
-            {
-                if (const auto real_comment_length =
-                        offset_from_end + 2048 - i - sizeof(ZipEndOfCentralDirectoryRecord);
-                    real_comment_length != le16toh(eocd_p->comment_length))
-                {
-                    std::cerr << "no EOCD, exit!" << std::endl;
-                    is_valid_ = false;
-                    return;
-                }
-                break;
-            }
-        }
-        if (i > 2048 - sizeof(ZipEndOfCentralDirectoryRecord))
+        std::cerr << "central directory out of range, exit!" << std::endl;
+        is_valid_ = false;
+        return;
+    }
+    std::vector<char> directory(static_cast<size_t>(central_directory_size));
+    {
+        TRACE_SPAN(Zip, "zip.read_central_directory");
+        if (!read_fully(*source_, central_directory_offset, directory.data(), directory.size()))
         {
-            std::cerr << "no EOCD, exit!" << std::endl;
+            std::cerr << "read central directory failed, exit!" << std::endl;
             is_valid_ = false;
             return;
         }
     }
-    // 拷贝eocd,避免受 buffer 影响
-    eocd_ = *eocd_p;
-    // 从小端序中转换
-    eocd_le_to_host(eocd_);
-
-    if (eocd_.comment_length)
+    central_directory_offset_ = central_directory_offset;
+    if (!load_central_directory(directory, total_records))
+        is_valid_ = false;
+}
+void ZipFile::open_for_update(const std::filesystem::path& path)
+{
+    TRACE_SPAN(Zip, "zip.open_update");
+    ifs_ = IFStreamPointer(new std::ifstream(path, std::ios::binary), FStreamDeleter<std::ifstream>());
+    if (!ifs_ || !ifs_->is_open())
     {
-        ifs_->seekg(-eocd_.comment_length, std::ios::end);
-        comment_.resize(eocd_.comment_length);
-        ifs_->read(&comment_[0], eocd_.comment_length);
-        comment_.resize(ifs_->gcount());
+        is_valid_ = false;
+        return;
     }
-    // 解析中央目录
-    ifs_->seekg(eocd_.central_directory_offset, std::ios::beg);
-    if (!ifs_->good())
+    if (auto file = std::make_shared<FileSource>(path); file->is_open())
+        source_ = std::move(file);
+    else
+        is_valid_ = false;
+    index_->begin_load();
+    init_db_from_zip();
+    if (!index_->end_load())
+        is_valid_ = false;
+    ifs_.reset();
+    source_.reset();
+    // 读不出中央目录时不知道条目在哪里结束, 不能写入
+    if (!is_valid_)
+        return;
+    // in | out 打开不会截断文件; 新条目覆盖旧的中央目录, 之前的条目数据原样保留
+    ofs_ = OFStreamPointer(new std::ofstream(path, std::ios::binary | std::ios::in | std::ios::out), FStreamDeleter<std::ofstream>());
+    if (!ofs_ || !ofs_->is_open())
     {
-        std::cerr << "ifs not good" << std::endl;
         is_valid_ = false;
         return;
     }
-    for (size_t i=0; i < eocd_.total_central_directory_records; i++)
+    ofs_->seekp(static_cast<std::streamoff>(central_directory_offset_), std::ios::beg);
+    update_path_ = path;
+}
+bool ZipFile::load_central_directory(const std::vector<char>& directory, const uint64_t total_records) const
+{
+    TRACE_SPAN(Zip, "zip.load_central_directory");
+    size_t pos = 0;
+    for (uint64_t i = 0; i < total_records; i++)
     {
-        ZipCentralDirectoryFileHeader cdfh;
-        memset(reinterpret_cast<char*>(&cdfh), 0, sizeof(cdfh));
-        ifs_->read(reinterpret_cast<char*>(&cdfh), sizeof(cdfh));
-        if (ifs_->gcount() != sizeof(cdfh) || le32toh(cdfh.signature) != ZipFileHeaderSignature::CentralDirectoryFile)
+        ZipCentralDirectoryFileHeader cdfh{};
+        if (pos + sizeof(cdfh) <= directory.size())
         {
-            std::cerr << "invalid CDFH signature '<< " << std::uppercase << std::setw(8) << std::setfill('0') << std::hex << static_cast<uint16_t>(cdfh.signature) << " <<', not '" << static_cast<uint16_t>(ZipFileHeaderSignature::CentralDirectoryFile) << "', exit!" << std::endl;
-            is_valid_ = false;
-            return;
+            memcpy(&cdfh, directory.data() + pos, sizeof(cdfh));
         }
-        // 从小端序中转换
-        cdfh_le_to_host(cdfh);
-        std::string filename, file_comment;
-        std::vector<uint8_t> extra_field;
-        if (cdfh.file_name_length)
+        if (le32toh(cdfh.signature) != ZipFileHeaderSignature::CentralDirectoryFile)
         {
-            filename.resize(cdfh.file_name_length);
-            ifs_->read(&filename[0], cdfh.file_name_length);
+            std::cerr << "invalid CDFH signature '<< " << std::uppercase << std::setw(8) << std::setfill('0') << std::hex << static_cast<uint32_t>(cdfh.signature) << " <<', not '" << static_cast<uint32_t>(ZipFileHeaderSignature::CentralDirectoryFile) << "', exit!" << std::endl;
+            return false;
         }
-        if (cdfh.extra_field_length)
+        // 从小端序中转换
+        cdfh_le_to_host(cdfh);
+        pos += sizeof(cdfh);
+        if (static_cast<size_t>(cdfh.file_name_length) + cdfh.extra_field_length + cdfh.file_comment_length > directory.size() - pos)
         {
-            extra_field.resize(cdfh.extra_field_length);
-            ifs_->read(reinterpret_cast<char*>(extra_field.data()), cdfh.extra_field_length);
+            std::cerr << "truncated central directory, exit!" << std::endl;
+            return false;
         }
-        if (cdfh.file_comment_length)
+        CentralDirectoryEntry entry{{}, {}, {}, cdfh, cdfh.compressed_size, cdfh.uncompressed_size, cdfh.local_header_offset};
+        const char* p = directory.data() + pos;
+        entry.file_name.assign(p, cdfh.file_name_length);
+        p += cdfh.file_name_length;
+        entry.extra_field.assign(p, p + cdfh.extra_field_length);
+        p += cdfh.extra_field_length;
+        entry.file_comment.assign(p, cdfh.file_comment_length);
+        pos += static_cast<size_t>(cdfh.file_name_length) + cdfh.extra_field_length + cdfh.file_comment_length;
+        if (!take_zip64_extra_field(entry))
         {
-            file_comment.resize(cdfh.file_comment_length);
-            ifs_->read(&file_comment[0], cdfh.file_comment_length);
+            std::cerr << "invalid zip64 extra field of '" << entry.file_name << "', exit!" << std::endl;
+            return false;
         }
-        if (!insert_entity(&cdfh, filename, extra_field, file_comment))
+        if (!insert_entity(entry))
         {
-            std::cerr << "insert file '" << filename << "' failed, exit!" << std::endl;
-            is_valid_ = false;
-            return;
+            std::cerr << "insert file '" << entry.file_name << "' failed, exit!" << std::endl;
+            return false;
         }
     }
+    return true;
 }
-bool ZipFile::insert_entity(const ZipCentralDirectoryFileHeader* cdfh, const std::string& file_name,
-                            const std::vector<uint8_t>& extra_field, const std::string& file_comment) const
+std::unique_ptr<db::ArchiveIndex<ZipFile::CentralDirectoryEntry>> ZipFile::make_index(const db::IndexBackend backend)
 {
-    if (cdfh == nullptr) return false;
-    const auto stmt = db_.create_statement(
-        "INSERT INTO zip_entity (" + db::ZipInitializationStrategy::SQLEntityColumns + ") "
-        "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);"
-    );
-    if (!stmt) return false;
+    return db::make_archive_index<ZipIndexCodec>(backend);
+}
+void ZipIndexCodec::bind(sqlite3_stmt* stmt, const Record& record)
+{
+    const auto& cdfh = record.record;
     int i = 1;
-    db::bind_parameter(stmt.get(), i++, static_cast<uint16_t>(cdfh->version_made_by));
-    db::bind_parameter(stmt.get(), i++, static_cast<uint16_t>(cdfh->version_needed));
-    db::bind_parameter(stmt.get(), i++, cdfh->general_purpose);
-    db::bind_parameter(stmt.get(), i++, static_cast<uint16_t>(cdfh->compression_method));
-    db::bind_parameter(stmt.get(), i++, dos_to_unix_time(cdfh->last_mod_date, cdfh->last_mod_time));
-    db::bind_parameter(stmt.get(), i++, cdfh->crc32);
-    db::bind_parameter(stmt.get(), i++, cdfh->compressed_size);
-    db::bind_parameter(stmt.get(), i++, cdfh->uncompressed_size);
-    db::bind_parameter(stmt.get(), i++, cdfh->disk_number_start);
-    db::bind_parameter(stmt.get(), i++, cdfh->internal_file_attributes);
-    db::bind_parameter(stmt.get(), i++, cdfh->external_file_attributes);
-    db::bind_parameter(stmt.get(), i++, cdfh->local_header_offset);
-    db::bind_parameter(stmt.get(), i++, file_name);
-    if (extra_field.empty())
-    {
-        db::bind_parameter_null(stmt.get(), i++);
+    db::bind_parameter(stmt, i++, static_cast<uint16_t>(cdfh.version_made_by));
+    db::bind_parameter(stmt, i++, static_cast<uint16_t>(cdfh.version_needed));
+    db::bind_parameter(stmt, i++, cdfh.general_purpose);
+    db::bind_parameter(stmt, i++, static_cast<uint16_t>(cdfh.compression_method));
+    db::bind_parameter(stmt, i++, dos_to_unix_time(cdfh.last_mod_date, cdfh.last_mod_time));
+    db::bind_parameter(stmt, i++, cdfh.crc32);
+    db::bind_parameter(stmt, i++, record.compressed_size);
+    db::bind_parameter(stmt, i++, record.uncompressed_size);
+    db::bind_parameter(stmt, i++, cdfh.disk_number_start);
+    db::bind_parameter(stmt, i++, cdfh.internal_file_attributes);
+    db::bind_parameter(stmt, i++, cdfh.external_file_attributes);
+    db::bind_parameter(stmt, i++, record.local_header_offset);
+    db::bind_parameter(stmt, i++, record.file_name);
+    if (record.extra_field.empty())
+    {
+        db::bind_parameter_null(stmt, i++);
     } else
     {
-        db::bind_parameter(stmt.get(), i++, extra_field);
+        db::bind_parameter(stmt, i++, record.extra_field);
+    }
+    db::bind_parameter(stmt, i++, record.file_comment);
+}
+bool ZipFile::insert_entity(const CentralDirectoryEntry& entry) const
+{
+    TRACE_SPAN(Zip, "zip.insert_entity");
+    // 各长度字段以记录中保存的名字、扩展字段和注释为准(读入时已去掉 Zip64 扩展字段)
+    auto record = entry;
+    record.record.file_name_length = static_cast<uint16_t>(record.file_name.size());
+    record.record.extra_field_length = static_cast<uint16_t>(record.extra_field.size());
+    record.record.file_comment_length = static_cast<uint16_t>(record.file_comment.size());
+    std::lock_guard lock(index_mutex_);
+    return index_->insert(record.file_name, record);
+}
+
+// RC4 的密钥长度限制在 32-448 字节之间
+static std::vector<uint8_t> rc4_key(const std::vector<uint8_t>& password)
+{
+    std::vector rc4_pwd{password};
+    if (rc4_pwd.size() < 32)
+    {
+        rc4_pwd.resize(32, 0);
+    } else if (rc4_pwd.size() > 448)
+    {
+        rc4_pwd.resize(448);
     }
-    db::bind_parameter(stmt.get(), i++, file_comment);
+    return rc4_pwd;
+}
 
-    return db_.execute(*stmt, true);
+ZipFile::PayloadCipher::PayloadCipher(const ZipEncryptionMethod method, const std::vector<uint8_t>& password) : method(method)
+{
+    if (method == ZipEncryptionMethod::ZipCrypto)
+        zip_crypto = encryption::ZipCrypto(password);
+    else if (method == ZipEncryptionMethod::RC4)
+        rc4 = encryption::RC4(rc4_key(password));
+    else if (const auto strength = aes_strength(method))
+        aes.emplace(strength, password, encryption::WinZipAes::random_salt(strength).data());
+}
+
+void ZipFile::PayloadCipher::apply(std::byte* data, const size_t size)
+{
+    if (method == ZipEncryptionMethod::ZipCrypto)
+    {
+        TRACE_SPAN(Crypto, "zipcrypto.encrypt");
+        for (size_t i = 0; i < size; ++i)
+            data[i] = static_cast<std::byte>(zip_crypto.encrypt(static_cast<uint8_t>(data[i])));
+    } else if (method == ZipEncryptionMethod::RC4)
+    {
+        TRACE_SPAN(Crypto, "rc4.encrypt");
+        for (size_t i = 0; i < size; ++i)
+            data[i] = static_cast<std::byte>(rc4.encrypt(static_cast<uint8_t>(data[i])));
+    } else if (aes)
+    {
+        aes->encrypt(reinterpret_cast<uint8_t*>(data), size);
+    }
 }
 
 // 添加实体到zip归档
@@ -443,15 +723,74 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
     if (!is_valid_) {
         return false;
     }
-    std::random_device rd;
-    std::mt19937 rand(rd());
+    TRACE_SPAN(Zip, "zip.add_entity");
+    auto entry = std::make_shared<PendingEntry>();
+    if (!prepare_entry(file, compression_method, encryption_method, *entry))
+    {
+        return false;
+    }
+    if (compression_threads_ > 1)
+    {
+        return add_entity_parallel(file, entry);
+    }
+    if (!begin_entry(*entry))
+    {
+        return false;
+    }
+
+    // 文件内容依次经过 CRC32、压缩(若需要)和加密(若需要)后写出
+    transform::Pipeline pipeline;
+    const auto& checksum = pipeline.emplace<transform::Crc32Stage>();
+    if (entry->compression_method == ZipCompressionMethod::Deflate)
+    {
+        pipeline.emplace<transform::DeflateStage>(compression_level_);
+    }
+    if (entry->cipher.method != ZipEncryptionMethod::Unknown)
+    {
+        pipeline.emplace<transform::CipherStage>([&cipher = entry->cipher](std::byte* data, const size_t size)
+        {
+            cipher.apply(data, size);
+        });
+    }
+    const auto& sink = pipeline.emplace<transform::OstreamSink>(*ofs_);
+    if (!transform::pump(file, pipeline) || !pipeline.finish())
+    {
+        return false;
+    }
+    entry->compressed_size += sink.bytes();
+    entry->crc32 = checksum.value();
+    return finish_entry(*entry);
+}
 
+bool ZipFile::prepare_entry(ReadableFile& file, ZipCompressionMethod compression_method, ZipEncryptionMethod encryption_method,
+                            PendingEntry& entry) const
+{
     // 获取文件元数据
     auto meta = file.get_meta();
     update_file_entity_meta(meta);
     std::string filename = meta.path.generic_u8string();
+    // 目录条目名必须以 '/' 结尾(APPNOTE 4.4.17), 否则解压工具会把它当作空文件
+    if (meta.type == FileEntityType::Directory && !filename.empty() && filename.back() != '/')
+        filename += '/';
     std::vector<uint8_t> extra_field;
 
+    if (compression_method != ZipCompressionMethod::Store && compression_method != ZipCompressionMethod::Deflate)
+    {
+        std::cerr << "unsupported compression method: " << static_cast<uint16_t>(compression_method) << "\n";
+        return false;
+    }
+    // 目录、链接和空文件没有可压缩的内容, 按存储写入
+    if (meta.type != FileEntityType::RegularFile || meta.size == 0)
+    {
+        compression_method = ZipCompressionMethod::Store;
+    }
+    // WinZip AES 只用于普通文件, 其他条目不加密
+    const int strength = meta.type == FileEntityType::RegularFile ? aes_strength(encryption_method) : 0;
+    if (!strength && aes_strength(encryption_method))
+    {
+        encryption_method = ZipEncryptionMethod::Unknown;
+    }
+
     // 设置外部文件属性和扩展字段
     ZipVersionMadeBy version_made_by = meta.type == FileEntityType::SymbolicLink ? ZipVersionMadeBy::Unix : SYSTEM_VERSION_MADE_BY;
     uint32_t external_file_attributes = 0;
@@ -532,9 +871,16 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
         );
         extra_field.insert(extra_field.end(), unix_extra_field.begin(), unix_extra_field.end());
     }
+    // 与 WinZip 相同, 20 字节以下的文件使用 AE-2, 不写 CRC 以免由 CRC 推出内容; 其余使用 AE-1, 保留 CRC 校验
+    uint16_t aes_version = 0;
+    if (strength)
+    {
+        aes_version = meta.size < 20 ? 2 : 1;
+        const auto aes_extra_field = make_aes_extra_field({aes_version, strength, compression_method});
+        extra_field.insert(extra_field.end(), aes_extra_field.begin(), aes_extra_field.end());
+    }
 
-    // 计算本地文件头的偏移量
-    const uint32_t local_header_offset = ofs_->tellp();
+    const bool zip64_local = meta.type == FileEntityType::RegularFile && meta.size >= ZIP64_LOCAL_THRESHOLD;
 
     // 写入本地文件头
     ZipLocalFileHeader local_header { (ZipFileHeaderSignature::LocalFile), (ZipVersionNeeded::Version20) };
@@ -555,6 +901,17 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
             local_header.version_needed = ZipVersionNeeded::Version50;
         }
     }
+    // 5.1 - File is encrypted using AES encryption
+    if (strength && static_cast<uint16_t>(local_header.version_needed) < static_cast<uint16_t>(ZipVersionNeeded::Version51))
+    {
+        local_header.version_needed = ZipVersionNeeded::Version51;
+    }
+
+    // 4.5 - File uses ZIP64 format extensions
+    if (zip64_local && static_cast<uint16_t>(local_header.version_needed) < static_cast<uint16_t>(ZipVersionNeeded::Version45))
+    {
+        local_header.version_needed = ZipVersionNeeded::Version45;
+    }
 
     local_header.general_purpose = (static_cast<uint16_t>(ZipGeneralPurposeBitFlag::Utf8Encoding));
     local_header.compression_method = (compression_method);
@@ -565,19 +922,31 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
     local_header.last_mod_time = (dos_time);
     // crc32
     local_header.crc32 = (0); // 先写0，后面计算完再更新
-    // 文件大小（目前使用存储模式，压缩前后大小相同）
+    // 文件大小; 压缩后的大小在写完数据后回写
     local_header.uncompressed_size = (static_cast<uint32_t>(meta.size));
     local_header.compressed_size = (static_cast<uint32_t>(meta.size));
+    // 本地头的 Zip64 扩展字段必须同时包含两个大小, 写完数据后回写
+    std::vector<uint8_t> local_extra_field;
+    if (zip64_local)
+    {
+        local_header.uncompressed_size = ZIP64_MARK_32;
+        local_header.compressed_size = ZIP64_MARK_32;
+        local_extra_field.resize(20, 0);
+        *reinterpret_cast<uint16_t*>(&local_extra_field[0]) = htole16(ZIP64_EXTRA_FIELD_ID);
+        *reinterpret_cast<uint16_t*>(&local_extra_field[2]) = htole16(16);
+    }
+    local_extra_field.insert(local_extra_field.end(), extra_field.begin(), extra_field.end());
     // 文件名长度
     local_header.file_name_length = (static_cast<uint16_t>(filename.size()));
     // 扩展字段长度
-    local_header.extra_field_length = extra_field.size();
+    local_header.extra_field_length = local_extra_field.size();
 
     // 设置加密相关信息
     if (encryption_method == ZipEncryptionMethod::ZipCrypto)
     {
         // 开头写入12字节的头
-        local_header.compressed_size += 12;
+        if (!zip64_local)
+            local_header.compressed_size += 12;
         local_header.general_purpose |= static_cast<uint16_t>(ZipGeneralPurposeBitFlag::Encrypted);
         local_header.general_purpose &= ~static_cast<uint16_t>(ZipGeneralPurposeBitFlag::StrongEncryption);
     }
@@ -586,7 +955,52 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
         local_header.general_purpose |= static_cast<uint16_t>(ZipGeneralPurposeBitFlag::Encrypted);
         local_header.general_purpose |= static_cast<uint16_t>(ZipGeneralPurposeBitFlag::StrongEncryption);
     }
+    else if (strength)
+    {
+        // 数据前是盐和口令校验值, 后面是认证码; 头中的压缩方法固定为 AES_Encryption
+        if (!zip64_local)
+            local_header.compressed_size += encryption::WinZipAes::salt_size(strength) + encryption::WinZipAes::VERIFIER_SIZE +
+                                            encryption::WinZipAes::AUTH_CODE_SIZE;
+        local_header.general_purpose |= static_cast<uint16_t>(ZipGeneralPurposeBitFlag::Encrypted);
+        local_header.compression_method = ZipCompressionMethod::AES_Encryption;
+    }
+    // 流式写出时 CRC 和大小在数据之后才知道, 本地头(以及 Zip64 扩展字段)中写 0
+    if (streaming_)
+    {
+        local_header.general_purpose |= static_cast<uint16_t>(ZipGeneralPurposeBitFlag::DataDescriptor);
+        local_header.crc32 = 0;
+        if (!zip64_local)
+        {
+            local_header.compressed_size = 0;
+            local_header.uncompressed_size = 0;
+        }
+    }
 
+    entry.filename = std::move(filename);
+    entry.extra_field = std::move(extra_field);
+    entry.local_extra_field = std::move(local_extra_field);
+    entry.local_header = local_header;
+    entry.compression_method = compression_method;
+    entry.version_made_by = version_made_by;
+    entry.encryption_method = encryption_method;
+    entry.external_file_attributes = external_file_attributes;
+    entry.regular_file = meta.type == FileEntityType::RegularFile;
+    entry.zip64_local = zip64_local;
+    entry.aes_version = aes_version;
+    entry.size = static_cast<uint64_t>(meta.size);
+    return true;
+}
+
+bool ZipFile::begin_entry(PendingEntry& entry)
+{
+    std::random_device rd;
+    std::mt19937 rand(rd());
+    const auto& filename = entry.filename;
+    const auto& local_extra_field = entry.local_extra_field;
+
+    // 计算本地文件头的偏移量
+    entry.local_header_offset = output_offset();
+    auto local_header = entry.local_header;
     lfh_host_to_le(local_header);
     ofs_->write(reinterpret_cast<const char*>(&local_header), sizeof(local_header));
 
@@ -594,45 +1008,35 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
     // ReSharper disable once CppRedundantCastExpression
     ofs_->write(reinterpret_cast<const char*>(filename.c_str()), static_cast<long long>(filename.size()));
     // 写入文件名后紧跟扩展字段
-    if (!extra_field.empty())
+    if (!local_extra_field.empty())
     {
-        ofs_->write(reinterpret_cast<const char*>(extra_field.data()), static_cast<long long>(extra_field.size()));
+        ofs_->write(reinterpret_cast<const char*>(local_extra_field.data()), static_cast<long long>(local_extra_field.size()));
     }
 
-    // 写入文件内容并计算CRC32
-    uint32_t crc32 = 0;
-    crc::CRC32 crc32_inst;
-    uint32_t compressed_size = 0;
-    encryption::ZipCrypto zip_crypto(password_);
-    encryption::RC4 rc4_encryptor{};
-
-    if (meta.type == FileEntityType::RegularFile)
+    entry.compressed_size = 0;
+    if (entry.cipher.method != entry.encryption_method)
+    {
+        entry.cipher = PayloadCipher(entry.encryption_method, password_);
+    }
+    if (entry.regular_file)
     {
-        if (encryption_method == ZipEncryptionMethod::ZipCrypto)
+        if (entry.encryption_method == ZipEncryptionMethod::ZipCrypto)
         {
+            encryption::ZipCrypto zip_crypto(password_);
             std::uniform_int_distribution<uint16_t> dist(0, 255);
             // 避免二次写入,这里直接用 last_mod_time 字段写入头
+            uint8_t encryption_header[12];
             for (int i=0; i<11; i++)
             {
-                uint8_t bit = zip_crypto.encrypt(dist(rand));
-                ofs_->write(reinterpret_cast<const char*>(&bit), 1);
+                encryption_header[i] = zip_crypto.encrypt(dist(rand));
             }
-            uint8_t last_bit = zip_crypto.encrypt((local_header.last_mod_time>>8) & 0xff);
-            ofs_->write(reinterpret_cast<const char*>(&last_bit), 1);
-            compressed_size += 12;
-            zip_crypto = encryption::ZipCrypto(password_);
-        } else if (encryption_method == ZipEncryptionMethod::RC4)
+            encryption_header[11] = zip_crypto.encrypt((entry.local_header.last_mod_time>>8) & 0xff);
+            ofs_->write(reinterpret_cast<const char*>(encryption_header), sizeof(encryption_header));
+            entry.compressed_size += sizeof(encryption_header);
+        } else if (entry.encryption_method == ZipEncryptionMethod::RC4)
         {
-            std::vector rc4_pwd{password_};
-            if (rc4_pwd.size() < 32)
-            {
-                rc4_pwd.resize(32, 0);
-            } else if (rc4_pwd.size() > 448)
-            {
-                rc4_pwd.resize(448);
-            }
-            rc4_encryptor = encryption::RC4(rc4_pwd);
-            encryption::RC4 tmp_rc4_encryptor {rc4_pwd};
+            encryption::RC4 tmp_rc4_encryptor {rc4_key(password_)};
+            entry.rc4_bit_len = tmp_rc4_encryptor.bit_len();
 
             DecryptionHeaderRecord rc4_dec_header {
                 {},
@@ -653,60 +1057,99 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
             rc4_dec_header.v_crc32 = tmp_crc32_inst.finalize();
             const auto rc4_header_bytes = make_decryption_header(rc4_dec_header);
             ofs_->write(reinterpret_cast<const char*>(rc4_header_bytes.data()), static_cast<long long>(rc4_header_bytes.size()));
-            compressed_size += static_cast<uint32_t>(rc4_header_bytes.size());
+            entry.compressed_size += rc4_header_bytes.size();
+        } else if (entry.cipher.aes)
+        {
+            const auto& aes = *entry.cipher.aes;
+            ofs_->write(reinterpret_cast<const char*>(aes.salt().data()), static_cast<long long>(aes.salt().size()));
+            ofs_->write(reinterpret_cast<const char*>(aes.verifier().data()), static_cast<long long>(aes.verifier().size()));
+            entry.compressed_size += aes.salt().size() + aes.verifier().size();
         }
     }
+    return ofs_->good();
+}
 
-    // 使用ReadableFile的read(size)方法读取文件内容
-    if (compression_method == ZipCompressionMethod::Store)
+bool ZipFile::write_payload(PendingEntry& entry, std::byte* data, const size_t size, const bool encrypted)
+{
+    if (!encrypted)
     {
-        std::unique_ptr<std::vector<std::byte>> buffer;
-        while (((buffer = file.read(4096))) && buffer && !buffer->empty()) {
-            crc32_inst.update(buffer->data(), buffer->size());
-            compressed_size += static_cast<uint32_t>(buffer->size());
-            // 目前使用存储模式，不压缩
-            if (encryption_method == ZipEncryptionMethod::ZipCrypto)
-            {
-                for (const auto c : *buffer)
-                {
-                    uint8_t bit = zip_crypto.encrypt(static_cast<uint8_t>(c));
-                    ofs_->write(reinterpret_cast<const char*>(&bit), 1);
-                }
-            } else if (encryption_method == ZipEncryptionMethod::RC4)
-            {
-                for (const auto c : *buffer)
-                {
-                    uint8_t bit = rc4_encryptor.encrypt(static_cast<uint8_t>(c));
-                    ofs_->write(reinterpret_cast<const char*>(&bit), 1);
-                }
-            }
-            else
-            {
-                ofs_->write(reinterpret_cast<const char*>(buffer->data()), static_cast<long long>(buffer->size()));
-            }
+        entry.cipher.apply(data, size);
+    }
+    TRACE_SPAN(Zip, "zip.write_data");
+    entry.compressed_size += size;
+    ofs_->write(reinterpret_cast<const char*>(data), static_cast<long long>(size));
+    return ofs_->good();
+}
+
+bool ZipFile::finish_entry(PendingEntry& entry)
+{
+    if (entry.cipher.aes)
+    {
+        const auto auth_code = entry.cipher.aes->auth_code();
+        ofs_->write(reinterpret_cast<const char*>(auth_code.data()), static_cast<long long>(auth_code.size()));
+        entry.compressed_size += auth_code.size();
+    }
+    // AE-2 条目不写 CRC
+    if (entry.aes_version == 2)
+    {
+        entry.crc32 = 0;
+    }
+    const auto& filename = entry.filename;
+    const auto& local_header = entry.local_header;
+    const auto local_header_offset = entry.local_header_offset;
+    const auto compressed_size = entry.compressed_size;
+    const auto crc32 = entry.crc32;
+    auto& extra_field = entry.extra_field;
+
+    if (streaming_)
+    {
+        // 不能回写, CRC 和大小写在紧跟数据的数据描述符中; 本地头有 Zip64 扩展字段时大小为 8 字节
+        const auto write_descriptor = [this](auto descriptor) -> uint64_t
+        {
+            descriptor.signature = static_cast<ZipFileHeaderSignature>(htole32(static_cast<uint32_t>(descriptor.signature)));
+            descriptor.crc32 = htole32(descriptor.crc32);
+            ofs_->write(reinterpret_cast<const char*>(&descriptor), sizeof(descriptor));
+            return sizeof(descriptor);
+        };
+        const auto descriptor_size = entry.zip64_local
+            ? write_descriptor(Zip64DataDescriptor{ZipFileHeaderSignature::DataDescriptor, crc32, htole64(compressed_size), htole64(entry.size)})
+            : write_descriptor(ZipDataDescriptor{ZipFileHeaderSignature::DataDescriptor, crc32,
+                                                 htole32(zip64_clamp(compressed_size)), htole32(zip64_clamp(entry.size))});
+        if (!ofs_->good())
+        {
+            return false;
         }
+        stream_offset_ = local_header_offset + sizeof(ZipLocalFileHeader) + filename.size() + entry.local_extra_field.size() +
+                         compressed_size + descriptor_size;
     } else
     {
-        std::cerr << "unsupported compression method: " << static_cast<uint16_t>(compression_method) << "\n";
-        return false;
+        // 回写CRC32和压缩大小到本地文件头
+        const auto file_end_pos = ofs_->tellp();
+        ofs_->seekp(static_cast<long long>(local_header_offset + offsetof(ZipLocalFileHeader, crc32)));
+        const uint32_t le_crc32 = htole32(crc32);
+        ofs_->write(reinterpret_cast<const char*>(&le_crc32), sizeof(le_crc32));
+        if (entry.zip64_local)
+        {
+            // 32 位字段保持 ZIP64_MARK_32, 真实大小写入 Zip64 扩展字段
+            const uint64_t sizes[2] = {htole64(entry.size), htole64(compressed_size)};
+            ofs_->seekp(static_cast<long long>(local_header_offset + sizeof(ZipLocalFileHeader) + filename.size() + 4));
+            ofs_->write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        } else
+        {
+            const uint32_t le_compressed_size = htole32(zip64_clamp(compressed_size));
+            ofs_->write(reinterpret_cast<const char*>(&le_compressed_size), sizeof(le_compressed_size));
+        }
+        ofs_->seekp(file_end_pos);
+        if (!ofs_->good())
+        {
+            return false;
+        }
     }
 
-    // 回写CRC32和压缩大小到本地文件头
-    crc32 = crc32_inst.finalize();
-    const auto file_end_pos = ofs_->tellp();
-    ofs_->seekp(static_cast<long long>(local_header_offset + offsetof(ZipLocalFileHeader, crc32)));
-    crc32 = htole32(crc32);
-    ofs_->write(reinterpret_cast<const char*>(&crc32), sizeof(crc32));
-    crc32 = le32toh(crc32);
-    compressed_size = htole32(compressed_size);
-    ofs_->write(reinterpret_cast<const char*>(&compressed_size), sizeof(compressed_size));
-    compressed_size = htole32(compressed_size);
-    ofs_->seekp(file_end_pos);
-
     // Extra Field 0x0017 in central header only.
     // see https://pkwaredownloads.blob.core.windows.net/pkware-general/Documentation/APPNOTE-6.3.9.TXT
     // Only deal with encryption method we support here.
-    if (encryption_method == ZipEncryptionMethod::RC4)
+    if (entry.encryption_method == ZipEncryptionMethod::RC4)
     {
         std::vector<uint8_t> rc4_extra_field;
         rc4_extra_field.resize(12, 0);
@@ -714,41 +1157,246 @@ bool ZipFile::add_entity(ReadableFile& file, ZipCompressionMethod compression_me
         *reinterpret_cast<uint16_t*>(&rc4_extra_field[2]) = htole16(8);
         *reinterpret_cast<uint16_t*>(&rc4_extra_field[4]) = htole16(2); // format = 2
         *reinterpret_cast<uint16_t*>(&rc4_extra_field[6]) = htole16(static_cast<uint16_t>(ZipEncryptionMethod::RC4));
-        *reinterpret_cast<uint16_t*>(&rc4_extra_field[8]) = htole16(rc4_encryptor.bit_len());
+        *reinterpret_cast<uint16_t*>(&rc4_extra_field[8]) = htole16(entry.rc4_bit_len);
         *reinterpret_cast<uint16_t*>(&rc4_extra_field[10]) = htole16(1); // flags
         extra_field.insert(extra_field.end(), rc4_extra_field.begin(), rc4_extra_field.end());
     }
-
     // 将文件元数据插入到数据库中
-    // 这里不涉及到大小端序问题，因为我们存储的是原始值
-    ZipCentralDirectoryFileHeader central_directory_header
-    {
-        ZipFileHeaderSignature::CentralDirectoryFile,
-        static_cast<uint8_t>(version_make_by_),
-        // 如果是符号链接,为了兼容性强制标记为Unix系统
-        version_made_by,
-        le16toh(local_header.version_needed),
-        le16toh(local_header.general_purpose),
-        le16toh(compression_method),
-        dos_time,
-        dos_date,
-        crc32,
+    // 这里不涉及到大小端序问题，因为我们存储的是原始值; 超出 32 位的大小和偏移在写出中央目录时转为 Zip64 扩展字段
+    const CentralDirectoryEntry cd_entry
+    {
+        filename,
+        extra_field,
+        "",  // 暂时不写入文件注释
+        {
+            ZipFileHeaderSignature::CentralDirectoryFile,
+            static_cast<uint8_t>(version_make_by_),
+            // 如果是符号链接,为了兼容性强制标记为Unix系统
+            entry.version_made_by,
+            local_header.version_needed,
+            local_header.general_purpose,
+            local_header.compression_method,
+            local_header.last_mod_time,
+            local_header.last_mod_date,
+            crc32,
+            zip64_clamp(compressed_size),
+            zip64_clamp(entry.size),
+            local_header.file_name_length,
+            static_cast<uint16_t>(extra_field.size()),
+            0,  // 暂时不写入文件注释
+            0,  // 不使用分卷压缩
+            // 内部文件属性
+            0,
+            entry.external_file_attributes,
+            zip64_clamp(local_header_offset)
+        },
         compressed_size,
-        static_cast<uint32_t>(meta.size),
-        le16toh(local_header.file_name_length),
-        le16toh(static_cast<uint16_t>(extra_field.size())),
-        0,  // 暂时不写入文件注释
-        0,  // 不使用分卷压缩
-        // 内部文件属性
-        0,
-        external_file_attributes,
+        entry.size,
         local_header_offset
     };
-    if (!insert_entity(&central_directory_header, filename, extra_field, ""))
+    return insert_entity(cd_entry);
+}
+
+uint64_t ZipFile::output_offset() const
+{
+    // 管道上 tellp 返回 -1, 流式写出时使用累计的偏移
+    return streaming_ ? stream_offset_ : static_cast<uint64_t>(ofs_->tellp());
+}
+
+// 并行写出时每个分块的未压缩大小; 非最后一个分块以同步刷新结束, 下一个分块以它的末尾 32 KiB 作为字典
+static constexpr size_t PARALLEL_CHUNK_SIZE = 1024 * 1024;
+// 写出队列中每项除数据外的估计开销, 避免大量小文件绕过背压
+static constexpr size_t WRITE_TASK_OVERHEAD = 4096;
+
+bool ZipFile::add_entity_parallel(ReadableFile& file, const std::shared_ptr<PendingEntry>& entry)
+{
+    if (!writes_)
+    {
+        start_pipeline();
+    }
+    if (write_failed_)
     {
         return false;
     }
-    return true;
+    const bool deflate = entry->compression_method == ZipCompressionMethod::Deflate;
+    const int level = compression_level_;
+    std::vector<std::byte> chunk, dictionary;
+    bool submitted = false;
+    const auto reserve = [&]
+    {
+        chunk.reserve(static_cast<size_t>(std::min<uint64_t>(PARALLEL_CHUNK_SIZE, entry->size)));
+    };
+    // 把当前分块交给工作线程, 对应的写出任务先入队以保证顺序
+    const auto submit = [&](const bool last)
+    {
+        const size_t cost = chunk.size() + WRITE_TASK_OVERHEAD;
+        // 第一个分块在工作线程里一并加密(AES 的密钥派生也在这里完成), 加密状态随结果交给写出线程;
+        // 流加密必须按序进行, 之后的分块由写出线程加密
+        const bool encrypt = !submitted;
+        std::vector<std::byte> next_dictionary;
+        if (deflate && !last)
+        {
+            const auto tail = std::min(chunk.size(), compress::deflate::WINDOW_SIZE);
+            next_dictionary.assign(chunk.end() - static_cast<std::ptrdiff_t>(tail), chunk.end());
+        }
+        std::packaged_task<CompressedChunk()> job(
+            [data = std::move(chunk), dictionary = std::move(dictionary), deflate, last, level,
+             cipher = encrypt ? PayloadCipher(entry->encryption_method, password_) : PayloadCipher()]() mutable
+            {
+                TRACE_SPAN(Compress, "zip.compress_chunk");
+                CompressedChunk result;
+                result.size = data.size();
+                result.encrypted = cipher.method != ZipEncryptionMethod::Unknown;
+                // 存储且不加密时数据原样写出, 省去流水线中的一次复制
+                if (!deflate && !result.encrypted)
+                {
+                    crc::CRC32 crc32_inst;
+                    crc32_inst.update(data.data(), data.size());
+                    result.crc32 = crc32_inst.finalize();
+                    result.payload = std::move(data);
+                    return result;
+                }
+                transform::Pipeline pipeline;
+                const auto& checksum = pipeline.emplace<transform::Crc32Stage>();
+                if (deflate)
+                {
+                    pipeline.emplace<transform::DeflateStage>(level, last).deflater().set_dictionary(dictionary.data(), dictionary.size());
+                }
+                if (result.encrypted)
+                {
+                    pipeline.emplace<transform::CipherStage>([&cipher](std::byte* buffer, const size_t size)
+                    {
+                        cipher.apply(buffer, size);
+                    });
+                }
+                pipeline.emplace<transform::VectorSink>(result.payload);
+                pipeline.write(data.data(), data.size());
+                pipeline.finish();
+                result.crc32 = checksum.value();
+                if (result.encrypted)
+                {
+                    result.cipher = std::move(cipher);
+                }
+                return result;
+            });
+        chunk = {};
+        dictionary = std::move(next_dictionary);
+        submitted = true;
+        if (!writes_->push(WriteTask{entry, job.get_future(), last}, cost))
+            return false;
+        return jobs_->push(std::move(job));
+    };
+
+    reserve();
+    const auto slab = buffer_pool::BufferPool::instance().acquire();
+    size_t n = 0;
+    while ((n = file.read_into(slab.data(), slab.size())) > 0)
+    {
+        for (size_t offset = 0; offset < n;)
+        {
+            // 分块满且后面还有数据时才提交, 这样最后一个分块总能以 finish 结束
+            if (chunk.size() == PARALLEL_CHUNK_SIZE)
+            {
+                if (!submit(false))
+                    return false;
+                reserve();
+            }
+            const auto take = std::min(n - offset, PARALLEL_CHUNK_SIZE - chunk.size());
+            chunk.insert(chunk.end(), slab.data() + offset, slab.data() + offset + take);
+            offset += take;
+        }
+    }
+    if (chunk.empty() && !submitted)
+    {
+        // 没有数据的条目不经过工作线程
+        if (!writes_->push(WriteTask{entry, {}, true}, WRITE_TASK_OVERHEAD))
+            return false;
+    } else if (!submit(true))
+    {
+        return false;
+    }
+    return !write_failed_ && !file.failed();
+}
+
+void ZipFile::start_pipeline()
+{
+    const auto threads = compression_threads_;
+    // 写出队列中的原始分块与对应的压缩结果同时驻留, 另有一个正在填充的分块; 非阻塞地占用预算,
+    // 为调用线程读取数据用的 slab 留出余量, 预算不足时缩小队列
+    auto& pool = buffer_pool::BufferPool::instance();
+    pipeline_budget_ = std::make_unique<buffer_pool::Reservation>(
+        pool, std::min(2 * threads * 4 * PARALLEL_CHUNK_SIZE + PARALLEL_CHUNK_SIZE, pool.memory_limit() / 2),
+        std::try_to_lock, pool.slab_size());
+    const auto granted = pipeline_budget_->size();
+    writes_ = std::make_unique<concurrency::BoundedQueue<WriteTask>>(
+        granted > PARALLEL_CHUNK_SIZE ? (granted - PARALLEL_CHUNK_SIZE) / 2 : 1);
+    jobs_ = std::make_unique<concurrency::BoundedQueue<std::packaged_task<CompressedChunk()>>>(threads * 4);
+    write_failed_ = false;
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers_.emplace_back([this]
+        {
+            while (auto job = jobs_->pop())
+                (*job)();
+        });
+    }
+    writer_ = std::thread([this] { write_loop(); });
+}
+
+void ZipFile::stop_pipeline()
+{
+    if (!writes_)
+    {
+        return;
+    }
+    // 写出线程先取完所有任务, 它等待的分块都已经交给工作线程
+    writes_->close();
+    writer_.join();
+    jobs_->close();
+    for (auto& worker : workers_)
+        worker.join();
+    workers_.clear();
+    writes_.reset();
+    jobs_.reset();
+    pipeline_budget_.reset();
+}
+
+void ZipFile::write_loop()
+{
+    std::shared_ptr<PendingEntry> current;
+    while (auto task = writes_->pop())
+    {
+        // 出错后继续取出任务, 避免调用线程在背压上永久阻塞
+        auto& entry = *task->entry;
+        std::optional<CompressedChunk> chunk;
+        if (task->chunk.valid())
+        {
+            try
+            {
+                chunk = task->chunk.get();
+            } catch ([[maybe_unused]] const std::exception& e)
+            {
+                write_failed_ = true;
+            }
+        }
+        if (task->entry != current)
+        {
+            current = task->entry;
+            // 加密头(如 AES 的盐)由第一个分块的加密状态决定
+            if (chunk && chunk->cipher)
+                entry.cipher = std::move(*chunk->cipher);
+            if (!write_failed_ && !begin_entry(entry))
+                write_failed_ = true;
+        }
+        if (chunk)
+        {
+            entry.crc32 = crc::crc32_combine(entry.crc32, chunk->crc32, chunk->size);
+            if (!write_failed_ && !write_payload(entry, chunk->payload.data(), chunk->payload.size(), chunk->encrypted))
+                write_failed_ = true;
+        }
+        if (task->last && !write_failed_ && !finish_entry(entry))
+            write_failed_ = true;
+    }
 }
 
 ZipFile::CentralDirectoryEntry ZipFile::sql_entity_to_cdfh(const db::ZipInitializationStrategy::SQLZipEntity& entity)
@@ -769,16 +1417,19 @@ ZipFile::CentralDirectoryEntry ZipFile::sql_entity_to_cdfh(const db::ZipInitiali
             last_mod_time,
             last_mod_date,
             crc32,
-            compressed_size,
-            uncompressed_size,
+            zip64_clamp(compressed_size),
+            zip64_clamp(uncompressed_size),
             static_cast<uint16_t>(filename.size()),
             static_cast<uint16_t>(extra_field.size()),
             static_cast<uint16_t>(file_comment.size()),
             disk_number,
             internal_attributes,
             external_attributes,
-            local_header_offset
-        }
+            zip64_clamp(local_header_offset)
+        },
+        compressed_size,
+        uncompressed_size,
+        local_header_offset
     };
     return entry;
 }
@@ -786,45 +1437,28 @@ ZipFile::CentralDirectoryEntry ZipFile::sql_entity_to_cdfh(const db::ZipInitiali
 // 实现list_dir方法
 std::vector<ZipFile::CentralDirectoryEntry> ZipFile::list_dir(const std::filesystem::path& path) const
 {
+    TRACE_SPAN(Zip, "zip.list_dir");
     // path like "/...", and not contain any driver letter
     if (path.has_root_name() || !path.is_relative())
         return {}; // cannot analyze a path starts with "C:\"
 
-    // 调试输出：检查数据库是否已初始化
-    if (!db_.is_open()) {
-        return {};
-    }
-
-    auto stmt = db_.create_statement(
-        "SELECT " + db::ZipInitializationStrategy::SQLEntityColumns +
-        " FROM zip_entity WHERE filename LIKE ? ORDER BY filename ASC;"
-    );
-
-    std::string like_path = path.generic_u8string();
-    if (like_path == "." || like_path.empty())
-        like_path = "/%";
-    else if (like_path.back() == '/')
-        like_path += "%";
-    else
-        like_path += "/%";
-    if (like_path.front() == '/')
-        like_path = like_path.substr(1);
-
-    sqlite3_bind_text(stmt.get(), 1, like_path.c_str(), -1, SQLITE_TRANSIENT);
+    // 子树是按路径排序后的一段连续区间: ["dir/", "dir0"), '0' 是 '/' 的下一个字符
+    return index_->list_subtree(path.generic_u8string());
+}
 
-    std::vector<ZipFile::CentralDirectoryEntry> results;
-    auto rs = db_.query<db::ZipInitializationStrategy::SQLZipEntity>(std::move(stmt));
-    for (const auto& entity : rs)
-    {
-        results.push_back(sql_entity_to_cdfh(entity));
-    }
-    return results;
+std::vector<ZipFile::CentralDirectoryEntry> ZipFile::list_children(const std::filesystem::path& path) const
+{
+    TRACE_SPAN(Zip, "zip.list_children");
+    if (path.has_root_name() || !path.is_relative())
+        return {};
+    return index_->list_children(path.generic_u8string());
 }
 
 // 实现get_file_stream方法
 std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesystem::path& path)
 {
-    if (!is_valid_ || !ifs_ || !ifs_->is_open())
+    TRACE_SPAN(Zip, "zip.lookup");
+    if (!is_valid_ || !ifs_ || !ifs_->is_open() || !source_)
     {
         return nullptr;
     }
@@ -846,43 +1480,63 @@ std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesys
     }
     if (path_str.empty()) return nullptr;
 
-    auto stmt = db_.create_statement(
-        "SELECT " + db::ZipInitializationStrategy::SQLEntityColumns +
-        " FROM zip_entity WHERE filename = ? LIMIT 1;"
-    );
-
-    // reinterpret_cast for C++20
-    sqlite3_bind_text(stmt.get(), 1, reinterpret_cast<const char*>(path_str.c_str()), -1, SQLITE_TRANSIENT);
-
-    std::unique_ptr<ZipIstream> zip_stream;
-    db::ZipInitializationStrategy::SQLZipEntity entity;
-    CentralDirectoryEntry cdfh;
-    try
-    {
-        entity = db_.query_one<db::ZipInitializationStrategy::SQLZipEntity>(std::move(stmt));
-        cdfh = sql_entity_to_cdfh(entity);
-    } catch ([[maybe_unused]] const std::exception& e)
-    {
+    // 目录条目以 '/' 结尾, 不带 '/' 的路径也能找到对应目录
+    auto found = index_->find(path_str);
+    if (!found && path_str.back() != '/')
+        found = index_->find(path_str + "/");
+    if (!found)
         return nullptr;
-    }
+    const auto& cdfh = *found;
+    std::unique_ptr<ZipIstream> zip_stream;
     ZipLocalFileHeader lfh;
-    ifs_->seekg(cdfh.record.local_header_offset, std::ios::beg);
-    ifs_->read(reinterpret_cast<char*>(&lfh), sizeof(ZipLocalFileHeader));
-    if (ifs_->gcount() != sizeof(ZipLocalFileHeader) || le32toh(lfh.signature) != ZipFileHeaderSignature::LocalFile)
+    if (source_->read_at(cdfh.local_header_offset, reinterpret_cast<char*>(&lfh), sizeof(ZipLocalFileHeader)) != sizeof(ZipLocalFileHeader) ||
+        le32toh(lfh.signature) != ZipFileHeaderSignature::LocalFile)
     {
         return nullptr;
     }
     // 从小端序中转换
     lfh_le_to_host(lfh);
-    size_t real_offset = cdfh.record.local_header_offset + sizeof(lfh) + lfh.file_name_length + lfh.extra_field_length;
-    auto meta = sql_zip_entity2file_meta(entity);
+    const uint64_t real_offset = cdfh.local_header_offset + sizeof(lfh) + lfh.file_name_length + lfh.extra_field_length;
+    auto meta = entry2file_meta(cdfh);
     std::unique_ptr<ZipIstreamBuf> stream_buf = nullptr;
+    // AES 条目的真实压缩方法记在 0x9901 扩展字段中
+    const auto aes_field = cdfh.record.compression_method == ZipCompressionMethod::AES_Encryption
+                               ? find_aes_extra_field(cdfh.extra_field) : AesExtraField{};
+    const auto compression_method = aes_field.vendor_version ? aes_field.method : cdfh.record.compression_method;
+    const bool deflated = compression_method == ZipCompressionMethod::Deflate;
+    // 从 data_offset 开始的数据长度: 存储时即原始大小, 压缩时为压缩数据去掉加密头(以及 AES 认证码)之后的部分
+    const auto payload_size = [&](const uint64_t data_offset) -> size_t
+    {
+        if (!deflated)
+            return meta.size;
+        const uint64_t overhead = data_offset - real_offset + (aes_field.vendor_version ? encryption::WinZipAes::AUTH_CODE_SIZE : 0);
+        return cdfh.compressed_size > overhead ? static_cast<size_t>(cdfh.compressed_size - overhead) : 0;
+    };
 
     if ((lfh.general_purpose & static_cast<uint16_t>(ZipGeneralPurposeBitFlag::Encrypted)) && meta.size > 0)
     {
         // ReSharper disable once CppDFAUnreachableCode
         do
         {
+            if (aes_field.vendor_version)
+            {
+                // 数据前是盐和口令校验值
+                const auto salt_size = encryption::WinZipAes::salt_size(aes_field.strength);
+                if (!salt_size)
+                    break;
+                std::vector<uint8_t> aes_header(salt_size + encryption::WinZipAes::VERIFIER_SIZE);
+                if (source_->read_at(real_offset, reinterpret_cast<char*>(aes_header.data()), aes_header.size()) != aes_header.size())
+                    break;
+                encryption::WinZipAes decoder(aes_field.strength, password_, aes_header.data());
+                if (!std::equal(decoder.verifier().begin(), decoder.verifier().end(), aes_header.begin() + static_cast<std::ptrdiff_t>(salt_size)))
+                {
+                    invalid_password_ = true;
+                    break;
+                }
+                const uint64_t data_offset = real_offset + aes_header.size();
+                stream_buf = std::make_unique<AesIstreamBuf>(source_, std::move(decoder), data_offset, payload_size(data_offset), read_buffer_limit_);
+                break;
+            }
             auto encryption_method = ZipEncryptionMethod::Unknown;
             if (lfh.general_purpose & static_cast<uint16_t>(ZipGeneralPurposeBitFlag::StrongEncryption))
             {
@@ -908,8 +1562,8 @@ std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesys
                 // 解密头12个字节,判断是否与 CRC 相符
                 encryption::ZipCrypto decoder{password_};
                 uint8_t zip_crypto_header[12];
-                ifs_->seekg(static_cast<long long>(real_offset), std::ios::beg);
-                ifs_->read(reinterpret_cast<char*>(zip_crypto_header), 12);
+                if (source_->read_at(real_offset, reinterpret_cast<char*>(zip_crypto_header), 12) != 12)
+                    break;
                 for (unsigned char & i : zip_crypto_header)
                 {
                     i = decoder.decrypt(i);
@@ -928,12 +1582,12 @@ std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesys
                     {
                         if (static_cast<uint8_t>((lfh.crc32 >> 16) & 0xFF) == zip_crypto_header[10])
                         {
-                            stream_buf = std::make_unique<ZipCryptoIstreamBuf>(*ifs_.get(), decoder, real_offset + 12, meta.size);  // meta.size 使用的是 uncompression_size
+                            stream_buf = std::make_unique<ZipCryptoIstreamBuf>(source_, decoder, real_offset + 12, payload_size(real_offset + 12), read_buffer_limit_);
                             break;
                         }
                     } else
                     {
-                        stream_buf = std::make_unique<ZipCryptoIstreamBuf>(*ifs_.get(), decoder, real_offset + 12, meta.size);  // meta.size 使用的是 uncompression_size
+                        stream_buf = std::make_unique<ZipCryptoIstreamBuf>(source_, decoder, real_offset + 12, payload_size(real_offset + 12), read_buffer_limit_);
                         break;
                     }
                 }
@@ -941,7 +1595,7 @@ std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesys
                 if (static_cast<uint8_t>((lfh.last_mod_time >> 8) & 0xFF) == zip_crypto_header[11])
                 {
                     decoder = encryption::ZipCrypto{password_};
-                    stream_buf = std::make_unique<ZipCryptoIstreamBuf>(*ifs_.get(), decoder, real_offset + 12, meta.size);  // meta.size 使用的是 uncompression_size
+                    stream_buf = std::make_unique<ZipCryptoIstreamBuf>(source_, decoder, real_offset + 12, payload_size(real_offset + 12), read_buffer_limit_);
                 } else
                 {
                     invalid_password_ = true;
@@ -957,7 +1611,7 @@ std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesys
                     break;
                 } else
                 {
-                    const size_t raw_file_offset = static_cast<size_t>(ifs_->tellg());
+                    const uint64_t raw_file_offset = static_cast<uint64_t>(ifs_->tellg());
                     if (encryption_method == ZipEncryptionMethod::Unknown)
                     {
                         encryption_method = de_header.alg_id;
@@ -981,7 +1635,7 @@ std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesys
                             break;
                         }
                         rc4_decoder = encryption::RC4(rc4_pwd);
-                        stream_buf = std::make_unique<RC4IstreamBuf>(*ifs_.get(), rc4_decoder, raw_file_offset, meta.size);
+                        stream_buf = std::make_unique<RC4IstreamBuf>(source_, rc4_decoder, raw_file_offset, payload_size(raw_file_offset), read_buffer_limit_);
                     } else break;
                 }
             }
@@ -992,71 +1646,164 @@ std::unique_ptr<ZipFile::ZipIstream> ZipFile::get_file_stream(const std::filesys
         } while (false);
         if (!stream_buf)
         {
-            stream_buf = std::make_unique<ZipIstreamBuf>(*ifs_.get(), 0, 0);
+            stream_buf = std::make_unique<ZipIstreamBuf>(nullptr, 0, 0);
+        } else if (deflated)
+        {
+            stream_buf = std::make_unique<InflateIstreamBuf>(std::move(stream_buf));
         }
+    } else if (deflated && meta.size > 0)
+    {
+        stream_buf = std::make_unique<InflateIstreamBuf>(std::make_unique<ZipIstreamBuf>(source_, real_offset, payload_size(real_offset), read_buffer_limit_));
     } else
     {
-        stream_buf = std::make_unique<ZipIstreamBuf>(*ifs_.get(), real_offset, meta.size);
+        stream_buf = std::make_unique<ZipIstreamBuf>(source_, real_offset, meta.size, read_buffer_limit_);
     }
 
     zip_stream = std::make_unique<ZipIstream>(std::move(stream_buf), meta);
     return zip_stream;
 }
 
+bool ZipFile::has_unchanged_entry(const FileEntityMeta& meta) const
+{
+    if (!is_valid_)
+        return false;
+    // 与 prepare_entry 写入的名字一致
+    std::string filename = meta.path.generic_u8string();
+    if (meta.type == FileEntityType::Directory && !filename.empty() && filename.back() != '/')
+        filename += '/';
+    std::optional<CentralDirectoryEntry> found;
+    {
+        std::lock_guard lock(index_mutex_);
+        found = index_->find(filename);
+    }
+    if (!found)
+        return false;
+    // 中央目录里总有 DOS 时间, 扩展字段中的时间不一定存在, 统一按 DOS 时间比较
+    const auto [dos_date, dos_time] = unix_time_to_dos(std::chrono::duration_cast<std::chrono::seconds>(
+        meta.modification_time.time_since_epoch()).count());
+    return found->uncompressed_size == meta.size && found->record.last_mod_date == dos_date &&
+           found->record.last_mod_time == dos_time;
+}
+
 // 完成zip归档创建
-void ZipFile::close() {
+bool ZipFile::close() {
     if (!is_valid_) {
-        return;
+        return true;
     }
     if (ifs_)
     {
         if (ifs_->is_open()) ifs_->close();
         is_valid_ = false;
-        return;
+        return true;
     }
 
+    // 等待并行写出的条目全部落盘
+    stop_pipeline();
+    if (write_failed_)
+    {
+        // 中央目录会引用写了一半的条目, 不如不写, 让调用方知道归档不完整
+        std::cerr << "write zip entries failed, central directory not written!" << std::endl;
+        ofs_->close();
+        is_valid_ = false;
+        update_path_.clear();
+        return false;
+    }
+    TRACE_SPAN(Zip, "zip.write_central_directory");
+    [[maybe_unused]] const auto flushed = index_->flush();
     // 计算中央目录的偏移量和大小
-    uint32_t central_directory_offset = ofs_->tellp();
-    uint32_t central_directory_size = 0;
-    uint16_t total_central_directory_records = 0;
+    const uint64_t central_directory_offset = output_offset();
+    uint64_t central_directory_size = 0;
+    uint64_t total_central_directory_records = 0;
 
     // 写入中央目录
-    auto stmt = db_.create_statement(
-        "SELECT " + db::ZipInitializationStrategy::SQLEntityColumns +
-        " FROM zip_entity ORDER BY filename ASC;"
-    );
-    auto rs = db_.query<db::ZipInitializationStrategy::SQLZipEntity>(std::move(stmt));
-    for (const auto& entity : rs)
+    const auto write_record = [&](const CentralDirectoryEntry& stored)
     {
         total_central_directory_records++;
-        auto [file_name, extra_field, file_comment, record] = sql_entity_to_cdfh(entity);
+        auto entry = stored;
+        auto& record = entry.record;
+        // 大小或偏移超出 32 位时把 Zip64 扩展字段放在最前面
+        const auto zip64_extra_field = make_zip64_extra_field(entry);
+        if (!zip64_extra_field.empty() && static_cast<uint16_t>(record.version_needed) < static_cast<uint16_t>(ZipVersionNeeded::Version45))
+        {
+            record.version_needed = ZipVersionNeeded::Version45;
+        }
+        record.extra_field_length = static_cast<uint16_t>(zip64_extra_field.size() + entry.extra_field.size());
         cdfh_host_to_le(record);
         ofs_->write(reinterpret_cast<const char*>(&record), sizeof(ZipCentralDirectoryFileHeader));
         central_directory_size += sizeof(ZipCentralDirectoryFileHeader);
         // ReSharper disable once CppRedundantCastExpression
-        ofs_->write(reinterpret_cast<const char*>(file_name.c_str()), static_cast<long long>(file_name.size()));
-        central_directory_size += static_cast<uint32_t>(file_name.size());
-        if (!extra_field.empty())
+        ofs_->write(reinterpret_cast<const char*>(entry.file_name.c_str()), static_cast<long long>(entry.file_name.size()));
+        central_directory_size += entry.file_name.size();
+        for (const auto& field : {std::cref(zip64_extra_field), std::cref(entry.extra_field)})
         {
-            ofs_->write(reinterpret_cast<const char*>(extra_field.data()), static_cast<long long>(extra_field.size()));
-            central_directory_size += static_cast<uint32_t>(extra_field.size());
+            if (field.get().empty())
+                continue;
+            ofs_->write(reinterpret_cast<const char*>(field.get().data()), static_cast<long long>(field.get().size()));
+            central_directory_size += field.get().size();
         }
-        if (!file_comment.empty())
+        if (!entry.file_comment.empty())
         {
             // ReSharper disable once CppRedundantCastExpression
-            ofs_->write(reinterpret_cast<const char*>(file_comment.c_str()), static_cast<long long>(file_comment.size()));
-            central_directory_size += static_cast<uint32_t>(file_comment.size());
+            ofs_->write(reinterpret_cast<const char*>(entry.file_comment.c_str()), static_cast<long long>(entry.file_comment.size()));
+            central_directory_size += entry.file_comment.size();
         }
+    };
+    if (update_path_.empty())
+    {
+        index_->visit_subtree({}, write_record);
+    } else
+    {
+        // 更新模式下同一路径只保留最后写入的条目, 被替换的旧数据留在原处, 不再被引用
+        // visit_subtree 按路径排序、同一路径按写入顺序, 路径变化时写出上一条
+        std::optional<CentralDirectoryEntry> latest;
+        index_->visit_subtree({}, [&](const CentralDirectoryEntry& stored)
+        {
+            if (latest && latest->file_name != stored.file_name)
+                write_record(*latest);
+            latest = stored;
+        });
+        if (latest)
+            write_record(*latest);
     }
 
+    // 任何一项超出 EOCD 的字段范围时, 先写 Zip64 EOCD 和定位记录, EOCD 中对应字段写成全 1
+    if (total_central_directory_records >= ZIP64_MARK_16 || central_directory_size >= ZIP64_MARK_32 ||
+        central_directory_offset >= ZIP64_MARK_32)
+    {
+        const uint64_t zip64_eocd_offset = central_directory_offset + central_directory_size;
+        Zip64EndOfCentralDirectory zip64_eocd {
+            ZipFileHeaderSignature::Zip64EndOfCentralDirectoryRecord,
+            sizeof(Zip64EndOfCentralDirectory) - 12,
+            static_cast<uint8_t>(ZipVersionNeeded::Version45),
+            SYSTEM_VERSION_MADE_BY,
+            ZipVersionNeeded::Version45,
+            0,
+            0,
+            total_central_directory_records,
+            total_central_directory_records,
+            central_directory_size,
+            central_directory_offset
+        };
+        zip64_eocd_host_to_le(zip64_eocd);
+        ofs_->write(reinterpret_cast<const char*>(&zip64_eocd), sizeof(zip64_eocd));
+        Zip64EndOfCentralDirectoryLocator locator {
+            ZipFileHeaderSignature::Zip64EndOfCentralDirectoryLocator,
+            0,
+            zip64_eocd_offset,
+            1
+        };
+        zip64_locator_host_to_le(locator);
+        ofs_->write(reinterpret_cast<const char*>(&locator), sizeof(locator));
+    }
+    const auto total_records = static_cast<uint16_t>(std::min<uint64_t>(total_central_directory_records, ZIP64_MARK_16));
     ZipEndOfCentralDirectoryRecord eocd {
         ZipFileHeaderSignature::EndOfCentralDirectory,
         0,
         0,
-        static_cast<uint16_t>(total_central_directory_records),
-        static_cast<uint16_t>(total_central_directory_records),
-        central_directory_size,
-        central_directory_offset,
+        total_records,
+        total_records,
+        zip64_clamp(central_directory_size),
+        zip64_clamp(central_directory_offset),
         static_cast<uint16_t>(comment_.size())
     };
     eocd_host_to_le(eocd);
@@ -1067,15 +1814,27 @@ void ZipFile::close() {
         ofs_->write(reinterpret_cast<const char*>(comment_.data()), static_cast<long long>(comment_.size()));
     }
     // 关闭文件
+    const auto end = output_offset();
+    ofs_->flush();
+    const bool ok = ofs_->good();
     ofs_->close();
     is_valid_ = false;
+    // 新的中央目录比原来的短时, 截掉末尾残留的旧数据
+    if (!update_path_.empty())
+    {
+        std::error_code ec;
+        if (std::filesystem::file_size(update_path_, ec) > end && !ec)
+            std::filesystem::resize_file(update_path_, end, ec);
+        update_path_.clear();
+    }
+    return ok;
 }
 FileEntityMeta ZipFile::cdfh_to_file_meta(const CentralDirectoryEntry& cdfh)
 {
     FileEntityMeta meta {
         std::filesystem::path(cdfh.file_name),
         FileEntityType::RegularFile,
-        cdfh.record.uncompressed_size,
+        static_cast<size_t>(cdfh.uncompressed_size),
         std::chrono::system_clock::from_time_t(dos_to_unix_time(cdfh.record.last_mod_date, cdfh.record.last_mod_time)),
         std::chrono::system_clock::from_time_t(dos_to_unix_time(cdfh.record.last_mod_date, cdfh.record.last_mod_time)),
         std::chrono::system_clock::from_time_t(dos_to_unix_time(cdfh.record.last_mod_date, cdfh.record.last_mod_time)),
@@ -0,0 +1,130 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+#include "filesystem/device.h"
+#include "utils/buffer_pool.h"
+
+using namespace buffer_pool;
+
+TEST(buffer_pool, ReuseAndAlignment)
+{
+    BufferPool pool(4096, 4 * 4096);
+    const std::byte* first = nullptr;
+    {
+        const auto slab = pool.acquire();
+        ASSERT_TRUE(slab.valid());
+        EXPECT_EQ(slab.size(), 4096u);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(slab.data()) % PAGE_ALIGNMENT, 0u);
+        EXPECT_EQ(pool.in_use(), 4096u);
+        first = slab.data();
+    }
+    EXPECT_EQ(pool.in_use(), 0u);
+    // 归还后的 slab 会被复用而不是重新分配
+    const auto again = pool.acquire();
+    EXPECT_EQ(again.data(), first);
+    EXPECT_EQ(pool.allocated(), 4096u);
+}
+
+TEST(buffer_pool, BackpressureAtLimit)
+{
+    BufferPool pool(4096, 2 * 4096);
+    auto a = pool.acquire();
+    auto b = pool.acquire();
+    EXPECT_FALSE(pool.try_acquire().valid());
+    EXPECT_FALSE(pool.acquire_for(std::chrono::milliseconds(10)).valid());
+
+    std::atomic<bool> acquired{false};
+    std::thread waiter([&]
+    {
+        const auto c = pool.acquire();
+        acquired = c.valid();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(acquired.load());
+    a.release();
+    waiter.join();
+    EXPECT_TRUE(acquired.load());
+    EXPECT_LE(pool.allocated(), pool.memory_limit());
+}
+
+TEST(buffer_pool, ReserveAndShrinkLimit)
+{
+    BufferPool pool(4096, 4 * 4096);
+    EXPECT_FALSE(pool.reserve(5 * 4096));
+    {
+        const Reservation reservation(pool, 3 * 4096);
+        ASSERT_TRUE(reservation.valid());
+        const auto slab = pool.acquire();
+        EXPECT_FALSE(pool.try_acquire().valid());
+    }
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+    }
+    EXPECT_EQ(pool.allocated(), 2 * 4096u);
+    pool.set_memory_limit(4096);
+    EXPECT_EQ(pool.allocated(), 4096u);
+    pool.trim();
+    EXPECT_EQ(pool.allocated(), 0u);
+}
+
+TEST(buffer_pool, TryReserveLeavesHeadroom)
+{
+    BufferPool pool(4096, 4 * 4096);
+    {
+        // 空闲 slab 会被回收, 预算不足时只占用剩余部分, 并为 acquire() 留出一个 slab
+        { const auto slab = pool.acquire(); }
+        const Reservation reservation(pool, 8 * 4096, std::try_to_lock, 4096);
+        ASSERT_TRUE(reservation.valid());
+        EXPECT_EQ(reservation.size(), 3 * 4096u);
+        EXPECT_EQ(pool.allocated(), 0u);
+        const auto slab = pool.try_acquire();
+        EXPECT_TRUE(slab.valid());
+        const Reservation none(pool, 4096, std::try_to_lock);
+        EXPECT_FALSE(none.valid());
+        EXPECT_EQ(none.size(), 0u);
+    }
+    EXPECT_EQ(pool.try_reserve(4 * 4096), 4 * 4096u);
+    pool.unreserve(4 * 4096);
+}
+
+// 整文件读取在分配前占用等量的全局预算, 预算被占满时等待而不是越过上限
+TEST(buffer_pool, WholeFileReadWaitsForBudget)
+{
+    const auto path = std::filesystem::temp_directory_path() / "backup_suite_whole_read.bin";
+    std::ofstream(path, std::ios::binary) << "whole file";
+    {
+        FileEntityMeta meta;
+        meta.path = path;
+        meta.type = FileEntityType::RegularFile;
+        meta.size = 10;
+        PhysicalDeviceReadableFile file(meta, std::make_unique<std::ifstream>(path, std::ios::binary));
+        auto& pool = BufferPool::instance();
+        auto all = std::make_unique<Reservation>(pool, pool.memory_limit());
+        ASSERT_TRUE(all->valid());
+
+        std::atomic<bool> done{false};
+        std::unique_ptr<std::vector<std::byte>> data;
+        std::thread reader([&]
+        {
+            data = file.read();
+            done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        EXPECT_FALSE(done.load());
+        all.reset();
+        reader.join();
+        ASSERT_NE(data, nullptr);
+        EXPECT_EQ(std::string(reinterpret_cast<const char*>(data->data()), data->size()), "whole file");
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,122 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "core/core_utils.h"
+#include "backup/backup_controller.h"
+#include "backup/change_journal.h"
+#include "filesystem/compresses_device.h"
+#include "filesystem/system_device.h"
+#include "utils/tmpfile.h"
+
+namespace fs = std::filesystem;
+using namespace tmpfile_utils;
+
+TEST(change_journal, SnapshotAndConsume)
+{
+    const auto journal_file = TmpFile::create();
+    {
+        ChangeJournal journal(journal_file->path());
+        ASSERT_TRUE(journal.is_open());
+        // 新建的日志没有基线, 第一次必须全量扫描
+        auto snapshot = journal.snapshot();
+        ASSERT_TRUE(snapshot.valid);
+        EXPECT_TRUE(snapshot.full_scan);
+        ASSERT_TRUE(journal.consume(snapshot.seq));
+
+        ASSERT_TRUE(journal.record({{"a/b.txt", false}, {"c", true}}));
+        snapshot = journal.snapshot();
+        EXPECT_FALSE(snapshot.full_scan);
+        ASSERT_EQ(snapshot.entries.size(), 2u);
+        EXPECT_EQ(snapshot.entries[0].path, fs::path("a/b.txt"));
+        EXPECT_TRUE(snapshot.entries[1].recursive);
+
+        // 读取快照之后记录的路径在 consume 后保留
+        ASSERT_TRUE(journal.record({{"d.txt", false}}));
+        ASSERT_TRUE(journal.consume(snapshot.seq));
+    }
+    {
+        // 重新打开后内容仍在
+        ChangeJournal journal(journal_file->path());
+        auto snapshot = journal.snapshot();
+        ASSERT_EQ(snapshot.entries.size(), 1u);
+        EXPECT_EQ(snapshot.entries[0].path, fs::path("d.txt"));
+
+        ASSERT_TRUE(journal.mark_overflow());
+        snapshot = journal.snapshot();
+        EXPECT_TRUE(snapshot.full_scan);
+        ASSERT_TRUE(journal.consume(snapshot.seq));
+        EXPECT_FALSE(journal.snapshot().full_scan);
+    }
+}
+
+TEST_F(TestSystemDevice, TestJournalBackupToTar)
+{
+    const auto journal_file = TmpFile::create();
+    const auto tmp_tar_file = TmpFile::create();
+    ChangeJournal journal(journal_file->path());
+    ASSERT_TRUE(journal.consume(journal.snapshot().seq));
+    ASSERT_TRUE(journal.record({{test_folder / "test_file.txt", false}, {"no_such_file.txt", false}}));
+    {
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        const BackupController controller{};
+        EXPECT_TRUE(controller.run_backup(device, tar_device, journal));
+        tar_device.close();
+    }
+    EXPECT_TRUE(journal.snapshot().entries.empty());
+
+    TarDevice read_tar_device(tmp_tar_file->path(), TarDevice::Mode::ReadOnly);
+    ASSERT_TRUE(read_tar_device.is_open());
+    EXPECT_TRUE(read_tar_device.exists(test_folder));
+    EXPECT_TRUE(read_tar_device.exists(test_folder / "test_file.txt"));
+    // 只写入日志中的路径
+    const auto root_folder = read_tar_device.get_folder({});
+    ASSERT_NE(root_folder, nullptr);
+    EXPECT_EQ(root_folder->get_children().size(), 1u);
+}
+
+#ifdef __linux__
+TEST(change_journal, WatcherRecordsChanges)
+{
+    const auto journal_file = TmpFile::create();
+    const auto watch_root = fs::temp_directory_path() / "backup_suite_tests_watch";
+    fs::remove_all(watch_root);
+    fs::create_directories(watch_root / "existing");
+
+    ChangeJournal journal(journal_file->path());
+    ASSERT_TRUE(journal.consume(journal.snapshot().seq));
+    ChangeWatcher watcher(watch_root, journal);
+    ASSERT_TRUE(watcher.start());
+    // 启动之前的变化未知, 第一次备份完整扫描
+    const auto initial = journal.snapshot();
+    ASSERT_TRUE(initial.full_scan);
+    ASSERT_TRUE(journal.consume(initial.seq));
+    std::atomic<bool> stop{false};
+    std::thread runner([&] { watcher.run(stop, std::chrono::milliseconds(20)); });
+
+    std::ofstream(watch_root / "existing" / "changed.txt") << "changed";
+    fs::create_directories(watch_root / "new_dir" / "sub");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stop = true;
+    runner.join();
+
+    const auto snapshot = journal.snapshot();
+    ASSERT_FALSE(snapshot.full_scan);
+    const auto find = [&](const fs::path& path) {
+        return std::find_if(snapshot.entries.begin(), snapshot.entries.end(),
+                            [&](const ChangeJournal::Entry& entry) { return entry.path == path; });
+    };
+    EXPECT_NE(find(fs::path("existing") / "changed.txt"), snapshot.entries.end());
+    const auto new_dir = find("new_dir");
+    ASSERT_NE(new_dir, snapshot.entries.end());
+    EXPECT_TRUE(new_dir->recursive);
+    fs::remove_all(watch_root);
+}
+#endif
@@ -5,12 +5,18 @@
 #include <gtest/gtest.h>
 #include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
 #include <archive.h>
 #include <archive_entry.h>
 
 #include "core/core_utils.h"
+#include "compress/deflate.h"
 #include "utils/database.h"
 #include "utils/tar.h"
+#include "utils/transform.h"
 #include "utils/zip.h"
 #include "filesystem/entities.h"
 
@@ -37,6 +43,36 @@ TEST(TestSqlite3, TestOpenDatabase)
     sqlite3_close(db);
 }
 
+// 批量写入: 语句复用, 每 batch_rows 行提交; 未提交的事务在离开作用域时回滚
+TEST(TestSqlite3, TestBulkInserter)
+{
+    const db::Database db;
+    ASSERT_TRUE(db.exec("CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT);"));
+    {
+        db::BulkInserter inserter(db, "INSERT INTO t (id, name) VALUES (?, ?);", 4);
+        ASSERT_NE(inserter.statement(), nullptr);
+        for (int i = 0; i < 10; ++i)
+        {
+            db::bind_parameter(inserter.statement(), 1, i);
+            db::bind_parameter(inserter.statement(), 2, "row " + std::to_string(i));
+            ASSERT_TRUE(inserter.insert());
+        }
+        // 最后 2 行还在未提交的批次中
+        EXPECT_TRUE(db.in_transaction());
+        // 主键冲突只影响这一行
+        db::bind_parameter(inserter.statement(), 1, 3);
+        EXPECT_FALSE(inserter.insert());
+    }
+    EXPECT_FALSE(db.in_transaction());
+    EXPECT_EQ(std::get<0>(db.query_one<std::tuple<int>>("SELECT COUNT(*) FROM t;")), 10);
+    {
+        db::Transaction transaction(db);
+        EXPECT_TRUE(transaction.active());
+        ASSERT_TRUE(db.exec("DELETE FROM t;"));
+    }
+    EXPECT_EQ(std::get<0>(db.query_one<std::tuple<int>>("SELECT COUNT(*) FROM t;")), 10);
+}
+
 // 简单的测试文件实现，用于测试压缩功能
 class TestFile : public ReadableFile {
 public:
@@ -107,6 +143,149 @@ TEST(TestTar, TestTarCreate) {
 
     GTEST_LOG_(INFO) << "Tar create test passed!" << std::endl;
 }
+// 内嵌索引: 打开时直接加载末尾的索引, 索引损坏时退回扫描, 两者结果一致
+TEST(TestTar, TestTarEmbeddedIndex) {
+    const std::string tar_path = "test_index.tar";
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::output);
+        tar.set_standard(tar::TarStandard::POSIX_2001_PAX);
+        for (const std::string name : {std::string("b.txt"), "a/long_" + std::string(120, 'x') + ".txt", std::string("a/c.txt")})
+        {
+            TestFile file(name, "content of " + name);
+            ASSERT_TRUE(tar.add_entity(file));
+        }
+        tar.close();
+    }
+    const auto read_all = [&] {
+        tar::TarFile tar(tar_path, tar::TarFile::input);
+        EXPECT_TRUE(tar.is_open());
+        EXPECT_EQ(tar.get_standard(), tar::TarStandard::POSIX_2001_PAX);
+        std::vector<std::string> contents;
+        for (const auto& [meta, offset] : tar.list_dir("."))
+        {
+            const auto stream = tar.get_file_stream(meta.path);
+            EXPECT_NE(stream, nullptr);
+            if (!stream)
+                continue;
+            std::string content(meta.size, '\0');
+            stream->read(&content[0], static_cast<std::streamsize>(content.size()));
+            contents.push_back(meta.path.generic_string() + ":" + content);
+        }
+        return contents;
+    };
+    const auto indexed = read_all();
+    ASSERT_EQ(indexed.size(), 3u);
+    EXPECT_EQ(indexed[1], "a/long_" + std::string(120, 'x') + ".txt:content of a/long_" + std::string(120, 'x') + ".txt");
+
+    // 破坏定位块中的校验值
+    {
+        std::fstream file(tar_path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-512 + 16 + 4 + 8 + 8 + 8, std::ios::end);
+        file.put('\x5A');
+    }
+    EXPECT_EQ(read_all(), indexed);
+    std::filesystem::remove(tar_path);
+}
+
+// 追加模式: 从结束标记处继续写入并重写内嵌索引, 同名成员以最后追加的为准
+TEST(TestTar, TestTarAppend) {
+    const std::string tar_path = "test_append.tar";
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::output);
+        tar.set_standard(tar::TarStandard::POSIX_2001_PAX);
+        TestFile a("a.txt", "first"), b("b.txt", "old");
+        ASSERT_TRUE(tar.add_entity(a));
+        ASSERT_TRUE(tar.add_entity(b));
+        tar.close();
+    }
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::append);
+        ASSERT_TRUE(tar.writable());
+        EXPECT_EQ(tar.get_standard(), tar::TarStandard::POSIX_2001_PAX);
+        TestFile c("c.txt", "appended"), b("b.txt", "new");
+        ASSERT_TRUE(tar.add_entity(c));
+        ASSERT_TRUE(tar.add_entity(b));
+        tar.close();
+    }
+    tar::TarFile tar(tar_path, tar::TarFile::input);
+    ASSERT_TRUE(tar.is_open());
+    EXPECT_EQ(tar.list_dir(".").size(), 4u);
+    for (const auto& [path, content] : {std::pair<std::string, std::string>{"a.txt", "first"}, {"b.txt", "new"}, {"c.txt", "appended"}})
+    {
+        const auto stream = tar.get_file_stream(path);
+        ASSERT_NE(stream, nullptr);
+        std::string read_back(content.size(), '\0');
+        stream->read(&read_back[0], static_cast<std::streamsize>(read_back.size()));
+        EXPECT_EQ(read_back, content);
+    }
+    tar.close();
+    std::filesystem::remove(tar_path);
+}
+
+// 长路径在 tar 头中只写占位名, 内嵌索引和追加后重写的索引都必须记录真实路径
+TEST(TestTar, TestTarLongPathIndex) {
+    const std::string tar_path = "test_long_path.tar";
+    const std::string gnu_path = "dir/" + std::string(130, 'g') + ".txt";
+    const std::string pax_path = "deep/" + std::string(120, 'p') + "/" + std::string(130, 'q') + ".txt";
+    const std::string batch_path = "deep/" + std::string(120, 'p') + "/" + std::string(130, 'b') + ".txt";
+    const std::string appended_path = "dir/" + std::string(250, 'a') + ".txt";
+    for (const auto standard : {tar::TarStandard::GNU, tar::TarStandard::POSIX_2001_PAX})
+    {
+        {
+            tar::TarFile tar(tar_path, tar::TarFile::output);
+            tar.set_standard(standard);
+            TestFile gnu(gnu_path, "gnu"), pax(pax_path, "pax"), batch(batch_path, "batch");
+            ASSERT_TRUE(tar.add_entity(gnu));
+            ASSERT_TRUE(tar.add_entity(pax));
+            ASSERT_TRUE(tar.add_entities({&batch}));
+            tar.close();
+        }
+        {
+            tar::TarFile tar(tar_path, tar::TarFile::append);
+            ASSERT_TRUE(tar.writable());
+            TestFile appended(appended_path, "appended");
+            ASSERT_TRUE(tar.add_entity(appended));
+            tar.close();
+        }
+        tar::TarFile tar(tar_path, tar::TarFile::input);
+        ASSERT_TRUE(tar.is_open());
+        for (const auto& [path, content] : {std::pair<std::string, std::string>{gnu_path, "gnu"}, {pax_path, "pax"}, {batch_path, "batch"}, {appended_path, "appended"}})
+        {
+            const auto stream = tar.get_file_stream(path);
+            ASSERT_NE(stream, nullptr) << path;
+            std::string read_back(content.size(), '\0');
+            stream->read(&read_back[0], static_cast<std::streamsize>(read_back.size()));
+            EXPECT_EQ(read_back, content);
+        }
+        EXPECT_EQ(tar.list_children("dir").size(), 2u);
+        EXPECT_EQ(tar.list_children("deep/" + std::string(120, 'p')).size(), 2u);
+        for (const auto& [meta, offset] : tar.list_dir("."))
+            EXPECT_EQ(meta.path.generic_string().find("@PathCut"), std::string::npos);
+        tar.close();
+        std::filesystem::remove(tar_path);
+    }
+}
+
+// 超过 8 GiB 的大小无法用 11 位八进制表示, 头部改用 base-256 编码
+class TarHeaderCodec : public tar::TarFile
+{
+public:
+    using TarFile::file_meta2tar_header;
+    using TarFile::tar_header2file_meta;
+};
+TEST(TestTar, TestTarLargeSizeHeader) {
+    for (const uint64_t size : {uint64_t{077777777777}, (uint64_t{100} << 30) + 7})
+    {
+        FileEntityMeta meta{};
+        meta.path = "vm.img";
+        meta.type = FileEntityType::RegularFile;
+        meta.size = static_cast<size_t>(size);
+        const auto header = TarHeaderCodec::file_meta2tar_header(meta, tar::TarStandard::GNU);
+        EXPECT_EQ(static_cast<bool>(static_cast<unsigned char>(header.size[0]) & 0x80), size > 077777777777);
+        EXPECT_EQ(TarHeaderCodec::tar_header2file_meta(header, tar::TarStandard::GNU).size, size);
+    }
+}
+
 TEST(TestZip, TestZipCreate) {
     // 创建一个临时文件用于测试
     const std::string test_content = "Hello, this is a test file for zip compression!";
@@ -326,3 +505,695 @@ TEST_F(TestSystemDevice, TestCrossCompatibility) {
 
     GTEST_LOG_(INFO) << "All cross compatibility tests passed!" << std::endl;
 }
+
+TEST(TestDeflate, TestDeflateRoundTrip) {
+    std::string text;
+    for (int i = 0; i < 2000; i++)
+        text += "line " + std::to_string(i % 97) + ": the quick brown fox jumps over the lazy dog\n";
+    std::string noise(70000, '\0');
+    uint32_t seed = 1;
+    for (auto& c : noise)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = static_cast<char>(seed >> 24);
+    }
+    for (const auto& input : {std::string(), std::string("a"), text, noise + text})
+    {
+        const auto* data = reinterpret_cast<const std::byte*>(input.data());
+        for (const int level : {0, 1, 6, 9})
+        {
+            // 分块输入与一次输入得到的流都能还原
+            compress::deflate::Deflater deflater(level);
+            std::vector<std::byte> compressed;
+            for (size_t offset = 0; offset < input.size(); offset += 1000)
+                deflater.update(data + offset, std::min<size_t>(1000, input.size() - offset), compressed);
+            deflater.finish(compressed);
+            std::vector<std::byte> restored;
+            ASSERT_TRUE(compress::deflate::decompress(compressed.data(), compressed.size(), restored));
+            ASSERT_EQ(std::string(reinterpret_cast<const char*>(restored.data()), restored.size()), input);
+            if (level > 0 && input == text)
+                EXPECT_LT(compressed.size(), input.size() / 5);
+        }
+    }
+    // 截断的流报告错误
+    const auto compressed = compress::deflate::compress(reinterpret_cast<const std::byte*>(text.data()), text.size());
+    std::vector<std::byte> restored;
+    EXPECT_FALSE(compress::deflate::decompress(compressed.data(), compressed.size() / 2, restored));
+}
+
+TEST(TestDeflate, TestDeflateSyncFlush) {
+    std::string input;
+    for (int i = 0; i < 20000; i++)
+        input += "chunk " + std::to_string(i % 251) + " of a sync flushed stream\n";
+    const auto* data = reinterpret_cast<const std::byte*>(input.data());
+    // 每段用独立的 Deflater 压缩, 以前一段的末尾作为字典, 拼接后仍是一个完整的流
+    constexpr size_t chunk = 100000;
+    std::vector<std::byte> compressed;
+    for (size_t offset = 0; offset < input.size(); offset += chunk)
+    {
+        compress::deflate::Deflater deflater;
+        deflater.set_dictionary(data, offset);
+        const auto n = std::min(chunk, input.size() - offset);
+        deflater.update(data + offset, n, compressed);
+        if (offset + n < input.size())
+            deflater.flush(compressed);
+        else
+            deflater.finish(compressed);
+    }
+    std::vector<std::byte> restored;
+    ASSERT_TRUE(compress::deflate::decompress(compressed.data(), compressed.size(), restored));
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(restored.data()), restored.size()), input);
+    EXPECT_LT(compressed.size(), input.size() / 10);
+}
+
+TEST(TestTransform, TestPipeline) {
+    std::string input;
+    for (int i = 0; i < 3000; i++)
+        input += "pipeline stage " + std::to_string(i % 31) + "\n";
+    TestFile file("pipeline.txt", input);
+    // CRC32 -> Deflate -> 异或"加密" -> 内存
+    std::vector<std::byte> out;
+    transform::Pipeline pipeline;
+    const auto& checksum = pipeline.emplace<transform::Crc32Stage>();
+    pipeline.emplace<transform::DeflateStage>();
+    pipeline.emplace<transform::CipherStage>([](std::byte* data, const size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            data[i] ^= std::byte{0x5A};
+    });
+    pipeline.emplace<transform::VectorSink>(out);
+    ASSERT_TRUE(transform::pump(file, pipeline));
+    ASSERT_TRUE(pipeline.finish());
+    EXPECT_EQ(pipeline.bytes_in(), input.size());
+    EXPECT_EQ(checksum.value(), crc::crc32(input.data(), input.size()));
+
+    for (auto& byte : out)
+        byte ^= std::byte{0x5A};
+    std::vector<std::byte> restored;
+    ASSERT_TRUE(compress::deflate::decompress(out.data(), out.size(), restored));
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(restored.data()), restored.size()), input);
+}
+
+TEST(TestZip, TestZipDeflate) {
+    std::string content;
+    for (int i = 0; i < 5000; i++)
+        content += "backup-suite deflate entry " + std::to_string(i % 13) + "\n";
+    const std::string zip_path = "test_deflate.zip";
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output);
+        TestFile deflated("deflated.txt", content);
+        TestFile stored("stored.txt", content);
+        ASSERT_TRUE(zip.add_entity(deflated, zip::header::ZipCompressionMethod::Deflate));
+        ASSERT_TRUE(zip.add_entity(stored, zip::header::ZipCompressionMethod::Store));
+        zip.close();
+    }
+    {
+        zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+        const auto results = zip_reader.list_dir(".");
+        ASSERT_EQ(results.size(), 2);
+        for (const auto& entry : results)
+        {
+            const bool deflated = entry.file_name == "deflated.txt";
+            EXPECT_EQ(entry.record.compression_method, deflated ? zip::header::ZipCompressionMethod::Deflate : zip::header::ZipCompressionMethod::Store);
+            if (deflated)
+                EXPECT_LT(entry.record.compressed_size, content.size() / 10);
+            const auto stream = zip_reader.get_file_stream(entry.file_name);
+            ASSERT_NE(stream, nullptr);
+            const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+            EXPECT_EQ(read_content, content);
+        }
+    }
+    // libarchive 能够读取我们写出的 Deflate 条目
+    EXPECT_TRUE(libarchive_read_tar(zip_path, "deflated.txt", content));
+    std::filesystem::remove(zip_path);
+}
+
+// 分帧压缩的 tar: 仍是合法的 gzip 流, 按索引读取单个文件时只解压它所在的帧
+TEST(TestTar, TestTarFrameCompression) {
+    const std::string tar_path = "test_frames.tar.gz";
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 20; i++)
+        files.emplace_back("dir/file" + std::to_string(i) + ".txt", std::string(10000 + i * 997, static_cast<char>('a' + i)));
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::output);
+        ASSERT_TRUE(tar.set_frame_compression(16 * 1024));
+        for (const auto& [path, content] : files)
+        {
+            TestFile file(path, content);
+            ASSERT_TRUE(tar.add_entity(file));
+        }
+        tar.close();
+    }
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::input);
+        ASSERT_TRUE(tar.is_open());
+        EXPECT_TRUE(tar.frame_compressed());
+        EXPECT_LT(std::filesystem::file_size(tar_path), 32 * 1024);
+        for (const auto index : {19, 0, 7})
+        {
+            const auto stream = tar.get_file_stream(files[index].first);
+            ASSERT_NE(stream, nullptr);
+            const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+            EXPECT_EQ(read_content, files[index].second);
+        }
+    }
+    EXPECT_TRUE(libarchive_read_tar(tar_path, files[3].first, files[3].second));
+    std::filesystem::remove(tar_path);
+}
+
+// 同一个 TarFile 打开的多个流各自按位置读取, 可以交错或在不同线程中读取
+TEST(TestTar, TestTarConcurrentStreams) {
+    const std::string tar_path = "test_concurrent.tar";
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 8; i++)
+        files.emplace_back("file" + std::to_string(i) + ".txt", std::string(50000 + i * 4093, static_cast<char>('a' + i)));
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::output);
+        for (const auto& [path, content] : files)
+        {
+            TestFile file(path, content);
+            ASSERT_TRUE(tar.add_entity(file));
+        }
+        tar.close();
+    }
+    tar::TarFile tar(tar_path, tar::TarFile::input);
+    ASSERT_TRUE(tar.is_open());
+    tar.set_read_buffer_limit(16 * 1024);
+    std::vector<std::unique_ptr<FileEntityIstream>> streams;
+    for (const auto& [path, content] : files)
+    {
+        streams.push_back(tar.get_file_stream(path));
+        ASSERT_NE(streams.back(), nullptr);
+    }
+    std::vector<std::string> results(files.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < files.size(); i++)
+        threads.emplace_back([&, i] {
+            results[i].assign(std::istreambuf_iterator<char>(*streams[i]), std::istreambuf_iterator<char>());
+        });
+    for (auto& thread : threads)
+        thread.join();
+    for (size_t i = 0; i < files.size(); i++)
+        EXPECT_EQ(results[i], files[i].second);
+    streams.clear();
+    tar.close();
+    std::filesystem::remove(tar_path);
+}
+
+// 目录树: 只列出直接子节点, 没有目录条目的中间目录也能列出, '_' 和大小写按字面匹配
+TEST(TestTar, TestTarListChildren) {
+    const std::string tar_path = "test_children.tar";
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::output);
+        FileEntityMeta dir_meta{};
+        dir_meta.path = "dir/";
+        dir_meta.type = FileEntityType::Directory;
+        EmptyReadableFile dir(dir_meta);
+        ASSERT_TRUE(tar.add_entity(dir));
+        for (const auto* path : {"dir/a.txt", "dir/sub/b.txt", "dir/sub/deep/c.txt", "dir_x/d.txt", "DIR/e.txt", "top.txt", "implicit/f.txt"})
+        {
+            TestFile file(path, path);
+            ASSERT_TRUE(tar.add_entity(file));
+        }
+        tar.close();
+    }
+    tar::TarFile tar(tar_path, tar::TarFile::input);
+    ASSERT_TRUE(tar.is_open());
+    const auto names = [&tar](const std::filesystem::path& path) {
+        std::vector<std::string> result;
+        for (const auto& [meta, offset] : tar.list_children(path))
+            result.push_back(meta.path.generic_u8string());
+        return result;
+    };
+    EXPECT_EQ(names("."), (std::vector<std::string>{"dir/", "top.txt"}));
+    EXPECT_EQ(names("dir"), (std::vector<std::string>{"dir/a.txt"}));
+    EXPECT_EQ(names("dir/sub/"), (std::vector<std::string>{"dir/sub/b.txt"}));
+    EXPECT_EQ(names("implicit"), (std::vector<std::string>{"implicit/f.txt"}));
+    EXPECT_TRUE(names("missing").empty());
+    // 整棵子树不包含同前缀的兄弟目录
+    EXPECT_EQ(tar.list_dir("dir").size(), 4u);
+    tar.close();
+    std::filesystem::remove(tar_path);
+}
+
+// 超过 65535 个条目时写出 Zip64 EOCD 和定位记录, EOCD 中的记录数写成 0xFFFF
+TEST(TestZip, TestZipParallelCompression) {
+    std::string large;
+    for (int i = 0; i < 120000; i++)
+        large += "parallel deflate line " + std::to_string(i * 7919 % 100003) + "\n";
+    const std::string zip_path = "test_parallel.zip";
+    const std::vector<uint8_t> password{'p', 'a', 's', 's'};
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output);
+        zip.set_password(password);
+        zip.set_compression_threads(4);
+        for (int i = 0; i < 50; i++)
+        {
+            TestFile file("small/file" + std::to_string(i) + ".txt", std::string(i * 100, static_cast<char>('a' + i % 26)));
+            ASSERT_TRUE(zip.add_entity(file, zip::header::ZipCompressionMethod::Deflate));
+        }
+        // 大文件被切成多个分块并行压缩; 加密的条目第一个分块在工作线程里加密, 其余由写出线程按序加密
+        TestFile plain("large.txt", large);
+        TestFile encrypted("large_encrypted.txt", large);
+        ASSERT_TRUE(zip.add_entity(plain, zip::header::ZipCompressionMethod::Deflate));
+        ASSERT_TRUE(zip.add_entity(encrypted, zip::header::ZipCompressionMethod::Deflate, zip::header::ZipEncryptionMethod::ZipCrypto));
+        EXPECT_TRUE(zip.close());
+    }
+    {
+        zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+        zip_reader.set_password(password);
+        ASSERT_EQ(zip_reader.list_dir(".").size(), 52);
+        for (const auto& name : {"large.txt", "large_encrypted.txt"})
+        {
+            const auto stream = zip_reader.get_file_stream(name);
+            ASSERT_NE(stream, nullptr);
+            const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+            EXPECT_EQ(read_content, large);
+        }
+        const auto stream = zip_reader.get_file_stream("small/file27.txt");
+        ASSERT_NE(stream, nullptr);
+        const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(read_content, std::string(2700, 'b'));
+    }
+    EXPECT_TRUE(libarchive_read_tar(zip_path, "large.txt", large));
+    std::filesystem::remove(zip_path);
+}
+
+#ifdef __linux__
+// 并行写出失败(/dev/full 上每次写入都报 ENOSPC)时 close 报告失败, 不再写中央目录
+TEST(TestZip, TestZipParallelWriteFailure) {
+    zip::ZipFile zip("/dev/full", zip::ZipFile::ZipMode::output);
+    ASSERT_TRUE(zip.is_open());
+    zip.set_compression_threads(2);
+    TestFile file("large.txt", std::string(3 * 1024 * 1024, 'x'));
+    (void)zip.add_entity(file, zip::header::ZipCompressionMethod::Deflate);
+    EXPECT_FALSE(zip.close());
+}
+#endif
+
+// WinZip AES: 串行和并行写出的条目都能读回, 口令错误或数据被篡改时读不出完整内容
+TEST(TestZip, TestZipAesEncryption) {
+    std::string large;
+    for (int i = 0; i < 60000; i++)
+        large += "aes entry line " + std::to_string(i * 7919 % 100003) + "\n";
+    const std::string tiny = "short";
+    const std::string zip_path = "test_aes.zip";
+    const std::vector<uint8_t> password{'a', 'e', 's', 'k', 'e', 'y'};
+    for (const size_t threads : {1, 4})
+    {
+        {
+            zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output);
+            zip.set_password(password);
+            zip.set_compression_threads(threads);
+            TestFile deflated("large.txt", large);
+            TestFile stored("stored.txt", large);
+            TestFile small("tiny.txt", tiny);
+            ASSERT_TRUE(zip.add_entity(deflated, zip::header::ZipCompressionMethod::Deflate, zip::header::ZipEncryptionMethod::AES256));
+            ASSERT_TRUE(zip.add_entity(stored, zip::header::ZipCompressionMethod::Store, zip::header::ZipEncryptionMethod::AES128));
+            ASSERT_TRUE(zip.add_entity(small, zip::header::ZipCompressionMethod::Deflate, zip::header::ZipEncryptionMethod::AES192));
+            zip.close();
+        }
+        {
+            zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+            zip_reader.set_password(password);
+            for (const auto& entry : zip_reader.list_dir("."))
+            {
+                EXPECT_EQ(entry.record.compression_method, zip::header::ZipCompressionMethod::AES_Encryption);
+                // 20 字节以下的条目为 AE-2, 不写 CRC
+                EXPECT_EQ(entry.record.crc32 == 0, entry.file_name == "tiny.txt");
+            }
+            const std::vector<std::pair<std::string, std::string>> expected{{"large.txt", large}, {"stored.txt", large}, {"tiny.txt", tiny}};
+            for (const auto& [name, content] : expected)
+            {
+                const auto stream = zip_reader.get_file_stream(name);
+                ASSERT_NE(stream, nullptr);
+                const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+                EXPECT_EQ(read_content, content) << name << " with " << threads << " threads";
+            }
+            zip_reader.set_password({'w', 'r', 'o', 'n', 'g'});
+            const auto stream = zip_reader.get_file_stream("large.txt");
+            ASSERT_NE(stream, nullptr);
+            EXPECT_TRUE(zip_reader.is_invalid_password());
+        }
+    }
+    {
+        // 篡改存储条目的最后一个字节, 认证码核对失败
+        uint64_t offset = 0;
+        {
+            zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+            for (const auto& entry : zip_reader.list_dir("."))
+                if (entry.file_name == "stored.txt")
+                    offset = entry.local_header_offset + sizeof(zip::header::ZipLocalFileHeader) + entry.file_name.size() +
+                             entry.extra_field.size() + entry.compressed_size - encryption::WinZipAes::AUTH_CODE_SIZE - 1;
+        }
+        std::fstream file(zip_path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(static_cast<std::streamoff>(offset));
+        const auto byte = static_cast<char>(file.get() ^ 1);
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.put(byte);
+    }
+    {
+        zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+        zip_reader.set_password(password);
+        const auto stream = zip_reader.get_file_stream("stored.txt");
+        ASSERT_NE(stream, nullptr);
+        const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+        EXPECT_LT(read_content.size(), large.size());
+    }
+    std::filesystem::remove(zip_path);
+}
+
+TEST(TestZip, TestZip64EntryCount) {
+    const std::string zip_path = "test_zip64_count.zip";
+    constexpr int count = 70000;
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output);
+        for (int i = 0; i < count; i++)
+        {
+            TestFile file("dir" + std::to_string(i % 4) + "/file" + std::to_string(i) + ".txt", std::to_string(i));
+            ASSERT_TRUE(zip.add_entity(file));
+        }
+        zip.close();
+    }
+    {
+        std::ifstream ifs(zip_path, std::ios::binary);
+        ifs.seekg(-static_cast<std::streamoff>(sizeof(zip::header::ZipEndOfCentralDirectoryRecord) + sizeof(zip::header::Zip64EndOfCentralDirectoryLocator)), std::ios::end);
+        zip::header::Zip64EndOfCentralDirectoryLocator locator{};
+        zip::header::ZipEndOfCentralDirectoryRecord eocd{};
+        ifs.read(reinterpret_cast<char*>(&locator), sizeof(locator));
+        ifs.read(reinterpret_cast<char*>(&eocd), sizeof(eocd));
+        EXPECT_EQ(locator.signature, zip::header::ZipFileHeaderSignature::Zip64EndOfCentralDirectoryLocator);
+        EXPECT_EQ(eocd.total_central_directory_records, zip::header::ZIP64_MARK_16);
+    }
+    {
+        zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+        ASSERT_TRUE(zip_reader.is_open());
+        EXPECT_EQ(zip_reader.list_dir(".").size(), static_cast<size_t>(count));
+        const auto stream = zip_reader.get_file_stream("dir3/file69999.txt");
+        ASSERT_NE(stream, nullptr);
+        const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(read_content, "69999");
+    }
+    EXPECT_TRUE(libarchive_read_tar(zip_path, "dir3/file69999.txt", "69999"));
+    std::filesystem::remove(zip_path);
+}
+
+// 注释中出现 EOCD 签名时仍能找到真正的 EOCD; 中央目录一次读入后解析
+TEST(TestZip, TestZipCommentWithSignature) {
+    const std::string zip_path = "test_zip_comment.zip";
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output);
+        for (int i = 0; i < 3; i++)
+        {
+            TestFile file("dir/file" + std::to_string(i) + ".txt", "content " + std::to_string(i));
+            ASSERT_TRUE(zip.add_entity(file, zip::header::ZipCompressionMethod::Deflate));
+        }
+        zip.close();
+    }
+    const std::string comment = std::string("backup ") + "PK\x05\x06" + std::string(30, 'x');
+    {
+        // 改写 EOCD 的注释长度并在末尾追加注释
+        std::fstream file(zip_path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(-2, std::ios::end);
+        const auto length = static_cast<uint16_t>(comment.size());
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.seekp(0, std::ios::end);
+        file.write(comment.data(), static_cast<std::streamsize>(comment.size()));
+    }
+    {
+        zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+        ASSERT_TRUE(zip_reader.is_open());
+        EXPECT_EQ(zip_reader.comment(), comment);
+        EXPECT_EQ(zip_reader.list_dir("dir").size(), 3);
+        const auto stream = zip_reader.get_file_stream("dir/file2.txt");
+        ASSERT_NE(stream, nullptr);
+        const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(read_content, "content 2");
+    }
+    std::filesystem::remove(zip_path);
+}
+
+// 流式写出: 本地头中 CRC 和大小为 0, 数据后紧跟数据描述符; 串行和并行写出的压缩、加密条目都能读回
+TEST(TestZip, TestZipStream) {
+    std::string large;
+    for (int i = 0; i < 60000; i++)
+        large += "streamed line " + std::to_string(i * 7919 % 100003) + "\n";
+    const std::string zip_path = "test_stream.zip";
+    const std::vector<uint8_t> password{'s', 't', 'r', 'e', 'a', 'm'};
+    const std::vector<std::pair<std::string, std::string>> expected{
+        {"stored.txt", "stored"}, {"deflated.txt", large}, {"zipcrypto.txt", large}, {"aes.txt", large}};
+    for (const size_t threads : {1, 4})
+    {
+        {
+            zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::stream);
+            ASSERT_TRUE(zip.is_streaming());
+            zip.set_password(password);
+            zip.set_compression_threads(threads);
+            TestFile stored(expected[0].first, expected[0].second), deflated(expected[1].first, expected[1].second),
+                     zip_crypto(expected[2].first, expected[2].second), aes(expected[3].first, expected[3].second);
+            ASSERT_TRUE(zip.add_entity(stored));
+            ASSERT_TRUE(zip.add_entity(deflated, zip::header::ZipCompressionMethod::Deflate));
+            ASSERT_TRUE(zip.add_entity(zip_crypto, zip::header::ZipCompressionMethod::Deflate, zip::header::ZipEncryptionMethod::ZipCrypto));
+            ASSERT_TRUE(zip.add_entity(aes, zip::header::ZipCompressionMethod::Deflate, zip::header::ZipEncryptionMethod::AES256));
+            zip.close();
+        }
+        {
+            std::ifstream file(zip_path, std::ios::binary);
+            zip::header::ZipLocalFileHeader lfh;
+            file.read(reinterpret_cast<char*>(&lfh), sizeof(lfh));
+            EXPECT_TRUE(lfh.general_purpose & static_cast<uint16_t>(zip::header::ZipGeneralPurposeBitFlag::DataDescriptor));
+            EXPECT_EQ(lfh.crc32, 0u);
+            EXPECT_EQ(lfh.compressed_size, 0u);
+            file.seekg(static_cast<std::streamoff>(sizeof(lfh) + lfh.file_name_length + lfh.extra_field_length + expected[0].second.size()));
+            zip::header::ZipDataDescriptor descriptor{};
+            file.read(reinterpret_cast<char*>(&descriptor), sizeof(descriptor));
+            EXPECT_EQ(descriptor.signature, zip::header::ZipFileHeaderSignature::DataDescriptor);
+            EXPECT_NE(descriptor.crc32, 0u);
+            EXPECT_EQ(descriptor.compressed_size, expected[0].second.size());
+            EXPECT_EQ(descriptor.uncompressed_size, expected[0].second.size());
+        }
+        {
+            zip::ZipFile zip_reader(zip_path, zip::ZipFile::ZipMode::input);
+            ASSERT_TRUE(zip_reader.is_open());
+            zip_reader.set_password(password);
+            for (const auto& [name, content] : expected)
+            {
+                const auto stream = zip_reader.get_file_stream(name);
+                ASSERT_NE(stream, nullptr);
+                const std::string read_content((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+                EXPECT_EQ(read_content, content) << name << " with " << threads << " threads";
+            }
+        }
+        EXPECT_TRUE(libarchive_read_tar(zip_path, "deflated.txt", large));
+    }
+    std::filesystem::remove(zip_path);
+}
+
+// 更新模式: 已有条目的数据原样保留, 新条目从旧中央目录处写入, 同名条目以最后写入的为准
+TEST(TestZip, TestZipUpdate) {
+    const std::string zip_path = "test_update.zip";
+    const auto read_file = [&zip_path]()
+    {
+        std::ifstream file(zip_path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    TestFile a("a.txt", "first"), b_old("b.txt", "old");
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output);
+        ASSERT_TRUE(zip.add_entity(a, zip::header::ZipCompressionMethod::Deflate));
+        ASSERT_TRUE(zip.add_entity(b_old));
+        zip.close();
+    }
+    const auto original = read_file();
+    // 没有注释时 EOCD 是最后 22 字节, 偏移 16 处是中央目录的偏移
+    ASSERT_GE(original.size(), sizeof(zip::header::ZipEndOfCentralDirectoryRecord));
+    uint32_t central_directory_offset = 0;
+    memcpy(&central_directory_offset, original.data() + original.size() - sizeof(zip::header::ZipEndOfCentralDirectoryRecord) + 16, sizeof(uint32_t));
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::update);
+        ASSERT_TRUE(zip.is_writable());
+        EXPECT_TRUE(zip.has_unchanged_entry(a.get_meta()));
+        auto changed = a.get_meta();
+        changed.size += 1;
+        EXPECT_FALSE(zip.has_unchanged_entry(changed));
+        changed = a.get_meta();
+        changed.modification_time += std::chrono::hours(1);
+        EXPECT_FALSE(zip.has_unchanged_entry(changed));
+        TestFile c("c.txt", "appended"), b("b.txt", "new");
+        ASSERT_TRUE(zip.add_entity(c));
+        ASSERT_TRUE(zip.add_entity(b, zip::header::ZipCompressionMethod::Deflate));
+        zip.close();
+    }
+    const auto updated = read_file();
+    EXPECT_EQ(updated.compare(0, central_directory_offset, original, 0, central_directory_offset), 0);
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::input);
+        ASSERT_TRUE(zip.is_open());
+        EXPECT_EQ(zip.list_dir(".").size(), 3u);
+        for (const auto& [path, content] : {std::pair<std::string, std::string>{"a.txt", "first"}, {"b.txt", "new"}, {"c.txt", "appended"}})
+        {
+            const auto stream = zip.get_file_stream(path);
+            ASSERT_NE(stream, nullptr);
+            const std::string read_back((std::istreambuf_iterator<char>(*stream)), std::istreambuf_iterator<char>());
+            EXPECT_EQ(read_back, content) << path;
+        }
+    }
+    EXPECT_TRUE(libarchive_read_tar(zip_path, "b.txt", "new"));
+    std::filesystem::remove(zip_path);
+}
+
+// 两种索引后端对同一组记录的查询结果应当一致: 同一路径以最后写入的为准, 目录带结尾的 '/'
+TEST(TestArchiveIndex, TestMemoryMatchesSqlite)
+{
+    using Record = tar::TarIndexCodec::Record;
+    const auto record = [](const std::string& path, const FileEntityType type, const uint64_t offset)
+    {
+        FileEntityMeta meta;
+        meta.path = path;
+        meta.type = type;
+        meta.modification_time = std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now());
+        meta.access_time = meta.creation_time = meta.modification_time;
+        return Record{meta, offset};
+    };
+    const std::vector<Record> records = {
+        record("b/", FileEntityType::Directory, 0),
+        record("b/z.txt", FileEntityType::RegularFile, 512),
+        record("a.txt", FileEntityType::RegularFile, 1024),
+        record("b/c/", FileEntityType::Directory, 1536),
+        record("b/c/d.txt", FileEntityType::RegularFile, 2048),
+        record("b/z.txt", FileEntityType::RegularFile, 2560),
+        record("b.txt", FileEntityType::RegularFile, 3072),
+    };
+    const auto offsets = [](const std::vector<Record>& list)
+    {
+        std::vector<uint64_t> result;
+        for (const auto& [meta, offset] : list)
+            result.push_back(offset);
+        return result;
+    };
+    for (const auto backend : {db::IndexBackend::Sqlite, db::IndexBackend::Memory})
+    {
+        const auto index = db::make_archive_index<tar::TarIndexCodec>(backend);
+        index->begin_load();
+        for (const auto& [meta, offset] : records)
+            ASSERT_TRUE(index->insert(meta.path.string(), {meta, offset}));
+        ASSERT_TRUE(index->end_load());
+
+        const auto found = index->find("b/z.txt");
+        ASSERT_TRUE(found.has_value());
+        EXPECT_EQ(found->second, 2560u);
+        EXPECT_EQ(found->first.path, "b/z.txt");
+        EXPECT_EQ(found->first.modification_time, records[1].first.modification_time);
+        EXPECT_FALSE(index->find("b/c").has_value());
+        EXPECT_FALSE(index->find("missing").has_value());
+
+        EXPECT_EQ(offsets(index->list_subtree("b")), (std::vector<uint64_t>{0, 1536, 2048, 512, 2560}));
+        EXPECT_EQ(offsets(index->list_subtree("")).size(), records.size());
+        EXPECT_EQ(offsets(index->list_children("")), (std::vector<uint64_t>{1024, 0, 3072}));
+        EXPECT_EQ(offsets(index->list_children("b")), (std::vector<uint64_t>{1536, 2560}));
+        EXPECT_EQ(offsets(index->list_children("b/c/")), (std::vector<uint64_t>{2048}));
+        EXPECT_TRUE(index->list_children("missing").empty());
+
+        index->clear();
+        EXPECT_FALSE(index->find("a.txt").has_value());
+        EXPECT_TRUE(index->list_subtree("").empty());
+    }
+}
+
+TEST(TestArchiveIndex, TestArchivesWithMemoryIndex)
+{
+    const std::string tar_path = "test_memory_index.tar", zip_path = "test_memory_index.zip";
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::output, db::IndexBackend::Memory);
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output, db::IndexBackend::Memory);
+        // 同名的 dir/b.txt 写入两次, 以后写入的为准
+        for (const auto& [path, content] : {std::pair<std::string, std::string>{"dir/a.txt", "first"}, {"dir/b.txt", "old"}, {"c.txt", "root"}, {"dir/b.txt", "new"}})
+        {
+            TestFile tar_file(path, content), zip_file(path, content);
+            ASSERT_TRUE(tar.add_entity(tar_file));
+            ASSERT_TRUE(zip.add_entity(zip_file));
+        }
+        tar.close();
+        zip.close();
+    }
+    const auto read_all = [](std::istream& stream)
+    {
+        return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    };
+    {
+        tar::TarFile tar(tar_path, tar::TarFile::input, db::IndexBackend::Memory);
+        ASSERT_TRUE(tar.is_open());
+        EXPECT_EQ(tar.list_dir("dir").size(), 3u);
+        const auto children = tar.list_children("dir");
+        ASSERT_EQ(children.size(), 2u);
+        EXPECT_EQ(children[1].first.path, "dir/b.txt");
+        const auto stream = tar.get_file_stream("dir/b.txt");
+        ASSERT_NE(stream, nullptr);
+        std::string read_back(3, '\0');
+        stream->read(&read_back[0], static_cast<std::streamsize>(read_back.size()));
+        EXPECT_EQ(read_back, "new");
+        tar.close();
+    }
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::input, db::IndexBackend::Memory);
+        ASSERT_TRUE(zip.is_open());
+        EXPECT_EQ(zip.list_dir("dir").size(), 3u);
+        EXPECT_EQ(zip.list_children("dir").size(), 2u);
+        const auto stream = zip.get_file_stream("dir/b.txt");
+        ASSERT_NE(stream, nullptr);
+        EXPECT_EQ(read_all(*stream), "new");
+    }
+    std::filesystem::remove(tar_path);
+    std::filesystem::remove(zip_path);
+}
+
+// 打开、查找和列出目录的耗时对比, 条目数较多, 设置 BACKUPSUITE_INDEX_BENCH_ENTRIES(如 1000000) 后才运行
+TEST(TestArchiveIndex, BenchmarkBackends)
+{
+    const char* env = std::getenv("BACKUPSUITE_INDEX_BENCH_ENTRIES");
+    if (!env)
+        GTEST_SKIP() << "set BACKUPSUITE_INDEX_BENCH_ENTRIES to run";
+    const auto entries = std::stoull(env);
+    constexpr size_t per_directory = 1000;
+    const auto entry_path = [](const size_t i) { return "d" + std::to_string(i / per_directory) + "/f" + std::to_string(i) + ".txt"; };
+    const std::string zip_path = "test_index_bench.zip";
+    {
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::output, db::IndexBackend::Memory);
+        for (size_t i = 0; i < entries; ++i)
+        {
+            TestFile file(entry_path(i), std::to_string(i));
+            ASSERT_TRUE(zip.add_entity(file));
+        }
+        zip.close();
+    }
+    const auto elapsed_ms = [](const std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+    constexpr size_t lookups = 10000;
+    for (const auto backend : {db::IndexBackend::Sqlite, db::IndexBackend::Memory})
+    {
+        auto start = std::chrono::steady_clock::now();
+        zip::ZipFile zip(zip_path, zip::ZipFile::ZipMode::input, backend);
+        ASSERT_TRUE(zip.is_open());
+        const auto open_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lookups; ++i)
+            ASSERT_NE(zip.get_file_stream(entry_path(i * 7919 % entries)), nullptr);
+        const auto lookup_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        EXPECT_EQ(zip.list_children("d0").size(), std::min<size_t>(entries, per_directory));
+        const auto children_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        EXPECT_EQ(zip.list_dir("").size(), entries);
+        const auto list_ms = elapsed_ms(start);
+
+        GTEST_LOG_(INFO) << (backend == db::IndexBackend::Memory ? "memory" : "sqlite") << ": open " << open_ms << " ms, "
+                         << lookups << " lookups " << lookup_ms << " ms, list_children " << children_ms << " ms, list_dir "
+                         << list_ms << " ms\n";
+    }
+    std::filesystem::remove(zip_path);
+}
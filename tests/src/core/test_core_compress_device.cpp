@@ -3,16 +3,21 @@
 //
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <fstream>
+#include <map>
 #include <filesystem>
 #include <string>
 #include <vector>
 
 #include "core/core_utils.h"
 #include "backup/backup_controller.h"
+#include "backup/backup_verifier.h"
+#include "backup/small_file_batcher.h"
 #include "filesystem/compresses_device.h"
 #include "filesystem/entities.h"
 #include "filesystem/system_device.h"
+#include "utils/crc.h"
 #include "utils/tmpfile.h"
 
 namespace fs = std::filesystem;
@@ -348,4 +353,451 @@ TEST_F(TestSystemDevice, TestBackupControllerZipToPhysical)
         EXPECT_TRUE(verify_restore_device.exists(test_folder));
         EXPECT_TRUE(verify_restore_device.exists(test_folder / "test_file.txt"));
     }
-}
\ No newline at end of file
+}
+TEST_F(TestSystemDevice, TestMultiSourceBackupToTar)
+{
+    const auto tmp_tar_file = TmpFile::create();
+    GTEST_LOG_(INFO) << "TestMultiSourceBackupToTar tmp tar path: " << tmp_tar_file->path() << "\n";
+    // 同一个物理目录作为两个源, 分别写入不同前缀下
+    {
+        SystemDevice second_source(root);
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        const BackupController controller{};
+        EXPECT_TRUE(controller.run_backup({{device, "first"}, {second_source, "nested/second"}}, tar_device));
+        tar_device.close();
+    }
+    {
+        TarDevice read_tar_device(tmp_tar_file->path(), TarDevice::Mode::ReadOnly);
+        EXPECT_TRUE(read_tar_device.is_open());
+        EXPECT_TRUE(read_tar_device.exists("first" / test_folder / "test_file.txt"));
+        EXPECT_TRUE(read_tar_device.exists("nested/second" / test_folder / "test_file.txt"));
+        EXPECT_TRUE(read_tar_device.exists("nested"));
+
+        const auto file = read_tar_device.get_file("nested/second" / test_folder / "test_file.txt");
+        ASSERT_NE(file, nullptr);
+        const auto content = file->read();
+        ASSERT_NE(content, nullptr);
+        EXPECT_EQ(std::string(reinterpret_cast<char*>(content->data()), content->size()), test_file_content);
+    }
+}
+TEST_F(TestSystemDevice, TestMultiSourceChunkedReads)
+{
+    BackupConfig config;
+    config.prefetch_file_threshold = 0;
+    config.chunk_bytes = 4;
+    const BackupController controller(config);
+    // 每个文件被切成多个 4 字节的分块, 由读取线程共用同一个输入流读出
+    const auto tmp_tar_file = TmpFile::create();
+    {
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        EXPECT_TRUE(controller.run_backup({{device, ""}}, tar_device));
+        tar_device.close();
+    }
+    {
+        TarDevice read_tar_device(tmp_tar_file->path(), TarDevice::Mode::ReadOnly);
+        const auto file = read_tar_device.get_file(test_folder / "test_file.txt");
+        ASSERT_NE(file, nullptr);
+        const auto content = file->read();
+        ASSERT_NE(content, nullptr);
+        EXPECT_EQ(std::string(reinterpret_cast<char*>(content->data()), content->size()), test_file_content);
+    }
+
+    // 写出阶段抛出异常时, 遍历与读取线程被回收, 异常交给调用方
+    class FailingDevice final : public Device
+    {
+    public:
+        std::unique_ptr<Folder> get_folder(const fs::path&) override { return nullptr; }
+        std::unique_ptr<ReadableFile> get_file(const fs::path&) override { return nullptr; }
+        std::unique_ptr<FileEntityMeta> get_meta(const fs::path&) override { return nullptr; }
+        bool exists(const fs::path&) override { return false; }
+        bool write_file(ReadableFile&) override { throw std::runtime_error("write failed"); }
+        bool write_file_force(ReadableFile& file) override { return write_file(file); }
+        bool write_folder(Folder&) override { return true; }
+    } failing;
+    EXPECT_THROW((void)controller.run_backup({{device, ""}}, failing), std::runtime_error);
+}
+// 分块读取时源文件打不开, 条目应当失败并由 run_backup 报告, 而不是写入一段全 0 的内容
+TEST(CoreBackupController, UnreadableChunkedFileFailsBackup)
+{
+    class UnreadableDevice final : public PhysicalDevice
+    {
+    public:
+        std::unique_ptr<Folder> get_folder(const fs::path&) override
+        {
+            FileEntityMeta root_meta;
+            root_meta.type = FileEntityType::Directory;
+            FileEntityMeta big;
+            big.path = "big.bin";
+            big.type = FileEntityType::RegularFile;
+            big.size = 4 * 1024 * 1024;
+            return std::make_unique<Folder>(root_meta, std::vector<FileEntity>{FileEntity(big)});
+        }
+        std::unique_ptr<FileEntityMeta> get_meta(const fs::path&) override { return nullptr; }
+        bool exists(const fs::path&) override { return false; }
+        bool write_file(ReadableFile&) override { return false; }
+        bool write_file_force(ReadableFile&) override { return false; }
+        bool write_folder(Folder&) override { return false; }
+        [[nodiscard]] std::unique_ptr<std::ifstream> get_file_stream(const fs::path&) const override { return nullptr; }
+    } unreadable;
+
+    BackupConfig config;
+    config.chunk_bytes = 1024 * 1024;
+    const BackupController controller(config);
+    const auto tmp_tar_file = TmpFile::create();
+    {
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        EXPECT_FALSE(controller.run_backup({{unreadable, ""}}, tar_device));
+        tar_device.close();
+    }
+    const auto tmp_zip_file = TmpFile::create();
+    {
+        ZipDevice zip_device(tmp_zip_file->path(), ZipDevice::Mode::WriteOnly);
+        EXPECT_FALSE(controller.run_backup({{unreadable, ""}}, zip_device));
+        zip_device.close();
+    }
+}
+TEST_F(TestSystemDevice, TestVerifyTarBackup)
+{
+    const auto tmp_tar_file = TmpFile::create();
+    GTEST_LOG_(INFO) << "TestVerifyTarBackup tmp tar path: " << tmp_tar_file->path() << "\n";
+    {
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        BackupController{}.run_backup(device, tar_device);
+        tar_device.close();
+    }
+    TarDevice read_tar_device(tmp_tar_file->path(), TarDevice::Mode::ReadOnly);
+    ASSERT_TRUE(read_tar_device.is_open());
+    const BackupVerifier verifier(4);
+    {
+        const auto report = verifier.verify(device, read_tar_device);
+        EXPECT_TRUE(report.ok());
+        EXPECT_GT(report.files_checked, 0u);
+    }
+    // 内容被改动的源文件应报告不一致
+    const auto changed_root = root.parent_path() / "backup_suite_tests_verify";
+    fs::create_directories(changed_root / test_folder);
+    std::ofstream(changed_root / test_folder / "test_file.txt", std::ios::binary) << "Hello, Verify!" << NEWLINE;
+    {
+        SystemDevice changed_source(changed_root);
+        const auto report = verifier.verify(changed_source, read_tar_device);
+        EXPECT_FALSE(report.ok());
+        const auto it = std::find_if(report.issues.begin(), report.issues.end(), [](const VerifyIssue& issue)
+        {
+            return issue.path == test_folder / "test_file.txt";
+        });
+        ASSERT_NE(it, report.issues.end());
+        EXPECT_NE(it->reason.find("CRC32 mismatch"), std::string::npos);
+    }
+    fs::remove_all(changed_root);
+}
+TEST_F(TestSystemDevice, TestVerifyMultiSourceBackup)
+{
+    const auto tmp_tar_file = TmpFile::create();
+    // 根源(空前缀)与另一个源写入同一个归档
+    SystemDevice second_source(root);
+    {
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        EXPECT_TRUE(BackupController{}.run_backup({{device, ""}, {second_source, "extra"}}, tar_device));
+        tar_device.close();
+    }
+    TarDevice read_tar_device(tmp_tar_file->path(), TarDevice::Mode::ReadOnly);
+    ASSERT_TRUE(read_tar_device.is_open());
+    const BackupVerifier verifier(2);
+    const std::vector<fs::path> prefixes{"", "extra"};
+    const auto root_report = verifier.verify(device, read_tar_device, "", prefixes);
+    EXPECT_TRUE(root_report.ok());
+    const auto extra_report = verifier.verify(second_source, read_tar_device, "extra", prefixes);
+    EXPECT_TRUE(extra_report.ok());
+    EXPECT_GT(extra_report.files_checked, 0u);
+    EXPECT_EQ(root_report.files_checked, extra_report.files_checked);
+    // 不排除其他源时, 根源会把 extra 下的成员当成自己的
+    EXPECT_FALSE(verifier.verify(device, read_tar_device).ok());
+}
+TEST(CoreCrc32, BlockKernelMatchesBytewise)
+{
+    EXPECT_EQ(crc::crc32("123456789", 9), 0xCBF43926u);
+    std::vector<std::byte> data(4099);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<std::byte>(i * 131 + 7);
+    // 不同长度与起始对齐下, 分块实现与逐字节实现一致
+    for (const size_t offset : {0, 1, 3, 7})
+    {
+        for (const size_t length : {0, 1, 7, 8, 9, 64, 4091})
+        {
+            uint32_t expected = 0xFFFFFFFF;
+            for (size_t i = 0; i < length; ++i)
+                expected = crc::crc32_update(expected, static_cast<uint8_t>(data[offset + i]));
+            crc::CRC32 crc;
+            crc.update(data.data() + offset, length);
+            EXPECT_EQ(crc.finalize(), expected ^ 0xFFFFFFFF);
+        }
+    }
+}
+TEST(CoreCrc32, CombineMatchesWhole)
+{
+    std::vector<char> data(100003);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<char>(i * 131 + 7);
+    const auto whole = crc::crc32(data.data(), data.size());
+    // 分成两段各自计算后合并, 与整段计算一致
+    for (const size_t cut : {size_t{0}, size_t{1}, size_t{4096}, size_t{99999}, data.size()})
+    {
+        const auto first = crc::crc32(data.data(), cut);
+        const auto second = crc::crc32(data.data() + cut, data.size() - cut);
+        EXPECT_EQ(crc::crc32_combine(first, second, data.size() - cut), whole);
+    }
+}
+namespace
+{
+    class StringReadableFile final : public ReadableFile
+    {
+        std::string data_; size_t cursor_ = 0;
+    public:
+        StringReadableFile(const fs::path& p, std::string s) : data_(std::move(s))
+        {
+            meta.path = p; meta.type = FileEntityType::RegularFile; meta.size = data_.size();
+        }
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read() override { return read(data_.size()); }
+        [[nodiscard]] std::unique_ptr<std::vector<std::byte>> read(const size_t n) override
+        {
+            if (cursor_ >= data_.size() || n == 0) return nullptr;
+            const auto take = (std::min)(n, data_.size() - cursor_);
+            const auto begin = reinterpret_cast<const std::byte*>(data_.data()) + cursor_;
+            cursor_ += take;
+            return std::make_unique<std::vector<std::byte>>(begin, begin + take);
+        }
+    };
+}
+
+// 小文件聚合: 一批文件经 SmallFileBatcher -> TarDevice::write_files 整批写入
+TEST(CoreSmallFileBatcher, TarBatchRoundtrip)
+{
+    const auto tmp_tar_file = TmpFile::create();
+    constexpr int file_count = 300;
+    {
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        // 小批次以覆盖多次 flush
+        SmallFileBatcher batcher(tar_device, 1024, 8 * 1024, 64);
+        for (int i = 0; i < file_count; ++i)
+        {
+            StringReadableFile file("small/file_" + std::to_string(i) + ".txt", std::string(i % 700, static_cast<char>('a' + i % 26)));
+            ASSERT_TRUE(batcher.accepts(file.get_meta()));
+            ASSERT_TRUE(batcher.add(file));
+        }
+        EXPECT_TRUE(batcher.flush());
+        EXPECT_EQ(batcher.pending(), 0u);
+        tar_device.close();
+    }
+    TarDevice read_tar_device(tmp_tar_file->path(), TarDevice::Mode::ReadOnly);
+    ASSERT_TRUE(read_tar_device.is_open());
+    for (int i : {0, 1, 63, 64, 150, file_count - 1})
+    {
+        auto file = read_tar_device.get_file("small/file_" + std::to_string(i) + ".txt");
+        ASSERT_NE(file, nullptr) << i;
+        EXPECT_EQ(file->get_meta().size, static_cast<size_t>(i % 700));
+        if (i % 700 == 0) continue;
+        auto content = file->read();
+        ASSERT_NE(content, nullptr);
+        EXPECT_EQ(std::string(reinterpret_cast<char*>(content->data()), content->size()),
+                  std::string(i % 700, static_cast<char>('a' + i % 26)));
+    }
+}
+
+// 读取顺序调度: 按物理位置打开文件, 写入归档的顺序保持不变
+TEST(CoreSmallFileBatcher, ScheduledReadsKeepArchiveOrder)
+{
+    // 物理位置与逻辑顺序相反的内存设备, 记录打开文件的顺序
+    class ReversedDevice final : public Device
+    {
+    public:
+        std::vector<std::string> names;
+        std::vector<fs::path> opened;
+        std::unique_ptr<Folder> get_folder(const fs::path&) override { return nullptr; }
+        std::unique_ptr<ReadableFile> get_file(const fs::path& path) override
+        {
+            opened.push_back(path);
+            return std::make_unique<StringReadableFile>(path, path.filename().string());
+        }
+        std::unique_ptr<FileEntityMeta> get_meta(const fs::path&) override { return nullptr; }
+        bool exists(const fs::path&) override { return false; }
+        bool write_file(ReadableFile&) override { return false; }
+        bool write_file_force(ReadableFile&) override { return false; }
+        bool write_folder(Folder&) override { return false; }
+        read_order::Location read_location(const fs::path& path) override
+        {
+            const auto index = std::find(names.begin(), names.end(), path.filename().string()) - names.begin();
+            return {static_cast<uint64_t>(names.size() - index), 0};
+        }
+    };
+
+    ReversedDevice from;
+    std::vector<FileEntityMeta> files;
+    for (int i = 0; i < 5; ++i)
+    {
+        from.names.push_back("file_" + std::to_string(i));
+        FileEntityMeta meta;
+        meta.path = fs::path("small") / from.names.back();
+        meta.type = FileEntityType::RegularFile;
+        meta.size = from.names.back().size();
+        files.push_back(meta);
+    }
+    const auto tmp_tar_file = TmpFile::create();
+    {
+        TarDevice tar_device(tmp_tar_file->path(), TarDevice::Mode::WriteOnly);
+        SmallFileBatcher batcher(tar_device, 1024, 8 * 1024, 64);
+        ASSERT_TRUE(batcher.add_files(from, files));
+        EXPECT_TRUE(batcher.flush());
+        tar_device.close();
+    }
+    ASSERT_EQ(from.opened.size(), files.size());
+    EXPECT_EQ(from.opened.front(), files.back().path);
+    EXPECT_EQ(from.opened.back(), files.front().path);
+
+    // tar 成员依次排列, 按偏移读出的成员名即归档顺序
+    std::ifstream tar(tmp_tar_file->path(), std::ios::binary);
+    for (const auto& meta : files)
+    {
+        char header[512];
+        ASSERT_TRUE(tar.read(header, sizeof(header)));
+        EXPECT_EQ(std::string(header), meta.path.generic_string());
+        tar.seekg(static_cast<std::streamoff>((meta.size + 511) / 512 * 512), std::ios::cur);
+    }
+
+    // 只有部分文件位置已知时不能排序
+    const auto order = read_order::schedule({{3, 1}, {0, 0}, {1, 2}});
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1, 2}));
+    EXPECT_EQ(read_order::schedule({{3, 2}, {0, 1}}), (std::vector<size_t>{1, 0}));
+}
+
+// 小文件聚合不改变条目顺序: 暂存的小文件先于其后的大文件与目录写出
+TEST(CoreSmallFileBatcher, BackupKeepsEntryOrder)
+{
+    // 内存中的目录树, 目录内容为 "" -> {s1, big, s2, a}, "a" -> {a/s3}
+    class TreeDevice final : public Device
+    {
+    public:
+        std::map<fs::path, std::vector<std::pair<fs::path, size_t>>> folders{
+            {"", {{"s1", 10}, {"big", 100 * 1024}, {"s2", 20}, {"a", 0}}},
+            {"a", {{fs::path("a") / "s3", 30}}},
+        };
+        static FileEntityMeta make_meta(const fs::path& path, const size_t size, const FileEntityType type)
+        {
+            FileEntityMeta meta;
+            meta.path = path;
+            meta.size = size;
+            meta.type = type;
+            return meta;
+        }
+        std::unique_ptr<Folder> get_folder(const fs::path& path) override
+        {
+            std::vector<FileEntity> children;
+            for (const auto& [child, size] : folders.at(path))
+                children.emplace_back(make_meta(child, size, folders.count(child) ? FileEntityType::Directory : FileEntityType::RegularFile));
+            return std::make_unique<Folder>(make_meta(path, 0, FileEntityType::Directory), children);
+        }
+        std::unique_ptr<ReadableFile> get_file(const fs::path& path) override
+        {
+            for (const auto& [folder, children] : folders)
+                for (const auto& [child, size] : children)
+                    if (child == path)
+                        return std::make_unique<StringReadableFile>(path, std::string(size, 'x'));
+            return nullptr;
+        }
+        std::unique_ptr<FileEntityMeta> get_meta(const fs::path&) override { return nullptr; }
+        bool exists(const fs::path&) override { return false; }
+        bool write_file(ReadableFile&) override { return false; }
+        bool write_file_force(ReadableFile&) override { return false; }
+        bool write_folder(Folder&) override { return false; }
+    };
+    // 记录写入顺序的目标设备
+    class RecordingDevice final : public Device
+    {
+    public:
+        std::vector<fs::path> written;
+        std::unique_ptr<Folder> get_folder(const fs::path&) override { return nullptr; }
+        std::unique_ptr<ReadableFile> get_file(const fs::path&) override { return nullptr; }
+        std::unique_ptr<FileEntityMeta> get_meta(const fs::path&) override { return nullptr; }
+        bool exists(const fs::path&) override { return false; }
+        bool write_file(ReadableFile& file) override { written.push_back(file.get_meta().path); return true; }
+        bool write_file_force(ReadableFile& file) override { return write_file(file); }
+        bool write_folder(Folder& folder) override { written.push_back(folder.get_meta().path); return true; }
+    };
+
+    TreeDevice from;
+    RecordingDevice to;
+    const BackupController controller{};
+    controller.run_backup(from, to);
+    EXPECT_EQ(to.written, (std::vector<fs::path>{"", "s1", "big", "s2", "a", fs::path("a") / "s3"}));
+}
+
+// zip 更新: 未变化的小文件在读入批次之前就被跳过, 只有变化的文件被打开
+TEST(CoreSmallFileBatcher, ZipUpdateSkipsUnchangedBeforeReading)
+{
+    class FlatDevice final : public Device
+    {
+    public:
+        std::vector<std::pair<std::string, std::string>> files{{"a.txt", "alpha"}, {"b.txt", "bravo"}};
+        size_t opened = 0;
+        static FileEntityMeta make_meta(const fs::path& path, const size_t size, const FileEntityType type)
+        {
+            FileEntityMeta meta;
+            meta.path = path;
+            meta.size = size;
+            meta.type = type;
+            meta.modification_time = std::chrono::system_clock::from_time_t(1700000000);
+            return meta;
+        }
+        std::unique_ptr<Folder> get_folder(const fs::path&) override
+        {
+            std::vector<FileEntity> children;
+            for (const auto& [name, content] : files)
+                children.emplace_back(make_meta(name, content.size(), FileEntityType::RegularFile));
+            return std::make_unique<Folder>(make_meta("", 0, FileEntityType::Directory), children);
+        }
+        std::unique_ptr<ReadableFile> get_file(const fs::path& path) override
+        {
+            for (const auto& [name, content] : files)
+            {
+                if (path != name)
+                    continue;
+                ++opened;
+                auto file = std::make_unique<StringReadableFile>(path, content);
+                file->get_meta() = make_meta(path, content.size(), FileEntityType::RegularFile);
+                return file;
+            }
+            return nullptr;
+        }
+        std::unique_ptr<FileEntityMeta> get_meta(const fs::path&) override { return nullptr; }
+        bool exists(const fs::path&) override { return false; }
+        bool write_file(ReadableFile&) override { return false; }
+        bool write_file_force(ReadableFile&) override { return false; }
+        bool write_folder(Folder&) override { return false; }
+    };
+
+    FlatDevice from;
+    const auto tmp_zip_file = TmpFile::create();
+    {
+        ZipDevice zip_device(tmp_zip_file->path(), ZipDevice::Mode::WriteOnly);
+        BackupController{}.run_backup(from, zip_device);
+        EXPECT_TRUE(zip_device.close());
+    }
+    EXPECT_EQ(from.opened, 2u);
+    from.opened = 0;
+    from.files[1].second = "bravo, changed";
+    {
+        ZipDevice zip_device(tmp_zip_file->path(), ZipDevice::Mode::Update);
+        ASSERT_TRUE(zip_device.is_open());
+        BackupController{}.run_backup(from, zip_device);
+        EXPECT_TRUE(zip_device.close());
+    }
+    EXPECT_EQ(from.opened, 1u);
+    ZipDevice read_zip_device(tmp_zip_file->path());
+    for (const auto& [name, content] : from.files)
+    {
+        const auto file = read_zip_device.get_file(name);
+        ASSERT_NE(file, nullptr) << name;
+        const auto data = file->read();
+        ASSERT_NE(data, nullptr) << name;
+        EXPECT_EQ(std::string(reinterpret_cast<char*>(data->data()), data->size()), content);
+    }
+}
@@ -3,7 +3,10 @@
 //
 #include <gtest/gtest.h>
 
+#include "encryption/aes.h"
 #include "encryption/rc.h"
+#include "encryption/sha1.h"
+#include "encryption/winzip_aes.h"
 #include "encryption/zip_crypto.h"
 
 TEST(encrypt, ZipCrypto)
@@ -57,4 +60,78 @@ TEST(encrypt, RC4)
         decrypted_text.push_back(static_cast<char>(plain_byte));
     }
     EXPECT_EQ(plaintext, decrypted_text);
-}
\ No newline at end of file
+}
+TEST(encrypt, AesKnownAnswer)
+{
+    using namespace encryption;
+    // FIPS-197 附录 C 的测试向量, 查表实现和 AES-NI(若可用)结果相同
+    uint8_t key[32];
+    for (int i = 0; i < 32; ++i)
+        key[i] = static_cast<uint8_t>(i);
+    const uint8_t plaintext[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    const std::vector<std::pair<size_t, std::vector<uint8_t>>> expected = {
+        {16, {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a}},
+        {24, {0xdd, 0xa9, 0x7c, 0xa4, 0x86, 0x4c, 0xdf, 0xe0, 0x6e, 0xaf, 0x70, 0xa0, 0xec, 0x0d, 0x71, 0x91}},
+        {32, {0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89}},
+    };
+    for (const bool hardware : {true, false})
+    {
+        Aes::set_hardware_enabled(hardware);
+        for (const auto& [key_size, ciphertext] : expected)
+        {
+            const Aes aes(key, key_size);
+            ASSERT_TRUE(aes.is_valid());
+            uint8_t out[16];
+            aes.encrypt_block(plaintext, out);
+            EXPECT_EQ(std::vector<uint8_t>(out, out + 16), ciphertext) << "key size " << key_size << ", hardware " << hardware;
+        }
+    }
+    Aes::set_hardware_enabled(true);
+    EXPECT_FALSE(Aes(key, 20).is_valid());
+}
+TEST(encrypt, Pbkdf2HmacSha1)
+{
+    using namespace encryption;
+    // RFC 6070 的测试向量
+    const std::vector<uint8_t> password{'p', 'a', 's', 's', 'w', 'o', 'r', 'd'};
+    const uint8_t salt[] = {'s', 'a', 'l', 't'};
+    const std::vector<uint8_t> one = {0x0c, 0x60, 0xc8, 0x0f, 0x96, 0x1f, 0x0e, 0x71, 0xf3, 0xa9,
+                                      0xb5, 0x24, 0xaf, 0x60, 0x12, 0x06, 0x2f, 0xe0, 0x37, 0xa6};
+    const std::vector<uint8_t> many = {0x4b, 0x00, 0x79, 0x01, 0xb7, 0x65, 0x48, 0x9a, 0xbe, 0xad,
+                                       0x49, 0xd9, 0x26, 0xf7, 0x21, 0xd0, 0x65, 0xa4, 0x29, 0xc1};
+    EXPECT_EQ(pbkdf2_hmac_sha1(password, salt, sizeof(salt), 1, 20), one);
+    EXPECT_EQ(pbkdf2_hmac_sha1(password, salt, sizeof(salt), 4096, 20), many);
+}
+TEST(encrypt, WinZipAes)
+{
+    using namespace encryption;
+    const std::vector<uint8_t> password{'s', 'e', 'c', 'r', 'e', 't'};
+    std::vector<uint8_t> data(5000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<uint8_t>(i * 31);
+    for (int strength = 1; strength <= 3; ++strength)
+    {
+        const auto salt = WinZipAes::random_salt(strength);
+        ASSERT_EQ(salt.size(), WinZipAes::salt_size(strength));
+        WinZipAes encryptor(strength, password, salt.data());
+        auto ciphertext = data;
+        // 分段加密与一次加密的结果相同
+        encryptor.encrypt(ciphertext.data(), 7);
+        encryptor.encrypt(ciphertext.data() + 7, ciphertext.size() - 7);
+        const auto auth_code = encryptor.auth_code();
+        EXPECT_NE(ciphertext, data);
+
+        WinZipAes decryptor(strength, password, salt.data());
+        EXPECT_EQ(decryptor.verifier(), encryptor.verifier());
+        auto plaintext = ciphertext;
+        decryptor.decrypt(plaintext.data(), plaintext.size());
+        EXPECT_EQ(plaintext, data);
+        EXPECT_EQ(decryptor.auth_code(), auth_code);
+
+        // 篡改密文后认证码不同
+        WinZipAes tampered(strength, password, salt.data());
+        ciphertext[100] ^= 1;
+        tampered.decrypt(ciphertext.data(), ciphertext.size());
+        EXPECT_NE(tampered.auth_code(), auth_code);
+    }
+}
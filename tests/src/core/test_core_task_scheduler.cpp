@@ -0,0 +1,102 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "backup/task_scheduler.h"
+
+namespace
+{
+    FileEntityMeta file_meta(const std::string& path, const size_t size)
+    {
+        FileEntityMeta meta;
+        meta.path = path;
+        meta.type = FileEntityType::RegularFile;
+        meta.size = size;
+        return meta;
+    }
+}
+
+TEST(task_scheduler, LanesAndLargestFirst)
+{
+    bool drained = false;
+    TaskScheduler scheduler(100, 1024, 4, [&] { drained = true; });
+    scheduler.add(0, file_meta("small_a", 10), false);
+    scheduler.add(0, file_meta("medium", 500), false);
+    scheduler.add(1, file_meta("small_b", 20), false);
+    scheduler.add(1, file_meta("largest", 5000), false);
+    scheduler.add(0, file_meta("large", 800), false);
+
+    // 遍历结束前大文件道只能帮忙处理小文件
+    auto task = scheduler.next(TaskScheduler::Lane::Large);
+    ASSERT_TRUE(task);
+    EXPECT_EQ(task->meta.path, "small_a");
+    scheduler.complete();
+    scheduler.finish();
+
+    task = scheduler.next(TaskScheduler::Lane::Large);
+    ASSERT_TRUE(task);
+    EXPECT_EQ(task->meta.path, "largest");
+    EXPECT_EQ(task->source, 1u);
+    scheduler.complete();
+    // 小文件道优先处理小文件
+    task = scheduler.next(TaskScheduler::Lane::Small);
+    ASSERT_TRUE(task);
+    EXPECT_EQ(task->meta.path, "small_b");
+    scheduler.complete();
+    task = scheduler.next(TaskScheduler::Lane::Small);
+    ASSERT_TRUE(task);
+    EXPECT_EQ(task->meta.path, "large");
+    scheduler.complete();
+    EXPECT_FALSE(drained);
+    task = scheduler.next(TaskScheduler::Lane::Large);
+    ASSERT_TRUE(task);
+    EXPECT_EQ(task->meta.path, "medium");
+    scheduler.complete();
+    EXPECT_TRUE(drained);
+
+    scheduler.shutdown();
+    EXPECT_FALSE(scheduler.next(TaskScheduler::Lane::Small));
+}
+
+TEST(task_scheduler, ChunksAreTakenInOrder)
+{
+    TaskScheduler scheduler(0, 4, 2, nullptr);
+    scheduler.add(0, file_meta("huge", 4 * 16 + 3), true);
+    scheduler.finish();
+    const auto file_task = scheduler.next(TaskScheduler::Lane::Large);
+    ASSERT_TRUE(file_task);
+    ASSERT_TRUE(file_task->chunked);
+    const auto stream = scheduler.open_stream(*file_task);
+    ASSERT_EQ(stream->chunks, 17u);
+    EXPECT_EQ(stream->length(16), 3u);
+    scheduler.complete();
+
+    const auto make_chunk = [&](const size_t chunk) {
+        return std::vector<std::byte>(stream->length(chunk), static_cast<std::byte>(chunk));
+    };
+    // 两个读取线程并行读分块, 写出线程按序取走
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 2; ++i)
+        readers.emplace_back([&] {
+            while (auto task = scheduler.next(TaskScheduler::Lane::Large))
+                scheduler.put(task->stream, task->chunk, make_chunk(task->chunk));
+        });
+    scheduler.activate(stream);
+    size_t expected = 0;
+    while (auto data = scheduler.take(stream, make_chunk))
+    {
+        ASSERT_EQ(data->size(), stream->length(expected));
+        EXPECT_EQ(data->front(), static_cast<std::byte>(expected));
+        ++expected;
+    }
+    EXPECT_EQ(expected, 17u);
+    scheduler.release(stream);
+    scheduler.shutdown();
+    for (auto& reader : readers)
+        reader.join();
+}
@@ -0,0 +1,46 @@
+//
+// Created by ycm on 2026/1/6.
+//
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "utils/tmpfile.h"
+#include "utils/trace.h"
+
+using namespace tmpfile_utils;
+
+TEST(trace, SpanAndChromeExport)
+{
+    if (!trace::is_compiled_in())
+        GTEST_SKIP() << "tracing compiled out";
+    trace::clear();
+    trace::set_enabled(true);
+    {
+        TRACE_SPAN(Tar, "test.outer");
+        TRACE_SPAN(Database, "test.inner");
+    }
+    std::thread worker([] { TRACE_SPAN(Crypto, "test.worker"); });
+    worker.join();
+    trace::set_enabled(false);
+    {
+        // 关闭后不再记录
+        TRACE_SPAN(Zip, "test.disabled");
+    }
+    EXPECT_EQ(trace::span_count(), 3u);
+
+    const auto tmp = TmpFile::create();
+    ASSERT_TRUE(trace::dump_chrome_trace(tmp->path()));
+    std::ifstream ifs(tmp->path());
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    const auto json = ss.str();
+    EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"test.outer","cat":"tar","ph":"X")"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"test.inner","cat":"database")"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"test.worker","cat":"crypto")"), std::string::npos);
+    EXPECT_EQ(json.find("test.disabled"), std::string::npos);
+    trace::clear();
+}